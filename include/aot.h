@@ -0,0 +1,84 @@
+#ifndef CHIP8_AOT
+#define CHIP8_AOT
+
+#include "cpu.h"
+
+#include <ostream>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Ahead-of-time compilation
+ * -------------------------
+ * AotCompiler turns the reachable code of a ROM (see RomAnalyzer) into a C++ translation unit
+ * with one function per basic block. Every compiled instruction has exactly the same effect on
+ * the CPU as emulate_cycle() would have: simple opcodes are inlined on CPU::State and the rest
+ * go through CPU::execute_instruction().
+ *
+ * Blocks of ROMs without static code also end after each store (FX33, FX55), so a block never
+ * runs instructions that its own stores may have changed.
+ *
+ * AotRunner executes a compiled program. A block only runs when the CPU is at its first
+ * address, the whole block fits in the remaining cycle budget and its bytes are still the
+ * compiled ones. Otherwise (self-modified or undiscovered code) the interpreter runs one cycle.
+ * The byte check is skipped for ROMs with static code and otherwise cached per memory page
+ * version, so use one runner per CPU.
+ *
+ * Programs emitted with a main take "cycles [--check]": --check runs the interpreter in
+ * lockstep, one step() at a time, and stops at the first state that differs.
+ */
+
+typedef void (*AotFunction)(CPU&);
+
+struct AotBlock
+{
+    WORD address;
+    WORD length;            // Instructions
+    AotFunction function;
+};
+
+struct AotProgram
+{
+    const char* name;
+    uint64_t image_hash;    // Hash of the whole memory image the program was compiled from
+    uint32_t rom_length;
+    const byte* rom;
+    unsigned block_count;
+    const AotBlock* blocks;
+    bool static_code;       // RomAnalyzer proved no store can hit the code: blocks run unchecked
+};
+
+class AotRunner
+{
+    public:
+        AotRunner(const AotProgram&);
+
+        unsigned step(CPU&, uint64_t);
+        void run(CPU&, uint64_t);
+
+        uint64_t get_compiled_cycles() const;
+        uint64_t get_interpreted_cycles() const;
+
+    private:
+        const AotProgram& program;
+        std::vector<const AotBlock*> table;
+        std::vector<unsigned> checked_versions;
+        const CPU::Image* checked_image;
+        bool image_matches;
+        uint64_t compiled_cycles;
+        uint64_t interpreted_cycles;
+
+        bool is_intact(const CPU&, const AotBlock&);
+};
+
+class AotCompiler
+{
+    public:
+        static bool emit(std::ostream&, const byte*, size_t, const string&, const string&, bool);
+        static uint64_t image_hash(const byte*, size_t);
+
+    private:
+        static void emit_instruction(std::ostream&, WORD, WORD);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef CHIP8_AUDIO
+#define CHIP8_AUDIO
+
+#include "cpu.h"
+
+#include <atomic>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*
+ * Buzzer
+ * ------
+ * The emulation thread publishes whether the sound timer is running (and, for XO-CHIP
+ * programs, a 128-bit pattern and its pitch) through atomics; the audio thread renders
+ * signed 16-bit mono samples from them in render(). Neither side ever waits for the other:
+ * a change is heard from the next rendered sample.
+ *
+ * Without a pattern the buzzer is a square wave of TONE_FREQUENCY Hz. With a pattern, its
+ * bits are played in a loop at 4000 * 2 ^ ((pitch - 64) / 48) bits per second (XO-CHIP).
+ *
+ * render() can be called from an SDL audio callback, or by AudioRecorder when there is no
+ * audio device (headless runs, tests).
+ */
+
+class Buzzer
+{
+    public:
+        static const unsigned SAMPLE_RATE = 44100;
+        static const unsigned TONE_FREQUENCY = 440;
+        static const int16_t AMPLITUDE = 6000;
+        static const unsigned PATTERN_BYTES = 16;
+        static const byte DEFAULT_PITCH = 64;
+
+        Buzzer(unsigned = Buzzer::SAMPLE_RATE);
+
+        // Emulation thread
+        void set_active(bool);
+        void set_pattern(const byte*, byte = Buzzer::DEFAULT_PITCH);
+        void clear_pattern();
+
+        // Audio thread
+        bool is_active() const;
+        void render(int16_t*, size_t);
+
+        unsigned get_sample_rate() const;
+
+    private:
+        unsigned sample_rate;
+        std::atomic<bool> active;
+        std::atomic<bool> has_pattern;
+        std::atomic<uint32_t> pattern[Buzzer::PATTERN_BYTES / 4];
+        std::atomic<byte> pitch;
+
+        // Audio thread only: position in the wave (cycles of a tone or bits of the pattern)
+        double phase;
+};
+
+/*
+ * Audio recorder
+ * --------------
+ * Backend without an audio device: pulls the samples of every emulated frame from a buzzer
+ * and either drops them (null backend, empty path) or appends them to a WAV file. The WAV
+ * header gets its final sizes in close().
+ */
+class AudioRecorder
+{
+    public:
+        AudioRecorder(Buzzer&, double);
+        ~AudioRecorder();
+
+        bool open(const std::string& = "");
+        void frame();
+        void close();
+
+        uint64_t get_samples() const;
+        uint64_t get_active_samples() const;
+
+    private:
+        Buzzer& buzzer;
+        double samples_per_frame;
+        double pending;
+        std::ofstream file;
+        std::vector<int16_t> buffer;
+        uint64_t samples;
+        uint64_t active_samples;
+
+        void write_header(uint32_t);
+};
+
+#endif
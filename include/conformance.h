@@ -0,0 +1,60 @@
+#ifndef CHIP8_CONFORMANCE
+#define CHIP8_CONFORMANCE
+
+#include "cpu.h"
+#include "rom_catalog.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Golden-frame conformance
+ * ------------------------
+ * Runs a ROM headless for a fixed number of frames (ConformanceOptions::cycles_per_frame
+ * cycles each) with a scripted input schedule, and records the framebuffer hash
+ * (CPU::get_frame_hash()) every checkpoint_period frames. Everything a run depends on comes from the ROM hash (CXNN seed,
+ * key presses), so the hashes are the same on every machine and for every engine that
+ * behaves exactly like the interpreter.
+ *
+ * The golden file keeps the expected hashes of every ROM, keyed by ROM hash:
+ *
+ *   CHIP8-CONFORMANCE <version> <frames> <cycles_per_frame> <checkpoint_period> <entries>
+ *   <rom hash>\t<checkpoint hash> <checkpoint hash> ...\t<path>
+ */
+
+struct ConformanceOptions
+{
+    unsigned frames;
+    unsigned cycles_per_frame;
+    unsigned checkpoint_period;     // Frames between framebuffer hashes
+};
+
+struct ConformanceRecord
+{
+    uint64_t rom_hash;
+    std::vector<uint64_t> checkpoints;
+    std::string path;
+};
+
+class Conformance
+{
+    public:
+        static const unsigned VERSION = 2;
+        static const ConformanceOptions DEFAULT_OPTIONS;
+        static const char* const DEFAULT_GOLDEN;
+
+        Conformance(const ConformanceOptions& = Conformance::DEFAULT_OPTIONS);
+
+        ConformanceRecord run(const RomEntry&, bool) const;
+        bool run_corpus(const std::vector<RomEntry>&, bool, unsigned, std::vector<ConformanceRecord>&) const;
+
+        bool load(const string&, std::vector<ConformanceRecord>&) const;
+        bool save(const string&, const std::vector<ConformanceRecord>&) const;
+
+    private:
+        ConformanceOptions options;
+};
+
+#endif
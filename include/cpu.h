@@ -5,8 +5,13 @@
 //#define CHIP8_CPU_DEBUG_LOAD_ROM_VERBOSE
 //#define CHIP8_CPU_DEBUG_OPCODE_VERBOSE
 //#define CHIP8_CPU_DEBUG_HALT_NEXT_STEP
+//#define CHIP8_CPU_DEBUG_VIOLATIONS
+//#define CHIP8_CPU_DEBUG_WARNINGS
 
 #include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
 
 using std::string;
 
@@ -28,110 +33,326 @@ class CPU
         static const unsigned COLOR_BLACK = 0;
         static const unsigned COLOR_WHITE = 1;
 
-        // Fontset
+        // Fontset (shared by every instance)
         static const unsigned FONTSET_MEMORY_BEGIN = 0x0050;
         static const unsigned FONTSET_SIZE = 80;
-        const byte FONTSET[CPU::FONTSET_SIZE] = 
+        static const byte FONTSET[CPU::FONTSET_SIZE];
+
+        // Memory pages
+        static const unsigned MEMORY_PAGE_SIZE = 256;
+        static const unsigned MEMORY_PAGES = CPU::MEMORY_LENGTH_B / CPU::MEMORY_PAGE_SIZE;
+
+        // Immutable memory image (fontset + ROM), shared between instances loaded with the same ROM
+        struct Image
         {
-            0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-            0x20, 0x60, 0x20, 0x20, 0x70, // 1
-            0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-            0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-            0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-            0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-            0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-            0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-            0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-            0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-            0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-            0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-            0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-            0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-            0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-            0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+            byte data[CPU::MEMORY_LENGTH_B];
+        };
+
+        /*
+         * Paged memory
+         * ------------
+         * The 4KB are split in pages of CPU::MEMORY_PAGE_SIZE bytes. Pages that have not been
+         * written are read straight from the shared image. The first write to a page (FX33, FX55)
+         * gives the instance its own copy of that page (copy-on-write).
+         *
+         * Addresses are masked to 12 bits, so accesses past 0xFFF wrap around.
+         */
+        class Memory
+        {
+            public:
+                Memory();
+                Memory(const Memory&);
+                Memory& operator=(const Memory&);
+                ~Memory();
+
+                void attach(const std::shared_ptr<const CPU::Image>&);
+                const std::shared_ptr<const CPU::Image>& get_image() const;
+                unsigned get_private_pages() const;
+
+                bool is_shared(WORD addr) const
+                {
+                    return this->private_pages[(addr & (CPU::MEMORY_LENGTH_B - 1)) / CPU::MEMORY_PAGE_SIZE] == NULL;
+                }
+
+                byte read(WORD addr) const
+                {
+                    addr &= CPU::MEMORY_LENGTH_B - 1;
+
+                    return this->pages[addr / CPU::MEMORY_PAGE_SIZE][addr % CPU::MEMORY_PAGE_SIZE];
+                }
+
+                void write(WORD addr, byte value)
+                {
+                    addr &= CPU::MEMORY_LENGTH_B - 1;
+
+                    unsigned page = addr / CPU::MEMORY_PAGE_SIZE;
+
+                    if (this->private_pages[page] == NULL)
+                    {
+                        this->copy_page(page);
+                    }
+
+                    this->private_pages[page][addr % CPU::MEMORY_PAGE_SIZE] = value;
+                    this->versions[page]++;
+                }
+
+                // Incremented on every write to the page (lets engines cache checks on code)
+                unsigned get_version(WORD addr) const
+                {
+                    return this->versions[(addr & (CPU::MEMORY_LENGTH_B - 1)) / CPU::MEMORY_PAGE_SIZE];
+                }
+
+            private:
+                // Backing of every page that has not been written yet
+                std::shared_ptr<const CPU::Image> image;
+
+                // Page table used for reads: points into the image or into a private page
+                const byte* pages[CPU::MEMORY_PAGES];
+
+                // Private copies of the written pages (NULL while the page is shared)
+                byte* private_pages[CPU::MEMORY_PAGES];
+
+                // Buffers behind the private pages, kept when a page goes back to the image (reused by its next copy)
+                byte* buffers[CPU::MEMORY_PAGES];
+
+                // Write counters per page
+                unsigned versions[CPU::MEMORY_PAGES];
+
+                void copy_page(unsigned);
+                void own_page(unsigned);
+                void release();
+        };
+
+        /*
+         * Interpreter state
+         * -----------------
+         * Everything an instruction reads or writes besides memory, keys and the screen,
+         * packed in a single cache line. The layout is stable (checked below) and the struct
+         * is trivially copyable, so save states and batched engines can memcpy it directly.
+         * The alignment holds on the heap too (new CPU, std::vector<CPU>) since the build is
+         * C++17, where new and std::allocator honour extended alignment.
+         *
+         *  Offset  Size  Field
+         *  ------  ----  -----
+         *     0      2   pc
+         *     2      2   opcode
+         *     4      2   I
+         *     6      2   sp
+         *     8     16   V[0x0] .. V[0xF]
+         *    24     32   stack[0] .. stack[15]
+         *    56      1   delay_timer
+         *    57      1   sound_timer
+         *    58      1   draw_flag
+         *    59      1   halt
+         *    60      4   random
+         */
+        struct alignas(64) State
+        {
+            // Program couter (0x000 - 0xFFF)
+            WORD pc;
+
+            // Current opcode
+            WORD opcode;
+
+            // Index register (0x000 - 0xFFF)
+            WORD I;
+
+            // Stack pointer
+            WORD sp;
+
+            /*
+             * CPU registers (8-bit)
+             * ---------------------
+             * V[0] .. V[14] -> General purpose registers
+             * V[15] -> Carry flag
+             */
+            byte V[CPU::GENERAL_PURPOSE_REGISTERS];
+
+            // Stack (subroutines), max. deepness: 16
+            WORD stack[CPU::STACK_DEEPNESS];
+
+            /*
+             * Timer registers (60 Hz) for sound.
+             */
+
+            // Time that system's buzzer sounds
+            byte delay_timer;
+
+            // Timer that, when reaches 0, makes the system's buzzer sounds
+            byte sound_timer;
+
+            // Flag to know when we have to draw on the screen.
+            bool draw_flag;
+
+            // Variable to halt the program
+            bool halt;
+
+            // Random number generator (xorshift32) used by CXNN, never 0
+            DWORD random;
+        };
+
+        /*
+         * Quirks
+         * ------
+         * Behaviours that differ between interpreters. Out-of-range accesses are always defined:
+         * memory addresses (PC, I + N) wrap at 4KB, key indexes use the low nibble of VX and
+         * sprite origins wrap around the screen. What happens to the sprite pixels that go past
+         * an edge depends on the quirks.
+         */
+        struct Quirks
+        {
+            bool wrap_sprites;      // Pixels past an edge wrap to the other side (false: clipped, as the VIP does)
+        };
+
+        static const CPU::Quirks DEFAULT_QUIRKS;
+
+        /*
+         * Out-of-range accesses seen since initializate(). Only counted when the interpreter is
+         * built with CHIP8_CPU_DEBUG_VIOLATIONS (zero otherwise), so the hot paths stay branch-free.
+         */
+        struct Violations
+        {
+            uint64_t fetch;     // Instructions fetched across the end of memory
+            uint64_t memory;    // I + N accesses across the end of memory (DXYN, FX33, FX55, FX65)
+            uint64_t screen;    // Sprites going past an edge of the screen (clipped or wrapped)
+            uint64_t font;      // FX29 with VX > 0xF
+            uint64_t keys;      // EX9E and EXA1 with VX > 0xF
+            uint64_t stack;     // Stack overflows and underflows (the program halts)
         };
 
         CPU();
 
+        // Images can be created once and handed to many instances with load_image()
+        static std::shared_ptr<const CPU::Image> create_image(const byte*, size_t);
+        static std::shared_ptr<const CPU::Image> read_image(const string&);
+
         void initializate();
+        void seed(DWORD);
         bool load_rom(const string&);
+        bool load_rom_from_buffer(const byte*, size_t);
+        void load_image(const std::shared_ptr<const CPU::Image>&);
+        const std::shared_ptr<const CPU::Image>& get_image() const;
         void emulate_cycle();
         bool is_draw_flag_set() const;
         void update_pressed_keys(byte*);
+        void update_pressed_keys(WORD);
+        void key_event(byte, bool);
+        WORD get_pressed_keys() const;
+        bool is_waiting_for_key() const;
         byte* get_gfx();
+        const byte* get_gfx() const;
+        uint64_t get_frame_hash() const;
+        static uint64_t hash_frame(const byte*);
+        uint64_t get_state_hash() const;
+        uint32_t get_dirty_rows() const;
+        void clear_dirty_rows();
+        void restore(const CPU&);
+        byte load(const WORD&) const;
+        const CPU::State& get_state() const;
+        void set_state(const CPU::State&);
+        const CPU::Quirks& get_quirks() const;
+        void set_quirks(const CPU::Quirks&);
+        const CPU::Violations& get_violations() const;
+
+        /*
+         * Execution engines (e.g. AOT compiled blocks) drive the state directly and fall back to
+         * execute_instruction() for the opcodes they don't handle themselves. Each emulated
+         * cycle must end with tick_timers(), as emulate_cycle() does.
+         */
+        CPU::State& get_state();
+        void execute_instruction(const WORD&);
+        bool is_unmodified(const WORD&, const unsigned&) const;
+
+        unsigned get_memory_version(const WORD& addr) const
+        {
+            return this->memory.get_version(addr);
+        }
+
+        // Handler of an opcode, resolved once (decode() never fails: unknown opcodes get the handler that reports them)
+        typedef void (CPU::*Handler)();
+
+        static Handler decode(const WORD&);
+        static bool is_known(const WORD&);
+
+        // One cycle of an already fetched and decoded instruction (same as emulate_cycle())
+        void execute_decoded(const WORD& instruction, Handler handler)
+        {
+            this->state.draw_flag = false;
+            this->state.opcode = instruction;
+
+            (this->*handler)();
+
+            // Addresses are 12 bits: BNNN and the skips at the end of memory wrap around
+            this->state.pc &= CPU::MEMORY_LENGTH_B - 1;
+
+            this->tick_timers();
+        }
+
+        void tick_timers()
+        {
+            if (this->state.delay_timer > 0)
+            {
+                this->state.delay_timer--;
+            }
+            // The buzzer sounds while the sound timer is running (frontends read it, see Buzzer)
+            if (this->state.sound_timer > 0)
+            {
+                this->state.sound_timer--;
+            }
+        }
 
         #ifdef CHIP8_CPU_DEBUG
         void print_memory() const;
         void print_status() const;
         void print_screen() const;
-        void execute_instruction(const WORD&);
         void store(const WORD&, const byte&);
         #endif
 
     private:
-        // Current opcode
-        WORD opcode;
-
-        // CHIP-8 memory (4KB = 1024B * 4 = 4096b = 4KB)
-        byte memory[CPU::MEMORY_LENGTH_B];
-
-        /*
-         * CPU registers (8-bit)
-         * ---------------------
-         * V[0] .. V[14] -> General purpose registers
-         * V[15] -> Carry flag
-         */
-        byte V[CPU::GENERAL_PURPOSE_REGISTERS];
-
-        // Index register (0x000 - 0xFFF)
-        WORD I;
-
-        // Program couter (0x000 - 0xFFF)
-        WORD pc;
-
-        // Graphics of the CHIP-8 (64 width x 32 height)
-        byte gfx[CPU::GFX_LENGTH];
+        // Hot interpreter state (first cache line), see CPU::State
+        CPU::State state;
 
         /*
-         * Timer registers (60 Hz) for sound.
+         * Key mapping -> HEX based keyboard (0x0 - 0xF)
+         * ---------------------------------------------
+         * One bit per key (bit N: key N pressed). Presses and releases are also kept as edges,
+         * so FX0A sees a key that was pressed and released between two instructions.
          */
 
-        // Time that system's buzzer sounds
-        byte delay_timer;
+        // Pressed keys
+        WORD keys;
 
-        // Timer that, when reaches 0, makes the system's buzzer sounds
-        byte sound_timer;
+        // Keys pressed since FX0A started waiting, and those of them released since
+        WORD key_presses;
+        WORD key_releases;
 
-        /*
-         * Stack -> subroutines
-         * 
-         * Max. deepness: 16
-         */
+        // FX0A is waiting for a key (it runs again every cycle until one is released)
+        bool key_waiting;
 
-        // Stack
-        WORD stack[CPU::STACK_DEEPNESS];
+        // CHIP-8 memory (4KB = 1024B * 4 = 4096b = 4KB), see CPU::Memory
+        CPU::Memory memory;
 
-        // Stack pointer
-        WORD sp;
+        // Graphics of the CHIP-8 (64 width x 32 height). Only touched by 00E0 and DXYN.
+        byte gfx[CPU::GFX_LENGTH];
 
         /*
-         * Key mapping -> HEX based keyboard (0x0 - 0xF)
+         * Zobrist hash of gfx: the XOR of a random key per lit pixel (0 for a blank screen).
+         * DXYN updates it with the keys of the pixels it flips and 00E0 resets it, so a frame
+         * that ends up like the previous one has the same hash even though the draw flag was
+         * set. Writes through get_gfx() aren't seen (hash_frame() recomputes it from scratch).
          */
+        uint64_t frame_hash;
 
-        // Key mapping
-        byte key[CPU::KEY_MAPPING_SIZE];
+        // Rows of gfx DXYN and 00E0 wrote to since clear_dirty_rows() (bit N: row N), for delta encoders
+        uint32_t dirty_rows;
 
-        // Flag to know when we have to draw on the screen.
-        bool draw_flag;
-
-        // Variable to halt the program
-        bool halt;
+        CPU::Quirks quirks;
+        CPU::Violations violations;
 
         // Private function
-        std::streampos get_file_length(const string&) const;
-        void print_unknown_opcode(const string = "") const;
-        void push(WORD);
-        WORD pop();
+        void print_unknown_opcode(const char* = "") const;
+        bool push(WORD);
+        bool pop(WORD&);
         void execute_instruction();
 
         // Instructions
@@ -190,8 +411,17 @@ class CPU
         void xFX55();
         void xFX65();
 
-        // Pointer function to instructions
-        void (CPU::*instructions[0x10])();
+        // Pointer function to instructions (shared by every instance)
+        static void (CPU::* const instructions[0x10])();
 };
 
+static_assert(sizeof(CPU::State) == 64, "CPU::State must fit in one cache line");
+static_assert(offsetof(CPU::State, V) == 8, "CPU::State layout changed");
+static_assert(offsetof(CPU::State, stack) == 24, "CPU::State layout changed");
+static_assert(offsetof(CPU::State, delay_timer) == 56, "CPU::State layout changed");
+static_assert(offsetof(CPU::State, halt) == 59, "CPU::State layout changed");
+static_assert(offsetof(CPU::State, random) == 60, "CPU::State layout changed");
+static_assert((CPU::WIDTH & (CPU::WIDTH - 1)) == 0 && (CPU::HEIGHT & (CPU::HEIGHT - 1)) == 0,
+              "Screen coordinates are wrapped with masks");
+
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef CHIP8_DIFF_HARNESS
+#define CHIP8_DIFF_HARNESS
+
+#include "cpu.h"
+#include "execution_manager.h"
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+/*
+ * Lockstep differential execution
+ * -------------------------------
+ * Runs the reference interpreter (CPU::emulate_cycle()) and a candidate engine side by side
+ * on the same image, seed and key presses. The candidate runs one step (a block, a fused
+ * operation or an interpreted run, see ExecutionManager::step()), the reference runs the same
+ * number of cycles, and then both are compared:
+ *
+ *   - CPU::State field by field (pc, opcode, I, sp, V, stack, timers, flags, random state).
+ *   - Memory pages written by either CPU since the last step (CPU::get_memory_version()).
+ *   - The screen, after a step where either CPU drew.
+ *
+ * The run stops at the first mismatch with a report of what differs, the step that caused it
+ * and the last instructions run by the reference.
+ *
+ * Keys change at random points of the run (DiffOptions::key_period), drawn from an RNG seeded
+ * with the run seed, so a failing run can be repeated with the same seed.
+ */
+
+enum class DiffEngine
+{
+    DECODED,    // Every block decoded on first entry, no fusion
+    FUSED,      // Every block decoded on first entry, fused operations
+    TIERED      // Default thresholds and fusion (what chip8-server --tiered runs)
+};
+
+struct DiffOptions
+{
+    uint64_t cycles;        // Cycles to run per ROM
+    unsigned key_period;    // Maximum cycles between key changes (0: no keys)
+};
+
+struct DiffResult
+{
+    bool match;
+    uint64_t cycles;        // Cycles compared
+    uint64_t steps;         // Comparisons made
+    std::string report;     // Mismatch description (empty when match)
+};
+
+class DiffHarness
+{
+    public:
+        static const unsigned TRACE_LENGTH = 16;    // Reference instructions kept for the report
+        static const DiffOptions DEFAULT_OPTIONS;
+
+        DiffHarness(DiffEngine, const DiffOptions& = DiffHarness::DEFAULT_OPTIONS);
+
+        DiffResult run(const std::shared_ptr<const CPU::Image>&, uint32_t);
+
+        static const char* engine_name(DiffEngine);
+        static bool parse_engine(const string&, DiffEngine&);
+        static std::unique_ptr<ExecutionManager> create_manager(DiffEngine);
+
+    private:
+        struct TraceEntry
+        {
+            WORD pc;
+            WORD opcode;
+        };
+
+        DiffEngine engine;
+        DiffOptions options;
+        TraceEntry trace[DiffHarness::TRACE_LENGTH];
+        uint64_t traced;
+
+        bool compare(const CPU&, const CPU&, bool, const bool*, std::string&) const;
+        std::string describe(const CPU::State&, uint64_t, uint64_t, Tier) const;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef CHIP8_ENV_SERVER
+#define CHIP8_ENV_SERVER
+
+#include "cpu.h"
+#include "execution_manager.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/*
+ * Shared-memory environment for external agents
+ * ----------------------------------------------
+ *
+ * Layout of the POSIX shared-memory object:
+ *
+ *   [EnvHeader][EnvSlot 0][EnvSlot 1] ... [EnvSlot N-1]
+ *
+ * Every slot is a mailbox plus the CPU object itself (constructed in place by
+ * the server), so the agent reads the framebuffer directly at
+ * `slot + EnvHeader::gfx_offset` without any copy per step.
+ *
+ * Protocol (one outstanding request per slot):
+ *   1. The agent fills keys/command/cycles/read window and bumps `request`.
+ *   2. The agent rings the doorbell of the worker that owns the slot.
+ *   3. The worker runs the command, fills `read_buffer` and sets
+ *      `response = request`.
+ *
+ * Waiting is spin-then-futex on both sides, so a busy worker answers without
+ * any syscall.
+ *
+ * With tiered execution every slot gets its own ExecutionManager (server side
+ * only), so long-running instances move their hot blocks out of the interpreter.
+ */
+
+enum EnvCommand : uint32_t
+{
+    ENV_COMMAND_NONE = 0,
+    ENV_COMMAND_STEP = 1,   // Update keys and run `cycles` cycles
+    ENV_COMMAND_RESET = 2,  // Reinitializate the CPU and reload the ROM
+    ENV_COMMAND_READ = 3    // Only fill the read window
+};
+
+struct EnvSlot
+{
+    static const unsigned READ_WINDOW_SIZE = 256;
+
+    // Written by the agent
+    std::atomic<uint32_t> request;
+    uint32_t command;
+    uint32_t cycles;
+    uint32_t read_addr;
+    uint32_t read_length;
+    byte keys[CPU::KEY_MAPPING_SIZE];
+
+    // Written by the server
+    std::atomic<uint32_t> response;
+    std::atomic<uint32_t> agent_waiting;
+    uint32_t draw_flag;
+    uint64_t total_cycles;
+    uint64_t frame_hash;    // CPU::get_frame_hash() after the command (same hash, same frame)
+    byte read_buffer[EnvSlot::READ_WINDOW_SIZE];
+
+    // CPU constructed in place by the server (agents only read from here)
+    alignas(64) unsigned char cpu_storage[sizeof(CPU)];
+};
+
+struct EnvHeader
+{
+    static const uint32_t MAGIC = 0x38504843;   // "CHP8"
+    static const uint32_t VERSION = 2;
+    static const unsigned MAX_WORKERS = 64;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t slots_offset;
+    uint32_t gfx_offset;    // Offset of the framebuffer inside each slot
+    uint32_t worker_count;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> shutdown;
+
+    // One doorbell per worker, each on its own cache line
+    struct alignas(64) Doorbell
+    {
+        std::atomic<uint32_t> rings;
+        std::atomic<uint32_t> sleeping;
+    } doorbell[EnvHeader::MAX_WORKERS];
+};
+
+class EnvServer
+{
+    public:
+        EnvServer();
+        ~EnvServer();
+
+        bool create(const string&, const string&, unsigned, unsigned, bool = false);
+        void run();
+        void stop();
+        void destroy();
+        TierMetrics get_metrics() const;
+
+    private:
+        string name;
+        string rom_path;
+        std::shared_ptr<const CPU::Image> image;
+        void* mapping;
+        size_t mapping_length;
+        EnvHeader* header;
+        unsigned constructed;
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<ExecutionManager> > managers;
+
+        EnvSlot* slot(unsigned) const;
+        void worker_loop(unsigned);
+        void process(EnvSlot*, ExecutionManager*);
+};
+
+class EnvClient
+{
+    public:
+        EnvClient();
+        ~EnvClient();
+
+        bool attach(const string&);
+        void detach();
+
+        unsigned get_slot_count() const;
+        const byte* get_gfx(unsigned) const;
+        const byte* get_read_buffer(unsigned) const;
+        uint64_t get_total_cycles(unsigned) const;
+        bool is_draw_flag_set(unsigned) const;
+        uint64_t get_frame_hash(unsigned) const;
+
+        void set_read_window(unsigned, WORD, unsigned);
+        void submit(unsigned, EnvCommand, const byte*, unsigned);
+        void wait(unsigned);
+
+        void step(unsigned, const byte*, unsigned);
+        void reset(unsigned);
+
+    private:
+        void* mapping;
+        size_t mapping_length;
+        EnvHeader* header;
+        std::vector<uint32_t> sequence;
+
+        EnvSlot* slot(unsigned) const;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef CHIP8_EXECUTION_MANAGER
+#define CHIP8_EXECUTION_MANAGER
+
+#include "cpu.h"
+#include "aot.h"
+
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+/*
+ * Tiered execution
+ * ----------------
+ * Every block starts in the interpreter (CPU::emulate_cycle()). The manager counts how many
+ * times each block is entered and promotes it:
+ *
+ *   INTERPRETER --(decode entries)--> DECODED --(compile entries)--> COMPILED
+ *
+ * DECODED blocks keep the fetched opcodes and their resolved handlers (CPU::decode()), so they
+ * skip the fetch and the two-level dispatch. COMPILED blocks run the function generated by
+ * chip8-aot for the same block, when a program for the loaded image was given.
+ *
+ * A block goes from its entry to the first instruction that may change the control flow
+ * (RomAnalyzer::ends_block()) or write memory (FX33, FX55), so a block never runs stale code
+ * after its own stores. Before running a promoted block its bytes are checked again when a
+ * memory page it lives in was written (CPU::get_memory_version()). If they changed, the block
+ * drops back to the interpreter and has to get hot again.
+ *
+ * Superinstructions
+ * -----------------
+ * When a block is decoded, frequent sequences are fused into one operation that runs them in
+ * a single dispatch, with the same per-cycle effects as lib/cpu.cpp (opcode, PC, draw flag and
+ * a timer tick per instruction):
+ *
+ *   LOAD_PAIR      6XNN; 6YNN
+ *   DRAW           ANNN; DXYN
+ *   COUNTED_LOOP   L: 7XNN; 3XKK (or 4XKK); 1L     (whole iterations while the budget allows)
+ *   DELAY_WAIT     L: FX07; 3X00; 1L               (waits for the delay timer in one step)
+ *
+ * Blocks with a fused loop stay decoded (they are already faster than their compiled version).
+ *
+ * The manager caches per CPU state (page versions), so use one manager per CPU.
+ */
+
+enum class Tier
+{
+    INTERPRETER,
+    DECODED,
+    COMPILED
+};
+
+enum class Fusion
+{
+    NONE,
+    LOAD_PAIR,
+    DRAW,
+    COUNTED_LOOP,
+    DELAY_WAIT
+};
+
+struct TierThresholds
+{
+    unsigned decode;    // Block entries to decode it
+    unsigned compile;   // Block entries to run the compiled block
+};
+
+struct TierMetrics
+{
+    static const unsigned TIERS = 3;
+    static const unsigned FUSIONS = 5;
+
+    uint64_t cycles[TierMetrics::TIERS];        // Cycles run by each tier
+    uint64_t promotions[TierMetrics::TIERS];    // Blocks promoted to each tier
+    uint64_t invalidations;                     // Promoted blocks dropped after their code changed
+    unsigned blocks[TierMetrics::TIERS];        // Blocks currently in each tier
+    uint64_t fused[TierMetrics::FUSIONS];       // Times each fused operation ran
+    uint64_t fused_cycles[TierMetrics::FUSIONS];    // Cycles run by each fused operation
+};
+
+class ExecutionManager
+{
+    public:
+        static const unsigned MAX_BLOCK_LENGTH = 64;    // Instructions
+        static const TierThresholds DEFAULT_THRESHOLDS;
+
+        ExecutionManager(const TierThresholds& = ExecutionManager::DEFAULT_THRESHOLDS);
+
+        void set_program(const AotProgram*);
+        void set_fusion(bool);
+        bool run(CPU&, uint64_t);
+        bool step(CPU&, uint64_t&);     // One block (or interpreted run) at the PC, its cycles taken from the budget
+        void reset();
+
+        Tier get_tier(WORD) const;
+        const TierMetrics& get_metrics() const;
+        void print_metrics(std::ostream&) const;
+
+        static const char* tier_name(Tier);
+        static const char* fusion_name(Fusion);
+        static void print_metrics(std::ostream&, const TierMetrics&);
+
+    private:
+        struct DecodedInstruction
+        {
+            WORD opcode;
+            CPU::Handler handler;
+        };
+
+        // What actually runs: one instruction or a fused sequence
+        struct Operation
+        {
+            Fusion fusion;
+            WORD opcode;
+            WORD second;
+            CPU::Handler handler;
+            CPU::Handler second_handler;
+        };
+
+        struct Block
+        {
+            Tier tier;
+            unsigned entries;
+            unsigned cycles;        // Cycles of a run (one iteration for fused loops)
+            unsigned version;       // Versions of the first and last pages when last checked
+            bool draws;             // Has 00E0 or DXYN
+            bool compilable;        // Still worth looking for a compiled block
+            std::vector<DecodedInstruction> code;
+            std::vector<Operation> operations;
+            std::vector<AotFunction> functions;     // Compiled blocks covering the same code
+        };
+
+        TierThresholds thresholds;
+        TierMetrics metrics;
+        const AotProgram* program;
+        std::vector<const AotBlock*> compiled;
+        std::vector<std::unique_ptr<Block> > blocks;    // By entry address, allocated when first entered
+        const CPU::Image* image;
+        bool fusion;
+
+        static bool ends_block(WORD);
+
+        void attach(const CPU&);
+        void promote(const CPU&, WORD, Block&);
+        void fuse(const CPU&, WORD, Block&);
+        void demote(Block&);
+        bool is_valid(const CPU&, WORD, Block&);
+        bool dispatch(CPU&, uint64_t&);
+        bool interpret(CPU&, uint64_t&);
+        bool execute(CPU&, Block&, uint64_t&);
+        unsigned run_loop(CPU&, const Operation&, uint64_t);
+};
+
+#endif
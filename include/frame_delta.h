@@ -0,0 +1,69 @@
+#ifndef CHIP8_FRAME_DELTA
+#define CHIP8_FRAME_DELTA
+
+#include "cpu.h"
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * Frame deltas
+ * ------------
+ * Wire format of the display for streaming (see StreamServer). A row is 8 bytes, the leftmost
+ * pixel in the most significant bit of the first one (as chip8-headless --format=raw). Two
+ * messages, numbers little-endian:
+ *
+ *   keyframe   'K', frame (u32), the HEIGHT rows
+ *   delta      'D', frame (u32), mask of the rows that changed (u32, bit N: row N), then for
+ *              each of them, top to bottom: a byte with a bit per byte of the row that changed
+ *              (bit 7: first byte) followed by those bytes XORed with the previous frame
+ *
+ * So a delta only costs the bytes that changed (a moving 8x5 sprite is some 30 bytes) and a
+ * frame where nothing changed isn't sent at all. The encoder only looks at the rows the core
+ * wrote to (CPU::get_dirty_rows()); rows drawn again with the same pixels aren't sent.
+ *
+ * The encoder keeps the last frame it encoded, so a client that joins late gets a keyframe()
+ * of it and then the same deltas as everyone else.
+ */
+
+class FrameDeltaEncoder
+{
+    public:
+        static const byte KEYFRAME = 'K';
+        static const byte DELTA = 'D';
+        static const unsigned ROW_BYTES = CPU::WIDTH / 8;
+        static const unsigned KEYFRAME_SIZE = 5 + CPU::HEIGHT * ROW_BYTES;
+        static const unsigned MAX_DELTA_SIZE = 9 + CPU::HEIGHT * (1 + ROW_BYTES);
+
+        FrameDeltaEncoder();
+
+        void reset();
+        bool encode(const byte*, uint32_t, uint32_t, std::vector<byte>&);
+        void keyframe(std::vector<byte>&) const;
+        uint32_t get_frame() const;
+
+        static uint64_t pack_row(const byte*);
+
+    private:
+        // Last frame encoded, a row per word (first byte of the row in the most significant bits)
+        uint64_t rows[CPU::HEIGHT];
+        uint32_t frame;
+};
+
+class FrameDeltaDecoder
+{
+    public:
+        FrameDeltaDecoder();
+
+        bool apply(const byte*, size_t);
+        bool is_synced() const;
+        uint32_t get_frame() const;
+        void get_gfx(byte*) const;
+
+    private:
+        uint64_t rows[CPU::HEIGHT];
+        uint32_t frame;
+        bool synced;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef CHIP8_FRAME_PACER
+#define CHIP8_FRAME_PACER
+
+#include <chrono>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+/*
+ * Frame pacing
+ * ------------
+ * Frames are due on an absolute schedule (start + n * period), so the time spent on a frame
+ * never shifts the next deadlines and rounding errors don't add up. wait() blocks until the
+ * next deadline:
+ *
+ *   LOW_LATENCY    sleeps until a margin before the deadline and spins the rest. The margin
+ *                  follows how late the OS wakes the thread up, so most wake-ups land within
+ *                  a few microseconds of the deadline.
+ *   LOW_POWER      only sleeps (the wake-up may be late by the scheduler granularity).
+ *
+ * When a frame ends after its deadline the next one is due right away (catch up). After
+ * MAX_LATE_FRAMES missed deadlines the schedule starts again from now instead of running a
+ * burst of frames (e.g. after the process was stopped).
+ *
+ * The last WINDOW frame times (deadline to deadline, as observed) are kept for percentiles
+ * and jitter (standard deviation).
+ */
+
+enum class PacingMode
+{
+    LOW_LATENCY,
+    LOW_POWER
+};
+
+struct PacerStats
+{
+    uint64_t frames;
+    uint64_t overruns;      // Frames that ended after their deadline
+    uint64_t resyncs;       // Times the schedule was restarted
+    double mean;            // Frame times (ms)
+    double p50;
+    double p95;
+    double p99;
+    double max;
+    double jitter;
+};
+
+class FramePacer
+{
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        static const double DEFAULT_FREQUENCY;
+        static const unsigned MAX_LATE_FRAMES = 4;
+        static const unsigned WINDOW = 600;
+
+        FramePacer(double = FramePacer::DEFAULT_FREQUENCY, PacingMode = PacingMode::LOW_LATENCY);
+
+        void start();
+        bool wait();
+
+        PacingMode get_mode() const;
+        void set_mode(PacingMode);
+        Clock::duration get_period() const;
+
+        PacerStats get_stats() const;
+        void print_stats(std::ostream&) const;
+
+        static const char* mode_name(PacingMode);
+
+    private:
+        Clock::duration period;
+        PacingMode mode;
+        Clock::time_point deadline;
+        Clock::time_point last;
+        Clock::duration margin;
+        uint64_t frames;
+        uint64_t overruns;
+        uint64_t resyncs;
+        std::vector<double> samples;
+        size_t next_sample;
+
+        void sleep_until(Clock::time_point);
+};
+
+#endif
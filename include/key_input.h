@@ -0,0 +1,54 @@
+#ifndef CHIP8_KEY_INPUT
+#define CHIP8_KEY_INPUT
+
+#include "cpu.h"
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Key input
+ * ---------
+ * Hands the keypad from the input thread (producer) to the emulation thread (consumer)
+ * without locks:
+ *
+ *   - the pressed keys as a single atomic 16-bit mask (bit N: key N pressed), for anyone
+ *     that only needs the current keys;
+ *   - every press and release in order, in a single-producer single-consumer ring of
+ *     QUEUE_SIZE edges, so a key tapped between two frames still reaches FX0A.
+ *
+ * If the ring is full the edge is dropped; apply() still leaves the CPU with the right mask.
+ */
+
+struct KeyEdge
+{
+    byte key;
+    bool pressed;
+};
+
+class KeyInput
+{
+    public:
+        static const unsigned QUEUE_SIZE = 64;
+
+        KeyInput();
+
+        // Producer
+        void press(byte);
+        void release(byte);
+
+        // Consumer
+        WORD get_mask() const;
+        bool poll(KeyEdge&);
+        void apply(CPU&);
+
+    private:
+        std::atomic<WORD> mask;
+        KeyEdge queue[KeyInput::QUEUE_SIZE];
+        std::atomic<unsigned> head;     // Next edge to poll
+        std::atomic<unsigned> tail;     // Next free slot
+
+        void push(byte, bool);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef CHIP8_PIXEL_PIPELINE
+#define CHIP8_PIXEL_PIPELINE
+
+#include "cpu.h"
+
+#include <cstdint>
+
+/*
+ * Pixel pipeline
+ * --------------
+ * Turns the display into 32-bit pixels (ARGB8888 with the default palette) for frontends,
+ * video export and streaming, always into buffers given by the caller:
+ *
+ *   expand()          gfx (a byte per pixel, 0 or 1) -> WIDTH x HEIGHT pixels
+ *   expand_packed()   1 bit per pixel (most significant bit first, as chip8-headless --format=raw)
+ *   scale_nearest()   each pixel to a factor x factor square
+ *   scale2x/3x()      Scale2x / Scale3x (AdvMAME): smooths diagonals, keeps the palette
+ *   render()          expand() and then one of the scalers, in one call
+ *
+ * expand() and expand_packed() have a scalar version and SSE2 and AVX2 kernels (x86 only),
+ * picked at run time from what the CPU supports (best_kernel()); every kernel gives the
+ * same pixels. Nothing is allocated per call: render() keeps its intermediate frame inside
+ * the pipeline, so use a pipeline per thread.
+ */
+
+enum class PixelKernel
+{
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+enum class PixelScaler
+{
+    NEAREST,
+    SCALE2X,
+    SCALE3X
+};
+
+struct Palette
+{
+    uint32_t off;
+    uint32_t on;
+};
+
+class PixelPipeline
+{
+    public:
+        static const Palette DEFAULT_PALETTE;
+
+        PixelPipeline(PixelKernel = PixelPipeline::best_kernel());
+
+        PixelKernel get_kernel() const;
+
+        void expand(const byte*, const Palette&, uint32_t*) const;
+        void expand_packed(const byte*, const Palette&, uint32_t*) const;
+        void render(const byte*, const Palette&, PixelScaler, unsigned, uint32_t*);
+
+        static void scale_nearest(const uint32_t*, unsigned, unsigned, unsigned, uint32_t*);
+        static void scale2x(const uint32_t*, unsigned, unsigned, uint32_t*);
+        static void scale3x(const uint32_t*, unsigned, unsigned, uint32_t*);
+
+        static bool is_supported(PixelKernel);
+        static PixelKernel best_kernel();
+        static const char* kernel_name(PixelKernel);
+
+    private:
+        PixelKernel kernel;
+
+        // Expanded frame of render()
+        uint32_t pixels[CPU::GFX_LENGTH];
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef CHIP8_ROLLBACK
+#define CHIP8_ROLLBACK
+
+#include "cpu.h"
+
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+/*
+ * Rollback netplay
+ * ----------------
+ * Two peers run the same ROM without waiting for each other: every frame runs right away with
+ * the local input and a prediction of the remote one (the last remote input received). When
+ * the real remote input of a past frame arrives and differs from its prediction, the CPU goes
+ * back to the snapshot taken before that frame and runs the frames up to the present again
+ * with the inputs now known, all before the next display frame.
+ *
+ * Inputs are key masks (CPU::update_pressed_keys()); the CPU gets the OR of both peers' masks,
+ * as two players share one keypad on the original machine. With input_delay, local inputs
+ * apply that many frames later (fewer rollbacks, more latency).
+ *
+ * A snapshot is a copy of the CPU (state, written memory pages, display) into a ring of
+ * MAX_ROLLBACK + 1 CPUs kept by the session, so saving and restoring don't allocate once the
+ * ring is warm. Both peers must use the same image and seed (CXNN). A peer MAX_ROLLBACK frames
+ * ahead of the remote inputs it has stalls (advance() returns false) until they arrive.
+ *
+ * Every CHECK_INTERVAL frames the state hash of a frame whose inputs are all known is kept
+ * (get_checkpoint()), so peers can exchange them and spot desyncs (check_remote()).
+ *
+ * There's no transport here: see chip8-netplay (UDP) and tests/test_rollback (in memory).
+ */
+
+struct RollbackStats
+{
+    uint64_t frames;            // Frames advanced
+    uint64_t stalls;            // advance() calls that had to wait for the remote inputs
+    uint64_t rollbacks;
+    uint64_t resimulated;       // Frames run again
+    uint64_t mispredictions;    // Remote inputs that weren't what was predicted
+    uint64_t remote_inputs;
+    double late_mean;           // Frames remote inputs arrived after the frame they belong to (hidden latency)
+    unsigned late_max;
+    unsigned depth_max;         // Most frames gone back at once
+    double resimulation_mean;   // Time to restore and run the frames again (ms per rollback)
+    double resimulation_max;
+    double snapshot_mean;       // Time to save a snapshot (us)
+    uint64_t checks;            // Remote checkpoints compared
+    uint64_t desyncs;           // ...that didn't match
+};
+
+class RollbackSession
+{
+    public:
+        static const unsigned MAX_ROLLBACK = 8;
+        static const unsigned MAX_INPUT_DELAY = 8;
+        static const unsigned INPUT_WINDOW = 64;
+        static const unsigned CHECK_INTERVAL = 30;
+
+        RollbackSession(const std::shared_ptr<const CPU::Image>&, DWORD, unsigned = 1, unsigned = 0);
+
+        uint32_t get_frame() const;
+        uint32_t get_confirmed_frame() const;
+
+        void set_local_input(WORD);
+        bool get_local_input(uint32_t, WORD&) const;
+        uint32_t get_local_frames() const;
+        void add_remote_input(uint32_t, WORD);
+
+        bool can_advance() const;
+        bool advance();
+        void synchronize();
+
+        const CPU& get_cpu() const;
+
+        bool get_checkpoint(uint32_t&, uint64_t&) const;
+        bool check_remote(uint32_t, uint64_t);
+
+        RollbackStats get_stats() const;
+        static void print_stats(std::ostream&, const RollbackStats&);
+
+    private:
+        struct FrameInput
+        {
+            WORD local;         // Kept for INPUT_WINDOW frames (the peer may ask for them again)
+            WORD remote;        // Received, or the prediction the frame last ran with
+            bool received;
+        };
+
+        struct Checkpoint
+        {
+            uint32_t frame;
+            uint64_t hash;
+        };
+
+        CPU cpu;
+        std::vector<CPU> snapshots;
+        FrameInput inputs[RollbackSession::INPUT_WINDOW];
+        unsigned cycles_per_frame;
+        unsigned input_delay;
+
+        uint32_t frame;             // Next frame to run
+        uint32_t local_frames;      // Frames with a local input (frame + input_delay once set)
+        uint32_t confirmed;         // Frames before it have their remote input
+        uint32_t rollback_to;       // Earliest mispredicted frame (frame if none)
+        uint32_t retired;           // Remote inputs before it are no longer kept
+        WORD last_remote;           // Prediction: the last remote input confirmed
+        uint32_t next_checkpoint;
+        Checkpoint checkpoints[4];
+        unsigned newest_checkpoint;
+
+        RollbackStats stats;
+        uint64_t late_sum;
+        uint64_t snapshots_taken;
+        double snapshot_time;
+        double resimulation_time;
+
+        FrameInput& input(uint32_t);
+        const FrameInput& input(uint32_t) const;
+        void save(uint32_t);
+        void run(uint32_t);
+        void record_checkpoints();
+};
+
+#endif
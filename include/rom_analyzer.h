@@ -0,0 +1,88 @@
+#ifndef CHIP8_ROM_ANALYZER
+#define CHIP8_ROM_ANALYZER
+
+#include "cpu.h"
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+/*
+ * ROM analyzer
+ * ------------
+ * Recovers the code reachable from CPU::ROM_MEMORY_BEGIN by following jumps, calls,
+ * returns and skips, and splits it in basic blocks. Targets that can't be known
+ * statically (BNNN, 00EE) end a block without successors. Unknown opcodes that leave
+ * the PC unchanged end a block that loops on itself.
+ *
+ * The value of I is propagated over the control-flow graph (ANNN sets it, FX1E and FX29
+ * make it unknown), so that:
+ *   - DXYN and FX65 mark the bytes they read as data (sprites, tables).
+ *   - FX33 and FX55 are recorded as stores, flagged when they may hit code.
+ *
+ * A ROM has static code when no store can change it and all its code was found
+ * (no BNNN, no jumps below CPU::ROM_MEMORY_BEGIN): cached or compiled blocks don't need
+ * to be checked against memory before running.
+ */
+
+struct BasicBlock
+{
+    WORD begin;                     // Address of the first instruction
+    WORD end;                       // Address after the last instruction
+    std::vector<WORD> successors;   // Statically known successors
+    bool dynamic;                   // Ends with BNNN or 00EE (target known only at runtime)
+
+    unsigned get_length() const;    // Number of instructions
+};
+
+struct RomStore
+{
+    WORD address;                   // Address of the FX33/FX55 instruction
+    WORD target;                    // First byte written (if known)
+    WORD length;                    // Bytes written
+    bool known;                     // I is known at that point
+    bool hits_code;                 // Known and overlaps code
+};
+
+class RomAnalyzer
+{
+    public:
+        RomAnalyzer();
+
+        void analyze(const byte*, size_t);
+
+        const std::vector<BasicBlock>& get_blocks() const;
+        const std::vector<RomStore>& get_stores() const;
+        const BasicBlock* find_block(WORD) const;
+        bool is_code(WORD) const;
+        bool is_data(WORD) const;
+        WORD get_opcode(WORD) const;
+        unsigned get_code_size() const;
+        unsigned get_data_size() const;
+        bool is_complete() const;
+        bool has_static_code() const;
+
+        void print(std::ostream&) const;
+        void print_dot(std::ostream&, const string&) const;
+
+        static bool ends_block(WORD);
+        static bool stalls(WORD);
+        static string disassemble(WORD);
+
+    private:
+        byte memory[CPU::MEMORY_LENGTH_B];
+        bool code[CPU::MEMORY_LENGTH_B];
+        bool leader[CPU::MEMORY_LENGTH_B];
+        bool data[CPU::MEMORY_LENGTH_B];
+        std::vector<BasicBlock> blocks;
+        std::vector<RomStore> stores;
+        bool complete;
+
+        void successors(WORD, WORD, std::vector<WORD>&) const;
+        void find_code();
+        void find_blocks();
+        void find_accesses();
+        int walk_block(const BasicBlock&, int, bool);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef CHIP8_ROM_CATALOG
+#define CHIP8_ROM_CATALOG
+
+#include "cpu.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/*
+ * ROM catalog
+ * -----------
+ * Scans a ROM tree once (e.g. roms/) and keeps, for every .ch8 file, its content hash, size,
+ * path, the metadata found in the file name and in the sidecar .txt, and the detected platform.
+ *
+ * The index file is plain text, one ROM per line, so it can be loaded without touching
+ * the ROM files again:
+ *
+ *   CHIP8-CATALOG <version> <entries>
+ *   <hash>\t<size>\t<platform>\t<path>\t<title>\t<author>\t<year>\t<controls>
+ */
+
+enum class RomPlatform
+{
+    CHIP8,          // Original CHIP-8 (64x32)
+    CHIP8_HIRES,    // VIP 2-page hires mode (64x64), starts with 0x1260
+    SCHIP           // SuperChip opcodes found
+};
+
+struct RomEntry
+{
+    uint64_t hash;
+    uint32_t size;
+    RomPlatform platform;
+    std::string path;
+    std::string title;
+    std::string author;
+    std::string year;
+    std::string controls;
+};
+
+class RomCatalog
+{
+    public:
+        static const unsigned VERSION = 1;
+        static const char* const DEFAULT_INDEX;
+
+        RomCatalog();
+
+        bool build(const string&);
+        bool save(const string&) const;
+        bool load(const string&);
+
+        const std::vector<RomEntry>& get_entries() const;
+        const RomEntry* find_by_hash(uint64_t) const;
+        const RomEntry* find_by_name(const string&) const;
+        const RomEntry* find(const string&) const;
+
+        static uint64_t hash(const byte*, size_t);
+        static RomPlatform detect_platform(const byte*, size_t);
+        static const char* platform_name(RomPlatform);
+        static CPU::Quirks quirks_profile();
+
+    private:
+        std::vector<RomEntry> entries;
+        std::unordered_map<uint64_t, size_t> by_hash;
+
+        bool scan(const string&);
+        bool add(const string&);
+        void reindex();
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef CHIP8_SESSION_SCHEDULER
+#define CHIP8_SESSION_SCHEDULER
+
+#include "cpu.h"
+#include "work_pool.h"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+/*
+ * Session scheduler
+ * -----------------
+ * Hosts many long-lived CPUs (sessions) in one process on a WorkStealingPool, instead of a
+ * process per ROM with its own loop. Every tick() runs one frame (the session's cycles per
+ * frame) of every session that isn't parked: the sessions are split in chunks of CHUNK, one
+ * task each, and idle workers steal chunks from busy ones, so sessions with more cycles or
+ * slower frames don't hold the tick back on a single worker. The chunk order rotates every
+ * tick, so the same sessions aren't always the last ones to run.
+ *
+ * Parking: a frame that leaves the CPU exactly as it found it (state, display and memory) will
+ * do the same again and again with the same keys: a program waiting in FX0A, spinning on a
+ * jump to itself, polling keys with no timer running, or halted. Such sessions are parked and
+ * skipped until set_keys() gives them other keys. This is exact, not a heuristic: a parked
+ * session is where it would be if it had run.
+ *
+ * Deadlines: a session's frame is due at the start of the tick plus the session's deadline
+ * (the tick period by default). Frames that end later count as missed for that session.
+ *
+ * set_keys() can be called from any thread at any time (the keys apply from the next frame).
+ * add_session(), tick() and the getters must be called from one thread, between ticks.
+ */
+
+struct SessionStats
+{
+    uint64_t frames;        // Frames run
+    uint64_t parked;        // Ticks skipped while parked
+    uint64_t wakeups;       // Times new keys woke it up
+    uint64_t missed;        // Frames that ended after their deadline
+    double late_max;        // Most a frame ended after its deadline (ms)
+    double run_mean;        // Time to run a frame (us)
+    double run_max;
+};
+
+struct SchedulerStats
+{
+    unsigned sessions;
+    unsigned parked_now;
+    uint64_t ticks;
+    uint64_t frames;        // Frames run (all sessions)
+    uint64_t parked;        // Frames skipped because the session was parked
+    uint64_t missed;        // Frames that ended after their session's deadline
+    unsigned late_sessions; // Sessions that missed at least one deadline
+    double tick_mean;       // Time to run a tick (ms)
+    double tick_max;
+    WorkPoolStats pool;
+};
+
+class SessionScheduler
+{
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        static const unsigned CHUNK = 16;   // Sessions per task
+        static const double DEFAULT_FREQUENCY;
+
+        SessionScheduler(WorkStealingPool&, double = SessionScheduler::DEFAULT_FREQUENCY);
+
+        unsigned add_session(const std::shared_ptr<const CPU::Image>&, unsigned, DWORD, double = 0);
+        unsigned get_sessions() const;
+        void set_keys(unsigned, WORD);
+
+        void tick();
+
+        bool is_parked(unsigned) const;
+        const CPU& get_cpu(unsigned) const;
+        SessionStats get_session_stats(unsigned) const;
+        SchedulerStats get_stats() const;
+
+        static void print_stats(std::ostream&, const SchedulerStats&);
+
+    private:
+        struct Session
+        {
+            CPU cpu;
+            unsigned cycles;
+            Clock::duration deadline;
+            std::atomic<WORD> keys;     // Wanted (set_keys())
+            WORD applied;               // Given to the CPU
+            bool parked;
+            SessionStats stats;
+            double run_time;            // us
+        };
+
+        WorkStealingPool& pool;
+        Clock::duration period;
+        std::vector<std::unique_ptr<Session> > sessions;
+        std::vector<unsigned> active;
+        uint64_t ticks;
+        uint64_t parked_frames;
+        double tick_time;
+        double tick_max;
+        WorkPoolStats pool_start;
+
+        static void run(Session&, Clock::time_point);
+};
+
+#endif
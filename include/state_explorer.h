@@ -0,0 +1,111 @@
+#ifndef CHIP8_STATE_EXPLORER
+#define CHIP8_STATE_EXPLORER
+
+#include "cpu.h"
+#include "work_pool.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+/*
+ * State-space explorer
+ * --------------------
+ * Plays a ROM as a search problem. From a snapshot, every frame boundary branches in
+ * StateExplorer::BRANCHES ways: no key, or one of the 16 keys held for the frame (released at
+ * its end, so FX0A sees it too). The children are deduplicated by CPU::get_state_hash()
+ * (registers, stack, timers, RNG, memory and display), so a game that ignores most keys
+ * doesn't multiply its states.
+ *
+ * The search goes level by level (frame by frame): the frontier is split in tasks on a
+ * WorkStealingPool, and the new states of a level are merged, sorted and deduplicated
+ * before the next one, so the result doesn't depend on the number of workers or their timing.
+ * It stops when no new state is found (the whole reachable space was seen), at max_depth
+ * frames or once max_states states were found.
+ *
+ * Every instruction run is checked before it runs, with the same conditions as
+ * CPU::Violations but in any build:
+ *
+ *   UNKNOWN_OPCODE     CPU::is_known() is false (0NNN included)
+ *   STACK_OVERFLOW     2NNN with the stack full (the CPU halts)
+ *   STACK_UNDERFLOW    00EE with the stack empty (the CPU halts)
+ *   DRAW_OFF_SCREEN    DXYN with lit sprite pixels past the right or bottom edge
+ *   DRAW_PAST_MEMORY   DXYN reading the sprite across the end of memory
+ *   STUCK              a state no input can leave (halted, or spinning with no timer running)
+ *
+ * Each finding is reported once per kind and address, with the shortest key sequence
+ * (ties broken by the sequence) that reaches it, so it can be played again.
+ */
+
+enum class Finding
+{
+    UNKNOWN_OPCODE,
+    STACK_OVERFLOW,
+    STACK_UNDERFLOW,
+    DRAW_OFF_SCREEN,
+    DRAW_PAST_MEMORY,
+    STUCK
+};
+
+struct ExploreOptions
+{
+    unsigned cycles;        // Instructions per frame
+    unsigned max_depth;     // Frames
+    uint64_t max_states;
+    DWORD seed;             // CXNN
+    CPU::Quirks quirks;
+};
+
+struct ExploreFinding
+{
+    Finding kind;
+    WORD pc;
+    WORD opcode;
+    unsigned frame;             // Frame it happens in (0: the first one)
+    std::vector<byte> keys;     // Branch of each frame up to it (0: no key, 1 + K: key K)
+    uint64_t count;             // Frames run that hit it
+};
+
+struct ExploreResult
+{
+    static const unsigned FINDINGS = 6;
+
+    uint64_t states;            // Distinct states found (the snapshot included)
+    uint64_t frames_run;        // Branches run
+    uint64_t duplicates;        // ...that led to a state already found
+    unsigned depth;             // Frames deep the search got
+    bool exhausted;             // No new states were left
+    bool truncated;             // Stopped by max_states
+    unsigned screens;           // Distinct displays among the states
+    unsigned instructions;      // Distinct addresses run
+    unsigned static_code;       // Instructions found by RomAnalyzer...
+    unsigned static_covered;    // ...that were run
+    uint64_t counts[ExploreResult::FINDINGS];
+    std::vector<ExploreFinding> findings;
+    WorkPoolStats pool;
+    double seconds;
+};
+
+class StateExplorer
+{
+    public:
+        static const unsigned BRANCHES = CPU::KEY_MAPPING_SIZE + 1;
+        static const ExploreOptions DEFAULT_OPTIONS;
+
+        StateExplorer(WorkStealingPool&, const ExploreOptions& = StateExplorer::DEFAULT_OPTIONS);
+
+        ExploreResult explore(const std::shared_ptr<const CPU::Image>&) const;
+        ExploreResult explore(const CPU&) const;
+
+        static const char* finding_name(Finding);
+        static string describe_keys(const std::vector<byte>&);
+        static void print(std::ostream&, const ExploreResult&, bool = true);
+
+    private:
+        WorkStealingPool& pool;
+        ExploreOptions options;
+};
+
+#endif
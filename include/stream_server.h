@@ -0,0 +1,96 @@
+#ifndef CHIP8_STREAM_SERVER
+#define CHIP8_STREAM_SERVER
+
+#include "cpu.h"
+#include "frame_delta.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Frame streaming over WebSocket
+ * ------------------------------
+ * Runs instances at FREQUENCY frames per second and serves them to local browsers:
+ *
+ *   GET /              the client page (web/chip8_stream.html, see set_page())
+ *   GET /instance/N    WebSocket (RFC 6455) of instance N
+ *
+ * A client gets a keyframe and then a delta per frame that changed (FrameDeltaEncoder), as
+ * binary messages. Each delta is encoded once per instance and queued for all its clients,
+ * so hundreds of sessions cost little more than running them. Clients send their pressed
+ * keys back as a binary message of 2 bytes (key mask, little-endian), applied with
+ * CPU::update_pressed_keys() before the next frame.
+ *
+ * Everything runs on the thread that calls run(): poll() on the sockets until the next frame
+ * is due (same schedule as FramePacer), then frame(). Sockets are non-blocking; a client more
+ * than MAX_QUEUED bytes behind stops getting deltas and gets a keyframe once it has caught up.
+ *
+ * Meant for loopback (listen() defaults to 127.0.0.1): no TLS, no authentication, no
+ * fragmented messages from clients.
+ */
+
+struct StreamStats
+{
+    uint64_t frames;
+    uint64_t messages;      // WebSocket messages sent (keyframes and deltas)
+    uint64_t keyframes;
+    uint64_t bytes_sent;    // Everything written to the sockets, headers included
+    unsigned clients;       // WebSocket clients connected now
+};
+
+class StreamServer
+{
+    public:
+        static const double FREQUENCY;
+        static const size_t MAX_QUEUED = 64 * 1024;
+        static const size_t MAX_REQUEST = 8 * 1024;
+        static const size_t MAX_MESSAGE = 125;
+
+        StreamServer();
+        ~StreamServer();
+
+        bool listen(unsigned short, const string& = "127.0.0.1");
+        unsigned short get_port() const;
+        void set_page(const string&);
+
+        unsigned add_instance(const std::shared_ptr<const CPU::Image>&, unsigned = 1);
+        unsigned get_instance_count() const;
+        CPU& get_cpu(unsigned);
+
+        void run();
+        void stop();
+
+        void poll(int);
+        void frame();
+
+        StreamStats get_stats() const;
+
+        static string accept_key(const string&);
+
+    private:
+        struct Instance;
+        struct Client;
+
+        int listener;
+        unsigned short port;
+        string page;
+        std::atomic<bool> running;
+        std::vector<std::unique_ptr<Instance> > instances;
+        std::vector<std::unique_ptr<Client> > clients;
+        StreamStats stats;
+        std::vector<byte> message;
+
+        void accept_clients();
+        void read_client(Client&);
+        void write_client(Client&);
+        void handle_request(Client&);
+        void handle_frames(Client&);
+        void send_message(Client&, byte, const byte*, size_t);
+        void send_keyframe(Client&);
+        void close_client(Client&);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CHIP8_TERMINAL_RENDERER
+#define CHIP8_TERMINAL_RENDERER
+
+#include "cpu.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Terminal renderer
+ * -----------------
+ * Draws the display with Unicode cells on an ANSI terminal:
+ *
+ *   HALF_BLOCKS    1x2 pixels per cell (' ', U+2580, U+2584, U+2588): 64x16 cells
+ *   BRAILLE        2x4 pixels per cell (U+2800 - U+28FF): 32x8 cells
+ *
+ * It remembers the cells on the terminal and render() only emits the ones that changed.
+ * The cursor goes to the next changed cell the cheapest way: it writes the cells in between
+ * again, moves right (CSI n C) or jumps (CSI row;col H), whichever is shorter. A frame that
+ * didn't change costs no bytes at all, so it stays usable over slow SSH links.
+ */
+
+enum class TerminalGlyphs
+{
+    HALF_BLOCKS,
+    BRAILLE
+};
+
+class TerminalRenderer
+{
+    public:
+        TerminalRenderer(TerminalGlyphs = TerminalGlyphs::HALF_BLOCKS, unsigned = 1, unsigned = 1);
+
+        unsigned get_rows() const;
+        unsigned get_columns() const;
+
+        void invalidate();
+        unsigned render(const byte*, std::string&);
+
+        static const char* const HIDE_CURSOR;
+        static const char* const SHOW_CURSOR;
+        static const char* const CLEAR;
+
+    private:
+        TerminalGlyphs glyphs;
+        unsigned origin_row;        // Terminal position (1-based) of the top left cell
+        unsigned origin_col;
+        unsigned rows;
+        unsigned columns;
+        std::vector<byte> cells;    // Pixels of each cell as drawn (bit per pixel)
+        std::vector<byte> next;
+        bool valid;                 // The terminal shows the cells (false: clear and repaint)
+
+        byte cell(const byte*, unsigned, unsigned) const;
+        void glyph(byte, std::string&) const;
+};
+
+#endif
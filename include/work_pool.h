@@ -0,0 +1,82 @@
+#ifndef CHIP8_WORK_POOL
+#define CHIP8_WORK_POOL
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Work-stealing pool
+ * ------------------
+ * A fixed set of worker threads, each with its own deque of tasks. A task submitted from a
+ * worker goes to the back of that worker's deque and the worker takes its own tasks from the
+ * back (the newest first, still warm in its cache). An idle worker steals from the front of
+ * the others' deques (the oldest, usually the biggest pieces of work), so the load balances
+ * itself when tasks are uneven or spawn more tasks. Tasks submitted from other threads are
+ * spread round-robin.
+ *
+ * Workers with nothing to run or steal sleep until a task is submitted. wait() returns once
+ * every task submitted so far (and those they submitted) has finished.
+ *
+ * Tasks get the index of the worker running them, to keep per-worker results without locks.
+ */
+
+struct WorkPoolStats
+{
+    uint64_t tasks;     // Tasks run
+    uint64_t steals;    // ...taken from another worker's deque
+    uint64_t sleeps;    // Times a worker found nothing to do and slept
+};
+
+class WorkStealingPool
+{
+    public:
+        typedef std::function<void(unsigned)> Task;
+
+        WorkStealingPool(unsigned = 0);
+        ~WorkStealingPool();
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        unsigned get_workers() const;
+        void submit(Task);
+        void wait();
+
+        WorkPoolStats get_stats() const;
+        WorkPoolStats get_worker_stats(unsigned) const;
+
+    private:
+        struct Worker
+        {
+            std::mutex lock;
+            std::deque<Task> tasks;
+            std::atomic<uint64_t> executed;
+            std::atomic<uint64_t> stolen;
+            std::atomic<uint64_t> sleeps;
+        };
+
+        std::vector<std::unique_ptr<Worker> > workers;
+        std::vector<std::thread> threads;
+
+        std::atomic<uint64_t> queued;       // Tasks in the deques
+        std::atomic<uint64_t> pending;      // Tasks submitted and not finished
+        std::atomic<unsigned> sleeping;
+        std::atomic<unsigned> next_worker;  // Round-robin of outside submissions
+        bool stopping;
+
+        std::mutex idle_lock;
+        std::condition_variable work_available;
+        std::condition_variable all_done;
+
+        void worker_loop(unsigned);
+        bool take(unsigned, Task&);
+};
+
+#endif
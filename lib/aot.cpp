@@ -0,0 +1,407 @@
+#include "aot.h"
+#include "rom_analyzer.h"
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <cstdio>
+#include <utility>
+
+using std::string;
+
+AotRunner::AotRunner(const AotProgram& compiled) :
+    program(compiled),
+    table(CPU::MEMORY_LENGTH_B, NULL),
+    checked_versions(CPU::MEMORY_LENGTH_B, 0),
+    checked_image(NULL),
+    image_matches(false),
+    compiled_cycles(0),
+    interpreted_cycles(0)
+{
+    for (unsigned i = 0; i < this->program.block_count; i++)
+    {
+        const AotBlock& block = this->program.blocks[i];
+
+        this->table[block.address % CPU::MEMORY_LENGTH_B] = &block;
+    }
+}
+
+bool AotRunner::is_intact(const CPU& cpu, const AotBlock& block)
+{
+    unsigned length = block.length * 2;
+
+    if (this->program.static_code || cpu.is_unmodified(block.address, length))
+    {
+        return true;
+    }
+
+    // Blocks are short: the first and last pages are the only ones they can touch
+    unsigned version = cpu.get_memory_version(block.address) + cpu.get_memory_version(block.address + length - 1);
+    unsigned& checked = this->checked_versions[block.address % CPU::MEMORY_LENGTH_B];
+
+    if (checked == version && version != 0)
+    {
+        return true;
+    }
+
+    // Some page of the block was written: compare against the compiled bytes
+    for (unsigned i = 0; i < length; i++)
+    {
+        unsigned addr = block.address + i;
+        byte compiled = 0;
+
+        if (addr >= CPU::ROM_MEMORY_BEGIN && addr - CPU::ROM_MEMORY_BEGIN < this->program.rom_length)
+        {
+            compiled = this->program.rom[addr - CPU::ROM_MEMORY_BEGIN];
+        }
+
+        if (cpu.load(addr) != compiled)
+        {
+            return false;
+        }
+    }
+
+    checked = version;
+
+    return true;
+}
+
+/*
+ * Runs the block at the PC if it fits in cycles (and is intact), one interpreted cycle
+ * otherwise. Returns the cycles run (0 once the CPU is halted).
+ */
+unsigned AotRunner::step(CPU& cpu, uint64_t cycles)
+{
+    // By reference: no reference count to update on every block
+    const std::shared_ptr<const CPU::Image>& image = cpu.get_image();
+
+    if (image.get() != this->checked_image)
+    {
+        // Only run the blocks on the image they were compiled from
+        this->checked_image = image.get();
+        this->image_matches = AotCompiler::image_hash(image->data, CPU::MEMORY_LENGTH_B) == this->program.image_hash;
+    }
+
+    const CPU::State& state = cpu.get_state();
+
+    if (cycles == 0 || state.halt)
+    {
+        return 0;
+    }
+
+    const AotBlock* block = this->image_matches ? this->table[state.pc % CPU::MEMORY_LENGTH_B] : NULL;
+
+    if (block != NULL && block->length <= cycles && this->is_intact(cpu, *block))
+    {
+        block->function(cpu);
+
+        this->compiled_cycles += block->length;
+
+        return block->length;
+    }
+
+    cpu.emulate_cycle();
+
+    this->interpreted_cycles++;
+
+    return 1;
+}
+
+void AotRunner::run(CPU& cpu, uint64_t cycles)
+{
+    unsigned ran;
+
+    while ((ran = this->step(cpu, cycles)) > 0)
+    {
+        cycles -= ran;
+    }
+}
+
+uint64_t AotRunner::get_compiled_cycles() const
+{
+    return this->compiled_cycles;
+}
+
+uint64_t AotRunner::get_interpreted_cycles() const
+{
+    return this->interpreted_cycles;
+}
+
+uint64_t AotCompiler::image_hash(const byte* image, size_t length)
+{
+    return RomCatalog::hash(image, length);
+}
+
+void AotCompiler::emit_instruction(std::ostream& out, WORD addr, WORD opcode)
+{
+    char line[128];
+    unsigned x = (opcode & 0x0F00) >> 8;
+    unsigned y = (opcode & 0x00F0) >> 4;
+    unsigned n = opcode & 0x000F;
+    unsigned nn = opcode & 0x00FF;
+    unsigned nnn = opcode & 0x0FFF;
+    WORD next = (addr + 2) & 0x0FFF;
+    WORD skip = (addr + 4) & 0x0FFF;
+
+    snprintf(line, sizeof(line), "    // 0x%04X: %04X\n    s.draw_flag = false;\n    s.opcode = 0x%04X;\n", addr, opcode, opcode);
+    out << line;
+
+    // Same statements (and order) as the handlers in lib/cpu.cpp
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+            snprintf(line, sizeof(line), "    s.pc = 0x%03X;\n", nnn);
+            break;
+        case 0x3000:
+            snprintf(line, sizeof(line), "    s.pc = s.V[0x%X] == 0x%02X ? 0x%03X : 0x%03X;\n", x, nn, skip, next);
+            break;
+        case 0x4000:
+            snprintf(line, sizeof(line), "    s.pc = s.V[0x%X] != 0x%02X ? 0x%03X : 0x%03X;\n", x, nn, skip, next);
+            break;
+        case 0x5000:
+            line[0] = '\0';
+
+            if (n == 0)
+            {
+                snprintf(line, sizeof(line), "    s.pc = s.V[0x%X] == s.V[0x%X] ? 0x%03X : 0x%03X;\n", x, y, skip, next);
+            }
+
+            break;
+        case 0x6000:
+            snprintf(line, sizeof(line), "    s.V[0x%X] = 0x%02X;\n    s.pc = 0x%03X;\n", x, nn, next);
+            break;
+        case 0x7000:
+            snprintf(line, sizeof(line), "    s.V[0x%X] += 0x%02X;\n    s.pc = 0x%03X;\n", x, nn, next);
+            break;
+        case 0x8000:
+            switch (n)
+            {
+                case 0x0:
+                    snprintf(line, sizeof(line), "    s.V[0x%X] = s.V[0x%X];\n", x, y);
+                    break;
+                case 0x1:
+                    snprintf(line, sizeof(line), "    s.V[0x%X] |= s.V[0x%X];\n", x, y);
+                    break;
+                case 0x2:
+                    snprintf(line, sizeof(line), "    s.V[0x%X] &= s.V[0x%X];\n", x, y);
+                    break;
+                case 0x3:
+                    snprintf(line, sizeof(line), "    s.V[0x%X] ^= s.V[0x%X];\n", x, y);
+                    break;
+                case 0x4:
+                    snprintf(line, sizeof(line), "    s.V[0xF] = s.V[0x%X] > 0xFF - s.V[0x%X];\n    s.V[0x%X] += s.V[0x%X];\n", x, y, x, y);
+                    break;
+                case 0x5:
+                    snprintf(line, sizeof(line), "    s.V[0xF] = !(s.V[0x%X] < s.V[0x%X]);\n    s.V[0x%X] -= s.V[0x%X];\n", x, y, x, y);
+                    break;
+                case 0x6:
+                    snprintf(line, sizeof(line), "    s.V[0xF] = s.V[0x%X] & 0x01;\n    s.V[0x%X] >>= 1;\n", x, x);
+                    break;
+                case 0x7:
+                    snprintf(line, sizeof(line), "    s.V[0xF] = !(s.V[0x%X] < s.V[0x%X]);\n    s.V[0x%X] = s.V[0x%X] - s.V[0x%X];\n", y, x, x, y, x);
+                    break;
+                case 0xE:
+                    snprintf(line, sizeof(line), "    s.V[0xF] = s.V[0x%X] >> 7;\n    s.V[0x%X] <<= 1;\n", x, x);
+                    break;
+                default:
+                    line[0] = '\0';
+                    break;
+            }
+
+            if (line[0] != '\0')
+            {
+                out << line;
+                snprintf(line, sizeof(line), "    s.pc = 0x%03X;\n", next);
+            }
+
+            break;
+        case 0x9000:
+            line[0] = '\0';
+
+            if (n == 0)
+            {
+                snprintf(line, sizeof(line), "    s.pc = s.V[0x%X] != s.V[0x%X] ? 0x%03X : 0x%03X;\n", x, y, skip, next);
+            }
+
+            break;
+        case 0xA000:
+            snprintf(line, sizeof(line), "    s.I = 0x%03X;\n    s.pc = 0x%03X;\n", nnn, next);
+            break;
+        case 0xB000:
+            snprintf(line, sizeof(line), "    s.pc = (0x%03X + s.V[0x0]) & 0xFFF;\n", nnn);
+            break;
+        case 0xF000:
+            switch (nn)
+            {
+                case 0x07:
+                    snprintf(line, sizeof(line), "    s.V[0x%X] = s.delay_timer;\n    s.pc = 0x%03X;\n", x, next);
+                    break;
+                case 0x15:
+                    snprintf(line, sizeof(line), "    s.delay_timer = s.V[0x%X];\n    s.pc = 0x%03X;\n", x, next);
+                    break;
+                case 0x18:
+                    snprintf(line, sizeof(line), "    s.sound_timer = s.V[0x%X];\n    s.pc = 0x%03X;\n", x, next);
+                    break;
+                case 0x1E:
+                    snprintf(line, sizeof(line), "    s.V[0xF] = s.I > 0xFF - s.V[0x%X];\n    s.I = (s.I + s.V[0x%X]) & 0xFFF;\n    s.pc = 0x%03X;\n", x, x, next);
+                    break;
+                default:
+                    line[0] = '\0';
+                    break;
+            }
+
+            break;
+        default:
+            line[0] = '\0';
+            break;
+    }
+
+    if (line[0] == '\0')
+    {
+        // Everything else (screen, stack, keys, memory stores, RNG, unknown opcodes) goes through the interpreter
+        snprintf(line, sizeof(line), "    s.pc = 0x%03X;\n    cpu.execute_instruction(0x%04X);\n", addr, opcode);
+    }
+
+    out << line;
+    out << "    cpu.tick_timers();\n\n";
+}
+
+bool AotCompiler::emit(std::ostream& out, const byte* rom, size_t length, const string& name, const string& source, bool with_main)
+{
+    std::shared_ptr<const CPU::Image> image = CPU::create_image(rom, length);
+
+    if (!image)
+    {
+        return false;
+    }
+
+    RomAnalyzer analyzer;
+
+    analyzer.analyze(rom, length);
+
+    const std::vector<BasicBlock>& analyzed = analyzer.get_blocks();
+    std::vector<std::pair<WORD, WORD> > blocks;
+    char line[160];
+
+    // Unless no store can hit code, a block ends after each store (the next instruction may have changed)
+    for (size_t i = 0; i < analyzed.size(); i++)
+    {
+        WORD begin = analyzed[i].begin;
+
+        for (WORD addr = begin; addr < analyzed[i].end; addr += 2)
+        {
+            WORD opcode = analyzer.get_opcode(addr);
+
+            if (!analyzer.has_static_code() && addr + 2 < analyzed[i].end &&
+                ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055))
+            {
+                blocks.push_back(std::make_pair(begin, addr + 2));
+                begin = addr + 2;
+            }
+        }
+
+        blocks.push_back(std::make_pair(begin, analyzed[i].end));
+    }
+
+    out << "// Generated by chip8-aot from " << source << ". Do not edit.\n";
+    out << "#include \"aot.h\"\n\n";
+
+    if (with_main)
+    {
+        out << "#include <iostream>\n#include <string>\n#include <chrono>\n#include <cstdlib>\n\n";
+    }
+
+    out << "namespace\n{\n\n";
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        WORD begin = blocks[i].first;
+        WORD end = blocks[i].second;
+
+        snprintf(line, sizeof(line), "// 0x%04X - 0x%04X (%u instructions)\nvoid block_%04X(CPU& cpu)\n{\n",
+                 begin, end, (end - begin) / 2, begin);
+        out << line;
+        out << "    CPU::State& s = cpu.get_state();\n\n";
+
+        for (WORD addr = begin; addr < end; addr += 2)
+        {
+            AotCompiler::emit_instruction(out, addr, analyzer.get_opcode(addr));
+        }
+
+        out << "}\n\n";
+    }
+
+    out << "const AotBlock blocks[] =\n{\n";
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        snprintf(line, sizeof(line), "    {0x%04X, %u, block_%04X},\n", blocks[i].first, (blocks[i].second - blocks[i].first) / 2, blocks[i].first);
+        out << line;
+    }
+
+    out << "};\n\nconst byte rom[] =\n{";
+
+    for (size_t i = 0; i < length; i++)
+    {
+        snprintf(line, sizeof(line), "%s0x%02X,", i % 16 == 0 ? "\n    " : " ", rom[i]);
+        out << line;
+    }
+
+    out << "\n};\n\n}\n\n";
+
+    snprintf(line, sizeof(line), "0x%016llXULL, %u", (unsigned long long)AotCompiler::image_hash(image->data, CPU::MEMORY_LENGTH_B), (unsigned)length);
+
+    out << "extern const AotProgram chip8_aot_" << name << " =\n{\n";
+    out << "    \"" << name << "\", " << line << ", rom, " << blocks.size() << ", blocks, "
+        << (analyzer.has_static_code() ? "true" : "false") << "\n};\n";
+
+    if (with_main)
+    {
+        // "--check": lockstep against the interpreter, compared after every block (as DiffHarness does)
+        out << "\n"
+               "int main(int argc, char** argv)\n"
+               "{\n"
+               "    unsigned long long cycles = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000ULL;\n"
+               "    CPU cpu;\n"
+               "    AotRunner runner(chip8_aot_" << name << ");\n\n"
+               "    cpu.initializate();\n"
+               "    cpu.seed(1);\n"
+               "    cpu.load_rom_from_buffer(rom, sizeof(rom));\n\n"
+               "    if (argc > 2 && std::string(argv[2]) == \"--check\")\n"
+               "    {\n"
+               "        CPU reference;\n"
+               "        unsigned long long done = 0;\n"
+               "        unsigned ran;\n\n"
+               "        // Same seed, or CXNN tells them apart\n"
+               "        reference.initializate();\n"
+               "        reference.seed(1);\n"
+               "        reference.load_rom_from_buffer(rom, sizeof(rom));\n\n"
+               "        while ((ran = runner.step(cpu, cycles - done)) > 0)\n"
+               "        {\n"
+               "            WORD pc = reference.get_state().pc;\n\n"
+               "            for (unsigned i = 0; i < ran; i++)\n"
+               "            {\n"
+               "                reference.emulate_cycle();\n"
+               "            }\n\n"
+               "            done += ran;\n\n"
+               "            if (cpu.get_state_hash() != reference.get_state_hash())\n"
+               "            {\n"
+               "                std::cerr << \"MISMATCH: \" << ran << \" cycle(s) from 0x\" << std::hex << pc << std::dec\n"
+               "                          << \" differ from the interpreter (after \" << done << \" cycles)\" << std::endl;\n\n"
+               "                return 1;\n"
+               "            }\n"
+               "        }\n\n"
+               "        std::cerr << \"Lockstep: \" << done << \" cycles match the interpreter (\" << runner.get_compiled_cycles()\n"
+               "                  << \" compiled, \" << runner.get_interpreted_cycles() << \" interpreted)\" << std::endl;\n\n"
+               "        return 0;\n"
+               "    }\n\n"
+               "    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();\n\n"
+               "    runner.run(cpu, cycles);\n\n"
+               "    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - begin;\n\n"
+               "    std::cerr << cycles << \" cycles in \" << time.count() << \" s (\" << cycles / time.count() << \" cycles/s, \"\n"
+               "              << runner.get_compiled_cycles() << \" compiled, \" << runner.get_interpreted_cycles() << \" interpreted)\" << std::endl;\n\n"
+               "    return 0;\n"
+               "}\n";
+    }
+
+    return true;
+}
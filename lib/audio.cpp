@@ -0,0 +1,219 @@
+#include "audio.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+Buzzer::Buzzer(unsigned rate) :
+    sample_rate(rate),
+    active(false),
+    has_pattern(false),
+    pitch(Buzzer::DEFAULT_PITCH),
+    phase(0)
+{
+    for (std::atomic<uint32_t>& word : this->pattern)
+    {
+        word = 0;
+    }
+}
+
+void Buzzer::set_active(bool on)
+{
+    this->active.store(on, std::memory_order_relaxed);
+}
+
+void Buzzer::set_pattern(const byte* bytes, byte new_pitch)
+{
+    for (unsigned i = 0; i < Buzzer::PATTERN_BYTES / 4; i++)
+    {
+        this->pattern[i].store((uint32_t)bytes[4 * i] << 24 | (uint32_t)bytes[4 * i + 1] << 16 |
+                               (uint32_t)bytes[4 * i + 2] << 8 | bytes[4 * i + 3], std::memory_order_relaxed);
+    }
+
+    this->pitch.store(new_pitch, std::memory_order_relaxed);
+    this->has_pattern.store(true, std::memory_order_release);
+}
+
+void Buzzer::clear_pattern()
+{
+    this->has_pattern.store(false, std::memory_order_release);
+}
+
+bool Buzzer::is_active() const
+{
+    return this->active.load(std::memory_order_relaxed);
+}
+
+void Buzzer::render(int16_t* samples, size_t count)
+{
+    if (!this->is_active())
+    {
+        std::fill(samples, samples + count, 0);
+
+        return;
+    }
+
+    if (this->has_pattern.load(std::memory_order_acquire))
+    {
+        uint32_t words[Buzzer::PATTERN_BYTES / 4];
+        double step = 4000.0 * std::pow(2.0, (this->pitch.load(std::memory_order_relaxed) - 64) / 48.0) / this->sample_rate;
+
+        for (unsigned i = 0; i < Buzzer::PATTERN_BYTES / 4; i++)
+        {
+            words[i] = this->pattern[i].load(std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned bit = (unsigned)this->phase % (Buzzer::PATTERN_BYTES * 8);
+
+            samples[i] = (words[bit / 32] >> (31 - bit % 32)) & 1 ? Buzzer::AMPLITUDE : -Buzzer::AMPLITUDE;
+
+            this->phase = std::fmod(this->phase + step, Buzzer::PATTERN_BYTES * 8);
+        }
+
+        return;
+    }
+
+    double step = (double)Buzzer::TONE_FREQUENCY / this->sample_rate;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        samples[i] = this->phase < 0.5 ? Buzzer::AMPLITUDE : -Buzzer::AMPLITUDE;
+
+        this->phase = std::fmod(this->phase + step, 1.0);
+    }
+}
+
+unsigned Buzzer::get_sample_rate() const
+{
+    return this->sample_rate;
+}
+
+AudioRecorder::AudioRecorder(Buzzer& source, double frequency) :
+    buzzer(source),
+    samples_per_frame(source.get_sample_rate() / frequency),
+    pending(0),
+    buffer((size_t)samples_per_frame + 1),
+    samples(0),
+    active_samples(0)
+{
+
+}
+
+AudioRecorder::~AudioRecorder()
+{
+    this->close();
+}
+
+// Empty path: null backend (samples are rendered and counted, nothing is written)
+bool AudioRecorder::open(const std::string& path)
+{
+    this->close();
+
+    this->samples = 0;
+    this->active_samples = 0;
+
+    if (path.empty())
+    {
+        return true;
+    }
+
+    this->file.open(path, std::ios::binary);
+
+    if (!this->file.is_open())
+    {
+        std::cerr << "ERROR: the WAV file (" << path << ") couldn't be written." << std::endl;
+
+        return false;
+    }
+
+    this->write_header(0);
+
+    return true;
+}
+
+// Samples of one emulated frame (the fraction left is carried to the next one)
+void AudioRecorder::frame()
+{
+    this->pending += this->samples_per_frame;
+
+    // The buffer holds the largest frame (the carried fraction adds one sample at most)
+    size_t count = (size_t)this->pending;
+
+    this->pending -= count;
+
+    if (this->buzzer.is_active())
+    {
+        this->active_samples += count;
+    }
+
+    this->buzzer.render(this->buffer.data(), count);
+    this->samples += count;
+
+    if (this->file.is_open())
+    {
+        // WAV samples are little endian, converted in place so the frame is written at once
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(this->buffer.data());
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t sample = (uint16_t)this->buffer[i];
+
+            bytes[2 * i] = sample & 0xFF;
+            bytes[2 * i + 1] = sample >> 8;
+        }
+
+        this->file.write(reinterpret_cast<const char*>(bytes), count * 2);
+    }
+}
+
+void AudioRecorder::close()
+{
+    if (!this->file.is_open())
+    {
+        return;
+    }
+
+    this->file.seekp(0);
+    this->write_header(this->samples * 2);
+    this->file.close();
+}
+
+uint64_t AudioRecorder::get_samples() const
+{
+    return this->samples;
+}
+
+uint64_t AudioRecorder::get_active_samples() const
+{
+    return this->active_samples;
+}
+
+// RIFF header of a 16-bit mono PCM WAV file with the given data size (fields are little endian)
+void AudioRecorder::write_header(uint32_t data_size)
+{
+    const uint32_t rate = this->buzzer.get_sample_rate();
+    std::ofstream& wav = this->file;
+    auto field = [&wav](uint32_t value, unsigned size)
+    {
+        for (unsigned b = 0; b < size; b++)
+        {
+            wav.put((char)((value >> (8 * b)) & 0xFF));
+        }
+    };
+
+    wav.write("RIFF", 4);
+    field(36 + data_size, 4);
+    wav.write("WAVEfmt ", 8);
+    field(16, 4);           // Size of the format chunk
+    field(1, 2);            // PCM
+    field(1, 2);            // Mono
+    field(rate, 4);
+    field(rate * 2, 4);     // Bytes per second
+    field(2, 2);            // Bytes per sample
+    field(16, 2);           // Bits per sample
+    wav.write("data", 4);
+    field(data_size, 4);
+}
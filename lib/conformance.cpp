@@ -0,0 +1,214 @@
+#include "conformance.h"
+#include "execution_manager.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+const ConformanceOptions Conformance::DEFAULT_OPTIONS = {6000, 16, 600};
+const char* const Conformance::DEFAULT_GOLDEN = "tests/conformance.golden";
+
+Conformance::Conformance(const ConformanceOptions& conformance_options) :
+    options(conformance_options)
+{
+
+}
+
+ConformanceRecord Conformance::run(const RomEntry& entry, bool tiered) const
+{
+    ConformanceRecord record = {entry.hash, std::vector<uint64_t>(), entry.path};
+    std::shared_ptr<const CPU::Image> image = CPU::read_image(entry.path);
+
+    if (!image)
+    {
+        return record;
+    }
+
+    CPU cpu;
+    ExecutionManager manager;
+    byte keys[CPU::KEY_MAPPING_SIZE] = {};
+    uint64_t random = entry.hash | 1;
+
+    cpu.initializate();
+    cpu.load_image(image);
+    cpu.seed((DWORD)(entry.hash ^ (entry.hash >> 32)));
+
+    for (unsigned frame = 1; frame <= this->options.frames; frame++)
+    {
+        // Scripted input (xorshift64): every 8 frames on average, release all keys or press one
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+
+        if (random % 8 == 0)
+        {
+            std::fill(keys, keys + CPU::KEY_MAPPING_SIZE, 0);
+
+            if ((random >> 8) % 2 == 0)
+            {
+                keys[(random >> 16) % CPU::KEY_MAPPING_SIZE] = 1;
+            }
+
+            cpu.update_pressed_keys(keys);
+        }
+
+        if (tiered)
+        {
+            manager.run(cpu, this->options.cycles_per_frame);
+        }
+        else
+        {
+            for (unsigned cycle = 0; cycle < this->options.cycles_per_frame; cycle++)
+            {
+                cpu.emulate_cycle();
+            }
+        }
+
+        if (frame % this->options.checkpoint_period == 0)
+        {
+            // Kept up to date by the CPU itself, nothing to hash here
+            record.checkpoints.push_back(cpu.get_frame_hash());
+        }
+    }
+
+    return record;
+}
+
+bool Conformance::run_corpus(const std::vector<RomEntry>& entries, bool tiered, unsigned jobs,
+                             std::vector<ConformanceRecord>& records) const
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    records.assign(entries.size(), ConformanceRecord());
+
+    for (unsigned t = 0; t < std::max(1u, std::min<unsigned>(jobs, entries.size())); t++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (size_t i = next++; i < entries.size(); i = next++)
+            {
+                records[i] = this->run(entries[i], tiered);
+            }
+        }));
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const ConformanceRecord& record : records)
+    {
+        if (record.checkpoints.empty())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Conformance::load(const string& path, std::vector<ConformanceRecord>& records) const
+{
+    std::ifstream golden(path);
+    string magic;
+    unsigned version = 0;
+    ConformanceOptions stored = {0, 0, 0};
+    size_t count = 0;
+
+    if (!golden.is_open())
+    {
+        std::cerr << "ERROR: the golden file (" << path << ") couldn't be opened." << std::endl;
+
+        return false;
+    }
+
+    golden >> magic >> version >> stored.frames >> stored.cycles_per_frame >> stored.checkpoint_period >> count;
+
+    if (magic != "CHIP8-CONFORMANCE" || version != Conformance::VERSION)
+    {
+        std::cerr << "ERROR: " << path << " is not a golden file (version " << Conformance::VERSION << ")." << std::endl;
+
+        return false;
+    }
+    if (stored.frames != this->options.frames || stored.cycles_per_frame != this->options.cycles_per_frame ||
+        stored.checkpoint_period != this->options.checkpoint_period)
+    {
+        std::cerr << "ERROR: " << path << " was recorded with other options (" << stored.frames << " frames of "
+                  << stored.cycles_per_frame << " cycles, every " << stored.checkpoint_period << ")." << std::endl;
+
+        return false;
+    }
+
+    records.clear();
+
+    string line;
+
+    std::getline(golden, line);
+
+    while (std::getline(golden, line))
+    {
+        std::istringstream fields(line);
+        string hash;
+        string checkpoints;
+        ConformanceRecord record;
+
+        if (!std::getline(fields, hash, '\t') || !std::getline(fields, checkpoints, '\t') ||
+            !std::getline(fields, record.path))
+        {
+            continue;
+        }
+
+        record.rom_hash = strtoull(hash.c_str(), NULL, 16);
+
+        std::istringstream values(checkpoints);
+
+        while (values >> hash)
+        {
+            record.checkpoints.push_back(strtoull(hash.c_str(), NULL, 16));
+        }
+
+        records.push_back(record);
+    }
+
+    return records.size() == count;
+}
+
+bool Conformance::save(const string& path, const std::vector<ConformanceRecord>& records) const
+{
+    std::ofstream golden(path);
+
+    if (!golden.is_open())
+    {
+        std::cerr << "ERROR: the golden file (" << path << ") couldn't be written." << std::endl;
+
+        return false;
+    }
+
+    golden << "CHIP8-CONFORMANCE " << Conformance::VERSION << " " << this->options.frames << " "
+           << this->options.cycles_per_frame << " " << this->options.checkpoint_period << " " << records.size() << "\n";
+
+    for (const ConformanceRecord& record : records)
+    {
+        char hash[17];
+
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)record.rom_hash);
+        golden << hash << '\t';
+
+        for (size_t i = 0; i < record.checkpoints.size(); i++)
+        {
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)record.checkpoints[i]);
+            golden << (i > 0 ? " " : "") << hash;
+        }
+
+        golden << '\t' << record.path << '\n';
+    }
+
+    return true;
+}
@@ -6,13 +6,281 @@
 #include <fstream>
 #include <ctime>
 #include <cstdlib>
+#include <algorithm>
 
 using std::string;
 
+// Out-of-range accesses are only counted in debug builds (see CPU::Violations)
+#ifdef CHIP8_CPU_DEBUG_VIOLATIONS
+#define COUNT_VIOLATION(counter, condition) (this->violations.counter += (condition) ? 1 : 0)
+#else
+#define COUNT_VIOLATION(counter, condition)
+#endif
+
+// What the running program did wrong (stack errors, unknown opcodes, ROMs too big for a buffer)
+// is only written out in debug builds: CPUs run on many threads, the standard streams are shared
+#ifdef CHIP8_CPU_DEBUG_WARNINGS
+#define REPORT(stream, message) (stream << message << std::endl)
+#else
+#define REPORT(stream, message)
+#endif
+
+const CPU::Quirks CPU::DEFAULT_QUIRKS = {false};
+
+// Zobrist keys of the pixels (SplitMix64 from a fixed seed, so hashes are the same everywhere)
+static const struct ZobristKeys
+{
+    uint64_t keys[CPU::GFX_LENGTH];
+
+    ZobristKeys()
+    {
+        uint64_t seed = 0x43484950382D3634;    // "CHIP8-64"
+
+        for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+        {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15);
+
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+
+            this->keys[i] = z ^ (z >> 31);
+        }
+    }
+} ZOBRIST;
+
+const byte CPU::FONTSET[CPU::FONTSET_SIZE] = 
+{
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+void (CPU::* const CPU::instructions[0x10])() =
+{
+    &CPU::x0SET, &CPU::x1NNN, &CPU::x2NNN, &CPU::x3XNN, &CPU::x4XNN, &CPU::x5XY0,
+    &CPU::x6XNN, &CPU::x7XNN, &CPU::x8SET, &CPU::x9XY0, &CPU::xANNN, &CPU::xBNNN,
+    &CPU::xCXNN, &CPU::xDXYN, &CPU::xESET, &CPU::xFSET
+};
+
+CPU::Handler CPU::decode(const WORD& instruction)
+{
+    static const CPU::Handler arithmetic[0x10] =
+    {
+        &CPU::x8XY0, &CPU::x8XY1, &CPU::x8XY2, &CPU::x8XY3, &CPU::x8XY4, &CPU::x8XY5, &CPU::x8XY6, &CPU::x8XY7,
+        &CPU::x8SET, &CPU::x8SET, &CPU::x8SET, &CPU::x8SET, &CPU::x8SET, &CPU::x8SET, &CPU::x8XYE, &CPU::x8SET
+    };
+
+    switch (instruction & 0xF000)
+    {
+        case 0x0000:
+            return instruction == 0x00E0 ? &CPU::x00E0 : instruction == 0x00EE ? &CPU::x00EE : &CPU::x0NNN;
+        case 0x8000:
+            return arithmetic[instruction & 0x000F];
+        case 0xE000:
+            switch (instruction & 0x00FF)
+            {
+                case 0x9E: return &CPU::xEX9E;
+                case 0xA1: return &CPU::xEXA1;
+                default: return &CPU::xESET;
+            }
+        case 0xF000:
+            switch (instruction & 0x00FF)
+            {
+                case 0x07: return &CPU::xFX07;
+                case 0x0A: return &CPU::xFX0A;
+                case 0x15: return &CPU::xFX15;
+                case 0x18: return &CPU::xFX18;
+                case 0x1E: return &CPU::xFX1E;
+                case 0x29: return &CPU::xFX29;
+                case 0x33: return &CPU::xFX33;
+                case 0x55: return &CPU::xFX55;
+                case 0x65: return &CPU::xFX65;
+                default: return &CPU::xFSET;
+            }
+        default:
+            // The rest of the families check their own operands
+            return CPU::instructions[(instruction & 0xF000) >> 12];
+    }
+}
+
+// False for the opcodes the interpreter reports as unknown (0NNN included: there's no RCA 1802 to call)
+bool CPU::is_known(const WORD& instruction)
+{
+    switch (instruction & 0xF000)
+    {
+        case 0x0000:
+            return instruction == 0x00E0 || instruction == 0x00EE;
+        case 0x5000:
+        case 0x9000:
+            return (instruction & 0x000F) == 0;
+        default:
+        {
+            CPU::Handler handler = CPU::decode(instruction);
+
+            return handler != &CPU::x8SET && handler != &CPU::xESET && handler != &CPU::xFSET;
+        }
+    }
+}
+
+// Image with only the fontset loaded, shared by every instance without a ROM
+static std::shared_ptr<const CPU::Image> blank_image()
+{
+    // Built once, also when the first CPUs are created from several threads
+    static const std::shared_ptr<const CPU::Image> image = []()
+    {
+        std::shared_ptr<CPU::Image> blank = std::make_shared<CPU::Image>();
+
+        memset(blank->data, 0, CPU::MEMORY_LENGTH_B * sizeof(byte));
+        memcpy(blank->data + CPU::FONTSET_MEMORY_BEGIN, CPU::FONTSET, CPU::FONTSET_SIZE * sizeof(byte));
+
+        return std::shared_ptr<const CPU::Image>(blank);
+    }();
+
+    return image;
+}
+
+CPU::Memory::Memory() :
+    private_pages(),
+    buffers(),
+    versions()
+{
+    this->attach(blank_image());
+}
+
+CPU::Memory::Memory(const CPU::Memory& other) :
+    image(other.image),
+    private_pages(),
+    buffers()
+{
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        this->pages[page] = this->image->data + page * CPU::MEMORY_PAGE_SIZE;
+        this->versions[page] = other.versions[page] + 1;
+
+        if (other.private_pages[page] != NULL)
+        {
+            this->own_page(page);
+            memcpy(this->private_pages[page], other.private_pages[page], CPU::MEMORY_PAGE_SIZE * sizeof(byte));
+        }
+    }
+}
+
+CPU::Memory& CPU::Memory::operator=(const CPU::Memory& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        // Never go back to a version this memory already had (its contents could differ)
+        this->versions[page] = std::max(this->versions[page], other.versions[page]) + 1;
+
+        if (other.private_pages[page] != NULL)
+        {
+            this->own_page(page);
+            memcpy(this->private_pages[page], other.private_pages[page], CPU::MEMORY_PAGE_SIZE * sizeof(byte));
+        }
+        else
+        {
+            this->private_pages[page] = NULL;
+            this->pages[page] = other.image->data + page * CPU::MEMORY_PAGE_SIZE;
+        }
+    }
+
+    // Only now: no page points into the old image any more, even if this was its last reference
+    this->image = other.image;
+
+    return *this;
+}
+
+CPU::Memory::~Memory()
+{
+    this->release();
+}
+
+void CPU::Memory::release()
+{
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        delete[] this->buffers[page];
+
+        this->buffers[page] = NULL;
+        this->private_pages[page] = NULL;
+    }
+}
+
+void CPU::Memory::attach(const std::shared_ptr<const CPU::Image>& new_image)
+{
+    this->image = new_image;
+
+    // The buffers of the private pages are kept for the next writes
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        this->private_pages[page] = NULL;
+        this->pages[page] = this->image->data + page * CPU::MEMORY_PAGE_SIZE;
+        this->versions[page]++;
+    }
+}
+
+const std::shared_ptr<const CPU::Image>& CPU::Memory::get_image() const
+{
+    return this->image;
+}
+
+unsigned CPU::Memory::get_private_pages() const
+{
+    unsigned count = 0;
+
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        if (this->private_pages[page] != NULL)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void CPU::Memory::copy_page(unsigned page)
+{
+    const byte* shared = this->pages[page];
+
+    this->own_page(page);
+
+    memcpy(this->private_pages[page], shared, CPU::MEMORY_PAGE_SIZE * sizeof(byte));
+}
+
+// Makes the page private without filling it (allocated only the first time)
+void CPU::Memory::own_page(unsigned page)
+{
+    if (this->buffers[page] == NULL)
+    {
+        this->buffers[page] = new byte[CPU::MEMORY_PAGE_SIZE];
+    }
+
+    this->private_pages[page] = this->buffers[page];
+    this->pages[page] = this->buffers[page];
+}
+
 CPU::CPU() :
-    instructions{&CPU::x0SET, &CPU::x1NNN, &CPU::x2NNN, &CPU::x3XNN, &CPU::x4XNN, &CPU::x5XY0,
-                 &CPU::x6XNN, &CPU::x7XNN, &CPU::x8SET, &CPU::x9XY0, &CPU::xANNN, &CPU::xBNNN,
-                 &CPU::xCXNN, &CPU::xDXYN, &CPU::xESET, &CPU::xFSET}
+    quirks(CPU::DEFAULT_QUIRKS),
+    violations()
 {
     
 }
@@ -20,129 +288,187 @@ CPU::CPU() :
 void CPU::initializate()
 {
     // Reset all registers and buffers
-    this->opcode = 0;
-    this->I = 0;
-    this->pc = 0x200;
-    this->sp = 0;
-    this->draw_flag = true; // Clear screen once
-    this->halt = false;
-
-    memset(this->memory, 0, CPU::MEMORY_LENGTH_B * sizeof(byte));
-    memset(this->V, 0, CPU::GENERAL_PURPOSE_REGISTERS * sizeof(byte));
+    this->state.opcode = 0;
+    this->state.I = 0;
+    this->state.pc = 0x200;
+    this->state.sp = 0;
+    this->state.draw_flag = true; // Clear screen once
+    this->state.halt = false;
+
+    memset(this->state.V, 0, CPU::GENERAL_PURPOSE_REGISTERS * sizeof(byte));
     memset(this->gfx, 0, CPU::GFX_LENGTH * sizeof(byte));
-    memset(this->stack, 0, CPU::STACK_DEEPNESS * sizeof(WORD));
-    memset(this->key, 0, CPU::KEY_MAPPING_SIZE * sizeof(byte));
+    this->frame_hash = 0;
+    this->dirty_rows = 0xFFFFFFFF;
+    memset(this->state.stack, 0, CPU::STACK_DEEPNESS * sizeof(WORD));
+    this->keys = 0;
+    this->key_presses = 0;
+    this->key_releases = 0;
+    this->key_waiting = false;
 
-    // Load fontset
-    for (size_t i = CPU::FONTSET_MEMORY_BEGIN; i < CPU::FONTSET_MEMORY_BEGIN + CPU::FONTSET_SIZE; i++)
-    {
-        this->memory[i] = CPU::FONTSET[i - CPU::FONTSET_MEMORY_BEGIN];
-    }
+    // Empty memory with the fontset loaded
+    this->memory.attach(blank_image());
 
     // Reset timers
-    this->delay_timer = 0;
-    this->sound_timer = 0;
+    this->state.delay_timer = 0;
+    this->state.sound_timer = 0;
+
+    memset(&this->violations, 0, sizeof(CPU::Violations));
 
     // Set a random seed
-    srand(time(NULL));
+    this->seed(time(NULL));
 }
 
-std::streampos CPU::get_file_length(const string& path) const
+// Same seed, same CXNN results (lockstep engines, replays)
+void CPU::seed(DWORD value)
 {
-    std::ifstream file;
-
-    file.open(path, std::ios::binary);
+    this->state.random = value != 0 ? value : 1;
+}
 
-    if (!file.is_open())
+std::shared_ptr<const CPU::Image> CPU::create_image(const byte* rom, size_t length)
+{
+    if (length > CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN)
     {
-        std::cerr << "The file (" << path << ") couldn't be opened or found." << std::endl;
+        REPORT(std::cerr, "ERROR: the whole game doesn't fit (" << length << " bytes, max. "
+                          << CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN << "). Aborting the loading.");
 
-        return -1;
+        return std::shared_ptr<const CPU::Image>();
     }
 
-    std::streampos begin, end;
+    std::shared_ptr<CPU::Image> image = std::make_shared<CPU::Image>();
 
-    begin = file.tellg();
-    file.seekg(0, std::ios::end);
-    end = file.tellg();
-    file.close();
+    memcpy(image->data, blank_image()->data, CPU::ROM_MEMORY_BEGIN * sizeof(byte));
+    memcpy(image->data + CPU::ROM_MEMORY_BEGIN, rom, length * sizeof(byte));
+    memset(image->data + CPU::ROM_MEMORY_BEGIN + length, 0, (CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN - length) * sizeof(byte));
 
-    return end - begin;
+    return image;
 }
 
-bool CPU::load_rom(const string& path)
+std::shared_ptr<const CPU::Image> CPU::read_image(const string& path)
 {
-    unsigned file_length = this->get_file_length(path);
-    std::ifstream rom;
+    // Opened once, at the end, so the length and the content come from the same descriptor
+    std::ifstream rom(path, std::ios::binary | std::ios::ate);
 
-    if (file_length == -1)
+    if (!rom.is_open())
     {
-        // Couldn't open the file or doesn't exist
+        std::cerr << "The file (" << path << ") couldn't be opened or found." << std::endl;
 
-        return false;
+        return std::shared_ptr<const CPU::Image>();
     }
 
-    rom.open(path, std::ios::binary);
+    std::streamoff file_length = rom.tellg();
 
-    if (!rom.is_open())
+    if (file_length < 0 || file_length > CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN)
     {
-        std::cerr << "The file (" << path << ") couldn't be opened or found." << std::endl;
+        std::cerr << "ERROR: the whole game doesn't fit (" << file_length << " bytes, max. "
+                  << CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN << "). Aborting the loading." << std::endl;
 
-        return false;
+        return std::shared_ptr<const CPU::Image>();
     }
 
-    unsigned free_space_after_fit = CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN - file_length;
+    byte buffer[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN];
+
+    rom.seekg(0, std::ios::beg);
+    rom.read((char*)buffer, file_length);
 
-    if (free_space_after_fit < 0)
+    if (rom.gcount() != file_length)
     {
-        std::cerr << "ERROR: the whole game doesn't fit. Aborting the loading." << std::endl;
+        std::cerr << "ERROR: couldn't read the whole file (" << path << ")." << std::endl;
 
-        return false;
+        return std::shared_ptr<const CPU::Image>();
     }
 
-    rom.read((char*)this->memory + CPU::ROM_MEMORY_BEGIN, file_length);
-
     #ifdef CHIP8_CPU_DEBUG_LOAD_ROM_VERBOSE
     std::cout << "CPU::MEMORY_LENGTH_B = " << CPU::MEMORY_LENGTH_B << std::endl;
     std::cout << "CPU::ROM_MEMORY_BEGIN = " << CPU::ROM_MEMORY_BEGIN << std::endl;
     std::cout << "ROM length (Bytes) = " << file_length << std::endl;
-    std:: cout << "free_space_after_fit = " << free_space_after_fit << std::endl;
+    std:: cout << "free_space_after_fit = " << CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN - file_length << std::endl;
+    #endif
+
+    return CPU::create_image(buffer, file_length);
+}
+
+bool CPU::load_rom(const string& path)
+{
+    std::shared_ptr<const CPU::Image> image = CPU::read_image(path);
+
+    if (!image)
+    {
+        return false;
+    }
+
+    this->memory.attach(image);
+
+    #ifdef CHIP8_CPU_DEBUG_LOAD_ROM_VERBOSE
     this->print_memory();
     #endif
 
-    rom.close();
+    return true;
+}
+
+bool CPU::load_rom_from_buffer(const byte* rom, size_t length)
+{
+    std::shared_ptr<const CPU::Image> image = CPU::create_image(rom, length);
+
+    if (!image)
+    {
+        return false;
+    }
+
+    this->memory.attach(image);
 
     return true;
 }
 
-void CPU::push(WORD value)
+void CPU::load_image(const std::shared_ptr<const CPU::Image>& image)
+{
+    this->memory.attach(image);
+}
+
+const std::shared_ptr<const CPU::Image>& CPU::get_image() const
 {
-    if (this->sp == CPU::STACK_DEEPNESS)
+    return this->memory.get_image();
+}
+
+bool CPU::push(WORD value)
+{
+    if (this->state.sp >= CPU::STACK_DEEPNESS)
     {
         // In case this situation happens, it can be solved increasing the stack deepness.
+        // Writing past the stack would corrupt the state, so the program halts instead.
 
-        std::cout << "WARNING: stack overflow detected (stack)!" << std::endl;
+        REPORT(std::cout, "WARNING: stack overflow detected (stack)! Halting.");
+
+        COUNT_VIOLATION(stack, true);
+        this->state.halt = true;
+
+        return false;
     }
 
-    this->stack[this->sp] = value;
-    this->sp++;
+    this->state.stack[this->state.sp] = value;
+    this->state.sp++;
+
+    return true;
 }
 
-WORD CPU::pop()
+bool CPU::pop(WORD& value)
 {
-    if (this->sp == 0)
+    if (this->state.sp == 0)
     {
         // In case this situation happens, it'd be due to a logic failure or a coding failure.
+        // There's no return address to go to, so the program halts.
 
-        std::cout << "WARNING: stack underflow detected (stack)!" << std::endl;
-    }
+        REPORT(std::cout, "WARNING: stack underflow detected (stack)! Halting.");
 
-    WORD value;
+        COUNT_VIOLATION(stack, true);
+        this->state.halt = true;
 
-    value = this->stack[this->sp - 1];
-    this->sp--;
+        return false;
+    }
+
+    value = this->state.stack[this->state.sp - 1];
+    this->state.sp--;
 
-    return value;
+    return true;
 }
 
 byte* CPU::get_gfx()
@@ -150,9 +476,181 @@ byte* CPU::get_gfx()
     return this->gfx;
 }
 
+const byte* CPU::get_gfx() const
+{
+    return this->gfx;
+}
+
+uint64_t CPU::get_frame_hash() const
+{
+    return this->frame_hash;
+}
+
+uint32_t CPU::get_dirty_rows() const
+{
+    return this->dirty_rows;
+}
+
+void CPU::clear_dirty_rows()
+{
+    this->dirty_rows = 0;
+}
+
+/*
+ * Copy assignment for snapshots restored over and over (fuzzing): only the rows of the screen
+ * this CPU drew on since clear_dirty_rows() are copied, the others must already match the
+ * snapshot. The memory keeps its page buffers and gets the snapshot's private pages only.
+ */
+void CPU::restore(const CPU& snapshot)
+{
+    for (uint32_t rows = this->dirty_rows; rows != 0; rows &= rows - 1)
+    {
+        unsigned offset = __builtin_ctz(rows) * CPU::WIDTH;
+
+        memcpy(this->gfx + offset, snapshot.gfx + offset, CPU::WIDTH * sizeof(byte));
+    }
+
+    this->state = snapshot.state;
+    this->keys = snapshot.keys;
+    this->key_presses = snapshot.key_presses;
+    this->key_releases = snapshot.key_releases;
+    this->key_waiting = snapshot.key_waiting;
+    this->memory = snapshot.memory;
+    this->frame_hash = snapshot.frame_hash;
+    this->dirty_rows = snapshot.dirty_rows;
+    this->quirks = snapshot.quirks;
+    this->violations = snapshot.violations;
+}
+
+// Same value get_frame_hash() keeps, for any display buffer
+uint64_t CPU::hash_frame(const byte* gfx)
+{
+    uint64_t hash = 0;
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        hash ^= ZOBRIST.keys[i] & (0 - (uint64_t)(gfx[i] & 1));
+    }
+
+    return hash;
+}
+
+/*
+ * Hash (FNV-1a) of everything the next instructions depend on: registers, the live part of the
+ * stack, timers, RNG, keys, memory and the display (its frame hash). Equal hashes, same future
+ * for the same inputs, so it tells whether two instances diverged (netplay) or reached a state
+ * already seen. Not incremental: reads the whole memory.
+ */
+uint64_t CPU::get_state_hash() const
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    auto mix = [&hash](uint64_t value, unsigned bytes)
+    {
+        for (unsigned i = 0; i < bytes; i++)
+        {
+            hash ^= (value >> (8 * i)) & 0xFF;
+            hash *= 0x100000001B3ULL;
+        }
+    };
+
+    mix(this->state.pc, 2);
+    mix(this->state.I, 2);
+    mix(this->state.sp, 2);
+
+    for (unsigned i = 0; i < CPU::GENERAL_PURPOSE_REGISTERS; i++)
+    {
+        mix(this->state.V[i], 1);
+    }
+
+    for (unsigned i = 0; i < this->state.sp && i < CPU::STACK_DEEPNESS; i++)
+    {
+        mix(this->state.stack[i], 2);
+    }
+
+    mix(this->state.delay_timer, 1);
+    mix(this->state.sound_timer, 1);
+    mix(this->state.halt, 1);
+    mix(this->state.random, 4);
+    mix(this->keys, 2);
+    mix(this->key_waiting, 1);
+    mix(this->frame_hash, 8);
+
+    // The key edges only matter while FX0A waits (it clears them when it starts)
+    if (this->key_waiting)
+    {
+        mix(this->key_presses, 2);
+        mix(this->key_releases, 2);
+    }
+
+    // Memory a word at a time (it's most of the work)
+    for (unsigned addr = 0; addr < CPU::MEMORY_LENGTH_B; addr += 8)
+    {
+        uint64_t word = 0;
+
+        for (unsigned i = 0; i < 8; i++)
+        {
+            word = word << 8 | this->memory.read(addr + i);
+        }
+
+        hash ^= word;
+        hash *= 0x100000001B3ULL;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+byte CPU::load(const WORD& addr) const
+{
+    return this->memory.read(addr);
+}
+
+const CPU::State& CPU::get_state() const
+{
+    return this->state;
+}
+
+CPU::State& CPU::get_state()
+{
+    return this->state;
+}
+
+bool CPU::is_unmodified(const WORD& addr, const unsigned& length) const
+{
+    for (unsigned i = 0; i < length; i += CPU::MEMORY_PAGE_SIZE)
+    {
+        if (!this->memory.is_shared(addr + i))
+        {
+            return false;
+        }
+    }
+
+    return length == 0 || this->memory.is_shared(addr + length - 1);
+}
+
+void CPU::set_state(const CPU::State& new_state)
+{
+    memcpy(&this->state, &new_state, sizeof(CPU::State));
+}
+
+const CPU::Quirks& CPU::get_quirks() const
+{
+    return this->quirks;
+}
+
+void CPU::set_quirks(const CPU::Quirks& new_quirks)
+{
+    this->quirks = new_quirks;
+}
+
+const CPU::Violations& CPU::get_violations() const
+{
+    return this->violations;
+}
+
 void CPU::emulate_cycle()
 {
-    if (this->halt)
+    if (this->state.halt)
     {
         // Halt -> skipping cycle
 
@@ -160,18 +658,15 @@ void CPU::emulate_cycle()
     }
 
     // We disable the draw flag and at the end of this function might be enabled
-    this->draw_flag = false;
+    this->state.draw_flag = false;
 
-    // Fetch opcode
-    if (this->pc + 1 >= CPU::MEMORY_LENGTH_B)
-    {
-        std::cout << "WARNING: stack overflow detected (memory)!." << std::endl;
-    }
+    // Fetch opcode (an instruction at 0xFFF takes its second byte from 0x000)
+    COUNT_VIOLATION(fetch, (this->state.pc & (CPU::MEMORY_LENGTH_B - 1)) == CPU::MEMORY_LENGTH_B - 1);
 
-    this->opcode = this->memory[this->pc] << 8 | this->memory[this->pc + 1];
+    this->state.opcode = this->memory.read(this->state.pc) << 8 | this->memory.read(this->state.pc + 1);
 
     #ifdef CHIP8_CPU_DEBUG_OPCODE_VERBOSE
-    std::cout << "Current opcode: 0x" << std::hex << this->opcode << std::dec << std::endl;
+    std::cout << "Current opcode: 0x" << std::hex << this->state.opcode << std::dec << std::endl;
     #endif
 
     #ifdef CHIP8_CPU_DEBUG_HALT_NEXT_STEP
@@ -185,25 +680,12 @@ void CPU::emulate_cycle()
     this->execute_instruction();
 
     // Update timers
-    if (this->delay_timer > 0)
-    {
-        this->delay_timer--;
-    }
-    if (this->sound_timer > 0)
-    {
-        if (this->sound_timer == 1)
-        {
-            std::cout << "BEEP!" << std::endl;
-            std::cout << '\a';
-        }
-
-        this->sound_timer--;
-    }
+    this->tick_timers();
 }
 
 void CPU::x0SET()
 {
-    switch (this->opcode)
+    switch (this->state.opcode)
     {
         case 0x00E0:
             this->x00E0();
@@ -220,7 +702,7 @@ void CPU::x0SET()
 //   0x00E0 -> Clears the screen.
 void CPU::x00E0()
 {
-    this->draw_flag = true;
+    this->state.draw_flag = true;
 
     /*
     for (size_t i = 0; i < CPU::GFX_LENGTH; i++)
@@ -230,113 +712,121 @@ void CPU::x00E0()
     */
     
     memset(this->gfx, CPU::COLOR_BLACK, CPU::GFX_LENGTH * sizeof(byte));
+    this->frame_hash = 0;
+    this->dirty_rows = 0xFFFFFFFF;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x00EE -> Returns from a subroutine.
 void CPU::x00EE()
 {
-    this->pc = this->pop();
-    this->pc += 2;
+    // On underflow the PC stays at the 00EE that halted the program
+    if (this->pop(this->state.pc))
+    {
+        this->state.pc += 2;
+    }
 }
 
 //   0x0NNN -> Calls RCA 1802 program at address NNN. Not necessary for most ROMs.
 void CPU::x0NNN()
 {
     this->print_unknown_opcode("RCA 1802 program invoked.");
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x1NNN -> Jumps to address NNN.
 void CPU::x1NNN()
 {
-    this->pc = this->opcode & 0x0FFF;
+    this->state.pc = this->state.opcode & 0x0FFF;
 }
 
 //   0x2NNN -> Calls subroutine at NNN.
 void CPU::x2NNN()
 {
-    this->push(this->pc);
-    this->pc = this->opcode & 0x0FFF;
+    // On overflow the PC stays at the 2NNN that halted the program
+    if (this->push(this->state.pc))
+    {
+        this->state.pc = this->state.opcode & 0x0FFF;
+    }
 }
 
 
 //   0x3XNN -> Skips the next instruction if VX equals NN. (Usually the next instruction is a jump to skip a code block)
 void CPU::x3XNN()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
-    byte value = this->opcode & 0x00FF;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+    byte value = this->state.opcode & 0x00FF;
 
-    if (this->V[index] == value)
+    if (this->state.V[index] == value)
     {
-        this->pc += 2;
+        this->state.pc += 2;
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x4XNN -> Skips the next instruction if VX doesn't equal NN. (Usually the next instruction is a jump to skip a code block)
 void CPU::x4XNN()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
-    byte value = this->opcode & 0x00FF;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+    byte value = this->state.opcode & 0x00FF;
 
-    if (this->V[index] != value)
+    if (this->state.V[index] != value)
     {
-        this->pc += 2;
+        this->state.pc += 2;
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x5XY0 -> Skips the next instruction if VX equals VY. (Usually the next instruction is a jump to skip a code block)
 void CPU::x5XY0()
 {
-    if ((this->opcode & 0x000F) != 0)
+    if ((this->state.opcode & 0x000F) != 0)
     {
         this->print_unknown_opcode();
-        this->pc += 2;
+        this->state.pc += 2;
 
         return;
     }
 
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    if (this->V[x_index] == this->V[y_index])
+    if (this->state.V[x_index] == this->state.V[y_index])
     {
-        this->pc += 2;
+        this->state.pc += 2;
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x6XNN -> Sets VX to NN.
 void CPU::x6XNN()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
-    byte value = this->opcode & 0x00FF;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+    byte value = this->state.opcode & 0x00FF;
 
-    this->V[index] = value;
+    this->state.V[index] = value;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x7XNN -> Adds NN to VX. (Carry flag is not changed)
 void CPU::x7XNN()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
-    byte value = this->opcode & 0x00FF;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+    byte value = this->state.opcode & 0x00FF;
 
-    this->V[index] += value;
+    this->state.V[index] += value;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 void CPU::x8SET()
 {
-    switch (this->opcode & 0x000F)
+    switch (this->state.opcode & 0x000F)
     {
         case 0x0:
             this->x8XY0();
@@ -374,176 +864,183 @@ void CPU::x8SET()
 //   0x8XY0 -> Sets VX to the value of VY.
 void CPU::x8XY0()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    this->V[x_index] = this->V[y_index];
+    this->state.V[x_index] = this->state.V[y_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY1 -> Sets VX to VX or VY. (Bitwise OR operation)
 void CPU::x8XY1()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    this->V[x_index] |= this->V[y_index];
+    this->state.V[x_index] |= this->state.V[y_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY2 -> Sets VX to VX and VY. (Bitwise AND operation)
 void CPU::x8XY2()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    this->V[x_index] &= this->V[y_index];
+    this->state.V[x_index] &= this->state.V[y_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY3 -> Sets VX to VX xor VY.
 void CPU::x8XY3()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    this->V[x_index] ^= this->V[y_index];
+    this->state.V[x_index] ^= this->state.V[y_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY4 -> Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
 void CPU::x8XY4()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    if (this->V[x_index] > 0xFF - this->V[y_index])
+    if (this->state.V[x_index] > 0xFF - this->state.V[y_index])
     {
-        this->V[0xF] = 1;
+        this->state.V[0xF] = 1;
     }
     else
     {
-        this->V[0xF] = 0;
+        this->state.V[0xF] = 0;
     }
 
-    this->V[x_index] += this->V[y_index];
+    this->state.V[x_index] += this->state.V[y_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY5 -> VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
 void CPU::x8XY5()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    if (this->V[x_index] < this->V[y_index])
+    if (this->state.V[x_index] < this->state.V[y_index])
     {
         // There is a borrow
-        this->V[0xF] = 0;
+        this->state.V[0xF] = 0;
     }
     else
     {
-        this->V[0xF] = 1;
+        this->state.V[0xF] = 1;
     }
 
-    this->V[x_index] -= this->V[y_index];
+    this->state.V[x_index] -= this->state.V[y_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY6 -> Stores the least significant bit of VX in VF and then shifts VX to the right by 1.
 void CPU::x8XY6()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
 
-    this->V[0xF] = this->V[x_index] & 0x01;
-    this->V[x_index] >>= 1;
+    this->state.V[0xF] = this->state.V[x_index] & 0x01;
+    this->state.V[x_index] >>= 1;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XY7 -> Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
 void CPU::x8XY7()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    if (this->V[y_index] < this->V[x_index])
+    if (this->state.V[y_index] < this->state.V[x_index])
     {
         // There is a borrow
-        this->V[0xF] = 0;
+        this->state.V[0xF] = 0;
     }
     else
     {
-        this->V[0xF] = 1;
+        this->state.V[0xF] = 1;
     }
 
-    this->V[x_index] = this->V[y_index] - this->V[x_index];
+    this->state.V[x_index] = this->state.V[y_index] - this->state.V[x_index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x8XYE -> Stores the most significant bit of VX in VF and then shifts VX to the left by 1.
 void CPU::x8XYE()
 {
-    byte x_index = (this->opcode & 0x0F00) >> 8;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
 
-    this->V[0xF] = this->V[x_index] >> 7;
-    this->V[x_index] <<= 1;
+    this->state.V[0xF] = this->state.V[x_index] >> 7;
+    this->state.V[x_index] <<= 1;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0x9XY0 -> Skips the next instruction if VX doesn't equal VY. (Usually the next instruction is a jump to skip a code block)
 void CPU::x9XY0()
 {
-    if ((this->opcode & 0x000F) != 0)
+    if ((this->state.opcode & 0x000F) != 0)
     {
         this->print_unknown_opcode();
-        this->pc += 2;
+        this->state.pc += 2;
 
         return;
     }
 
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
 
-    if (this->V[x_index] != this->V[y_index])
+    if (this->state.V[x_index] != this->state.V[y_index])
     {
-        this->pc += 2;
+        this->state.pc += 2;
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xANNN -> Sets I to the address NNN.
 void CPU::xANNN()
 {
-    this->I = this->opcode & 0x0FFF;
+    this->state.I = this->state.opcode & 0x0FFF;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
         
 //   0xBNNN -> Jumps to the address NNN plus V0.
 void CPU::xBNNN()
 {
-    this->pc = (this->opcode & 0x0FFF) + this->V[0];
+    this->state.pc = (this->state.opcode & 0x0FFF) + this->state.V[0];
 }
 
 //   0xCXNN -> Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN.
 void CPU::xCXNN()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
-    byte NN = (this->opcode & 0x00FF);
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+    byte NN = (this->state.opcode & 0x00FF);
+
+    DWORD random = this->state.random;
+
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
 
-    this->V[index] = (rand() % 0x100) & NN;
+    this->state.random = random;
+    this->state.V[index] = (random % 0x100) & NN;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xDXYN -> Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
@@ -552,57 +1049,65 @@ void CPU::xCXNN()
 // VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn’t happen.
 void CPU::xDXYN()
 {
-    this->draw_flag = true;
-    
-    this->V[0xF] = 0;
+    this->state.draw_flag = true;
+
+    byte x_index = (this->state.opcode & 0x0F00) >> 8;
+    byte y_index = (this->state.opcode & 0x00F0) >> 4;
+    byte n = (this->state.opcode & 0x000F);
+
+    // The origin always wraps around the screen (WIDTH and HEIGHT are powers of 2)
+    unsigned x = this->state.V[x_index] & (CPU::WIDTH - 1);
+    unsigned y = this->state.V[y_index] & (CPU::HEIGHT - 1);
+    unsigned rows = n;
+    byte columns = 0xFF;    // Sprite bits drawn (bit 7 is the leftmost pixel)
 
-    byte x_index = (this->opcode & 0x0F00) >> 8;
-    byte y_index = (this->opcode & 0x00F0) >> 4;
-    byte n = (this->opcode & 0x000F);
+    COUNT_VIOLATION(screen, x + 8 > CPU::WIDTH || y + n > CPU::HEIGHT);
+    COUNT_VIOLATION(memory, this->state.I + n > CPU::MEMORY_LENGTH_B);
 
-    // Each row
-    for (size_t row = 0; row < n; row++)
+    if (!this->quirks.wrap_sprites)
     {
+        // Clipped: rows and columns past the edges are dropped before drawing
+        rows = std::min(rows, CPU::HEIGHT - y);
+        columns = x + 8 > CPU::WIDTH ? 0xFF << (x + 8 - CPU::WIDTH) : 0xFF;
+    }
+
+    byte collision = 0;
+    uint64_t hash = this->frame_hash;
+    uint32_t dirty = 0;
+
+    // Each row: no bounds checks inside, every index is masked
+    for (unsigned row = 0; row < rows; row++)
+    {
+        byte sprite = this->memory.read(this->state.I + row) & columns;
+        unsigned line = ((y + row) & (CPU::HEIGHT - 1)) * CPU::WIDTH;
+
+        dirty |= (uint32_t)(sprite != 0) << ((y + row) & (CPU::HEIGHT - 1));
+
         // Each column
-        for (size_t col = 0; col < 8; col++)
+        for (unsigned col = 0; col < 8; col++)
         {
-            if (this->V[y_index] + row >= CPU::HEIGHT || 
-                this->V[x_index] + col >= CPU::WIDTH)
-            {
-                std::cout << "WARNING: screen buffer overflow (might not be dangerous if is not close the end of the buffer)." << std::endl;
+            byte pixel = (sprite >> (7 - col)) & 1;
+            unsigned index = line + ((x + col) & (CPU::WIDTH - 1));
 
-                if ((this->V[y_index] + row) * CPU::WIDTH + this->V[x_index] + col >= CPU::GFX_LENGTH)
-                {
-                    std::cerr << "ERROR: stack overflow detected. Skipping." << std::endl;
+            // Collision: a set pixel gets erased
+            collision |= this->gfx[index] & pixel;
+            this->gfx[index] ^= pixel;
 
-                    continue;
-                }
-            }
-
-            if ((this->memory[this->I + row] & (0x80 >> col)) != 0)   // WARNING: if memory's declaration was not unsigned, this might fail when col = 0 (memory = 1000 0000 (in C2's complement, if signed, is -0) or memory = 0000 0000)
-            {
-                // We draw the current pixel because it is set in the sprite
-
-                //                         ROW                               COL
-                //        -------------------------------------   ----------------------
-                this->gfx[(this->V[y_index] + row) * CPU::WIDTH + this->V[x_index] + col] ^= 1;
-
-                // Collision test
-                if (this->gfx[(this->V[y_index] + row) * CPU::WIDTH + this->V[x_index] + col] == 0)
-                {
-                    // Collision detected
-                    this->V[0xF] = 1;
-                }
-            }
+            // Every flipped pixel toggles its key
+            hash ^= ZOBRIST.keys[index] & (0 - (uint64_t)pixel);
         }
     }
-    
-    this->pc += 2;
+
+    this->frame_hash = hash;
+    this->dirty_rows |= dirty;
+    this->state.V[0xF] = collision;
+
+    this->state.pc += 2;
 }
 
 void CPU::xESET()
 {
-    switch (this->opcode & 0x00FF)
+    switch (this->state.opcode & 0x00FF)
     {
         case 0x9E:
             this->xEX9E();
@@ -619,36 +1124,40 @@ void CPU::xESET()
 //   0xEX9E -> Skips the next instruction if the key stored in VX is pressed. (Usually the next instruction is a jump to skip a code block)
 void CPU::xEX9E()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    if (this->key[this->V[index]] != 0)
+    COUNT_VIOLATION(keys, this->state.V[index] > 0x0F);
+
+    if ((this->keys & (1 << (this->state.V[index] & 0x0F))) != 0)   // Only the low nibble selects a key
     {
         // Key at V[index] is pressed -> skip next instruction
 
-        this->pc += 2;
+        this->state.pc += 2;
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xEXA1 -> Skips the next instruction if the key stored in VX isn't pressed. (Usually the next instruction is a jump to skip a code block)
 void CPU::xEXA1()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+
+    COUNT_VIOLATION(keys, this->state.V[index] > 0x0F);
 
-    if (this->key[this->V[index]] == 0)
+    if ((this->keys & (1 << (this->state.V[index] & 0x0F))) == 0)   // Only the low nibble selects a key
     {
         // Key at V[index] is not pressed -> skip next instruction
 
-        this->pc += 2;
+        this->state.pc += 2;
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 void CPU::xFSET()
 {
-    switch (this->opcode & 0x00FF)
+    switch (this->state.opcode & 0x00FF)
     {
         case 0x07:
             this->xFX07();
@@ -686,92 +1195,86 @@ void CPU::xFSET()
 //   0xFX07 -> Sets VX to the value of the delay timer.
 void CPU::xFX07()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    this->V[index] = this->delay_timer;
+    this->state.V[index] = this->state.delay_timer;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX0A -> A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted until next key event)
 void CPU::xFX0A()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
-    bool key_pressed = false;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    for (size_t index = 0; index < CPU::KEY_MAPPING_SIZE; index++)
+    // As on the VIP, the key counts once it is released, and only if it was pressed while waiting
+    if (!this->key_waiting)
     {
-        if (this->key[index] != 0)
-        {
-            this->V[index] = index;
-            key_pressed = true;
-
-            break;
-        }
+        this->key_waiting = true;
+        this->key_presses = 0;
+        this->key_releases = 0;
     }
-    
-    if (key_pressed)
+    else if (this->key_releases != 0)
     {
-        this->pc += 2;
+        this->state.V[index] = __builtin_ctz(this->key_releases);
+        this->key_waiting = false;
+        this->state.pc += 2;
     }
 
-    // If the key was not pressed, the PC would not be increased, and this instruction will be executed until a key is pressed
+    // If no key was released, the PC would not be increased, and this instruction will be executed until one is
 }
 
 //   0xFX15 -> Sets the delay timer to VX.
 void CPU::xFX15()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    this->delay_timer = this->V[index];
+    this->state.delay_timer = this->state.V[index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX18 -> Sets the sound timer to VX.
 void CPU::xFX18()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    this->sound_timer = this->V[index];
+    this->state.sound_timer = this->state.V[index];
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX1E -> Adds VX to I.
 void CPU::xFX1E()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    if (this->I > 0xFF - this->V[index])
+    if (this->state.I > 0xFF - this->state.V[index])
     {
-        this->V[0xF] = 1;
+        this->state.V[0xF] = 1;
     }
     else
     {
-        this->V[0xF] = 0;
+        this->state.V[0xF] = 0;
     }
 
-    this->I += this->V[index];
+    this->state.I = (this->state.I + this->state.V[index]) & 0x0FFF;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX29 -> Sets I to the location of the sprite for the character in VX. 
 // Characters 0-F (in hexadecimal) are represented by a 4x5 font.
 void CPU::xFX29()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
 
-    if (this->V[index] > 0xF ||
-        this->V[index] * 5 >= CPU::FONTSET_SIZE)    // Each character sprite is 5 bytes long
-    {
-        std::cout << "WARNING: fontset overflow." << std::endl;
-    }
+    // Each character sprite is 5 bytes long. Past 0xF, I points after the fontset (still in memory)
+    COUNT_VIOLATION(font, this->state.V[index] > 0xF);
 
-    this->I = CPU::FONTSET_MEMORY_BEGIN + this->V[index] * 5;
+    this->state.I = CPU::FONTSET_MEMORY_BEGIN + this->state.V[index] * 5;
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX33 -> Stores the binary-coded decimal representation of VX, 
@@ -781,641 +1284,123 @@ void CPU::xFX29()
 // the tens digit at location I+1, and the ones digit at location I+2.
 void CPU::xFX33()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+
+    COUNT_VIOLATION(memory, this->state.I + 3 > CPU::MEMORY_LENGTH_B);
 
-    this->memory[this->I + 0] =  this->V[index] / 100;          // Most significant BCD digit
-    this->memory[this->I + 1] = (this->V[index] / 10 ) % 10;    // Middle BCD digit
-    this->memory[this->I + 2] = (this->V[index] % 100) % 10;    // Least significant BCD digit
+    this->memory.write(this->state.I + 0,  this->state.V[index] / 100);         // Most significant BCD digit
+    this->memory.write(this->state.I + 1, (this->state.V[index] / 10 ) % 10);   // Middle BCD digit
+    this->memory.write(this->state.I + 2, (this->state.V[index] % 100) % 10);   // Least significant BCD digit
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX55 -> Stores V0 to VX (including VX) in memory starting at address I. 
 // The offset from I is increased by 1 for each value written, but I itself is left unmodified.
 void CPU::xFX55()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+
+    COUNT_VIOLATION(memory, this->state.I + index + 1 > CPU::MEMORY_LENGTH_B);
 
     for (size_t i = 0; i <= index; i++)
     {
-        this->memory[this->I + i] = this->V[i];
+        this->memory.write(this->state.I + i, this->state.V[i]);
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 //   0xFX65 -> Fills V0 to VX (including VX) with values from memory starting at address I. 
 // The offset from I is increased by 1 for each value written, but I itself is left unmodified.
 void CPU::xFX65()
 {
-    byte index = (this->opcode & 0x0F00) >> 8;
+    byte index = (this->state.opcode & 0x0F00) >> 8;
+
+    COUNT_VIOLATION(memory, this->state.I + index + 1 > CPU::MEMORY_LENGTH_B);
 
     for (size_t i = 0; i <= index; i++)
     {
-        this->V[i] = this->memory[this->I + i];
+        this->state.V[i] = this->memory.read(this->state.I + i);
     }
 
-    this->pc += 2;
+    this->state.pc += 2;
 }
 
 void CPU::execute_instruction()
 {
-    (this->*instructions[(this->opcode & 0xF000) >> 12])();
-
-    /*
-    switch(this->opcode & 0xF000)
-    {
-        case 0x0000:
-            switch(this->opcode)
-            {
-                //   0x00E0 -> Clears the screen.
-                case 0x00E0:
-                    this->draw_flag = true;
-                    
-                    memset(this->gfx, CPU::COLOR_BLACK, CPU::GFX_LENGTH * sizeof(byte));
-
-                    this->pc += 2;
-
-                    break;
-                //   0x00EE -> Returns from a subroutine.
-                case 0x00EE:
-                    this->pc = this->pop();
-                    this->pc += 2;
-                    
-                    break;
-                //   0x0NNN -> Calls RCA 1802 program at address NNN. Not necessary for most ROMs.
-                default:
-                    this->print_unknown_opcode("RCA 1802 program invoked.");
-                    this->pc += 2;
-
-                    break;
-            }
-
-            break;
-        //   0x1NNN -> Jumps to address NNN.
-        case 0x1000:
-            this->pc = this->opcode & 0x0FFF;
-
-            break;
-        //   0x2NNN -> Calls subroutine at NNN.
-        case 0x2000:
-            this->push(this->pc);
-            this->pc = this->opcode & 0x0FFF;
-
-            break;
-        //   0x3XNN -> Skips the next instruction if VX equals NN. (Usually the next instruction is a jump to skip a code block)
-        case 0x3000:
-        {
-            byte index = (this->opcode & 0x0F00) >> 8;
-            byte value = this->opcode & 0x00FF;
-
-            if (this->V[index] == value)
-            {
-                this->pc += 2;
-            }
-
-            this->pc += 2;
-        }
-
-            break;
-        //   0x4XNN -> Skips the next instruction if VX doesn't equal NN. (Usually the next instruction is a jump to skip a code block)
-        case 0x4000:
-        {
-            byte index = (this->opcode & 0x0F00) >> 8;
-            byte value = this->opcode & 0x00FF;
-
-            if (this->V[index] != value)
-            {
-                this->pc += 2;
-            }
-
-            this->pc += 2;
-        }
-
-            break;
-        //   0x5XY0 -> Skips the next instruction if VX equals VY. (Usually the next instruction is a jump to skip a code block)
-        case 0x5000:
-        {
-            if ((this->opcode & 0x000F) != 0)
-            {
-                this->print_unknown_opcode();
-                this->pc += 2;
-
-                break;
-            }
-
-            byte x_index = (this->opcode & 0x0F00) >> 8;
-            byte y_index = (this->opcode & 0x00F0) >> 4;
-
-            if (this->V[x_index] == this->V[y_index])
-            {
-                this->pc += 2;
-            }
-
-            this->pc += 2;
-        }
-
-            break;
-        //   0x6XNN -> Sets VX to NN.
-        case 0x6000:
-        {
-            byte index = (this->opcode & 0x0F00) >> 8;
-            byte value = this->opcode & 0x00FF;
-
-            this->V[index] = value;
-
-            this->pc += 2;
-        }
-
-            break;
-        //   0x7XNN -> Adds NN to VX. (Carry flag is not changed)
-        case 0x7000:
-        {
-            byte index = (this->opcode & 0x0F00) >> 8;
-            byte value = this->opcode & 0x00FF;
-
-            this->V[index] += value;
-
-            this->pc += 2;
-        }
-
-            break;
-        case 0x8000:
-            switch(this->opcode & 0x000F)
-            {
-                //   0x8XY0 -> Sets VX to the value of VY.
-                case 0x0000:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    this->V[x_index] = this->V[y_index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY1 -> Sets VX to VX or VY. (Bitwise OR operation)
-                case 0x0001:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    this->V[x_index] |= this->V[y_index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY2 -> Sets VX to VX and VY. (Bitwise AND operation)
-                case 0x0002:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    this->V[x_index] &= this->V[y_index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY3 -> Sets VX to VX xor VY.
-                case 0x0003:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    this->V[x_index] ^= this->V[y_index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY4 -> Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
-                case 0x0004:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    if (this->V[x_index] > 0xFF - this->V[y_index])
-                    {
-                        this->V[0xF] = 1;
-                    }
-                    else
-                    {
-                        this->V[0xF] = 0;
-                    }
-
-                    this->V[x_index] += this->V[y_index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY5 -> VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
-                case 0x0005:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    if (this->V[x_index] < this->V[y_index])
-                    {
-                        // There is a borrow
-                        this->V[0xF] = 0;
-                    }
-                    else
-                    {
-                        this->V[0xF] = 1;
-                    }
-
-                    this->V[x_index] -= this->V[y_index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY6 -> Stores the least significant bit of VX in VF and then shifts VX to the right by 1.
-                case 0x0006:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-
-                    this->V[0xF] = this->V[x_index] & 0x01;
-                    this->V[x_index] >>= 1;
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0x8XY7 -> Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
-                case 0x0007:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-                    byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                    if (this->V[y_index] < this->V[x_index])
-                    {
-                        // There is a borrow
-                        this->V[0xF] = 0;
-                    }
-                    else
-                    {
-                        this->V[0xF] = 1;
-                    }
-
-                    this->V[x_index] = this->V[y_index] - this->V[x_index];
-
-                    this->pc += 2;
-                }
-                    break;
-                //   0x8XYE -> Stores the most significant bit of VX in VF and then shifts VX to the left by 1.
-                case 0x000E:
-                {
-                    byte x_index = (this->opcode & 0x0F00) >> 8;
-
-                    this->V[0xF] = this->V[x_index] >> 7;
-                    this->V[x_index] <<= 1;
-
-                    this->pc += 2;
-                }
-
-                    break;
-                default:
-                    this->print_unknown_opcode();
-                    this->pc += 2;
-
-                    break;
-            }
-
-            break;
-        //   0x9XY0 -> Skips the next instruction if VX doesn't equal VY. (Usually the next instruction is a jump to skip a code block)
-        case 0x9000:
-            if ((this->opcode & 0x000F) != 0)
-            {
-                this->print_unknown_opcode();
-                this->pc += 2;
-
-                break;
-            }
-
-            {
-                byte x_index = (this->opcode & 0x0F00) >> 8;
-                byte y_index = (this->opcode & 0x00F0) >> 4;
-
-                if (this->V[x_index] != this->V[y_index])
-                {
-                    this->pc += 2;
-                }
-
-                this->pc += 2;
-            }
-
-            break;
-        //   0xANNN -> Sets I to the address NNN.
-        case 0xA000:
-            this->I = this->opcode & 0x0FFF;
-
-            this->pc += 2;
-
-            break;
-        //   0xBNNN -> Jumps to the address NNN plus V0.
-        case 0xB000:
-            this->pc = (this->opcode & 0x0FFF) + this->V[0];
-
-            break;
-        //   0xCXNN -> Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN.
-        case 0xC000:
-        {
-            byte index = (this->opcode & 0x0F00) >> 8;
-            byte NN = (this->opcode & 0x00FF);
-
-            this->V[index] = (rand() % 0x100) & NN;
-
-            this->pc += 2;
-        }
-
-            break;
-        //   0xDXYN -> Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
-        // Each row of 8 pixels is read as bit-coded starting from memory location I; 
-        // I value doesn’t change after the execution of this instruction. As described above, 
-        // VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn’t happen.
-        case 0xD000:
-        {
-            this->draw_flag = true;
-            
-            this->V[0xF] = 0;
-
-            byte x_index = (this->opcode & 0x0F00) >> 8;
-            byte y_index = (this->opcode & 0x00F0) >> 4;
-            byte n = (this->opcode & 0x000F);
-
-            // Each row
-            for (size_t row = 0; row < n; row++)
-            {
-                // Each column
-                for (size_t col = 0; col < 8; col++)
-                {
-                    if (this->V[y_index] + row >= CPU::HEIGHT || 
-                        this->V[x_index] + col >= CPU::WIDTH)
-                    {
-                        std::cout << "WARNING: screen buffer overflow (might not be dangerous if is not close the end of the buffer)." << std::endl;
-
-                        if ((this->V[y_index] + row) * CPU::WIDTH + this->V[x_index] + col >= CPU::GFX_LENGTH)
-                        {
-                            std::cerr << "ERROR: stack overflow detected. Skipping." << std::endl;
-
-                            continue;
-                        }
-                    }
-
-                    if ((this->memory[this->I + row] & (0x80 >> col)) != 0)   // WARNING: if memory's declaration was not unsigned, this might fail when col = 0 (memory = 1000 0000 (in C2's complement, if signed, is -0) or memory = 0000 0000)
-                    {
-                        // We draw the current pixel because it is set in the sprite
-
-                        //                         ROW                               COL
-                        //        -------------------------------------   ----------------------
-                        this->gfx[(this->V[y_index] + row) * CPU::WIDTH + this->V[x_index] + col] ^= 1;
-
-                        // Collision test
-                        if (this->gfx[(this->V[y_index] + row) * CPU::WIDTH + this->V[x_index] + col] == 0)
-                        {
-                            // Collision detected
-                            this->V[0xF] = 1;
-                        }
-                    }
-                }
-            }
-            
-            this->pc += 2;
-        }
-            
-            break;
-        case 0xE000:
-            switch(this->opcode & 0x00FF)
-            {
-                //   0xEX9E -> Skips the next instruction if the key stored in VX is pressed. (Usually the next instruction is a jump to skip a code block)
-                case 0x009E:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    if (this->key[this->V[index]] != 0)
-                    {
-                        // Key at V[index] is pressed -> skip next instruction
-
-                        this->pc += 2;
-                    }
+    (this->*instructions[(this->state.opcode & 0xF000) >> 12])();
 
-                    this->pc += 2;
-                }
+    // Addresses are 12 bits: BNNN and the skips at the end of memory wrap around
+    this->state.pc &= CPU::MEMORY_LENGTH_B - 1;
+}
 
-                    break;
-                //   0xEXA1 -> Skips the next instruction if the key stored in VX isn't pressed. (Usually the next instruction is a jump to skip a code block)
-                case 0x00A1:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
+void CPU::execute_instruction(const WORD& instruction)
+{
+    this->state.opcode = instruction;
 
-                    if (this->key[this->V[index]] == 0)
-                    {
-                        // Key at V[index] is not pressed -> skip next instruction
+    this->execute_instruction();
+}
 
-                        this->pc += 2;
-                    }
+bool CPU::is_draw_flag_set() const
+{
+    return this->state.draw_flag;
+}
 
-                    this->pc += 2;
-                }
+void CPU::update_pressed_keys(byte* keys)
+{
+    WORD mask = 0;
 
-                    break;
-                default:
-                    this->print_unknown_opcode();
-                    this->pc += 2;
+    for (size_t i = 0; i < KEY_MAPPING_SIZE; i++)
+    {
+        mask |= (keys[i] != 0) << i;
+    }
 
-                    break;
-            }
+    this->update_pressed_keys(mask);
+}
 
-            break;
-        case 0xF000:
-            switch (this->opcode & 0x00FF)
-            {
-                //   0xFX07 -> Sets VX to the value of the delay timer.
-                case 0x0007:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    this->V[index] = this->delay_timer;
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX0A -> A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted until next key event)
-                case 0x000A:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-                    bool key_pressed = false;
-
-                    for (size_t index = 0; index < CPU::KEY_MAPPING_SIZE; index++)
-                    {
-                        if (this->key[index] != 0)
-                        {
-                            this->V[index] = index;
-                            key_pressed = true;
-
-                            break;
-                        }
-                    }
-                    
-                    if (key_pressed)
-                    {
-                        this->pc += 2;
-                    }
-
-                    // If the key was not pressed, the PC would not be increased, and this instruction will be executed until a key is pressed
-                }
-
-                    break;
-                //   0xFX15 -> Sets the delay timer to VX.
-                case 0x0015:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    this->delay_timer = this->V[index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX18 -> Sets the sound timer to VX.
-                case 0x0018:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    this->sound_timer = this->V[index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX1E -> Adds VX to I.
-                case 0x001E:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    if (this->I > 0xFF - this->V[index])
-                    {
-                        this->V[0xF] = 1;
-                    }
-                    else
-                    {
-                        this->V[0xF] = 0;
-                    }
-
-                    this->I += this->V[index];
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX29 -> Sets I to the location of the sprite for the character in VX. 
-                // Characters 0-F (in hexadecimal) are represented by a 4x5 font.
-                case 0x0029:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    if (this->V[index] > 0xF ||
-                        this->V[index] * 5 >= CPU::FONTSET_SIZE)    // Each character sprite is 5 bytes long
-                    {
-                        std::cout << "WARNING: fontset overflow." << std::endl;
-                    }
-
-                    this->I = CPU::FONTSET_MEMORY_BEGIN + this->V[index] * 5;
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX33 -> Stores the binary-coded decimal representation of VX, 
-                // with the most significant of three digits at the address in I, 
-                // the middle digit at I plus 1, and the least significant digit at I plus 2. 
-                // In other words, take the decimal representation of VX, place the hundreds digit in memory at location in I, 
-                // the tens digit at location I+1, and the ones digit at location I+2.
-                case 0x0033:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    this->memory[this->I + 0] =  this->V[index] / 100;          // Most significant BCD digit
-                    this->memory[this->I + 1] = (this->V[index] / 10 ) % 10;    // Middle BCD digit
-                    this->memory[this->I + 2] = (this->V[index] % 100) % 10;    // Least significant BCD digit
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX55 -> Stores V0 to VX (including VX) in memory starting at address I. 
-                // The offset from I is increased by 1 for each value written, but I itself is left unmodified.
-                case 0x0055:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    for (size_t i = 0; i <= index; i++)
-                    {
-                        this->memory[this->I + i] = this->V[i];
-                    }
-
-                    this->pc += 2;
-                }
-
-                    break;
-                //   0xFX65 -> Fills V0 to VX (including VX) with values from memory starting at address I. 
-                // The offset from I is increased by 1 for each value written, but I itself is left unmodified.
-                case 0x0065:
-                {
-                    byte index = (this->opcode & 0x0F00) >> 8;
-
-                    for (size_t i = 0; i <= index; i++)
-                    {
-                        this->V[i] = this->memory[this->I + i];
-                    }
-
-                    this->pc += 2;
-                }
-
-                    break;
-                default:
-                    this->print_unknown_opcode();
-                    this->pc += 2;
-
-                    break;
-            }
+// All keys at once (bit N: key N pressed). The edges are the keys that changed since the last update.
+void CPU::update_pressed_keys(WORD mask)
+{
+    this->key_presses |= mask & ~this->keys;
+    this->key_releases |= this->keys & ~mask & this->key_presses;
+    this->keys = mask;
+}
 
-            break;
-        default:
-            this->print_unknown_opcode();
-            this->pc += 2;
+// A single press or release, in the order they happened
+void CPU::key_event(byte key, bool pressed)
+{
+    WORD bit = 1 << (key & 0x0F);
 
-            break;
+    if (pressed)
+    {
+        this->update_pressed_keys((WORD)(this->keys | bit));
+    }
+    else
+    {
+        this->update_pressed_keys((WORD)(this->keys & ~bit));
     }
-    */
 }
 
-bool CPU::is_draw_flag_set() const
+WORD CPU::get_pressed_keys() const
 {
-    return this->draw_flag;
+    return this->keys;
 }
 
-void CPU::update_pressed_keys(byte* keys)
+// FX0A is waiting for a key to be released
+bool CPU::is_waiting_for_key() const
 {
-    for (size_t i = 0; i < KEY_MAPPING_SIZE; i++)
-    {
-        this->key[i] = keys[i];
-    }
+    return this->key_waiting;
 }
 
-void CPU::print_unknown_opcode(const string msg) const
+// Called for every 0NNN (e.g. a PC running into zeroed memory): no string built when the report is compiled out
+void CPU::print_unknown_opcode(const char* msg) const
 {
-    std::cerr << "ERROR: unknown opcode (0x" << std::hex << this->opcode << std::dec << ")." << std::endl;
+    REPORT(std::cerr, "ERROR: unknown opcode (0x" << std::hex << this->state.opcode << std::dec << ").");
 
-    if (!msg.empty())
+    if (msg[0] != '\0')
     {
-        std::cerr << std::endl << msg << std::endl;
+        REPORT(std::cerr, std::endl << msg);
     }
 }
 
@@ -1427,12 +1412,12 @@ void CPU::print_memory() const
     {
         std::cout << "0x";
 
-        if ((unsigned)this->memory[i] < 0x10)
+        if ((unsigned)this->memory.read(i) < 0x10)
         {
             std::cout << "0";
         }
 
-        std::cout << std::hex << (unsigned)this->memory[i] << " ";
+        std::cout << std::hex << (unsigned)this->memory.read(i) << " ";
 
         if ((i + 1) % 16 == 0)
         {
@@ -1457,23 +1442,23 @@ void CPU::print_status() const
     
     for (size_t i = 0; i < CPU::GENERAL_PURPOSE_REGISTERS; i++)
     {
-        std::cout << " V[" << i << "] = " << (unsigned)this->V[i] << std::endl;
+        std::cout << " V[" << i << "] = " << (unsigned)this->state.V[i] << std::endl;
     }
 
     std::cout << "--------------------------" << std::endl;
-    std::cout << "Register I = " << (unsigned)this->I << std::endl;
-    std::cout << "Current opcode = " << (unsigned)this->opcode << std::endl;
-    std::cout << "Program Counter = " << (unsigned)this->pc << std::endl;
-    std::cout << "Delay timer = " << (unsigned)this->delay_timer << std::endl;
-    std::cout << "Sound timer = " << (unsigned)this->sound_timer << std::endl;
-    std::cout << "Draw flag = " << std::boolalpha << draw_flag << std::endl;
-    std::cout << "Stack Pointer = " << (unsigned)this->sp << std::endl;
+    std::cout << "Register I = " << (unsigned)this->state.I << std::endl;
+    std::cout << "Current opcode = " << (unsigned)this->state.opcode << std::endl;
+    std::cout << "Program Counter = " << (unsigned)this->state.pc << std::endl;
+    std::cout << "Delay timer = " << (unsigned)this->state.delay_timer << std::endl;
+    std::cout << "Sound timer = " << (unsigned)this->state.sound_timer << std::endl;
+    std::cout << "Draw flag = " << std::boolalpha << this->state.draw_flag << std::endl;
+    std::cout << "Stack Pointer = " << (unsigned)this->state.sp << std::endl;
     std::cout << "Stack:" << std::endl;
     std::cout << "------" << std::endl;
 
     for (size_t i = 0; i < CPU::STACK_DEEPNESS; i++)
     {
-        std::cout << " stack[" << i << "] = " << (unsigned)this->stack[i] << std::endl;
+        std::cout << " stack[" << i << "] = " << (unsigned)this->state.stack[i] << std::endl;
     }
 
     std::cout << "------" << std::endl;
@@ -1482,7 +1467,7 @@ void CPU::print_status() const
 
     for (size_t i = 0; i < CPU::KEY_MAPPING_SIZE; i++)
     {
-        std::cout << " key[" << i << "] = " << (unsigned)this->key[i] << std::endl;
+        std::cout << " key[" << i << "] = " << ((this->keys >> i) & 1) << std::endl;
     }
     
     std::cout << "------------" << std::endl;
@@ -1494,23 +1479,16 @@ void CPU::print_screen() const
     {
         for (size_t col = 0; col < CPU::WIDTH; col++)
         {
-            std::cout << (unsigned)this->gfx[row * CPU::HEIGHT + col];
+            std::cout << (unsigned)this->gfx[row * CPU::WIDTH + col];
         }
 
         std::cout << std::endl;
     }
 }
 
-void CPU::execute_instruction(const WORD& instruction)
-{
-    this->opcode = instruction;
-
-    this->execute_instruction();
-}
-
 void CPU::store(const WORD& addr, const byte& value)
 {
-    this->memory[addr] = value;
+    this->memory.write(addr, value);
 }
 
 #endif
\ No newline at end of file
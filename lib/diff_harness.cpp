@@ -0,0 +1,314 @@
+#include "diff_harness.h"
+#include "rom_analyzer.h"
+
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+const DiffOptions DiffHarness::DEFAULT_OPTIONS = {1000000, 2000};
+
+namespace
+{
+    // Hexadecimal with a fixed number of digits
+    std::string hex(uint64_t value, int digits)
+    {
+        std::ostringstream out;
+
+        out << "0x" << std::uppercase << std::hex << std::setw(digits) << std::setfill('0') << value;
+
+        return out.str();
+    }
+
+    void field(std::ostringstream& out, const std::string& name, uint64_t expected, uint64_t actual, int digits)
+    {
+        if (expected != actual)
+        {
+            out << "  " << std::left << std::setw(12) << name << std::right
+                << " expected " << hex(expected, digits) << ", got " << hex(actual, digits) << std::endl;
+        }
+    }
+}
+
+DiffHarness::DiffHarness(DiffEngine diff_engine, const DiffOptions& diff_options) :
+    engine(diff_engine),
+    options(diff_options),
+    trace(),
+    traced(0)
+{
+
+}
+
+const char* DiffHarness::engine_name(DiffEngine engine)
+{
+    switch (engine)
+    {
+        case DiffEngine::DECODED:
+            return "decoded";
+        case DiffEngine::FUSED:
+            return "fused";
+        default:
+            return "tiered";
+    }
+}
+
+bool DiffHarness::parse_engine(const string& name, DiffEngine& engine)
+{
+    const DiffEngine engines[] = {DiffEngine::DECODED, DiffEngine::FUSED, DiffEngine::TIERED};
+
+    for (DiffEngine candidate : engines)
+    {
+        if (name == DiffHarness::engine_name(candidate))
+        {
+            engine = candidate;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::unique_ptr<ExecutionManager> DiffHarness::create_manager(DiffEngine engine)
+{
+    const TierThresholds eager = {1, 1};
+    std::unique_ptr<ExecutionManager> manager(new ExecutionManager(engine == DiffEngine::TIERED ? ExecutionManager::DEFAULT_THRESHOLDS : eager));
+
+    manager->set_fusion(engine != DiffEngine::DECODED);
+
+    return manager;
+}
+
+DiffResult DiffHarness::run(const std::shared_ptr<const CPU::Image>& image, uint32_t seed)
+{
+    std::unique_ptr<ExecutionManager> engine_manager = DiffHarness::create_manager(this->engine);
+    ExecutionManager& manager = *engine_manager;
+    CPU reference;
+    CPU candidate;
+    std::mt19937 random(seed);
+    byte keys[CPU::KEY_MAPPING_SIZE] = {};
+    unsigned reference_versions[CPU::MEMORY_PAGES];
+    unsigned candidate_versions[CPU::MEMORY_PAGES];
+    bool pages[CPU::MEMORY_PAGES];
+    uint64_t next_keys = this->options.cycles;
+    DiffResult result = {true, 0, 0, ""};
+
+    reference.initializate();
+    candidate.initializate();
+    reference.load_image(image);
+    candidate.load_image(image);
+    reference.seed(seed);
+    candidate.seed(seed);
+
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        reference_versions[page] = reference.get_memory_version(page * CPU::MEMORY_PAGE_SIZE);
+        candidate_versions[page] = candidate.get_memory_version(page * CPU::MEMORY_PAGE_SIZE);
+    }
+
+    if (this->options.key_period > 0)
+    {
+        next_keys = random() % this->options.key_period;
+    }
+
+    this->traced = 0;
+
+    const CPU::State& state = reference.get_state();
+
+    while (result.cycles < this->options.cycles && !state.halt)
+    {
+        // New keys: half of the time none, otherwise one at random
+        if (result.cycles >= next_keys)
+        {
+            memset(keys, 0, sizeof(keys));
+
+            if (random() % 2 == 0)
+            {
+                keys[random() % CPU::KEY_MAPPING_SIZE] = 1;
+            }
+
+            reference.update_pressed_keys(keys);
+            candidate.update_pressed_keys(keys);
+
+            next_keys = result.cycles + 1 + random() % this->options.key_period;
+        }
+
+        uint64_t budget = std::min(this->options.cycles, next_keys) - result.cycles;
+        uint64_t remaining = budget;
+        CPU::State before = state;
+
+        bool drew = manager.step(candidate, remaining);
+        uint64_t consumed = budget - remaining;
+
+        for (uint64_t cycle = 0; cycle < consumed && !state.halt; cycle++)
+        {
+            TraceEntry& entry = this->trace[this->traced % DiffHarness::TRACE_LENGTH];
+
+            entry.pc = state.pc;
+            reference.emulate_cycle();
+            entry.opcode = state.opcode;
+
+            this->traced++;
+            drew |= reference.is_draw_flag_set();
+        }
+
+        result.cycles += consumed;
+        result.steps++;
+
+        // Only the pages either side wrote since the last step
+        for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+        {
+            unsigned reference_version = reference.get_memory_version(page * CPU::MEMORY_PAGE_SIZE);
+            unsigned candidate_version = candidate.get_memory_version(page * CPU::MEMORY_PAGE_SIZE);
+
+            pages[page] = reference_version != reference_versions[page] || candidate_version != candidate_versions[page];
+
+            reference_versions[page] = reference_version;
+            candidate_versions[page] = candidate_version;
+        }
+
+        std::string differences;
+
+        if (!this->compare(reference, candidate, drew, pages, differences) || consumed == 0)
+        {
+            if (consumed == 0)
+            {
+                differences = "  candidate made no progress\n";
+            }
+
+            result.match = false;
+            result.report = this->describe(before, result.cycles, consumed, manager.get_tier(before.pc)) + differences;
+
+            break;
+        }
+    }
+
+    return result;
+}
+
+bool DiffHarness::compare(const CPU& reference, const CPU& candidate, bool screen, const bool* pages,
+                          std::string& differences) const
+{
+    const CPU::State& expected = reference.get_state();
+    const CPU::State& actual = candidate.get_state();
+    const byte* expected_gfx = reference.get_gfx();
+    const byte* actual_gfx = candidate.get_gfx();
+    bool same = memcmp(&expected, &actual, offsetof(CPU::State, halt) + sizeof(expected.halt)) == 0 &&
+                expected.random == actual.random;
+
+    for (unsigned page = 0; same && page < CPU::MEMORY_PAGES; page++)
+    {
+        for (unsigned addr = page * CPU::MEMORY_PAGE_SIZE; pages[page] && addr < (page + 1) * CPU::MEMORY_PAGE_SIZE; addr++)
+        {
+            same &= reference.load(addr) == candidate.load(addr);
+        }
+    }
+
+    // Fast path: nothing to report (the frame hashes differ whenever the screens do)
+    if (same && (!screen || (reference.get_frame_hash() == candidate.get_frame_hash() &&
+                             memcmp(expected_gfx, actual_gfx, CPU::GFX_LENGTH) == 0)))
+    {
+        return true;
+    }
+
+    std::ostringstream out;
+
+    field(out, "pc", expected.pc, actual.pc, 3);
+    field(out, "opcode", expected.opcode, actual.opcode, 4);
+    field(out, "I", expected.I, actual.I, 3);
+    field(out, "sp", expected.sp, actual.sp, 2);
+
+    for (unsigned i = 0; i < CPU::GENERAL_PURPOSE_REGISTERS; i++)
+    {
+        field(out, "V" + hex(i, 1).substr(2), expected.V[i], actual.V[i], 2);
+    }
+
+    for (unsigned i = 0; i < CPU::STACK_DEEPNESS; i++)
+    {
+        field(out, "stack[" + std::to_string(i) + "]", expected.stack[i], actual.stack[i], 3);
+    }
+
+    field(out, "delay_timer", expected.delay_timer, actual.delay_timer, 2);
+    field(out, "sound_timer", expected.sound_timer, actual.sound_timer, 2);
+    field(out, "draw_flag", expected.draw_flag, actual.draw_flag, 1);
+    field(out, "halt", expected.halt, actual.halt, 1);
+    field(out, "random", expected.random, actual.random, 8);
+
+    unsigned bytes = 0;
+
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        for (unsigned addr = page * CPU::MEMORY_PAGE_SIZE; pages[page] && addr < (page + 1) * CPU::MEMORY_PAGE_SIZE; addr++)
+        {
+            if (reference.load(addr) != candidate.load(addr) && bytes++ < 8)
+            {
+                field(out, "mem[" + hex(addr, 3) + "]", reference.load(addr), candidate.load(addr), 2);
+            }
+        }
+    }
+
+    if (bytes > 8)
+    {
+        out << "  ... " << bytes << " memory bytes differ" << std::endl;
+    }
+
+    if (screen)
+    {
+        field(out, "frame_hash", reference.get_frame_hash(), candidate.get_frame_hash(), 16);
+
+        if (memcmp(expected_gfx, actual_gfx, CPU::GFX_LENGTH) != 0)
+        {
+            unsigned pixels = 0;
+            unsigned first = CPU::GFX_LENGTH;
+
+            for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+            {
+                if (expected_gfx[i] != actual_gfx[i])
+                {
+                    first = std::min(first, i);
+                    pixels++;
+                }
+            }
+
+            out << "  gfx          " << pixels << " pixel(s) differ, first at (" << first % CPU::WIDTH << ", "
+                << first / CPU::WIDTH << ")" << std::endl;
+        }
+    }
+
+    differences = out.str();
+
+    return differences.empty();
+}
+
+std::string DiffHarness::describe(const CPU::State& before, uint64_t cycles, uint64_t consumed, Tier tier) const
+{
+    std::ostringstream out;
+
+    out << "First mismatch after cycle " << cycles << ": step at " << hex(before.pc, 3) << " (" << consumed
+        << " cycle(s), " << ExecutionManager::tier_name(tier) << ")" << std::endl;
+
+    out << "  Before the step: I = " << hex(before.I, 3) << ", sp = " << before.sp << ", V =";
+
+    for (unsigned i = 0; i < CPU::GENERAL_PURPOSE_REGISTERS; i++)
+    {
+        out << " " << hex(before.V[i], 2).substr(2);
+    }
+
+    out << std::endl << "  Last instructions (reference):" << std::endl;
+
+    uint64_t first = this->traced > DiffHarness::TRACE_LENGTH ? this->traced - DiffHarness::TRACE_LENGTH : 0;
+
+    for (uint64_t i = first; i < this->traced; i++)
+    {
+        const TraceEntry& entry = this->trace[i % DiffHarness::TRACE_LENGTH];
+
+        out << "    " << hex(entry.pc, 3) << "  " << hex(entry.opcode, 4).substr(2) << "  "
+            << RomAnalyzer::disassemble(entry.opcode) << std::endl;
+    }
+
+    out << "  Differences (expected = reference, got = " << DiffHarness::engine_name(this->engine) << "):" << std::endl;
+
+    return out.str();
+}
@@ -0,0 +1,566 @@
+#include "env_server.h"
+
+#include <iostream>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+using std::string;
+
+// Spins before falling back to a futex sleep (a step usually takes less than this)
+static const unsigned SPIN_ITERATIONS = 4096;
+
+// Yield while spinning every so often, so oversubscribed cores still make progress
+static const unsigned SPIN_YIELD_MASK = 0xFF;
+
+static void futex_wait(std::atomic<uint32_t>* address, uint32_t expected)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* address)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static size_t slot_stride()
+{
+    // Keep every slot on its own cache lines
+    return (sizeof(EnvSlot) + 63) & ~(size_t)63;
+}
+
+static size_t slots_offset()
+{
+    return (sizeof(EnvHeader) + 63) & ~(size_t)63;
+}
+
+EnvServer::EnvServer() :
+    mapping(NULL),
+    mapping_length(0),
+    header(NULL),
+    constructed(0)
+{
+
+}
+
+EnvServer::~EnvServer()
+{
+    this->stop();
+    this->destroy();
+}
+
+EnvSlot* EnvServer::slot(unsigned index) const
+{
+    return reinterpret_cast<EnvSlot*>((char*)this->mapping + slots_offset() + index * slot_stride());
+}
+
+bool EnvServer::create(const string& shm_name, const string& path, unsigned instances, unsigned worker_count, bool tiered)
+{
+    if (instances == 0 || worker_count == 0 || worker_count > EnvHeader::MAX_WORKERS)
+    {
+        std::cerr << "ERROR: invalid number of instances or workers." << std::endl;
+
+        return false;
+    }
+
+    this->name = shm_name;
+    this->rom_path = path;
+    this->image = CPU::read_image(path);
+
+    if (!this->image)
+    {
+        return false;
+    }
+
+    this->mapping_length = slots_offset() + instances * slot_stride();
+
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+
+    if (fd == -1)
+    {
+        std::cerr << "ERROR: couldn't create the shared memory object (" << shm_name << ")." << std::endl;
+
+        return false;
+    }
+
+    if (ftruncate(fd, this->mapping_length) != 0)
+    {
+        std::cerr << "ERROR: couldn't resize the shared memory object." << std::endl;
+
+        close(fd);
+        shm_unlink(shm_name.c_str());
+
+        return false;
+    }
+
+    this->mapping = mmap(NULL, this->mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (this->mapping == MAP_FAILED)
+    {
+        std::cerr << "ERROR: couldn't map the shared memory object." << std::endl;
+
+        this->mapping = NULL;
+        shm_unlink(shm_name.c_str());
+
+        return false;
+    }
+
+    this->header = new (this->mapping) EnvHeader;
+    this->header->magic = EnvHeader::MAGIC;
+    this->header->version = EnvHeader::VERSION;
+    this->header->slot_count = instances;
+    this->header->slot_size = slot_stride();
+    this->header->slots_offset = slots_offset();
+    this->header->worker_count = worker_count;
+    this->header->ready = 0;
+    this->header->shutdown = 0;
+
+    for (unsigned i = 0; i < EnvHeader::MAX_WORKERS; i++)
+    {
+        this->header->doorbell[i].rings = 0;
+        this->header->doorbell[i].sleeping = 0;
+    }
+
+    for (unsigned i = 0; i < instances; i++)
+    {
+        EnvSlot* current = new (this->slot(i)) EnvSlot;
+
+        current->request = 0;
+        current->response = 0;
+        current->agent_waiting = 0;
+        current->command = ENV_COMMAND_NONE;
+        current->cycles = 0;
+        current->read_addr = 0;
+        current->read_length = 0;
+        current->draw_flag = 0;
+        current->total_cycles = 0;
+        current->frame_hash = 0;
+
+        memset(current->keys, 0, sizeof(current->keys));
+        memset(current->read_buffer, 0, sizeof(current->read_buffer));
+
+        CPU* cpu = new (current->cpu_storage) CPU;
+
+        this->constructed++;
+
+        // The ROM was read once and its image is shared by every instance
+        cpu->initializate();
+        cpu->load_image(this->image);
+
+        if (tiered)
+        {
+            this->managers.push_back(std::unique_ptr<ExecutionManager>(new ExecutionManager()));
+        }
+
+        if (i == 0)
+        {
+            this->header->gfx_offset = cpu->get_gfx() - reinterpret_cast<byte*>(current);
+        }
+    }
+
+    this->header->ready.store(1, std::memory_order_release);
+
+    return true;
+}
+
+void EnvServer::process(EnvSlot* current, ExecutionManager* manager)
+{
+    CPU* cpu = reinterpret_cast<CPU*>(current->cpu_storage);
+
+    switch (current->command)
+    {
+        case ENV_COMMAND_STEP:
+        {
+            bool draw = false;
+
+            cpu->update_pressed_keys(current->keys);
+
+            if (manager != NULL)
+            {
+                draw = manager->run(*cpu, current->cycles);
+            }
+
+            for (uint32_t i = 0; manager == NULL && i < current->cycles; i++)
+            {
+                cpu->emulate_cycle();
+                draw |= cpu->is_draw_flag_set();
+            }
+
+            current->draw_flag = draw;
+            current->total_cycles += current->cycles;
+            current->frame_hash = cpu->get_frame_hash();
+
+            break;
+        }
+        case ENV_COMMAND_RESET:
+            cpu->initializate();
+            cpu->load_image(this->image);
+
+            current->draw_flag = 1;
+            current->total_cycles = 0;
+            current->frame_hash = cpu->get_frame_hash();
+
+            break;
+        default:
+            break;
+    }
+
+    // Reward-relevant memory window, answered in the same round trip
+    uint32_t length = current->read_length;
+
+    if (length > EnvSlot::READ_WINDOW_SIZE)
+    {
+        length = EnvSlot::READ_WINDOW_SIZE;
+    }
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        current->read_buffer[i] = cpu->load((current->read_addr + i) % CPU::MEMORY_LENGTH_B);
+    }
+}
+
+void EnvServer::worker_loop(unsigned worker)
+{
+    EnvHeader::Doorbell& bell = this->header->doorbell[worker];
+    unsigned slot_count = this->header->slot_count;
+    unsigned worker_count = this->header->worker_count;
+    unsigned idle = 0;
+
+    while (!this->header->shutdown.load(std::memory_order_acquire))
+    {
+        uint32_t rings = bell.rings.load(std::memory_order_acquire);
+        bool worked = false;
+
+        for (unsigned i = worker; i < slot_count; i += worker_count)
+        {
+            EnvSlot* current = this->slot(i);
+            uint32_t request = current->request.load(std::memory_order_acquire);
+
+            if (request == current->response.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            this->process(current, this->managers.empty() ? NULL : this->managers[i].get());
+
+            current->response.store(request, std::memory_order_seq_cst);
+
+            if (current->agent_waiting.load(std::memory_order_seq_cst))
+            {
+                futex_wake(&current->response);
+            }
+
+            worked = true;
+        }
+
+        if (worked)
+        {
+            idle = 0;
+
+            continue;
+        }
+
+        if (++idle < SPIN_ITERATIONS)
+        {
+            if ((idle & SPIN_YIELD_MASK) == 0)
+            {
+                std::this_thread::yield();
+            }
+
+            continue;
+        }
+
+        // Nothing to do: announce that we sleep and re-check before blocking
+        bell.sleeping.store(1, std::memory_order_seq_cst);
+
+        if (bell.rings.load(std::memory_order_seq_cst) == rings &&
+            !this->header->shutdown.load(std::memory_order_seq_cst))
+        {
+            futex_wait(&bell.rings, rings);
+        }
+
+        bell.sleeping.store(0, std::memory_order_seq_cst);
+        idle = 0;
+    }
+}
+
+void EnvServer::run()
+{
+    for (unsigned i = 0; i < this->header->worker_count; i++)
+    {
+        this->workers.push_back(std::thread(&EnvServer::worker_loop, this, i));
+    }
+
+    for (size_t i = 0; i < this->workers.size(); i++)
+    {
+        this->workers[i].join();
+    }
+
+    this->workers.clear();
+}
+
+void EnvServer::stop()
+{
+    if (this->header == NULL)
+    {
+        return;
+    }
+
+    this->header->shutdown.store(1, std::memory_order_seq_cst);
+
+    for (unsigned i = 0; i < this->header->worker_count; i++)
+    {
+        this->header->doorbell[i].rings.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(&this->header->doorbell[i].rings);
+    }
+}
+
+void EnvServer::destroy()
+{
+    if (this->mapping == NULL)
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < this->constructed; i++)
+    {
+        reinterpret_cast<CPU*>(this->slot(i)->cpu_storage)->~CPU();
+    }
+
+    munmap(this->mapping, this->mapping_length);
+    shm_unlink(this->name.c_str());
+
+    this->mapping = NULL;
+    this->header = NULL;
+    this->constructed = 0;
+    this->image.reset();
+    this->managers.clear();
+}
+
+TierMetrics EnvServer::get_metrics() const
+{
+    TierMetrics total = TierMetrics();
+
+    for (size_t i = 0; i < this->managers.size(); i++)
+    {
+        const TierMetrics& metrics = this->managers[i]->get_metrics();
+
+        for (unsigned tier = 0; tier < TierMetrics::TIERS; tier++)
+        {
+            total.cycles[tier] += metrics.cycles[tier];
+            total.promotions[tier] += metrics.promotions[tier];
+            total.blocks[tier] += metrics.blocks[tier];
+        }
+
+        for (unsigned fusion = 0; fusion < TierMetrics::FUSIONS; fusion++)
+        {
+            total.fused[fusion] += metrics.fused[fusion];
+            total.fused_cycles[fusion] += metrics.fused_cycles[fusion];
+        }
+
+        total.invalidations += metrics.invalidations;
+    }
+
+    return total;
+}
+
+EnvClient::EnvClient() :
+    mapping(NULL),
+    mapping_length(0),
+    header(NULL)
+{
+
+}
+
+EnvClient::~EnvClient()
+{
+    this->detach();
+}
+
+EnvSlot* EnvClient::slot(unsigned index) const
+{
+    return reinterpret_cast<EnvSlot*>((char*)this->mapping + this->header->slots_offset + index * this->header->slot_size);
+}
+
+bool EnvClient::attach(const string& shm_name)
+{
+    int fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+
+    if (fd == -1)
+    {
+        std::cerr << "ERROR: the shared memory object (" << shm_name << ") couldn't be opened or found." << std::endl;
+
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(EnvHeader))
+    {
+        std::cerr << "ERROR: the shared memory object is not an environment." << std::endl;
+
+        close(fd);
+
+        return false;
+    }
+
+    this->mapping_length = info.st_size;
+    this->mapping = mmap(NULL, this->mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (this->mapping == MAP_FAILED)
+    {
+        this->mapping = NULL;
+
+        return false;
+    }
+
+    this->header = reinterpret_cast<EnvHeader*>(this->mapping);
+
+    if (this->header->magic != EnvHeader::MAGIC || this->header->version != EnvHeader::VERSION ||
+        this->header->ready.load(std::memory_order_acquire) == 0)
+    {
+        std::cerr << "ERROR: the environment is not ready or has a different version." << std::endl;
+
+        this->detach();
+
+        return false;
+    }
+
+    this->sequence.assign(this->header->slot_count, 0);
+
+    for (unsigned i = 0; i < this->header->slot_count; i++)
+    {
+        this->sequence[i] = this->slot(i)->response.load(std::memory_order_acquire);
+    }
+
+    return true;
+}
+
+void EnvClient::detach()
+{
+    if (this->mapping != NULL)
+    {
+        munmap(this->mapping, this->mapping_length);
+    }
+
+    this->mapping = NULL;
+    this->header = NULL;
+}
+
+unsigned EnvClient::get_slot_count() const
+{
+    return this->header->slot_count;
+}
+
+const byte* EnvClient::get_gfx(unsigned index) const
+{
+    return reinterpret_cast<const byte*>(this->slot(index)) + this->header->gfx_offset;
+}
+
+const byte* EnvClient::get_read_buffer(unsigned index) const
+{
+    return this->slot(index)->read_buffer;
+}
+
+uint64_t EnvClient::get_total_cycles(unsigned index) const
+{
+    return this->slot(index)->total_cycles;
+}
+
+bool EnvClient::is_draw_flag_set(unsigned index) const
+{
+    return this->slot(index)->draw_flag != 0;
+}
+
+uint64_t EnvClient::get_frame_hash(unsigned index) const
+{
+    return this->slot(index)->frame_hash;
+}
+
+void EnvClient::set_read_window(unsigned index, WORD addr, unsigned length)
+{
+    EnvSlot* current = this->slot(index);
+
+    current->read_addr = addr;
+    current->read_length = length;
+}
+
+void EnvClient::submit(unsigned index, EnvCommand command, const byte* keys, unsigned cycles)
+{
+    EnvSlot* current = this->slot(index);
+    unsigned worker = index % this->header->worker_count;
+    EnvHeader::Doorbell& bell = this->header->doorbell[worker];
+
+    current->command = command;
+    current->cycles = cycles;
+
+    if (keys != NULL)
+    {
+        memcpy(current->keys, keys, CPU::KEY_MAPPING_SIZE);
+    }
+
+    current->request.store(++this->sequence[index], std::memory_order_release);
+    bell.rings.fetch_add(1, std::memory_order_seq_cst);
+
+    if (bell.sleeping.load(std::memory_order_seq_cst))
+    {
+        futex_wake(&bell.rings);
+    }
+}
+
+void EnvClient::wait(unsigned index)
+{
+    EnvSlot* current = this->slot(index);
+    uint32_t expected = this->sequence[index];
+
+    for (unsigned i = 0; i < SPIN_ITERATIONS; i++)
+    {
+        if (current->response.load(std::memory_order_acquire) == expected)
+        {
+            return;
+        }
+
+        if ((i & SPIN_YIELD_MASK) == SPIN_YIELD_MASK)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    current->agent_waiting.store(1, std::memory_order_seq_cst);
+
+    for (;;)
+    {
+        uint32_t response = current->response.load(std::memory_order_seq_cst);
+
+        if (response == expected)
+        {
+            break;
+        }
+
+        futex_wait(&current->response, response);
+    }
+
+    current->agent_waiting.store(0, std::memory_order_relaxed);
+}
+
+void EnvClient::step(unsigned index, const byte* keys, unsigned cycles)
+{
+    this->submit(index, ENV_COMMAND_STEP, keys, cycles);
+    this->wait(index);
+}
+
+void EnvClient::reset(unsigned index)
+{
+    this->submit(index, ENV_COMMAND_RESET, NULL, 0);
+    this->wait(index);
+}
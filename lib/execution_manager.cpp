@@ -0,0 +1,571 @@
+#include "execution_manager.h"
+#include "rom_analyzer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+const TierThresholds ExecutionManager::DEFAULT_THRESHOLDS = {8, 64};
+
+ExecutionManager::ExecutionManager(const TierThresholds& tier_thresholds) :
+    thresholds(tier_thresholds),
+    metrics(),
+    program(NULL),
+    compiled(CPU::MEMORY_LENGTH_B, NULL),
+    blocks(CPU::MEMORY_LENGTH_B),
+    image(NULL),
+    fusion(true)
+{
+
+}
+
+const char* ExecutionManager::tier_name(Tier tier)
+{
+    switch (tier)
+    {
+        case Tier::DECODED:
+            return "decoded";
+        case Tier::COMPILED:
+            return "compiled";
+        default:
+            return "interpreter";
+    }
+}
+
+const char* ExecutionManager::fusion_name(Fusion fusion)
+{
+    switch (fusion)
+    {
+        case Fusion::LOAD_PAIR:
+            return "load pair";
+        case Fusion::DRAW:
+            return "draw";
+        case Fusion::COUNTED_LOOP:
+            return "counted loop";
+        case Fusion::DELAY_WAIT:
+            return "delay wait";
+        default:
+            return "none";
+    }
+}
+
+bool ExecutionManager::ends_block(WORD opcode)
+{
+    return RomAnalyzer::ends_block(opcode) || (opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055;
+}
+
+void ExecutionManager::set_program(const AotProgram* compiled_program)
+{
+    this->program = compiled_program;
+    this->reset();
+}
+
+void ExecutionManager::set_fusion(bool enabled)
+{
+    this->fusion = enabled;
+    this->reset();
+}
+
+void ExecutionManager::reset()
+{
+    // Cumulative counters are kept
+    for (size_t i = 0; i < this->blocks.size(); i++)
+    {
+        this->blocks[i].reset();
+    }
+
+    this->image = NULL;
+
+    for (unsigned tier = 0; tier < TierMetrics::TIERS; tier++)
+    {
+        this->metrics.blocks[tier] = 0;
+    }
+}
+
+void ExecutionManager::attach(const CPU& cpu)
+{
+    std::shared_ptr<const CPU::Image> current = cpu.get_image();
+
+    if (current.get() == this->image)
+    {
+        return;
+    }
+
+    // Another ROM: blocks and compiled code don't apply anymore
+    this->reset();
+    this->image = current.get();
+
+    std::fill(this->compiled.begin(), this->compiled.end(), (const AotBlock*)NULL);
+
+    if (this->program != NULL &&
+        AotCompiler::image_hash(current->data, CPU::MEMORY_LENGTH_B) == this->program->image_hash)
+    {
+        for (unsigned i = 0; i < this->program->block_count; i++)
+        {
+            const AotBlock& block = this->program->blocks[i];
+
+            this->compiled[block.address % CPU::MEMORY_LENGTH_B] = &block;
+        }
+    }
+}
+
+void ExecutionManager::promote(const CPU& cpu, WORD pc, Block& block)
+{
+    if (block.tier == Tier::INTERPRETER)
+    {
+        for (unsigned addr = pc; block.code.size() < ExecutionManager::MAX_BLOCK_LENGTH && addr + 1 < CPU::MEMORY_LENGTH_B; addr += 2)
+        {
+            DecodedInstruction instruction;
+
+            instruction.opcode = cpu.load(addr) << 8 | cpu.load(addr + 1);
+            instruction.handler = CPU::decode(instruction.opcode);
+
+            block.code.push_back(instruction);
+            block.draws |= instruction.opcode == 0x00E0 || (instruction.opcode & 0xF000) == 0xD000;
+
+            if (ExecutionManager::ends_block(instruction.opcode))
+            {
+                break;
+            }
+        }
+
+        if (block.code.empty())
+        {
+            return;
+        }
+
+        block.cycles = block.code.size();
+        this->fuse(cpu, pc, block);
+
+        block.version = cpu.get_memory_version(pc) + cpu.get_memory_version(pc + block.code.size() * 2 - 1);
+        block.tier = Tier::DECODED;
+    }
+    else
+    {
+        // The compiled blocks that follow each other from pc must cover exactly the same code
+        WORD addr = pc;
+        size_t covered = 0;
+
+        block.compilable = false;
+
+        while (covered < block.code.size() && this->compiled[addr % CPU::MEMORY_LENGTH_B] != NULL)
+        {
+            const AotBlock* piece = this->compiled[addr % CPU::MEMORY_LENGTH_B];
+
+            block.functions.push_back(piece->function);
+            covered += piece->length;
+            addr += piece->length * 2;
+        }
+
+        for (size_t i = 0; covered == block.code.size() && i < block.code.size(); i++)
+        {
+            unsigned offset = pc + i * 2 - CPU::ROM_MEMORY_BEGIN;
+
+            if (pc + i * 2 < CPU::ROM_MEMORY_BEGIN || offset + 1 >= this->program->rom_length ||
+                (this->program->rom[offset] << 8 | this->program->rom[offset + 1]) != block.code[i].opcode)
+            {
+                covered = 0;
+            }
+        }
+
+        if (covered != block.code.size())
+        {
+            block.functions.clear();
+
+            return;
+        }
+
+        block.tier = Tier::COMPILED;
+    }
+
+    this->metrics.promotions[(unsigned)block.tier]++;
+    this->metrics.blocks[(unsigned)block.tier]++;
+}
+
+void ExecutionManager::fuse(const CPU& cpu, WORD pc, Block& block)
+{
+    std::vector<DecodedInstruction>& code = block.code;
+
+    block.operations.clear();
+
+    // Two-instruction blocks that jump back to themselves
+    if (this->fusion && code.size() == 2 && (unsigned)pc + 5 < CPU::MEMORY_LENGTH_B)
+    {
+        WORD first = code[0].opcode;
+        WORD skip = code[1].opcode;
+        WORD jump = cpu.load(pc + 4) << 8 | cpu.load(pc + 5);
+        Fusion loop = Fusion::NONE;
+
+        if (jump == (0x1000 | pc) && (first & 0x0F00) == (skip & 0x0F00))
+        {
+            if ((first & 0xF000) == 0x7000 && ((skip & 0xF000) == 0x3000 || (skip & 0xF000) == 0x4000))
+            {
+                loop = Fusion::COUNTED_LOOP;
+            }
+            else if ((first & 0xF0FF) == 0xF007 && (skip & 0xF0FF) == 0x3000)
+            {
+                loop = Fusion::DELAY_WAIT;
+            }
+        }
+
+        if (loop != Fusion::NONE)
+        {
+            DecodedInstruction instruction;
+            Operation operation;
+
+            instruction.opcode = jump;
+            instruction.handler = CPU::decode(jump);
+            code.push_back(instruction);
+
+            operation.fusion = loop;
+            operation.opcode = first;
+            operation.second = skip;
+            operation.handler = code[0].handler;
+            operation.second_handler = code[1].handler;
+            block.operations.push_back(operation);
+
+            block.cycles = 3;
+            block.compilable = false;
+
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < code.size(); i++)
+    {
+        Operation operation;
+        WORD opcode = code[i].opcode;
+        WORD next = i + 1 < code.size() ? code[i + 1].opcode : 0;
+
+        operation.fusion = Fusion::NONE;
+        operation.opcode = opcode;
+        operation.second = 0;
+        operation.handler = code[i].handler;
+        operation.second_handler = NULL;
+
+        if (this->fusion && i + 1 < code.size())
+        {
+            if ((opcode & 0xF000) == 0x6000 && (next & 0xF000) == 0x6000)
+            {
+                operation.fusion = Fusion::LOAD_PAIR;
+            }
+            else if ((opcode & 0xF000) == 0xA000 && (next & 0xF000) == 0xD000)
+            {
+                operation.fusion = Fusion::DRAW;
+            }
+        }
+
+        if (operation.fusion != Fusion::NONE)
+        {
+            operation.second = next;
+            operation.second_handler = code[i + 1].handler;
+
+            i++;
+        }
+
+        block.operations.push_back(operation);
+    }
+}
+
+void ExecutionManager::demote(Block& block)
+{
+    this->metrics.invalidations++;
+    this->metrics.blocks[(unsigned)block.tier]--;
+
+    block.tier = Tier::INTERPRETER;
+    block.entries = 0;
+    block.draws = false;
+    block.compilable = true;
+    block.code.clear();
+    block.operations.clear();
+    block.functions.clear();
+}
+
+bool ExecutionManager::is_valid(const CPU& cpu, WORD pc, Block& block)
+{
+    unsigned length = block.code.size() * 2;
+    unsigned version = cpu.get_memory_version(pc) + cpu.get_memory_version(pc + length - 1);
+
+    if (version == block.version)
+    {
+        return true;
+    }
+
+    // A page of the block was written: is the code still the same?
+    for (size_t i = 0; i < block.code.size(); i++)
+    {
+        WORD addr = pc + i * 2;
+
+        if ((cpu.load(addr) << 8 | cpu.load(addr + 1)) != block.code[i].opcode)
+        {
+            this->demote(block);
+
+            return false;
+        }
+    }
+
+    block.version = version;
+
+    return true;
+}
+
+unsigned ExecutionManager::run_loop(CPU& cpu, const Operation& operation, uint64_t budget)
+{
+    CPU::State& state = cpu.get_state();
+    WORD loop = state.pc;
+    WORD jump = 0x1000 | loop;
+    byte x = (operation.opcode & 0x0F00) >> 8;
+    byte value = operation.second & 0x00FF;
+    bool skip_if_equal = (operation.second & 0xF000) == 0x3000;
+    unsigned consumed = 0;
+
+    // Whole iterations only, each cycle as emulate_cycle() would run it
+    while (budget - consumed >= 3)
+    {
+        state.draw_flag = false;
+        state.opcode = operation.opcode;
+
+        if (operation.fusion == Fusion::COUNTED_LOOP)
+        {
+            state.V[x] += operation.opcode & 0x00FF;    // 7XNN
+        }
+        else
+        {
+            state.V[x] = state.delay_timer;             // FX07
+        }
+
+        state.pc += 2;
+        cpu.tick_timers();
+
+        state.draw_flag = false;
+        state.opcode = operation.second;
+        consumed += 2;
+
+        if ((state.V[x] == value) == skip_if_equal)
+        {
+            // Skips the jump: out of the loop
+            state.pc += 4;
+            cpu.tick_timers();
+
+            return consumed;
+        }
+
+        state.pc += 2;
+        cpu.tick_timers();
+
+        state.draw_flag = false;
+        state.opcode = jump;
+        state.pc = loop;
+        cpu.tick_timers();
+        consumed++;
+    }
+
+    return consumed;
+}
+
+bool ExecutionManager::execute(CPU& cpu, Block& block, uint64_t& cycles)
+{
+    CPU::State& state = cpu.get_state();
+    uint64_t consumed = 0;
+
+    if (block.tier == Tier::COMPILED)
+    {
+        for (size_t i = 0; i < block.functions.size(); i++)
+        {
+            block.functions[i](cpu);
+        }
+
+        consumed = block.cycles;
+    }
+
+    for (size_t i = 0; block.tier == Tier::DECODED && i < block.operations.size(); i++)
+    {
+        const Operation& operation = block.operations[i];
+        uint64_t before = consumed;
+
+        switch (operation.fusion)
+        {
+            case Fusion::LOAD_PAIR:
+                // Same as CPU::x6XNN(), twice
+                state.draw_flag = false;
+                state.opcode = operation.opcode;
+                state.V[(operation.opcode & 0x0F00) >> 8] = operation.opcode & 0x00FF;
+                state.pc += 2;
+                cpu.tick_timers();
+
+                state.draw_flag = false;
+                state.opcode = operation.second;
+                state.V[(operation.second & 0x0F00) >> 8] = operation.second & 0x00FF;
+                state.pc += 2;
+                cpu.tick_timers();
+
+                consumed += 2;
+                break;
+            case Fusion::DRAW:
+                // Same as CPU::xANNN(), then DXYN
+                state.draw_flag = false;
+                state.opcode = operation.opcode;
+                state.I = operation.opcode & 0x0FFF;
+                state.pc += 2;
+                cpu.tick_timers();
+
+                cpu.execute_decoded(operation.second, operation.second_handler);
+
+                consumed += 2;
+                break;
+            case Fusion::COUNTED_LOOP:
+            case Fusion::DELAY_WAIT:
+                consumed += this->run_loop(cpu, operation, cycles - consumed);
+                break;
+            default:
+                cpu.execute_decoded(operation.opcode, operation.handler);
+
+                consumed++;
+                break;
+        }
+
+        if (operation.fusion != Fusion::NONE)
+        {
+            this->metrics.fused[(unsigned)operation.fusion]++;
+            this->metrics.fused_cycles[(unsigned)operation.fusion] += consumed - before;
+        }
+    }
+
+    // A fused operation ending the last block of memory carries the PC past 0xFFF (it wraps)
+    state.pc &= CPU::MEMORY_LENGTH_B - 1;
+
+    this->metrics.cycles[(unsigned)block.tier] += consumed;
+    cycles -= consumed;
+
+    // 00E0 and DXYN always set the draw flag
+    return block.draws;
+}
+
+bool ExecutionManager::interpret(CPU& cpu, uint64_t& cycles)
+{
+    const CPU::State& state = cpu.get_state();
+    bool draw = false;
+
+    // Up to the end of the block, as a decoded block would
+    for (unsigned executed = 0; cycles > 0 && !state.halt && executed < ExecutionManager::MAX_BLOCK_LENGTH; executed++)
+    {
+        cpu.emulate_cycle();
+
+        cycles--;
+        this->metrics.cycles[(unsigned)Tier::INTERPRETER]++;
+        draw |= cpu.is_draw_flag_set();
+
+        if (ExecutionManager::ends_block(state.opcode))
+        {
+            break;
+        }
+    }
+
+    return draw;
+}
+
+bool ExecutionManager::run(CPU& cpu, uint64_t cycles)
+{
+    const CPU::State& state = cpu.get_state();
+    bool draw = false;
+
+    this->attach(cpu);
+
+    while (cycles > 0 && !state.halt)
+    {
+        draw |= this->dispatch(cpu, cycles);
+    }
+
+    return draw;
+}
+
+bool ExecutionManager::step(CPU& cpu, uint64_t& cycles)
+{
+    if (cycles == 0 || cpu.get_state().halt)
+    {
+        return false;
+    }
+
+    this->attach(cpu);
+
+    return this->dispatch(cpu, cycles);
+}
+
+bool ExecutionManager::dispatch(CPU& cpu, uint64_t& cycles)
+{
+    const CPU::State& state = cpu.get_state();
+    WORD pc = state.pc % CPU::MEMORY_LENGTH_B;
+    std::unique_ptr<Block>& entry = this->blocks[pc];
+
+    if (!entry)
+    {
+        entry.reset(new Block());
+
+        entry->tier = Tier::INTERPRETER;
+        entry->entries = 0;
+        entry->cycles = 0;
+        entry->version = 0;
+        entry->draws = false;
+        entry->compilable = true;
+    }
+
+    Block& block = *entry;
+
+    block.entries++;
+
+    if ((block.tier == Tier::INTERPRETER && block.entries == this->thresholds.decode) ||
+        (block.tier == Tier::DECODED && block.compilable && this->program != NULL && block.entries >= this->thresholds.compile))
+    {
+        this->promote(cpu, pc, block);
+    }
+
+    if (block.tier != Tier::INTERPRETER && block.cycles <= cycles && this->is_valid(cpu, pc, block))
+    {
+        return this->execute(cpu, block, cycles);
+    }
+
+    return this->interpret(cpu, cycles);
+}
+
+Tier ExecutionManager::get_tier(WORD addr) const
+{
+    const std::unique_ptr<Block>& block = this->blocks[addr % CPU::MEMORY_LENGTH_B];
+
+    return block ? block->tier : Tier::INTERPRETER;
+}
+
+const TierMetrics& ExecutionManager::get_metrics() const
+{
+    return this->metrics;
+}
+
+void ExecutionManager::print_metrics(std::ostream& out) const
+{
+    ExecutionManager::print_metrics(out, this->metrics);
+}
+
+void ExecutionManager::print_metrics(std::ostream& out, const TierMetrics& metrics)
+{
+    char line[96];
+
+    out << "Tier         Cycles                Promotions  Blocks" << std::endl;
+
+    for (unsigned tier = 0; tier < TierMetrics::TIERS; tier++)
+    {
+        snprintf(line, sizeof(line), "%-11s  %20llu  %10llu  %6u", ExecutionManager::tier_name((Tier)tier),
+                 (unsigned long long)metrics.cycles[tier], (unsigned long long)metrics.promotions[tier],
+                 metrics.blocks[tier]);
+
+        out << line << std::endl;
+    }
+
+    out << "Invalidations: " << metrics.invalidations << std::endl;
+    out << "Fusion        Fired                 Cycles" << std::endl;
+
+    for (unsigned fusion = 1; fusion < TierMetrics::FUSIONS; fusion++)
+    {
+        snprintf(line, sizeof(line), "%-12s  %20llu  %20llu", ExecutionManager::fusion_name((Fusion)fusion),
+                 (unsigned long long)metrics.fused[fusion], (unsigned long long)metrics.fused_cycles[fusion]);
+
+        out << line << std::endl;
+    }
+}
@@ -0,0 +1,242 @@
+#include "frame_delta.h"
+
+#include <cstring>
+
+// Pushed into vectors (taken by reference), so they need a definition
+const byte FrameDeltaEncoder::KEYFRAME;
+const byte FrameDeltaEncoder::DELTA;
+
+static void put_u32(std::vector<byte>& output, uint32_t value)
+{
+    for (unsigned i = 0; i < 4; i++)
+    {
+        output.push_back((byte)(value >> (8 * i)));
+    }
+}
+
+static uint32_t get_u32(const byte* input)
+{
+    return (uint32_t)input[0] | (uint32_t)input[1] << 8 | (uint32_t)input[2] << 16 | (uint32_t)input[3] << 24;
+}
+
+FrameDeltaEncoder::FrameDeltaEncoder()
+{
+    this->reset();
+}
+
+// Back to a blank screen at frame 0 (e.g. after the CPU was reinitializated)
+void FrameDeltaEncoder::reset()
+{
+    memset(this->rows, 0, sizeof(this->rows));
+    this->frame = 0;
+}
+
+// A row of the display (a byte per pixel) as 64 bits, leftmost pixel in the most significant bit
+uint64_t FrameDeltaEncoder::pack_row(const byte* pixels)
+{
+    uint64_t row = 0;
+
+    for (unsigned col = 0; col < CPU::WIDTH; col++)
+    {
+        row = row << 1 | (pixels[col] & 1);
+    }
+
+    return row;
+}
+
+/*
+ * Appends the delta from the last frame encoded to gfx, only looking at the rows in dirty_rows.
+ * Returns false (and appends nothing) if no pixel changed.
+ */
+bool FrameDeltaEncoder::encode(const byte* gfx, uint32_t dirty_rows, uint32_t current_frame, std::vector<byte>& output)
+{
+    uint64_t changes[CPU::HEIGHT];
+    uint32_t changed = 0;
+
+    for (unsigned row = 0; row < CPU::HEIGHT; row++)
+    {
+        if ((dirty_rows >> row & 1) == 0)
+        {
+            continue;
+        }
+
+        uint64_t packed = FrameDeltaEncoder::pack_row(gfx + row * CPU::WIDTH);
+
+        changes[row] = packed ^ this->rows[row];
+        changed |= (uint32_t)(changes[row] != 0) << row;
+        this->rows[row] = packed;
+    }
+
+    this->frame = current_frame;
+
+    if (changed == 0)
+    {
+        return false;
+    }
+
+    output.push_back(FrameDeltaEncoder::DELTA);
+    put_u32(output, current_frame);
+    put_u32(output, changed);
+
+    for (unsigned row = 0; row < CPU::HEIGHT; row++)
+    {
+        if ((changed >> row & 1) == 0)
+        {
+            continue;
+        }
+
+        size_t mask_at = output.size();
+        byte mask = 0;
+
+        output.push_back(0);
+
+        for (unsigned b = 0; b < FrameDeltaEncoder::ROW_BYTES; b++)
+        {
+            byte value = (byte)(changes[row] >> (56 - 8 * b));
+
+            if (value != 0)
+            {
+                mask |= 0x80 >> b;
+                output.push_back(value);
+            }
+        }
+
+        output[mask_at] = mask;
+    }
+
+    return true;
+}
+
+// Appends the last frame encoded, whole
+void FrameDeltaEncoder::keyframe(std::vector<byte>& output) const
+{
+    output.push_back(FrameDeltaEncoder::KEYFRAME);
+    put_u32(output, this->frame);
+
+    for (unsigned row = 0; row < CPU::HEIGHT; row++)
+    {
+        for (unsigned b = 0; b < FrameDeltaEncoder::ROW_BYTES; b++)
+        {
+            output.push_back((byte)(this->rows[row] >> (56 - 8 * b)));
+        }
+    }
+}
+
+uint32_t FrameDeltaEncoder::get_frame() const
+{
+    return this->frame;
+}
+
+FrameDeltaDecoder::FrameDeltaDecoder() :
+    frame(0),
+    synced(false)
+{
+    memset(this->rows, 0, sizeof(this->rows));
+}
+
+// Applies a keyframe or a delta. Returns false if the message is malformed or is a delta before any keyframe.
+bool FrameDeltaDecoder::apply(const byte* message, size_t length)
+{
+    if (length >= FrameDeltaEncoder::KEYFRAME_SIZE && message[0] == FrameDeltaEncoder::KEYFRAME)
+    {
+        const byte* input = message + 5;
+
+        for (unsigned row = 0; row < CPU::HEIGHT; row++)
+        {
+            uint64_t packed = 0;
+
+            for (unsigned b = 0; b < FrameDeltaEncoder::ROW_BYTES; b++)
+            {
+                packed = packed << 8 | *input++;
+            }
+
+            this->rows[row] = packed;
+        }
+
+        this->frame = get_u32(message + 1);
+        this->synced = true;
+
+        return true;
+    }
+
+    if (length < 9 || message[0] != FrameDeltaEncoder::DELTA || !this->synced)
+    {
+        return false;
+    }
+
+    uint32_t changed = get_u32(message + 5);
+    size_t position = 9;
+
+    // Checked whole before applying anything, so a bad message leaves the frame as it was
+    for (unsigned pass = 0; pass < 2; pass++)
+    {
+        position = 9;
+
+        for (unsigned row = 0; row < CPU::HEIGHT; row++)
+        {
+            if ((changed >> row & 1) == 0)
+            {
+                continue;
+            }
+
+            if (position >= length)
+            {
+                return false;
+            }
+
+            byte mask = message[position++];
+            uint64_t change = 0;
+
+            for (unsigned b = 0; b < FrameDeltaEncoder::ROW_BYTES; b++)
+            {
+                if ((mask & (0x80 >> b)) == 0)
+                {
+                    continue;
+                }
+
+                if (position >= length)
+                {
+                    return false;
+                }
+
+                change |= (uint64_t)message[position++] << (56 - 8 * b);
+            }
+
+            if (pass == 1)
+            {
+                this->rows[row] ^= change;
+            }
+        }
+
+        if (position != length)
+        {
+            return false;
+        }
+    }
+
+    this->frame = get_u32(message + 1);
+
+    return true;
+}
+
+bool FrameDeltaDecoder::is_synced() const
+{
+    return this->synced;
+}
+
+uint32_t FrameDeltaDecoder::get_frame() const
+{
+    return this->frame;
+}
+
+// The frame as the display buffer (a byte per pixel, 0 or 1)
+void FrameDeltaDecoder::get_gfx(byte* gfx) const
+{
+    for (unsigned row = 0; row < CPU::HEIGHT; row++)
+    {
+        for (unsigned col = 0; col < CPU::WIDTH; col++)
+        {
+            gfx[row * CPU::WIDTH + col] = (byte)(this->rows[row] >> (CPU::WIDTH - 1 - col) & 1);
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include "frame_pacer.h"
+
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+const double FramePacer::DEFAULT_FREQUENCY = 60.0;
+
+// Bounds of the spin margin of LOW_LATENCY
+const FramePacer::Clock::duration MIN_MARGIN = std::chrono::microseconds(200);
+const FramePacer::Clock::duration MAX_MARGIN = std::chrono::milliseconds(4);
+
+FramePacer::FramePacer(double frequency, PacingMode pacing_mode) :
+    period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frequency))),
+    mode(pacing_mode),
+    margin(std::chrono::milliseconds(1)),
+    frames(0),
+    overruns(0),
+    resyncs(0),
+    next_sample(0)
+{
+    this->samples.reserve(FramePacer::WINDOW);
+    this->start();
+}
+
+void FramePacer::start()
+{
+    this->last = Clock::now();
+    this->deadline = this->last + this->period;
+}
+
+// Waits for the end of the current frame. Returns false if its deadline had already passed.
+bool FramePacer::wait()
+{
+    Clock::time_point now = Clock::now();
+    bool in_time = now <= this->deadline;
+
+    if (in_time)
+    {
+        this->sleep_until(this->deadline);
+
+        now = Clock::now();
+    }
+    else
+    {
+        this->overruns++;
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>(now - this->last).count();
+
+    if (this->samples.size() < FramePacer::WINDOW)
+    {
+        this->samples.push_back(elapsed);
+    }
+    else
+    {
+        this->samples[this->next_sample] = elapsed;
+        this->next_sample = (this->next_sample + 1) % FramePacer::WINDOW;
+    }
+
+    this->frames++;
+    this->last = now;
+    this->deadline += this->period;
+
+    if (now - this->deadline > this->period * (int)FramePacer::MAX_LATE_FRAMES)
+    {
+        this->resyncs++;
+        this->deadline = now + this->period;
+    }
+
+    return in_time;
+}
+
+void FramePacer::sleep_until(Clock::time_point target)
+{
+    if (this->mode == PacingMode::LOW_POWER)
+    {
+        std::this_thread::sleep_until(target);
+
+        return;
+    }
+
+    Clock::time_point wake = target - this->margin;
+
+    if (Clock::now() < wake)
+    {
+        std::this_thread::sleep_until(wake);
+
+        // Keep the margin a bit over how late the thread woke up (moving average)
+        Clock::duration late = Clock::now() - wake;
+        Clock::duration wanted = late + late / 2 + MIN_MARGIN;
+
+        this->margin = std::min(MAX_MARGIN, std::max(MIN_MARGIN, (this->margin * 7 + wanted) / 8));
+    }
+
+    while (Clock::now() < target)
+    {
+        std::this_thread::yield();
+    }
+}
+
+PacingMode FramePacer::get_mode() const
+{
+    return this->mode;
+}
+
+void FramePacer::set_mode(PacingMode pacing_mode)
+{
+    this->mode = pacing_mode;
+}
+
+FramePacer::Clock::duration FramePacer::get_period() const
+{
+    return this->period;
+}
+
+PacerStats FramePacer::get_stats() const
+{
+    PacerStats stats = {this->frames, this->overruns, this->resyncs, 0, 0, 0, 0, 0, 0};
+
+    if (this->samples.empty())
+    {
+        return stats;
+    }
+
+    std::vector<double> sorted(this->samples);
+    double variance = 0;
+
+    std::sort(sorted.begin(), sorted.end());
+
+    for (double sample : sorted)
+    {
+        stats.mean += sample;
+    }
+
+    stats.mean /= sorted.size();
+
+    for (double sample : sorted)
+    {
+        variance += (sample - stats.mean) * (sample - stats.mean);
+    }
+
+    stats.p50 = sorted[(sorted.size() - 1) * 50 / 100];
+    stats.p95 = sorted[(sorted.size() - 1) * 95 / 100];
+    stats.p99 = sorted[(sorted.size() - 1) * 99 / 100];
+    stats.max = sorted.back();
+    stats.jitter = std::sqrt(variance / sorted.size());
+
+    return stats;
+}
+
+void FramePacer::print_stats(std::ostream& output) const
+{
+    PacerStats stats = this->get_stats();
+    char line[256];
+
+    snprintf(line, sizeof(line), "Frame pacing (%s, %.3f ms): %llu frames, %llu overrun(s), %llu resync(s)",
+             FramePacer::mode_name(this->mode), std::chrono::duration<double, std::milli>(this->period).count(),
+             (unsigned long long)stats.frames, (unsigned long long)stats.overruns, (unsigned long long)stats.resyncs);
+    output << line << std::endl;
+
+    snprintf(line, sizeof(line), "Frame time (ms): mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f, jitter %.3f",
+             stats.mean, stats.p50, stats.p95, stats.p99, stats.max, stats.jitter);
+    output << line << std::endl;
+}
+
+const char* FramePacer::mode_name(PacingMode pacing_mode)
+{
+    switch (pacing_mode)
+    {
+        case PacingMode::LOW_LATENCY:
+            return "low latency";
+        case PacingMode::LOW_POWER:
+            return "low power";
+    }
+
+    return "unknown";
+}
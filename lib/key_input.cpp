@@ -0,0 +1,79 @@
+#include "key_input.h"
+
+static_assert((KeyInput::QUEUE_SIZE & (KeyInput::QUEUE_SIZE - 1)) == 0, "The queue size must be a power of two");
+
+KeyInput::KeyInput() :
+    mask(0),
+    head(0),
+    tail(0)
+{
+
+}
+
+void KeyInput::press(byte key)
+{
+    WORD bit = 1 << (key & 0x0F);
+
+    // Held keys repeat: only the first press is an edge
+    if ((this->mask.fetch_or(bit) & bit) == 0)
+    {
+        this->push(key & 0x0F, true);
+    }
+}
+
+void KeyInput::release(byte key)
+{
+    WORD bit = 1 << (key & 0x0F);
+
+    if ((this->mask.fetch_and((WORD)~bit) & bit) != 0)
+    {
+        this->push(key & 0x0F, false);
+    }
+}
+
+void KeyInput::push(byte key, bool pressed)
+{
+    unsigned tail = this->tail.load(std::memory_order_relaxed);
+
+    if (tail - this->head.load(std::memory_order_acquire) == KeyInput::QUEUE_SIZE)
+    {
+        return;
+    }
+
+    this->queue[tail & (KeyInput::QUEUE_SIZE - 1)].key = key;
+    this->queue[tail & (KeyInput::QUEUE_SIZE - 1)].pressed = pressed;
+    this->tail.store(tail + 1, std::memory_order_release);
+}
+
+WORD KeyInput::get_mask() const
+{
+    return this->mask.load(std::memory_order_acquire);
+}
+
+bool KeyInput::poll(KeyEdge& edge)
+{
+    unsigned head = this->head.load(std::memory_order_relaxed);
+
+    if (head == this->tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    edge = this->queue[head & (KeyInput::QUEUE_SIZE - 1)];
+    this->head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+// Replays the pending edges on the CPU, then syncs it with the current mask (covers dropped edges)
+void KeyInput::apply(CPU& cpu)
+{
+    KeyEdge edge;
+
+    while (this->poll(edge))
+    {
+        cpu.key_event(edge.key, edge.pressed);
+    }
+
+    cpu.update_pressed_keys(this->get_mask());
+}
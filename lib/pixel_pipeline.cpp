@@ -0,0 +1,338 @@
+#include "pixel_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHIP8_PIXEL_PIPELINE_X86
+#include <immintrin.h>
+#endif
+
+const Palette PixelPipeline::DEFAULT_PALETTE = {0xFF000000, 0xFFFFFFFF};
+
+static_assert(CPU::GFX_LENGTH % 32 == 0, "The kernels expand 32 pixels at a time");
+
+// Scalar kernels (the reference for the others)
+static void expand_scalar(const byte* gfx, const Palette& palette, uint32_t* out)
+{
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        out[i] = gfx[i] ? palette.on : palette.off;
+    }
+}
+
+static void expand_packed_scalar(const byte* packed, const Palette& palette, uint32_t* out)
+{
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        out[i] = (packed[i / 8] >> (7 - i % 8)) & 1 ? palette.on : palette.off;
+    }
+}
+
+#ifdef CHIP8_PIXEL_PIPELINE_X86
+
+// 16 pixels per iteration: a byte mask (0x00 or 0xFF) widened to 4 x 4 lanes of 32 bits
+__attribute__((target("sse2")))
+static void expand_sse2(const byte* gfx, const Palette& palette, uint32_t* out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i on = _mm_set1_epi32(palette.on);
+    const __m128i off = _mm_set1_epi32(palette.off);
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gfx + i));
+        __m128i mask = _mm_xor_si128(_mm_cmpeq_epi8(bytes, zero), _mm_set1_epi8(-1));
+        __m128i low = _mm_unpacklo_epi8(mask, mask);
+        __m128i high = _mm_unpackhi_epi8(mask, mask);
+        __m128i lanes[4] = {_mm_unpacklo_epi16(low, low), _mm_unpackhi_epi16(low, low),
+                            _mm_unpacklo_epi16(high, high), _mm_unpackhi_epi16(high, high)};
+
+        for (unsigned l = 0; l < 4; l++)
+        {
+            __m128i pixels = _mm_or_si128(_mm_and_si128(lanes[l], on), _mm_andnot_si128(lanes[l], off));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4 * l), pixels);
+        }
+    }
+}
+
+// 8 pixels per packed byte: the byte in every lane, each lane testing its own bit
+__attribute__((target("sse2")))
+static void expand_packed_sse2(const byte* packed, const Palette& palette, uint32_t* out)
+{
+    const __m128i on = _mm_set1_epi32(palette.on);
+    const __m128i off = _mm_set1_epi32(palette.off);
+    const __m128i bits_high = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+    const __m128i bits_low = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH / 8; i++)
+    {
+        __m128i value = _mm_set1_epi32(packed[i]);
+        __m128i high = _mm_cmpeq_epi32(_mm_and_si128(value, bits_high), bits_high);
+        __m128i low = _mm_cmpeq_epi32(_mm_and_si128(value, bits_low), bits_low);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8 * i),
+                         _mm_or_si128(_mm_and_si128(high, on), _mm_andnot_si128(high, off)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8 * i + 4),
+                         _mm_or_si128(_mm_and_si128(low, on), _mm_andnot_si128(low, off)));
+    }
+}
+
+// 8 pixels per step: bytes zero-extended to 32 bits, compared and blended
+__attribute__((target("avx2")))
+static void expand_avx2(const byte* gfx, const Palette& palette, uint32_t* out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i on = _mm256_set1_epi32(palette.on);
+    const __m256i off = _mm256_set1_epi32(palette.off);
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i += 8)
+    {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(gfx + i));
+        __m256i empty = _mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(bytes), zero);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_blendv_epi8(on, off, empty));
+    }
+}
+
+__attribute__((target("avx2")))
+static void expand_packed_avx2(const byte* packed, const Palette& palette, uint32_t* out)
+{
+    const __m256i on = _mm256_set1_epi32(palette.on);
+    const __m256i off = _mm256_set1_epi32(palette.off);
+    const __m256i bits = _mm256_set_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH / 8; i++)
+    {
+        __m256i value = _mm256_set1_epi32(packed[i]);
+        __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(value, bits), bits);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8 * i), _mm256_blendv_epi8(off, on, set));
+    }
+}
+
+#endif
+
+PixelPipeline::PixelPipeline(PixelKernel pixel_kernel) :
+    kernel(PixelPipeline::is_supported(pixel_kernel) ? pixel_kernel : PixelKernel::SCALAR)
+{
+
+}
+
+PixelKernel PixelPipeline::get_kernel() const
+{
+    return this->kernel;
+}
+
+void PixelPipeline::expand(const byte* gfx, const Palette& palette, uint32_t* out) const
+{
+    switch (this->kernel)
+    {
+        #ifdef CHIP8_PIXEL_PIPELINE_X86
+        case PixelKernel::AVX2:
+            expand_avx2(gfx, palette, out);
+            return;
+        case PixelKernel::SSE2:
+            expand_sse2(gfx, palette, out);
+            return;
+        #endif
+        default:
+            expand_scalar(gfx, palette, out);
+            return;
+    }
+}
+
+void PixelPipeline::expand_packed(const byte* packed, const Palette& palette, uint32_t* out) const
+{
+    switch (this->kernel)
+    {
+        #ifdef CHIP8_PIXEL_PIPELINE_X86
+        case PixelKernel::AVX2:
+            expand_packed_avx2(packed, palette, out);
+            return;
+        case PixelKernel::SSE2:
+            expand_packed_sse2(packed, palette, out);
+            return;
+        #endif
+        default:
+            expand_packed_scalar(packed, palette, out);
+            return;
+    }
+}
+
+// Output: WIDTH * factor x HEIGHT * factor pixels (factor 2 and 3 only for Scale2x and Scale3x)
+void PixelPipeline::render(const byte* gfx, const Palette& palette, PixelScaler scaler, unsigned factor, uint32_t* out)
+{
+    if (scaler == PixelScaler::NEAREST && factor == 1)
+    {
+        this->expand(gfx, palette, out);
+
+        return;
+    }
+
+    this->expand(gfx, palette, this->pixels);
+
+    switch (scaler)
+    {
+        case PixelScaler::NEAREST:
+            PixelPipeline::scale_nearest(this->pixels, CPU::WIDTH, CPU::HEIGHT, factor, out);
+            break;
+        case PixelScaler::SCALE2X:
+            PixelPipeline::scale2x(this->pixels, CPU::WIDTH, CPU::HEIGHT, out);
+            break;
+        case PixelScaler::SCALE3X:
+            PixelPipeline::scale3x(this->pixels, CPU::WIDTH, CPU::HEIGHT, out);
+            break;
+    }
+}
+
+// Each source row is widened once, then copied to the other factor - 1 rows
+void PixelPipeline::scale_nearest(const uint32_t* in, unsigned width, unsigned height, unsigned factor, uint32_t* out)
+{
+    const unsigned out_width = width * factor;
+
+    for (unsigned row = 0; row < height; row++)
+    {
+        uint32_t* first = out + row * factor * out_width;
+
+        for (unsigned col = 0; col < width; col++)
+        {
+            std::fill_n(first + col * factor, factor, in[row * width + col]);
+        }
+
+        for (unsigned copy = 1; copy < factor; copy++)
+        {
+            memcpy(first + copy * out_width, first, out_width * sizeof(uint32_t));
+        }
+    }
+}
+
+/*
+ * Scale2x: every pixel E becomes 2x2 from its neighbours (edges repeat the border pixel)
+ *
+ *    A B C
+ *    D E F   ->   E0 E1
+ *    G H I        E2 E3
+ */
+void PixelPipeline::scale2x(const uint32_t* in, unsigned width, unsigned height, uint32_t* out)
+{
+    const unsigned out_width = width * 2;
+
+    for (unsigned row = 0; row < height; row++)
+    {
+        const uint32_t* above = in + (row > 0 ? row - 1 : row) * width;
+        const uint32_t* line = in + row * width;
+        const uint32_t* below = in + (row + 1 < height ? row + 1 : row) * width;
+        uint32_t* top = out + 2 * row * out_width;
+        uint32_t* bottom = top + out_width;
+
+        for (unsigned col = 0; col < width; col++)
+        {
+            unsigned left = col > 0 ? col - 1 : col;
+            unsigned right = col + 1 < width ? col + 1 : col;
+            uint32_t B = above[col], D = line[left], E = line[col], F = line[right], H = below[col];
+
+            if (B != H && D != F)
+            {
+                top[2 * col] = D == B ? D : E;
+                top[2 * col + 1] = B == F ? F : E;
+                bottom[2 * col] = D == H ? D : E;
+                bottom[2 * col + 1] = H == F ? F : E;
+            }
+            else
+            {
+                top[2 * col] = top[2 * col + 1] = bottom[2 * col] = bottom[2 * col + 1] = E;
+            }
+        }
+    }
+}
+
+// Scale3x: same neighbourhood as Scale2x, every pixel becomes 3x3 (E0 .. E8, row by row)
+void PixelPipeline::scale3x(const uint32_t* in, unsigned width, unsigned height, uint32_t* out)
+{
+    const unsigned out_width = width * 3;
+
+    for (unsigned row = 0; row < height; row++)
+    {
+        const uint32_t* above = in + (row > 0 ? row - 1 : row) * width;
+        const uint32_t* line = in + row * width;
+        const uint32_t* below = in + (row + 1 < height ? row + 1 : row) * width;
+        uint32_t* rows[3] = {out + 3 * row * out_width, out + (3 * row + 1) * out_width, out + (3 * row + 2) * out_width};
+
+        for (unsigned col = 0; col < width; col++)
+        {
+            unsigned left = col > 0 ? col - 1 : col;
+            unsigned right = col + 1 < width ? col + 1 : col;
+            uint32_t A = above[left], B = above[col], C = above[right];
+            uint32_t D = line[left], E = line[col], F = line[right];
+            uint32_t G = below[left], H = below[col], I = below[right];
+            uint32_t* r0 = rows[0] + 3 * col;
+            uint32_t* r1 = rows[1] + 3 * col;
+            uint32_t* r2 = rows[2] + 3 * col;
+
+            if (B != H && D != F)
+            {
+                r0[0] = D == B ? D : E;
+                r0[1] = (D == B && E != C) || (B == F && E != A) ? B : E;
+                r0[2] = B == F ? F : E;
+                r1[0] = (D == B && E != G) || (D == H && E != A) ? D : E;
+                r1[1] = E;
+                r1[2] = (B == F && E != I) || (H == F && E != C) ? F : E;
+                r2[0] = D == H ? D : E;
+                r2[1] = (D == H && E != I) || (H == F && E != G) ? H : E;
+                r2[2] = H == F ? F : E;
+            }
+            else
+            {
+                r0[0] = r0[1] = r0[2] = r1[0] = r1[1] = r1[2] = r2[0] = r2[1] = r2[2] = E;
+            }
+        }
+    }
+}
+
+bool PixelPipeline::is_supported(PixelKernel pixel_kernel)
+{
+    switch (pixel_kernel)
+    {
+        case PixelKernel::SCALAR:
+            return true;
+        #ifdef CHIP8_PIXEL_PIPELINE_X86
+        case PixelKernel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case PixelKernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        #endif
+        default:
+            return false;
+    }
+}
+
+PixelKernel PixelPipeline::best_kernel()
+{
+    if (PixelPipeline::is_supported(PixelKernel::AVX2))
+    {
+        return PixelKernel::AVX2;
+    }
+    if (PixelPipeline::is_supported(PixelKernel::SSE2))
+    {
+        return PixelKernel::SSE2;
+    }
+
+    return PixelKernel::SCALAR;
+}
+
+const char* PixelPipeline::kernel_name(PixelKernel pixel_kernel)
+{
+    switch (pixel_kernel)
+    {
+        case PixelKernel::SCALAR:
+            return "scalar";
+        case PixelKernel::SSE2:
+            return "sse2";
+        case PixelKernel::AVX2:
+            return "avx2";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,339 @@
+#include "rollback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t NO_FRAME = 0xFFFFFFFF;
+
+RollbackSession::RollbackSession(const std::shared_ptr<const CPU::Image>& image, DWORD seed, unsigned cycles,
+                                 unsigned delay) :
+    snapshots(RollbackSession::MAX_ROLLBACK + 1),
+    cycles_per_frame(cycles),
+    input_delay(delay < RollbackSession::MAX_INPUT_DELAY ? delay : RollbackSession::MAX_INPUT_DELAY),
+    frame(0),
+    confirmed(0),
+    rollback_to(0),
+    retired(0),
+    last_remote(0),
+    next_checkpoint(0),
+    newest_checkpoint(0),
+    stats(),
+    late_sum(0),
+    snapshots_taken(0),
+    snapshot_time(0),
+    resimulation_time(0)
+{
+    this->cpu.initializate();
+    this->cpu.load_image(image);
+    this->cpu.seed(seed);
+
+    memset(this->inputs, 0, sizeof(this->inputs));
+
+    // The first input_delay frames run with no local keys
+    this->local_frames = this->input_delay;
+
+    for (unsigned i = 0; i < 4; i++)
+    {
+        this->checkpoints[i].frame = NO_FRAME;
+        this->checkpoints[i].hash = 0;
+    }
+}
+
+RollbackSession::FrameInput& RollbackSession::input(uint32_t input_frame)
+{
+    return this->inputs[input_frame % RollbackSession::INPUT_WINDOW];
+}
+
+const RollbackSession::FrameInput& RollbackSession::input(uint32_t input_frame) const
+{
+    return this->inputs[input_frame % RollbackSession::INPUT_WINDOW];
+}
+
+uint32_t RollbackSession::get_frame() const
+{
+    return this->frame;
+}
+
+uint32_t RollbackSession::get_confirmed_frame() const
+{
+    return this->confirmed;
+}
+
+// Local keys for the next frame without one (get_frame() + input delay). Once per frame.
+void RollbackSession::set_local_input(WORD mask)
+{
+    if (this->local_frames > this->frame + this->input_delay)
+    {
+        return;
+    }
+
+    this->input(this->local_frames).local = mask;
+    this->local_frames++;
+}
+
+// Local input of a frame, to send it (the last INPUT_WINDOW frames are kept)
+bool RollbackSession::get_local_input(uint32_t input_frame, WORD& mask) const
+{
+    if (input_frame >= this->local_frames || input_frame + RollbackSession::INPUT_WINDOW < this->local_frames)
+    {
+        return false;
+    }
+
+    mask = this->input(input_frame).local;
+
+    return true;
+}
+
+uint32_t RollbackSession::get_local_frames() const
+{
+    return this->local_frames;
+}
+
+// Remote input of a frame, in any order and any number of times
+void RollbackSession::add_remote_input(uint32_t input_frame, WORD mask)
+{
+    if (input_frame < this->confirmed || input_frame >= this->retired + RollbackSession::INPUT_WINDOW)
+    {
+        return;
+    }
+
+    FrameInput& current = this->input(input_frame);
+
+    if (current.received)
+    {
+        return;
+    }
+
+    unsigned late = input_frame < this->frame ? this->frame - input_frame : 0;
+
+    this->stats.remote_inputs++;
+    this->stats.late_max = std::max(this->stats.late_max, late);
+    this->late_sum += late;
+
+    // Already run with a prediction: if it was wrong, everything from there runs again
+    if (input_frame < this->frame && current.remote != mask)
+    {
+        this->stats.mispredictions++;
+        this->rollback_to = std::min(this->rollback_to, input_frame);
+    }
+
+    current.remote = mask;
+    current.received = true;
+
+    while (this->input(this->confirmed).received && this->confirmed < this->retired + RollbackSession::INPUT_WINDOW)
+    {
+        this->last_remote = this->input(this->confirmed).remote;
+        this->confirmed++;
+    }
+}
+
+// False while the remote inputs are MAX_ROLLBACK frames behind (there'd be no snapshot to go back to)
+bool RollbackSession::can_advance() const
+{
+    return this->frame < this->confirmed + RollbackSession::MAX_ROLLBACK;
+}
+
+// Fixes the past if needed and runs the next frame
+bool RollbackSession::advance()
+{
+    if (!this->can_advance())
+    {
+        this->stats.stalls++;
+
+        return false;
+    }
+
+    this->synchronize();
+    this->record_checkpoints();
+
+    // No local input for this frame: the keys stay as they were
+    if (this->local_frames <= this->frame)
+    {
+        this->set_local_input(this->local_frames > 0 ? this->input(this->local_frames - 1).local : 0);
+    }
+
+    this->save(this->frame);
+    this->run(this->frame);
+
+    this->frame++;
+    this->rollback_to = this->frame;
+    this->stats.frames++;
+
+    return true;
+}
+
+// Goes back to the earliest mispredicted frame (if any) and runs again up to the present
+void RollbackSession::synchronize()
+{
+    if (this->rollback_to < this->frame)
+    {
+        Clock::time_point start = Clock::now();
+        unsigned depth = this->frame - this->rollback_to;
+
+        // The snapshot of rollback_to is right (the frames before it didn't change)
+        this->cpu = this->snapshots[this->rollback_to % this->snapshots.size()];
+
+        for (uint32_t current = this->rollback_to; current < this->frame; current++)
+        {
+            if (current > this->rollback_to)
+            {
+                this->save(current);
+            }
+
+            this->run(current);
+        }
+
+        double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        this->stats.rollbacks++;
+        this->stats.resimulated += depth;
+        this->stats.depth_max = std::max(this->stats.depth_max, depth);
+        this->stats.resimulation_max = std::max(this->stats.resimulation_max, elapsed);
+        this->resimulation_time += elapsed;
+        this->rollback_to = this->frame;
+    }
+
+    // Remote inputs nothing can go back to anymore
+    for (; this->retired < std::min(this->confirmed, this->frame); this->retired++)
+    {
+        this->input(this->retired).remote = 0;
+        this->input(this->retired).received = false;
+    }
+}
+
+const CPU& RollbackSession::get_cpu() const
+{
+    return this->cpu;
+}
+
+void RollbackSession::save(uint32_t snapshot_frame)
+{
+    Clock::time_point start = Clock::now();
+
+    // Copy assignment reuses the memory pages the snapshot already has
+    this->snapshots[snapshot_frame % this->snapshots.size()] = this->cpu;
+
+    this->snapshot_time += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    this->snapshots_taken++;
+}
+
+void RollbackSession::run(uint32_t run_frame)
+{
+    FrameInput& current = this->input(run_frame);
+
+    if (!current.received)
+    {
+        current.remote = this->last_remote;
+    }
+
+    this->cpu.update_pressed_keys((WORD)(current.local | current.remote));
+
+    for (unsigned cycle = 0; cycle < this->cycles_per_frame; cycle++)
+    {
+        this->cpu.emulate_cycle();
+    }
+}
+
+// Hashes of the frames (multiples of CHECK_INTERVAL) whose inputs became all known
+void RollbackSession::record_checkpoints()
+{
+    uint32_t limit = std::min(this->confirmed, this->frame);
+
+    for (; this->next_checkpoint <= limit; this->next_checkpoint += RollbackSession::CHECK_INTERVAL)
+    {
+        uint32_t checkpoint_frame = this->next_checkpoint;
+        uint64_t hash;
+
+        if (checkpoint_frame == this->frame)
+        {
+            hash = this->cpu.get_state_hash();
+        }
+        else if (checkpoint_frame + this->snapshots.size() > this->frame)
+        {
+            hash = this->snapshots[checkpoint_frame % this->snapshots.size()].get_state_hash();
+        }
+        else
+        {
+            continue;
+        }
+
+        this->newest_checkpoint = (this->newest_checkpoint + 1) % 4;
+        this->checkpoints[this->newest_checkpoint].frame = checkpoint_frame;
+        this->checkpoints[this->newest_checkpoint].hash = hash;
+    }
+}
+
+// Newest checkpoint, to send it to the peer
+bool RollbackSession::get_checkpoint(uint32_t& checkpoint_frame, uint64_t& hash) const
+{
+    const Checkpoint& newest = this->checkpoints[this->newest_checkpoint];
+
+    if (newest.frame == NO_FRAME)
+    {
+        return false;
+    }
+
+    checkpoint_frame = newest.frame;
+    hash = newest.hash;
+
+    return true;
+}
+
+// Compares a checkpoint of the peer with ours. False if they differ (the peers desynced).
+bool RollbackSession::check_remote(uint32_t checkpoint_frame, uint64_t hash)
+{
+    for (unsigned i = 0; i < 4; i++)
+    {
+        if (this->checkpoints[i].frame == checkpoint_frame)
+        {
+            this->stats.checks++;
+
+            if (this->checkpoints[i].hash != hash)
+            {
+                this->stats.desyncs++;
+
+                return false;
+            }
+
+            return true;
+        }
+    }
+
+    return true;
+}
+
+RollbackStats RollbackSession::get_stats() const
+{
+    RollbackStats current = this->stats;
+
+    current.late_mean = current.remote_inputs > 0 ? (double)this->late_sum / current.remote_inputs : 0;
+    current.resimulation_mean = current.rollbacks > 0 ? this->resimulation_time / current.rollbacks : 0;
+    current.snapshot_mean = this->snapshots_taken > 0 ? this->snapshot_time / this->snapshots_taken : 0;
+
+    return current;
+}
+
+void RollbackSession::print_stats(std::ostream& output, const RollbackStats& stats)
+{
+    char line[256];
+
+    snprintf(line, sizeof(line), "Rollback: %llu frames, %llu stall(s), %llu rollback(s) (max. %u frames back), "
+             "%llu frame(s) resimulated, %llu of %llu remote input(s) mispredicted",
+             (unsigned long long)stats.frames, (unsigned long long)stats.stalls, (unsigned long long)stats.rollbacks,
+             stats.depth_max, (unsigned long long)stats.resimulated, (unsigned long long)stats.mispredictions,
+             (unsigned long long)stats.remote_inputs);
+    output << line << std::endl;
+
+    snprintf(line, sizeof(line), "Latency hidden: remote inputs %.2f frames late on average (max. %u); "
+             "resimulation %.3f ms per rollback (max. %.3f), snapshot %.2f us",
+             stats.late_mean, stats.late_max, stats.resimulation_mean, stats.resimulation_max, stats.snapshot_mean);
+    output << line << std::endl;
+
+    snprintf(line, sizeof(line), "Checkpoints: %llu compared, %llu desync(s)", (unsigned long long)stats.checks,
+             (unsigned long long)stats.desyncs);
+    output << line << std::endl;
+}
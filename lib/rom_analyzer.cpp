@@ -0,0 +1,671 @@
+#include "rom_analyzer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+namespace
+{
+    // Values of I during the analysis (anything else is a known address)
+    const int I_NOT_REACHED = -2;
+    const int I_UNKNOWN = -1;
+
+    int merge(int a, int b)
+    {
+        if (a == I_NOT_REACHED)
+        {
+            return b;
+        }
+
+        if (b == I_NOT_REACHED || a == b)
+        {
+            return a;
+        }
+
+        return I_UNKNOWN;
+    }
+}
+
+unsigned BasicBlock::get_length() const
+{
+    return (this->end - this->begin) / 2;
+}
+
+RomAnalyzer::RomAnalyzer() :
+    complete(false)
+{
+    memset(this->memory, 0, CPU::MEMORY_LENGTH_B * sizeof(byte));
+    memset(this->code, 0, CPU::MEMORY_LENGTH_B * sizeof(bool));
+    memset(this->leader, 0, CPU::MEMORY_LENGTH_B * sizeof(bool));
+    memset(this->data, 0, CPU::MEMORY_LENGTH_B * sizeof(bool));
+}
+
+bool RomAnalyzer::stalls(WORD opcode)
+{
+    // Unknown 8XY?, EX?? and FX?? opcodes leave the PC where it is (lib/cpu.cpp)
+    switch (opcode & 0xF000)
+    {
+        case 0x8000:
+            return (opcode & 0x000F) > 0x7 && (opcode & 0x000F) != 0xE;
+        case 0xE000:
+            return (opcode & 0x00FF) != 0x9E && (opcode & 0x00FF) != 0xA1;
+        case 0xF000:
+            switch (opcode & 0x00FF)
+            {
+                case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x33: case 0x55: case 0x65:
+                    return false;
+                default:
+                    return true;
+            }
+        default:
+            return false;
+    }
+}
+
+bool RomAnalyzer::ends_block(WORD opcode)
+{
+    if (RomAnalyzer::stalls(opcode))
+    {
+        return true;
+    }
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            return opcode == 0x00EE;
+        case 0x1000:    // Jump
+        case 0x2000:    // Call
+        case 0x3000:    // Skips
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+        case 0xB000:    // Jump + V0
+            return true;
+        case 0xE000:
+            return (opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1;
+        case 0xF000:
+            return (opcode & 0x00FF) == 0x0A;   // Waits (executes again) until a key is pressed and released
+        default:
+            return false;
+    }
+}
+
+void RomAnalyzer::successors(WORD addr, WORD opcode, std::vector<WORD>& targets) const
+{
+    targets.clear();
+
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+            targets.push_back(opcode & 0x0FFF);
+            return;
+        case 0x2000:
+            // 00EE comes back to the instruction after the call
+            targets.push_back(opcode & 0x0FFF);
+            targets.push_back(addr + 2);
+            return;
+        case 0xB000:
+            return;
+        default:
+            break;
+    }
+
+    if (opcode == 0x00EE)
+    {
+        return;
+    }
+
+    if (RomAnalyzer::stalls(opcode))
+    {
+        targets.push_back(addr);
+
+        return;
+    }
+
+    if ((opcode & 0xF0FF) == 0xF00A)
+    {
+        targets.push_back(addr);
+        targets.push_back(addr + 2);
+
+        return;
+    }
+
+    targets.push_back(addr + 2);
+
+    if (RomAnalyzer::ends_block(opcode))
+    {
+        // Skips
+        targets.push_back(addr + 4);
+    }
+}
+
+WORD RomAnalyzer::get_opcode(WORD addr) const
+{
+    if ((unsigned)addr + 1 >= CPU::MEMORY_LENGTH_B)
+    {
+        return 0;
+    }
+
+    return this->memory[addr] << 8 | this->memory[addr + 1];
+}
+
+bool RomAnalyzer::is_code(WORD addr) const
+{
+    return addr < CPU::MEMORY_LENGTH_B && this->code[addr];
+}
+
+void RomAnalyzer::analyze(const byte* rom, size_t length)
+{
+    if (length > CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN)
+    {
+        length = CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN;
+    }
+
+    memset(this->memory, 0, CPU::MEMORY_LENGTH_B * sizeof(byte));
+    memset(this->code, 0, CPU::MEMORY_LENGTH_B * sizeof(bool));
+    memset(this->leader, 0, CPU::MEMORY_LENGTH_B * sizeof(bool));
+    memset(this->data, 0, CPU::MEMORY_LENGTH_B * sizeof(bool));
+    memcpy(this->memory + CPU::ROM_MEMORY_BEGIN, rom, length * sizeof(byte));
+
+    this->blocks.clear();
+    this->stores.clear();
+    this->complete = true;
+
+    this->find_code();
+    this->find_blocks();
+    this->find_accesses();
+}
+
+void RomAnalyzer::find_code()
+{
+    // Find the reachable instructions and the block leaders
+    std::vector<WORD> pending(1, CPU::ROM_MEMORY_BEGIN);
+    std::vector<WORD> targets;
+
+    this->leader[CPU::ROM_MEMORY_BEGIN] = true;
+
+    while (!pending.empty())
+    {
+        unsigned addr = pending.back();
+
+        pending.pop_back();
+
+        // The fontset area is not code
+        if (addr < CPU::ROM_MEMORY_BEGIN)
+        {
+            this->complete = false;
+        }
+
+        while (addr >= CPU::ROM_MEMORY_BEGIN && addr + 1 < CPU::MEMORY_LENGTH_B && !this->code[addr])
+        {
+            WORD opcode = this->get_opcode(addr);
+
+            this->code[addr] = true;
+
+            if ((opcode & 0xF000) == 0xB000)
+            {
+                this->complete = false;
+            }
+
+            if (RomAnalyzer::ends_block(opcode))
+            {
+                this->successors(addr, opcode, targets);
+
+                for (size_t i = 0; i < targets.size(); i++)
+                {
+                    if (targets[i] < CPU::MEMORY_LENGTH_B)
+                    {
+                        this->leader[targets[i]] = true;
+                        pending.push_back(targets[i]);
+                    }
+                    else
+                    {
+                        this->complete = false;
+                    }
+                }
+
+                break;
+            }
+
+            addr += 2;
+        }
+    }
+}
+
+void RomAnalyzer::find_blocks()
+{
+    // Split the code in basic blocks, each one starting at a leader
+    for (unsigned addr = CPU::ROM_MEMORY_BEGIN; addr < CPU::MEMORY_LENGTH_B; addr++)
+    {
+        if (!this->leader[addr] || !this->code[addr])
+        {
+            continue;
+        }
+
+        BasicBlock block;
+        unsigned current = addr;
+
+        block.begin = addr;
+        block.dynamic = false;
+
+        for (;;)
+        {
+            WORD opcode = this->get_opcode(current);
+
+            if (RomAnalyzer::ends_block(opcode))
+            {
+                block.end = current + 2;
+                block.dynamic = opcode == 0x00EE || (opcode & 0xF000) == 0xB000;
+                this->successors(current, opcode, block.successors);
+
+                break;
+            }
+
+            current += 2;
+
+            if (current + 1 >= CPU::MEMORY_LENGTH_B || this->leader[current] || !this->code[current])
+            {
+                block.end = current;
+                block.successors.push_back(current);
+
+                break;
+            }
+        }
+
+        this->blocks.push_back(block);
+    }
+}
+
+int RomAnalyzer::walk_block(const BasicBlock& block, int i, bool record)
+{
+    for (WORD addr = block.begin; addr < block.end; addr += 2)
+    {
+        WORD opcode = this->get_opcode(addr);
+        unsigned x = (opcode & 0x0F00) >> 8;
+
+        if ((opcode & 0xF000) == 0xA000)
+        {
+            i = opcode & 0x0FFF;
+        }
+        else if ((opcode & 0xF0FF) == 0xF01E || (opcode & 0xF0FF) == 0xF029)
+        {
+            i = I_UNKNOWN;
+        }
+        else if (!record)
+        {
+            continue;
+        }
+        else if ((opcode & 0xF000) == 0xD000 || (opcode & 0xF0FF) == 0xF065)
+        {
+            // Sprite rows or loaded registers
+            unsigned length = (opcode & 0xF000) == 0xD000 ? opcode & 0x000F : x + 1;
+
+            for (unsigned offset = 0; i != I_UNKNOWN && offset < length; offset++)
+            {
+                this->data[(i + offset) % CPU::MEMORY_LENGTH_B] = true;
+            }
+        }
+        else if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055)
+        {
+            RomStore store;
+
+            store.address = addr;
+            store.target = i == I_UNKNOWN ? 0 : i;
+            store.length = (opcode & 0x00FF) == 0x33 ? 3 : x + 1;
+            store.known = i != I_UNKNOWN;
+            store.hits_code = false;
+
+            for (unsigned offset = 0; store.known && offset < store.length; offset++)
+            {
+                WORD target = (store.target + offset) % CPU::MEMORY_LENGTH_B;
+
+                // Both bytes of an instruction count
+                store.hits_code |= this->code[target] || (target > 0 && this->code[target - 1]);
+            }
+
+            this->stores.push_back(store);
+        }
+    }
+
+    return i;
+}
+
+void RomAnalyzer::find_accesses()
+{
+    if (this->blocks.empty())
+    {
+        return;
+    }
+
+    std::vector<int> block_index(CPU::MEMORY_LENGTH_B, -1);
+    std::vector<int> entry(this->blocks.size(), I_NOT_REACHED);
+    std::vector<size_t> pending(1, 0);
+
+    for (size_t i = 0; i < this->blocks.size(); i++)
+    {
+        block_index[this->blocks[i].begin] = i;
+    }
+
+    // CPU::initializate() clears I
+    entry[0] = 0;
+
+    // Propagate I over the graph until nothing changes
+    while (!pending.empty())
+    {
+        size_t current = pending.back();
+        const BasicBlock& block = this->blocks[current];
+
+        pending.pop_back();
+
+        int i = this->walk_block(block, entry[current], false);
+        bool call = (this->get_opcode(block.end - 2) & 0xF000) == 0x2000;
+
+        for (size_t s = 0; s < block.successors.size(); s++)
+        {
+            WORD successor = block.successors[s];
+            int next = successor < CPU::MEMORY_LENGTH_B ? block_index[successor] : -1;
+
+            if (next < 0)
+            {
+                continue;
+            }
+
+            // The subroutine may change I before coming back
+            int merged = merge(entry[next], call && successor == block.end ? I_UNKNOWN : i);
+
+            if (merged != entry[next])
+            {
+                entry[next] = merged;
+                pending.push_back(next);
+            }
+        }
+    }
+
+    // Record the accesses with the final values
+    for (size_t current = 0; current < this->blocks.size(); current++)
+    {
+        if (entry[current] != I_NOT_REACHED)
+        {
+            this->walk_block(this->blocks[current], entry[current], true);
+        }
+    }
+}
+
+const std::vector<RomStore>& RomAnalyzer::get_stores() const
+{
+    return this->stores;
+}
+
+bool RomAnalyzer::is_data(WORD addr) const
+{
+    return addr < CPU::MEMORY_LENGTH_B && this->data[addr];
+}
+
+unsigned RomAnalyzer::get_code_size() const
+{
+    return std::count(this->code, this->code + CPU::MEMORY_LENGTH_B, true) * 2;
+}
+
+unsigned RomAnalyzer::get_data_size() const
+{
+    return std::count(this->data, this->data + CPU::MEMORY_LENGTH_B, true);
+}
+
+bool RomAnalyzer::is_complete() const
+{
+    return this->complete;
+}
+
+bool RomAnalyzer::has_static_code() const
+{
+    if (!this->complete)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < this->stores.size(); i++)
+    {
+        if (!this->stores[i].known || this->stores[i].hits_code)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+string RomAnalyzer::disassemble(WORD opcode)
+{
+    char text[32];
+    unsigned x = (opcode & 0x0F00) >> 8;
+    unsigned y = (opcode & 0x00F0) >> 4;
+    unsigned n = opcode & 0x000F;
+    unsigned nn = opcode & 0x00FF;
+    unsigned nnn = opcode & 0x0FFF;
+
+    // Only the opcodes lib/cpu.cpp handles, everything else is shown as a raw word
+    snprintf(text, sizeof(text), "DW   0x%04X", opcode);
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            if (opcode == 0x00E0)
+            {
+                snprintf(text, sizeof(text), "CLS");
+            }
+            else if (opcode == 0x00EE)
+            {
+                snprintf(text, sizeof(text), "RET");
+            }
+            else
+            {
+                snprintf(text, sizeof(text), "SYS  0x%03X", nnn);
+            }
+            break;
+        case 0x1000:
+            snprintf(text, sizeof(text), "JP   0x%03X", nnn);
+            break;
+        case 0x2000:
+            snprintf(text, sizeof(text), "CALL 0x%03X", nnn);
+            break;
+        case 0x3000:
+            snprintf(text, sizeof(text), "SE   V%X, 0x%02X", x, nn);
+            break;
+        case 0x4000:
+            snprintf(text, sizeof(text), "SNE  V%X, 0x%02X", x, nn);
+            break;
+        case 0x5000:
+            if (n == 0)
+            {
+                snprintf(text, sizeof(text), "SE   V%X, V%X", x, y);
+            }
+            break;
+        case 0x6000:
+            snprintf(text, sizeof(text), "LD   V%X, 0x%02X", x, nn);
+            break;
+        case 0x7000:
+            snprintf(text, sizeof(text), "ADD  V%X, 0x%02X", x, nn);
+            break;
+        case 0x8000:
+        {
+            static const char* const names[0x10] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                                    NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL};
+
+            if (names[n] != NULL)
+            {
+                snprintf(text, sizeof(text), "%-4s V%X, V%X", names[n], x, y);
+            }
+            break;
+        }
+        case 0x9000:
+            if (n == 0)
+            {
+                snprintf(text, sizeof(text), "SNE  V%X, V%X", x, y);
+            }
+            break;
+        case 0xA000:
+            snprintf(text, sizeof(text), "LD   I, 0x%03X", nnn);
+            break;
+        case 0xB000:
+            snprintf(text, sizeof(text), "JP   V0, 0x%03X", nnn);
+            break;
+        case 0xC000:
+            snprintf(text, sizeof(text), "RND  V%X, 0x%02X", x, nn);
+            break;
+        case 0xD000:
+            snprintf(text, sizeof(text), "DRW  V%X, V%X, %u", x, y, n);
+            break;
+        case 0xE000:
+            if (nn == 0x9E)
+            {
+                snprintf(text, sizeof(text), "SKP  V%X", x);
+            }
+            else if (nn == 0xA1)
+            {
+                snprintf(text, sizeof(text), "SKNP V%X", x);
+            }
+            break;
+        case 0xF000:
+            switch (nn)
+            {
+                case 0x07: snprintf(text, sizeof(text), "LD   V%X, DT", x); break;
+                case 0x0A: snprintf(text, sizeof(text), "LD   V%X, K", x); break;
+                case 0x15: snprintf(text, sizeof(text), "LD   DT, V%X", x); break;
+                case 0x18: snprintf(text, sizeof(text), "LD   ST, V%X", x); break;
+                case 0x1E: snprintf(text, sizeof(text), "ADD  I, V%X", x); break;
+                case 0x29: snprintf(text, sizeof(text), "LD   F, V%X", x); break;
+                case 0x33: snprintf(text, sizeof(text), "LD   B, V%X", x); break;
+                case 0x55: snprintf(text, sizeof(text), "LD   [I], V%X", x); break;
+                case 0x65: snprintf(text, sizeof(text), "LD   V%X, [I]", x); break;
+                default: break;
+            }
+            break;
+    }
+
+    return string(text);
+}
+
+void RomAnalyzer::print(std::ostream& out) const
+{
+    char line[96];
+
+    snprintf(line, sizeof(line), "%u block(s), %u code byte(s), %u data byte(s), %u store(s), %s code%s\n\n",
+             (unsigned)this->blocks.size(), this->get_code_size(), this->get_data_size(), (unsigned)this->stores.size(),
+             this->has_static_code() ? "static" : "guarded", this->complete ? "" : " (incomplete)");
+    out << line;
+
+    for (size_t b = 0; b < this->blocks.size(); b++)
+    {
+        const BasicBlock& block = this->blocks[b];
+
+        snprintf(line, sizeof(line), "block_%04X:\n", block.begin);
+        out << line;
+
+        for (WORD addr = block.begin; addr < block.end; addr += 2)
+        {
+            WORD opcode = this->get_opcode(addr);
+
+            snprintf(line, sizeof(line), "    %04X  %04X  %s\n", addr, opcode, RomAnalyzer::disassemble(opcode).c_str());
+            out << line;
+        }
+
+        out << "    ->";
+
+        for (size_t s = 0; s < block.successors.size(); s++)
+        {
+            snprintf(line, sizeof(line), " %04X", block.successors[s]);
+            out << line;
+        }
+
+        out << (block.dynamic ? " (dynamic)\n\n" : "\n\n");
+    }
+
+    // Data ranges
+    for (unsigned addr = 0; addr < CPU::MEMORY_LENGTH_B; addr++)
+    {
+        unsigned end = addr;
+
+        while (end < CPU::MEMORY_LENGTH_B && this->data[end])
+        {
+            end++;
+        }
+
+        if (end > addr)
+        {
+            snprintf(line, sizeof(line), "data %04X - %04X (%u bytes)\n", addr, end, end - addr);
+            out << line;
+
+            addr = end;
+        }
+    }
+
+    for (size_t i = 0; i < this->stores.size(); i++)
+    {
+        const RomStore& store = this->stores[i];
+
+        if (store.known)
+        {
+            snprintf(line, sizeof(line), "store at %04X -> %04X - %04X%s\n", store.address, store.target,
+                     store.target + store.length, store.hits_code ? " (HITS CODE)" : "");
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "store at %04X -> unknown I (%u bytes)\n", store.address, store.length);
+        }
+
+        out << line;
+    }
+}
+
+void RomAnalyzer::print_dot(std::ostream& out, const string& name) const
+{
+    char line[64];
+
+    out << "digraph \"" << name << "\"\n{\n    node [shape=box, fontname=monospace];\n";
+
+    for (size_t b = 0; b < this->blocks.size(); b++)
+    {
+        const BasicBlock& block = this->blocks[b];
+
+        snprintf(line, sizeof(line), "    b%04X [label=\"", block.begin);
+        out << line;
+
+        for (WORD addr = block.begin; addr < block.end; addr += 2)
+        {
+            snprintf(line, sizeof(line), "%04X  %s\\l", addr, RomAnalyzer::disassemble(this->get_opcode(addr)).c_str());
+            out << line;
+        }
+
+        out << "\"];\n";
+
+        for (size_t s = 0; s < block.successors.size(); s++)
+        {
+            if (this->find_block(block.successors[s]) != NULL)
+            {
+                snprintf(line, sizeof(line), "    b%04X -> b%04X;\n", block.begin, block.successors[s]);
+                out << line;
+            }
+        }
+    }
+
+    out << "}\n";
+}
+
+const std::vector<BasicBlock>& RomAnalyzer::get_blocks() const
+{
+    return this->blocks;
+}
+
+const BasicBlock* RomAnalyzer::find_block(WORD addr) const
+{
+    std::vector<BasicBlock>::const_iterator it =
+        std::lower_bound(this->blocks.begin(), this->blocks.end(), addr,
+                         [](const BasicBlock& block, WORD value) { return block.begin < value; });
+
+    if (it == this->blocks.end() || it->begin != addr)
+    {
+        return NULL;
+    }
+
+    return &*it;
+}
@@ -0,0 +1,536 @@
+#include "rom_catalog.h"
+#include "rom_analyzer.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+using std::string;
+
+const char* const RomCatalog::DEFAULT_INDEX = "roms/catalog.idx";
+
+// Longest controls description kept from the sidecar .txt
+static const size_t MAX_CONTROLS_LENGTH = 160;
+
+static string to_lower(const string& text)
+{
+    string lower(text);
+
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    return lower;
+}
+
+static string trim(const string& text)
+{
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    size_t end = text.find_last_not_of(" \t\r\n");
+
+    if (begin == string::npos)
+    {
+        return "";
+    }
+
+    return text.substr(begin, end - begin + 1);
+}
+
+// Fields are tab separated and entries newline separated in the index
+static string sanitize(const string& text)
+{
+    string clean;
+    bool space = false;
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (isspace((unsigned char)text[i]))
+        {
+            space = !clean.empty();
+        }
+        else
+        {
+            if (space)
+            {
+                clean += ' ';
+            }
+
+            clean += text[i];
+            space = false;
+        }
+    }
+
+    return clean;
+}
+
+static bool ends_with(const string& text, const string& suffix)
+{
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool is_year(const string& text)
+{
+    // 1990, 199x, ...
+    return text.size() == 4 && (text[0] == '1' || text[0] == '2') &&
+           isdigit((unsigned char)text[1]) && isdigit((unsigned char)text[2]) &&
+           (isdigit((unsigned char)text[3]) || text[3] == 'x');
+}
+
+// "Pong [Paul Vervalin, 1990]", "Lunar Lander (Udo Pernisz, 1979)", "Trip8 Demo (2008) [Revival Studios]"
+static void parse_file_name(const string& name, RomEntry& entry)
+{
+    size_t title_end = name.find_first_of("[(");
+
+    entry.title = trim(name.substr(0, title_end));
+
+    for (size_t open = name.find_first_of("[("); open != string::npos; open = name.find_first_of("[(", open + 1))
+    {
+        size_t close = name.find_first_of("])", open);
+
+        if (close == string::npos)
+        {
+            break;
+        }
+
+        string group = trim(name.substr(open + 1, close - open - 1));
+        size_t comma = group.rfind(',');
+
+        if (is_year(group))
+        {
+            entry.year = group;
+        }
+        else if (comma != string::npos && is_year(trim(group.substr(comma + 1))))
+        {
+            entry.author = trim(group.substr(0, comma));
+            entry.year = trim(group.substr(comma + 1));
+        }
+        else if (name[open] == '[')
+        {
+            entry.author = group;
+        }
+        else
+        {
+            // "(alt)", "(1 player)", ... belong to the title
+            entry.title += " (" + group + ")";
+        }
+    }
+}
+
+static void parse_sidecar(const string& path, RomEntry& entry)
+{
+    std::ifstream sidecar(path);
+
+    if (!sidecar.is_open())
+    {
+        return;
+    }
+
+    string line;
+    bool in_controls = false;
+
+    while (std::getline(sidecar, line))
+    {
+        string clean = trim(line);
+        size_t colon = clean.find(':');
+
+        if (in_controls)
+        {
+            if (clean.empty() || entry.controls.size() >= MAX_CONTROLS_LENGTH)
+            {
+                in_controls = false;
+            }
+            else
+            {
+                entry.controls += " " + clean;
+            }
+
+            continue;
+        }
+
+        if (colon != string::npos && colon < 20)
+        {
+            string field = to_lower(trim(clean.substr(0, colon)));
+            string value = trim(clean.substr(colon + 1));
+
+            if (field == "author" && entry.author.empty())
+            {
+                entry.author = value;
+            }
+            else if (field == "date" && entry.year.empty() && value.size() >= 4)
+            {
+                entry.year = value.substr(value.size() - 4);
+            }
+        }
+
+        if (entry.controls.empty() && to_lower(clean).find("key") != string::npos)
+        {
+            entry.controls = clean;
+            in_controls = true;
+        }
+    }
+
+    if (entry.controls.size() > MAX_CONTROLS_LENGTH)
+    {
+        entry.controls = entry.controls.substr(0, MAX_CONTROLS_LENGTH - 3) + "...";
+    }
+}
+
+RomCatalog::RomCatalog()
+{
+
+}
+
+uint64_t RomCatalog::hash(const byte* data, size_t length)
+{
+    // FNV-1a (64 bits)
+    uint64_t value = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        value ^= data[i];
+        value *= 0x100000001B3ULL;
+    }
+
+    return value;
+}
+
+RomPlatform RomCatalog::detect_platform(const byte* rom, size_t length)
+{
+    // Hires ROMs start jumping over the 64x64 setup (see roms/hires/!hires_information.txt)
+    if (length >= 2 && rom[0] == 0x12 && rom[1] == 0x60)
+    {
+        return RomPlatform::CHIP8_HIRES;
+    }
+
+    // SuperChip: only look at the code reachable from 0x200, sprite data often looks like 00FF
+    RomAnalyzer analyzer;
+
+    analyzer.analyze(rom, length);
+
+    for (WORD addr = CPU::ROM_MEMORY_BEGIN; addr < CPU::MEMORY_LENGTH_B; addr++)
+    {
+        WORD opcode = analyzer.get_opcode(addr);
+
+        if (analyzer.is_code(addr) &&
+            (opcode == 0x00FE || opcode == 0x00FF || opcode == 0x00FB || opcode == 0x00FC ||
+             (opcode & 0xFFF0) == 0x00C0 ||
+             (opcode & 0xF0FF) == 0xF030 || (opcode & 0xF0FF) == 0xF075 || (opcode & 0xF0FF) == 0xF085))
+        {
+            return RomPlatform::SCHIP;
+        }
+    }
+
+    return RomPlatform::CHIP8;
+}
+
+const char* RomCatalog::platform_name(RomPlatform platform)
+{
+    switch (platform)
+    {
+        case RomPlatform::CHIP8_HIRES:
+            return "chip8-hires";
+        case RomPlatform::SCHIP:
+            return "schip";
+        default:
+            return "chip8";
+    }
+}
+
+// Quirks to run catalog ROMs with (frontends apply them after the lookup). The same for every
+// platform: the only one the core has, sprite wrapping, is off on both the VIP and the SuperChip.
+CPU::Quirks RomCatalog::quirks_profile()
+{
+    CPU::Quirks quirks = CPU::DEFAULT_QUIRKS;
+
+    quirks.wrap_sprites = false;
+
+    return quirks;
+}
+
+bool RomCatalog::add(const string& path)
+{
+    std::ifstream rom(path, std::ios::binary | std::ios::ate);
+
+    if (!rom.is_open())
+    {
+        std::cerr << "WARNING: the file (" << path << ") couldn't be opened. Skipping." << std::endl;
+
+        return false;
+    }
+
+    std::streamoff length = rom.tellg();
+
+    if (length < 0 || length > CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN)
+    {
+        std::cerr << "WARNING: the file (" << path << ") is not a CHIP-8 ROM. Skipping." << std::endl;
+
+        return false;
+    }
+
+    byte buffer[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN];
+
+    rom.seekg(0, std::ios::beg);
+    rom.read((char*)buffer, length);
+
+    // Empty files and short reads would be hashed (and indexed) as something else
+    if (length == 0 || rom.gcount() != length)
+    {
+        std::cerr << "WARNING: the file (" << path << ") couldn't be read. Skipping." << std::endl;
+
+        return false;
+    }
+
+    RomEntry entry;
+    size_t slash = path.rfind('/');
+    string name = path.substr(slash == string::npos ? 0 : slash + 1);
+
+    entry.hash = RomCatalog::hash(buffer, length);
+    entry.size = length;
+    entry.platform = RomCatalog::detect_platform(buffer, length);
+    entry.path = path;
+
+    parse_file_name(name.substr(0, name.size() - 4), entry);
+    parse_sidecar(path.substr(0, path.size() - 4) + ".txt", entry);
+
+    if (entry.platform == RomPlatform::CHIP8 && path.find("/hires/") != string::npos)
+    {
+        entry.platform = RomPlatform::CHIP8_HIRES;
+    }
+
+    entry.title = sanitize(entry.title);
+    entry.author = sanitize(entry.author);
+    entry.year = sanitize(entry.year);
+    entry.controls = sanitize(entry.controls);
+
+    this->entries.push_back(entry);
+
+    return true;
+}
+
+bool RomCatalog::scan(const string& directory)
+{
+    DIR* dir = opendir(directory.c_str());
+
+    if (dir == NULL)
+    {
+        std::cerr << "ERROR: the directory (" << directory << ") couldn't be opened or found." << std::endl;
+
+        return false;
+    }
+
+    std::vector<string> children;
+
+    for (struct dirent* child = readdir(dir); child != NULL; child = readdir(dir))
+    {
+        if (strcmp(child->d_name, ".") != 0 && strcmp(child->d_name, "..") != 0)
+        {
+            children.push_back(directory + "/" + child->d_name);
+        }
+    }
+
+    closedir(dir);
+
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        struct stat info;
+
+        if (stat(children[i].c_str(), &info) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(info.st_mode))
+        {
+            this->scan(children[i]);
+        }
+        else if (ends_with(to_lower(children[i]), ".ch8"))
+        {
+            this->add(children[i]);
+        }
+    }
+
+    return true;
+}
+
+bool RomCatalog::build(const string& root)
+{
+    this->entries.clear();
+
+    if (!this->scan(root))
+    {
+        return false;
+    }
+
+    std::sort(this->entries.begin(), this->entries.end(),
+              [](const RomEntry& a, const RomEntry& b) { return a.path < b.path; });
+
+    this->reindex();
+
+    return true;
+}
+
+void RomCatalog::reindex()
+{
+    this->by_hash.clear();
+
+    for (size_t i = 0; i < this->entries.size(); i++)
+    {
+        // Duplicated ROMs (same content, different name) are found by the first path
+        this->by_hash.insert(std::make_pair(this->entries[i].hash, i));
+    }
+}
+
+bool RomCatalog::save(const string& path) const
+{
+    std::ofstream index(path);
+
+    if (!index.is_open())
+    {
+        std::cerr << "ERROR: the index (" << path << ") couldn't be written." << std::endl;
+
+        return false;
+    }
+
+    index << "CHIP8-CATALOG " << RomCatalog::VERSION << " " << this->entries.size() << "\n";
+
+    for (size_t i = 0; i < this->entries.size(); i++)
+    {
+        const RomEntry& entry = this->entries[i];
+        char hash[17];
+
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)entry.hash);
+
+        index << hash << '\t' << entry.size << '\t' << RomCatalog::platform_name(entry.platform) << '\t'
+              << entry.path << '\t' << entry.title << '\t' << entry.author << '\t'
+              << entry.year << '\t' << entry.controls << '\n';
+    }
+
+    return true;
+}
+
+bool RomCatalog::load(const string& path)
+{
+    std::ifstream index(path);
+
+    if (!index.is_open())
+    {
+        std::cerr << "ERROR: the index (" << path << ") couldn't be opened or found." << std::endl;
+
+        return false;
+    }
+
+    string magic;
+    unsigned version = 0;
+    size_t count = 0;
+
+    index >> magic >> version >> count;
+
+    if (magic != "CHIP8-CATALOG" || version != RomCatalog::VERSION)
+    {
+        std::cerr << "ERROR: the index (" << path << ") has an unknown format. Rebuild it." << std::endl;
+
+        return false;
+    }
+
+    string line;
+
+    std::getline(index, line);
+
+    this->entries.clear();
+    this->entries.reserve(count);
+
+    while (std::getline(index, line))
+    {
+        std::vector<string> fields;
+        std::stringstream stream(line);
+        string field;
+
+        while (std::getline(stream, field, '\t'))
+        {
+            fields.push_back(field);
+        }
+
+        fields.resize(8);
+
+        RomEntry entry;
+
+        entry.hash = strtoull(fields[0].c_str(), NULL, 16);
+        entry.size = strtoul(fields[1].c_str(), NULL, 10);
+        entry.platform = fields[2] == "schip" ? RomPlatform::SCHIP :
+                         fields[2] == "chip8-hires" ? RomPlatform::CHIP8_HIRES : RomPlatform::CHIP8;
+        entry.path = fields[3];
+        entry.title = fields[4];
+        entry.author = fields[5];
+        entry.year = fields[6];
+        entry.controls = fields[7];
+
+        this->entries.push_back(entry);
+    }
+
+    this->reindex();
+
+    return true;
+}
+
+const std::vector<RomEntry>& RomCatalog::get_entries() const
+{
+    return this->entries;
+}
+
+const RomEntry* RomCatalog::find_by_hash(uint64_t value) const
+{
+    std::unordered_map<uint64_t, size_t>::const_iterator it = this->by_hash.find(value);
+
+    if (it == this->by_hash.end())
+    {
+        return NULL;
+    }
+
+    return &this->entries[it->second];
+}
+
+const RomEntry* RomCatalog::find_by_name(const string& name) const
+{
+    string wanted = to_lower(name);
+    const RomEntry* partial = NULL;
+
+    for (size_t i = 0; i < this->entries.size(); i++)
+    {
+        const RomEntry& entry = this->entries[i];
+        string path = to_lower(entry.path);
+
+        // Exact title or file name first, then any path containing the text
+        if (to_lower(entry.title) == wanted || ends_with(path, "/" + wanted) || path == wanted)
+        {
+            return &entry;
+        }
+
+        if (partial == NULL && path.find(wanted) != string::npos)
+        {
+            partial = &entry;
+        }
+    }
+
+    return partial;
+}
+
+const RomEntry* RomCatalog::find(const string& key) const
+{
+    if (key.size() == 16 && key.find_first_not_of("0123456789abcdefABCDEF") == string::npos)
+    {
+        const RomEntry* entry = this->find_by_hash(strtoull(key.c_str(), NULL, 16));
+
+        if (entry != NULL)
+        {
+            return entry;
+        }
+    }
+
+    return this->find_by_name(key);
+}
@@ -0,0 +1,235 @@
+#include "session_scheduler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+const double SessionScheduler::DEFAULT_FREQUENCY = 60.0;
+
+// Every page write bumps a version, so an unchanged sum means unchanged memory
+static uint64_t memory_versions(const CPU& cpu)
+{
+    uint64_t sum = 0;
+
+    for (unsigned page = 0; page < CPU::MEMORY_PAGES; page++)
+    {
+        sum += cpu.get_memory_version(page * CPU::MEMORY_PAGE_SIZE);
+    }
+
+    return sum;
+}
+
+SessionScheduler::SessionScheduler(WorkStealingPool& workers, double frequency) :
+    pool(workers),
+    period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frequency))),
+    ticks(0),
+    parked_frames(0),
+    tick_time(0),
+    tick_max(0),
+    pool_start(workers.get_stats())
+{
+
+}
+
+/*
+ * A session running image from the start (CXNN seeded with seed), cycles per frame. Its frames
+ * are due deadline ms after the start of their tick (the tick period if 0). Returns its index.
+ */
+unsigned SessionScheduler::add_session(const std::shared_ptr<const CPU::Image>& image, unsigned cycles, DWORD seed,
+                                       double deadline)
+{
+    std::unique_ptr<Session> session(new Session());
+
+    session->cpu.initializate();
+    session->cpu.load_image(image);
+    session->cpu.seed(seed);
+    session->cycles = cycles;
+    session->deadline = deadline > 0 ?
+                        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(deadline)) :
+                        this->period;
+    session->keys = 0;
+    session->applied = 0;
+    session->parked = false;
+    memset(&session->stats, 0, sizeof(session->stats));
+    session->run_time = 0;
+
+    this->sessions.push_back(std::move(session));
+
+    return this->sessions.size() - 1;
+}
+
+unsigned SessionScheduler::get_sessions() const
+{
+    return this->sessions.size();
+}
+
+// Keys held from the next frame on (bit N: key N). Wakes the session up if they changed.
+void SessionScheduler::set_keys(unsigned index, WORD mask)
+{
+    this->sessions[index]->keys = mask;
+}
+
+// One frame of the session, checking whether it changed anything
+void SessionScheduler::run(Session& session, Clock::time_point start)
+{
+    Clock::time_point begin = Clock::now();
+    CPU& cpu = session.cpu;
+    WORD keys = session.keys;
+
+    if (keys != session.applied)
+    {
+        cpu.update_pressed_keys(keys);
+        session.applied = keys;
+    }
+
+    CPU::State before = cpu.get_state();
+    uint64_t frame_hash = cpu.get_frame_hash();
+    uint64_t versions = memory_versions(cpu);
+
+    for (unsigned cycle = 0; cycle < session.cycles; cycle++)
+    {
+        cpu.emulate_cycle();
+    }
+
+    // The key edges FX0A looks at only change with update_pressed_keys(), so they're the same too
+    session.parked = memcmp(&before, &cpu.get_state(), sizeof(before)) == 0 && cpu.get_frame_hash() == frame_hash &&
+                     memory_versions(cpu) == versions;
+
+    Clock::time_point end = Clock::now();
+    double run_time = std::chrono::duration<double, std::micro>(end - begin).count();
+    double late = std::chrono::duration<double, std::milli>(end - (start + session.deadline)).count();
+
+    session.stats.frames++;
+    session.stats.run_max = std::max(session.stats.run_max, run_time);
+    session.run_time += run_time;
+
+    if (late > 0)
+    {
+        session.stats.missed++;
+        session.stats.late_max = std::max(session.stats.late_max, late);
+    }
+}
+
+// Runs a frame of every session that isn't parked, and returns once they're all done
+void SessionScheduler::tick()
+{
+    Clock::time_point start = Clock::now();
+
+    this->active.clear();
+
+    for (unsigned i = 0; i < this->sessions.size(); i++)
+    {
+        Session& session = *this->sessions[i];
+
+        if (session.parked)
+        {
+            if (session.keys == session.applied)
+            {
+                session.stats.parked++;
+                this->parked_frames++;
+
+                continue;
+            }
+
+            session.parked = false;
+            session.stats.wakeups++;
+        }
+
+        this->active.push_back(i);
+    }
+
+    size_t chunks = (this->active.size() + SessionScheduler::CHUNK - 1) / SessionScheduler::CHUNK;
+
+    for (size_t c = 0; c < chunks; c++)
+    {
+        size_t begin = (c + this->ticks) % chunks * SessionScheduler::CHUNK;
+
+        this->pool.submit([this, begin, start](unsigned)
+        {
+            size_t end = std::min<size_t>(begin + SessionScheduler::CHUNK, this->active.size());
+
+            for (size_t i = begin; i < end; i++)
+            {
+                SessionScheduler::run(*this->sessions[this->active[i]], start);
+            }
+        });
+    }
+
+    this->pool.wait();
+
+    double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    this->ticks++;
+    this->tick_time += elapsed;
+    this->tick_max = std::max(this->tick_max, elapsed);
+}
+
+bool SessionScheduler::is_parked(unsigned index) const
+{
+    return this->sessions[index]->parked;
+}
+
+const CPU& SessionScheduler::get_cpu(unsigned index) const
+{
+    return this->sessions[index]->cpu;
+}
+
+SessionStats SessionScheduler::get_session_stats(unsigned index) const
+{
+    const Session& session = *this->sessions[index];
+    SessionStats stats = session.stats;
+
+    stats.run_mean = stats.frames > 0 ? session.run_time / stats.frames : 0;
+
+    return stats;
+}
+
+SchedulerStats SessionScheduler::get_stats() const
+{
+    SchedulerStats stats;
+    WorkPoolStats pool_now = this->pool.get_stats();
+
+    memset(&stats, 0, sizeof(stats));
+    stats.sessions = this->sessions.size();
+    stats.ticks = this->ticks;
+    stats.parked = this->parked_frames;
+    stats.tick_mean = this->ticks > 0 ? this->tick_time / this->ticks : 0;
+    stats.tick_max = this->tick_max;
+    stats.pool.tasks = pool_now.tasks - this->pool_start.tasks;
+    stats.pool.steals = pool_now.steals - this->pool_start.steals;
+    stats.pool.sleeps = pool_now.sleeps - this->pool_start.sleeps;
+
+    for (const std::unique_ptr<Session>& session : this->sessions)
+    {
+        stats.parked_now += session->parked ? 1 : 0;
+        stats.frames += session->stats.frames;
+        stats.missed += session->stats.missed;
+        stats.late_sessions += session->stats.missed > 0 ? 1 : 0;
+    }
+
+    return stats;
+}
+
+void SessionScheduler::print_stats(std::ostream& output, const SchedulerStats& stats)
+{
+    char line[256];
+    uint64_t total = stats.frames + stats.parked;
+
+    snprintf(line, sizeof(line), "Sessions: %u (%u parked now), %llu tick(s) of %.3f ms on average (max. %.3f)",
+             stats.sessions, stats.parked_now, (unsigned long long)stats.ticks, stats.tick_mean, stats.tick_max);
+    output << line << std::endl;
+
+    snprintf(line, sizeof(line), "Frames: %llu run, %llu skipped while parked (%.1f%%)",
+             (unsigned long long)stats.frames, (unsigned long long)stats.parked,
+             total > 0 ? 100.0 * stats.parked / total : 0.0);
+    output << line << std::endl;
+
+    snprintf(line, sizeof(line), "Deadlines: %llu missed (%.3f%% of the frames run), by %u session(s)",
+             (unsigned long long)stats.missed, stats.frames > 0 ? 100.0 * stats.missed / stats.frames : 0.0,
+             stats.late_sessions);
+    output << line << std::endl;
+
+    snprintf(line, sizeof(line), "Pool: %llu task(s), %llu stolen", (unsigned long long)stats.pool.tasks,
+             (unsigned long long)stats.pool.steals);
+    output << line << std::endl;
+}
@@ -0,0 +1,477 @@
+#include "state_explorer.h"
+#include "rom_analyzer.h"
+
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+#include <map>
+#include <unordered_set>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+const ExploreOptions StateExplorer::DEFAULT_OPTIONS = {10, 600, 50000, 1, {false}};
+
+// Frontier states per task
+static const size_t CHUNK = 8;
+
+struct ExploreNode
+{
+    CPU cpu;
+    uint64_t hash;
+    std::vector<byte> keys;
+};
+
+typedef std::pair<unsigned, WORD> FindingKey;
+
+// What a worker found during a level (merged once the level is done)
+struct ExploreWorker
+{
+    CPU scratch;
+    std::vector<std::unique_ptr<ExploreNode> > children;
+    std::map<FindingKey, ExploreFinding> findings;
+    std::bitset<CPU::MEMORY_LENGTH_B> pcs;
+    uint64_t frames_run;
+    uint64_t duplicates;
+    uint64_t counts[ExploreResult::FINDINGS];
+};
+
+// Shortest key sequence first, then the smallest one
+static bool comes_before(unsigned frame, const std::vector<byte>& keys, const ExploreFinding& finding)
+{
+    if (frame != finding.frame)
+    {
+        return frame < finding.frame;
+    }
+
+    return keys < finding.keys;
+}
+
+static void note(ExploreWorker& worker, Finding kind, WORD pc, WORD opcode, unsigned frame,
+                 const std::vector<byte>& keys, int branch)
+{
+    std::vector<byte> path = keys;
+    unsigned index = (unsigned)kind;
+
+    if (branch >= 0)
+    {
+        path.push_back((byte)branch);
+    }
+
+    worker.counts[index]++;
+
+    auto found = worker.findings.find(FindingKey(index, pc));
+
+    if (found == worker.findings.end())
+    {
+        ExploreFinding finding = {kind, pc, opcode, frame, path, 1};
+
+        worker.findings.insert(std::make_pair(FindingKey(index, pc), finding));
+    }
+    else
+    {
+        found->second.count++;
+
+        if (comes_before(frame, path, found->second))
+        {
+            found->second.opcode = opcode;
+            found->second.frame = frame;
+            found->second.keys.swap(path);
+        }
+    }
+}
+
+// Runs a frame, checking every instruction before it runs
+static void run_frame(CPU& cpu, unsigned cycles, ExploreWorker& worker, const ExploreNode& parent, byte branch,
+                      unsigned frame)
+{
+    for (unsigned cycle = 0; cycle < cycles; cycle++)
+    {
+        const CPU::State& state = cpu.get_state();
+
+        if (state.halt)
+        {
+            return;
+        }
+
+        WORD pc = state.pc & (CPU::MEMORY_LENGTH_B - 1);
+        WORD opcode = cpu.load(pc) << 8 | cpu.load(pc + 1);
+
+        worker.pcs.set(pc);
+
+        if (!CPU::is_known(opcode))
+        {
+            note(worker, Finding::UNKNOWN_OPCODE, pc, opcode, frame, parent.keys, branch);
+        }
+        else if ((opcode & 0xF000) == 0x2000 && state.sp >= CPU::STACK_DEEPNESS)
+        {
+            note(worker, Finding::STACK_OVERFLOW, pc, opcode, frame, parent.keys, branch);
+        }
+        else if (opcode == 0x00EE && state.sp == 0)
+        {
+            note(worker, Finding::STACK_UNDERFLOW, pc, opcode, frame, parent.keys, branch);
+        }
+        else if ((opcode & 0xF000) == 0xD000)
+        {
+            unsigned x = state.V[(opcode & 0x0F00) >> 8] & (CPU::WIDTH - 1);
+            unsigned y = state.V[(opcode & 0x00F0) >> 4] & (CPU::HEIGHT - 1);
+            unsigned n = opcode & 0x000F;
+            byte past_right = x + 8 > CPU::WIDTH ? 0xFF >> (CPU::WIDTH - x) : 0;
+            bool off_screen = false;
+
+            for (unsigned row = 0; row < n && !off_screen; row++)
+            {
+                byte sprite = cpu.load(state.I + row);
+
+                off_screen = (sprite & past_right) != 0 || (y + row >= CPU::HEIGHT && sprite != 0);
+            }
+
+            if (off_screen)
+            {
+                note(worker, Finding::DRAW_OFF_SCREEN, pc, opcode, frame, parent.keys, branch);
+            }
+            if (state.I + n > CPU::MEMORY_LENGTH_B)
+            {
+                note(worker, Finding::DRAW_PAST_MEMORY, pc, opcode, frame, parent.keys, branch);
+            }
+        }
+
+        cpu.emulate_cycle();
+    }
+}
+
+// Runs every branch of a state, keeping the children not seen before
+static void expand(const ExploreNode& parent, unsigned frame, unsigned cycles, ExploreWorker& worker,
+                   const std::unordered_set<uint64_t>& visited)
+{
+    uint64_t siblings[StateExplorer::BRANCHES];
+    unsigned kept = 0;
+    unsigned unchanged = 0;
+
+    for (unsigned branch = 0; branch < StateExplorer::BRANCHES; branch++)
+    {
+        CPU& child = worker.scratch;
+
+        // Copy assignment reuses the scratch CPU's pages
+        child = parent.cpu;
+        child.update_pressed_keys((WORD)(branch == 0 ? 0 : 1 << (branch - 1)));
+        run_frame(child, cycles, worker, parent, (byte)branch, frame);
+        child.update_pressed_keys((WORD)0);
+
+        uint64_t hash = child.get_state_hash();
+
+        worker.frames_run++;
+
+        if (hash == parent.hash)
+        {
+            unchanged++;
+            worker.duplicates++;
+
+            continue;
+        }
+
+        if (std::find(siblings, siblings + kept, hash) != siblings + kept || visited.count(hash) > 0)
+        {
+            worker.duplicates++;
+
+            continue;
+        }
+
+        siblings[kept++] = hash;
+
+        std::unique_ptr<ExploreNode> node(new ExploreNode());
+
+        node->cpu = child;
+        node->hash = hash;
+        node->keys = parent.keys;
+        node->keys.push_back((byte)branch);
+        worker.children.push_back(std::move(node));
+    }
+
+    if (unchanged == StateExplorer::BRANCHES)
+    {
+        const CPU::State& state = parent.cpu.get_state();
+        WORD pc = state.pc & (CPU::MEMORY_LENGTH_B - 1);
+
+        note(worker, Finding::STUCK, pc, parent.cpu.load(pc) << 8 | parent.cpu.load(pc + 1), frame, parent.keys, -1);
+    }
+}
+
+static bool node_order(const std::unique_ptr<ExploreNode>& a, const std::unique_ptr<ExploreNode>& b)
+{
+    if (a->hash != b->hash)
+    {
+        return a->hash < b->hash;
+    }
+
+    return a->keys.size() != b->keys.size() ? a->keys.size() < b->keys.size() : a->keys < b->keys;
+}
+
+StateExplorer::StateExplorer(WorkStealingPool& workers, const ExploreOptions& explore_options) :
+    pool(workers),
+    options(explore_options)
+{
+
+}
+
+// From the start of a ROM (initializate(), then the image and the seed of the options)
+ExploreResult StateExplorer::explore(const std::shared_ptr<const CPU::Image>& image) const
+{
+    CPU cpu;
+
+    cpu.initializate();
+    cpu.load_image(image);
+    cpu.seed(this->options.seed);
+    cpu.set_quirks(this->options.quirks);
+
+    return this->explore(cpu);
+}
+
+// From a snapshot (its keys, quirks and seed are kept)
+ExploreResult StateExplorer::explore(const CPU& snapshot) const
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    WorkPoolStats pool_before = this->pool.get_stats();
+    ExploreResult result;
+    RomAnalyzer analyzer;
+    byte rom[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN];
+
+    result.states = 1;
+    result.frames_run = 0;
+    result.duplicates = 0;
+    result.depth = 0;
+    result.exhausted = false;
+    result.truncated = false;
+    memset(result.counts, 0, sizeof(result.counts));
+
+    for (unsigned addr = 0; addr < sizeof(rom); addr++)
+    {
+        rom[addr] = snapshot.load(CPU::ROM_MEMORY_BEGIN + addr);
+    }
+
+    analyzer.analyze(rom, sizeof(rom));
+
+    std::vector<std::unique_ptr<ExploreNode> > frontier;
+    std::unordered_set<uint64_t> visited;
+    std::unordered_set<uint64_t> screens;
+    std::vector<std::unique_ptr<ExploreWorker> > workers;
+
+    frontier.push_back(std::unique_ptr<ExploreNode>(new ExploreNode()));
+    frontier.back()->cpu = snapshot;
+    frontier.back()->hash = snapshot.get_state_hash();
+    visited.insert(frontier.back()->hash);
+    screens.insert(snapshot.get_frame_hash());
+
+    for (unsigned i = 0; i < this->pool.get_workers(); i++)
+    {
+        workers.push_back(std::unique_ptr<ExploreWorker>(new ExploreWorker()));
+        workers.back()->frames_run = 0;
+        workers.back()->duplicates = 0;
+        memset(workers.back()->counts, 0, sizeof(workers.back()->counts));
+    }
+
+    while (!frontier.empty() && result.depth < this->options.max_depth && !result.truncated)
+    {
+        unsigned frame = result.depth;
+        unsigned cycles = this->options.cycles;
+
+        for (size_t begin = 0; begin < frontier.size(); begin += CHUNK)
+        {
+            this->pool.submit([&, begin, frame, cycles](unsigned index)
+            {
+                size_t end = std::min(begin + CHUNK, frontier.size());
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    expand(*frontier[i], frame, cycles, *workers[index], visited);
+                }
+            });
+        }
+
+        this->pool.wait();
+
+        // New states of the level, in an order that doesn't depend on the workers
+        std::vector<std::unique_ptr<ExploreNode> > next;
+
+        for (std::unique_ptr<ExploreWorker>& worker : workers)
+        {
+            std::move(worker->children.begin(), worker->children.end(), std::back_inserter(next));
+            worker->children.clear();
+        }
+
+        std::sort(next.begin(), next.end(), node_order);
+        next.erase(std::unique(next.begin(), next.end(), [](const std::unique_ptr<ExploreNode>& a,
+                                                           const std::unique_ptr<ExploreNode>& b)
+                                                        { return a->hash == b->hash; }),
+                   next.end());
+
+        if (result.states + next.size() > this->options.max_states)
+        {
+            next.resize(this->options.max_states - result.states);
+            result.truncated = true;
+        }
+
+        for (const std::unique_ptr<ExploreNode>& node : next)
+        {
+            visited.insert(node->hash);
+            screens.insert(node->cpu.get_frame_hash());
+        }
+
+        result.states += next.size();
+        result.depth++;
+        frontier.swap(next);
+    }
+
+    result.exhausted = frontier.empty();
+
+    // Per-worker results together
+    std::map<FindingKey, ExploreFinding> findings;
+    std::bitset<CPU::MEMORY_LENGTH_B> pcs;
+
+    for (const std::unique_ptr<ExploreWorker>& worker : workers)
+    {
+        result.frames_run += worker->frames_run;
+        result.duplicates += worker->duplicates;
+        pcs |= worker->pcs;
+
+        for (unsigned i = 0; i < ExploreResult::FINDINGS; i++)
+        {
+            result.counts[i] += worker->counts[i];
+        }
+
+        for (const auto& entry : worker->findings)
+        {
+            auto found = findings.find(entry.first);
+
+            if (found == findings.end())
+            {
+                findings.insert(entry);
+            }
+            else
+            {
+                uint64_t count = found->second.count + entry.second.count;
+
+                if (comes_before(entry.second.frame, entry.second.keys, found->second))
+                {
+                    found->second = entry.second;
+                }
+
+                found->second.count = count;
+            }
+        }
+    }
+
+    for (const auto& entry : findings)
+    {
+        result.findings.push_back(entry.second);
+    }
+
+    result.screens = screens.size();
+    result.instructions = pcs.count();
+    result.static_code = analyzer.get_code_size() / 2;
+    result.static_covered = 0;
+
+    for (unsigned addr = 0; addr < CPU::MEMORY_LENGTH_B; addr++)
+    {
+        result.static_covered += pcs[addr] && analyzer.is_code(addr) ? 1 : 0;
+    }
+
+    WorkPoolStats pool_after = this->pool.get_stats();
+
+    result.pool.tasks = pool_after.tasks - pool_before.tasks;
+    result.pool.steals = pool_after.steals - pool_before.steals;
+    result.pool.sleeps = pool_after.sleeps - pool_before.sleeps;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+const char* StateExplorer::finding_name(Finding kind)
+{
+    switch (kind)
+    {
+        case Finding::UNKNOWN_OPCODE: return "unknown opcode";
+        case Finding::STACK_OVERFLOW: return "stack overflow";
+        case Finding::STACK_UNDERFLOW: return "stack underflow";
+        case Finding::DRAW_OFF_SCREEN: return "draw off screen";
+        case Finding::DRAW_PAST_MEMORY: return "draw past memory";
+        case Finding::STUCK: return "stuck";
+    }
+
+    return "?";
+}
+
+// Keys of each frame, run-length encoded: "-" for no key, the key in hex otherwise (e.g. "-x12 5 -x3")
+string StateExplorer::describe_keys(const std::vector<byte>& keys)
+{
+    string text;
+
+    for (size_t i = 0; i < keys.size();)
+    {
+        size_t run = 1;
+
+        while (i + run < keys.size() && keys[i + run] == keys[i])
+        {
+            run++;
+        }
+
+        if (!text.empty())
+        {
+            text += ' ';
+        }
+
+        text += keys[i] == 0 ? '-' : "0123456789ABCDEF"[(keys[i] - 1) & 0x0F];
+
+        if (run > 1)
+        {
+            text += 'x' + std::to_string(run);
+        }
+
+        i += run;
+    }
+
+    return text.empty() ? "(none)" : text;
+}
+
+void StateExplorer::print(std::ostream& out, const ExploreResult& result, bool details)
+{
+    char line[256];
+
+    snprintf(line, sizeof(line), "States: %llu in %u frame(s) (%s), %u distinct screen(s)",
+             (unsigned long long)result.states, result.depth,
+             result.exhausted ? "all reachable states seen" : result.truncated ? "stopped at the state limit"
+                                                                                : "stopped at the depth limit",
+             result.screens);
+    out << line << std::endl;
+
+    snprintf(line, sizeof(line), "Frames run: %llu (%llu back to known states), %.2f s",
+             (unsigned long long)result.frames_run, (unsigned long long)result.duplicates, result.seconds);
+    out << line << std::endl;
+
+    snprintf(line, sizeof(line), "Instructions run: %u address(es), %u of %u found statically",
+             result.instructions, result.static_covered, result.static_code);
+    out << line << std::endl;
+
+    string counts;
+
+    for (unsigned i = 0; i < ExploreResult::FINDINGS; i++)
+    {
+        snprintf(line, sizeof(line), "%s%s %llu", i > 0 ? ", " : "", StateExplorer::finding_name((Finding)i),
+                 (unsigned long long)result.counts[i]);
+        counts += line;
+    }
+
+    out << "Findings: " << counts << std::endl;
+
+    if (details)
+    {
+        for (const ExploreFinding& finding : result.findings)
+        {
+            snprintf(line, sizeof(line), "  %-16s at 0x%03X (%s), frame %u, %llu time(s), keys: ",
+                     StateExplorer::finding_name(finding.kind), finding.pc,
+                     RomAnalyzer::disassemble(finding.opcode).c_str(), finding.frame,
+                     (unsigned long long)finding.count);
+            out << line << StateExplorer::describe_keys(finding.keys) << std::endl;
+        }
+    }
+}
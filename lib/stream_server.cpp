@@ -0,0 +1,854 @@
+#include "stream_server.h"
+#include "frame_pacer.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+const double StreamServer::FREQUENCY = 60.0;
+
+// RFC 6455: appended to Sec-WebSocket-Key before hashing it
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+enum WebSocketOpcode : byte
+{
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA
+};
+
+// Close codes
+static const unsigned WS_PROTOCOL_ERROR = 1002;
+static const unsigned WS_UNSUPPORTED = 1003;
+static const unsigned WS_TOO_BIG = 1009;
+
+struct StreamServer::Instance
+{
+    CPU cpu;
+    FrameDeltaEncoder encoder;
+    unsigned cycles_per_frame;
+    uint32_t frame;
+    uint64_t encoded_hash;      // Frame hash of the last frame encoded
+    bool changed;               // delta holds this frame's delta
+    std::vector<byte> delta;
+};
+
+struct StreamServer::Client
+{
+    int fd;
+    bool websocket;             // Past the handshake (HTTP request until then)
+    bool closing;               // Closed once everything queued was sent
+    bool needs_keyframe;
+    unsigned instance;
+    string input;
+    std::vector<byte> output;
+    size_t sent;                // Bytes of output already written
+
+    size_t queued() const
+    {
+        return this->output.size() - this->sent;
+    }
+};
+
+/*
+ * SHA-1 (FIPS 180-4), only for the handshake
+ */
+static void sha1(const string& input, byte digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    string message(input);
+    uint64_t bits = (uint64_t)input.size() * 8;
+
+    message += (char)0x80;
+
+    while (message.size() % 64 != 56)
+    {
+        message += (char)0x00;
+    }
+
+    for (int i = 7; i >= 0; i--)
+    {
+        message += (char)(bits >> (8 * i));
+    }
+
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64)
+    {
+        uint32_t w[80];
+
+        for (unsigned i = 0; i < 16; i++)
+        {
+            const byte* word = reinterpret_cast<const byte*>(message.data() + chunk + 4 * i);
+
+            w[i] = (uint32_t)word[0] << 24 | (uint32_t)word[1] << 16 | (uint32_t)word[2] << 8 | word[3];
+        }
+
+        for (unsigned i = 16; i < 80; i++)
+        {
+            uint32_t value = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+
+            w[i] = value << 1 | value >> 31;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+        for (unsigned i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t temp = (a << 5 | a >> 27) + f + e + k + w[i];
+
+            e = d;
+            d = c;
+            c = b << 30 | b >> 2;
+            b = a;
+            a = temp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (unsigned i = 0; i < 20; i++)
+    {
+        digest[i] = (byte)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static string base64(const byte* data, size_t length)
+{
+    static const char* ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string output;
+
+    for (size_t i = 0; i < length; i += 3)
+    {
+        uint32_t group = (uint32_t)data[i] << 16;
+
+        group |= i + 1 < length ? (uint32_t)data[i + 1] << 8 : 0;
+        group |= i + 2 < length ? (uint32_t)data[i + 2] : 0;
+
+        output += ALPHABET[group >> 18 & 0x3F];
+        output += ALPHABET[group >> 12 & 0x3F];
+        output += i + 1 < length ? ALPHABET[group >> 6 & 0x3F] : '=';
+        output += i + 2 < length ? ALPHABET[group & 0x3F] : '=';
+    }
+
+    return output;
+}
+
+static string to_lower(string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+    return text;
+}
+
+static string http_response(const string& status, const string& headers, const string& body = "")
+{
+    return "HTTP/1.1 " + status + "\r\n" + headers + "Content-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + body;
+}
+
+StreamServer::StreamServer() :
+    listener(-1),
+    port(0),
+    running(false),
+    stats{0, 0, 0, 0, 0}
+{
+
+}
+
+StreamServer::~StreamServer()
+{
+    for (auto& client : this->clients)
+    {
+        this->close_client(*client);
+    }
+
+    if (this->listener >= 0)
+    {
+        close(this->listener);
+    }
+}
+
+// Listens on address:port (port 0: any free port, see get_port())
+bool StreamServer::listen(unsigned short listen_port, const string& address)
+{
+    sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(listen_port);
+
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        std::cerr << "ERROR: " << address << " isn't an IPv4 address." << std::endl;
+
+        return false;
+    }
+
+    this->listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+    int reuse = 1;
+    socklen_t length = sizeof(addr);
+
+    if (this->listener < 0 ||
+        setsockopt(this->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(this->listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(this->listener, 128) != 0 ||
+        getsockname(this->listener, reinterpret_cast<sockaddr*>(&addr), &length) != 0)
+    {
+        std::cerr << "ERROR: couldn't listen on " << address << ":" << listen_port << " (" << strerror(errno) << ")."
+                  << std::endl;
+
+        if (this->listener >= 0)
+        {
+            close(this->listener);
+            this->listener = -1;
+        }
+
+        return false;
+    }
+
+    this->port = ntohs(addr.sin_port);
+
+    return true;
+}
+
+unsigned short StreamServer::get_port() const
+{
+    return this->port;
+}
+
+// HTML served on "/" (nothing is served there if it's empty)
+void StreamServer::set_page(const string& html)
+{
+    this->page = html;
+}
+
+unsigned StreamServer::add_instance(const std::shared_ptr<const CPU::Image>& image, unsigned cycles_per_frame)
+{
+    std::unique_ptr<Instance> instance(new Instance());
+
+    instance->cpu.initializate();
+    instance->cpu.load_image(image);
+    instance->cycles_per_frame = cycles_per_frame;
+    instance->frame = 0;
+    instance->encoded_hash = instance->cpu.get_frame_hash();
+    instance->changed = false;
+
+    this->instances.push_back(std::move(instance));
+
+    return this->instances.size() - 1;
+}
+
+unsigned StreamServer::get_instance_count() const
+{
+    return this->instances.size();
+}
+
+CPU& StreamServer::get_cpu(unsigned index)
+{
+    return this->instances[index]->cpu;
+}
+
+// Serves and runs the instances until stop()
+void StreamServer::run()
+{
+    typedef FramePacer::Clock Clock;
+
+    const Clock::duration period =
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / StreamServer::FREQUENCY));
+    Clock::time_point deadline = Clock::now() + period;
+
+    this->running = true;
+
+    while (this->running)
+    {
+        Clock::time_point now = Clock::now();
+
+        if (now >= deadline)
+        {
+            this->frame();
+
+            deadline += period;
+
+            // Same as FramePacer: catch up, unless it's too late for that
+            if (now - deadline > period * (int)FramePacer::MAX_LATE_FRAMES)
+            {
+                deadline = now + period;
+            }
+
+            continue;
+        }
+
+        // Rounded up, so it doesn't wake up just before the deadline and spin
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::microseconds(999));
+
+        this->poll((int)timeout.count());
+    }
+}
+
+// Makes run() return (safe from a signal handler)
+void StreamServer::stop()
+{
+    this->running = false;
+}
+
+// Waits up to timeout ms for the sockets and handles what's ready
+void StreamServer::poll(int timeout)
+{
+    std::vector<pollfd> descriptors;
+
+    descriptors.reserve(this->clients.size() + 1);
+    descriptors.push_back({this->listener, POLLIN, 0});
+
+    for (auto& client : this->clients)
+    {
+        short events = client->closing ? 0 : POLLIN;
+
+        if (client->queued() > 0)
+        {
+            events |= POLLOUT;
+        }
+
+        descriptors.push_back({client->fd, events, 0});
+    }
+
+    if (::poll(descriptors.data(), descriptors.size(), timeout) <= 0)
+    {
+        return;
+    }
+
+    if (descriptors[0].revents & POLLIN)
+    {
+        this->accept_clients();
+    }
+
+    for (size_t i = 1; i < descriptors.size(); i++)
+    {
+        Client& client = *this->clients[i - 1];
+        short revents = descriptors[i].revents;
+
+        if (client.fd >= 0 && (revents & POLLOUT))
+        {
+            this->write_client(client);
+        }
+
+        if (client.fd >= 0 && (revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            this->read_client(client);
+        }
+    }
+
+    this->clients.erase(std::remove_if(this->clients.begin(), this->clients.end(),
+                                       [](const std::unique_ptr<Client>& client) { return client->fd < 0; }),
+                        this->clients.end());
+}
+
+// Runs every instance one frame and queues the deltas (and pending keyframes) for its clients
+void StreamServer::frame()
+{
+    for (auto& instance : this->instances)
+    {
+        CPU& cpu = instance->cpu;
+
+        for (unsigned cycle = 0; cycle < instance->cycles_per_frame; cycle++)
+        {
+            cpu.emulate_cycle();
+        }
+
+        instance->frame++;
+        instance->changed = false;
+        instance->delta.clear();
+
+        // Same hash, same pixels: the rows drawn were drawn back as they were
+        if (cpu.get_frame_hash() != instance->encoded_hash)
+        {
+            instance->changed = instance->encoder.encode(cpu.get_gfx(), cpu.get_dirty_rows(), instance->frame,
+                                                         instance->delta);
+            instance->encoded_hash = cpu.get_frame_hash();
+        }
+
+        cpu.clear_dirty_rows();
+    }
+
+    for (auto& client : this->clients)
+    {
+        if (!client->websocket || client->closing || client->fd < 0)
+        {
+            continue;
+        }
+
+        Instance& instance = *this->instances[client->instance];
+
+        if (client->needs_keyframe)
+        {
+            // The keyframe is the encoder's frame, so it already includes this frame's delta
+            if (client->queued() == 0)
+            {
+                this->send_keyframe(*client);
+            }
+        }
+        else if (instance.changed)
+        {
+            if (client->queued() > StreamServer::MAX_QUEUED)
+            {
+                client->needs_keyframe = true;
+            }
+            else
+            {
+                this->send_message(*client, WS_BINARY, instance.delta.data(), instance.delta.size());
+                this->stats.messages++;
+            }
+        }
+
+        if (client->queued() > 0)
+        {
+            this->write_client(*client);
+        }
+    }
+
+    this->stats.frames++;
+}
+
+StreamStats StreamServer::get_stats() const
+{
+    StreamStats current = this->stats;
+
+    current.clients = 0;
+
+    for (auto& client : this->clients)
+    {
+        current.clients += client->websocket && client->fd >= 0;
+    }
+
+    return current;
+}
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key
+string StreamServer::accept_key(const string& key)
+{
+    byte digest[20];
+
+    sha1(key + WEBSOCKET_GUID, digest);
+
+    return base64(digest, sizeof(digest));
+}
+
+void StreamServer::accept_clients()
+{
+    while (true)
+    {
+        int fd = accept4(this->listener, NULL, NULL, SOCK_NONBLOCK);
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        // Deltas are small and due now
+        int nodelay = 1;
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        std::unique_ptr<Client> client(new Client());
+
+        client->fd = fd;
+        client->websocket = false;
+        client->closing = false;
+        client->needs_keyframe = false;
+        client->instance = 0;
+        client->sent = 0;
+
+        this->clients.push_back(std::move(client));
+    }
+}
+
+void StreamServer::read_client(Client& client)
+{
+    char buffer[4096];
+
+    while (client.fd >= 0 && !client.closing)
+    {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            return;
+        }
+
+        if (received <= 0)
+        {
+            this->close_client(client);
+
+            return;
+        }
+
+        client.input.append(buffer, received);
+
+        if (client.websocket)
+        {
+            this->handle_frames(client);
+        }
+        else if (client.input.find("\r\n\r\n") != string::npos)
+        {
+            this->handle_request(client);
+        }
+        else if (client.input.size() > StreamServer::MAX_REQUEST)
+        {
+            string response = http_response("431 Request Header Fields Too Large", "");
+
+            client.output.insert(client.output.end(), response.begin(), response.end());
+            client.closing = true;
+        }
+    }
+}
+
+void StreamServer::write_client(Client& client)
+{
+    while (client.queued() > 0)
+    {
+        ssize_t written = send(client.fd, client.output.data() + client.sent, client.queued(), MSG_NOSIGNAL);
+
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            return;
+        }
+
+        if (written <= 0)
+        {
+            this->close_client(client);
+
+            return;
+        }
+
+        client.sent += written;
+        this->stats.bytes_sent += written;
+    }
+
+    client.output.clear();
+    client.sent = 0;
+
+    if (client.closing)
+    {
+        this->close_client(client);
+    }
+}
+
+// A whole HTTP request is in the input: answers it (only WebSocket upgrades keep the connection)
+void StreamServer::handle_request(Client& client)
+{
+    size_t end = client.input.find("\r\n\r\n");
+    string head = client.input.substr(0, end);
+    string method, path, key, version, upgrade, connection;
+    size_t line_end = head.find("\r\n");
+    string request_line = head.substr(0, line_end);
+    size_t first_space = request_line.find(' ');
+    size_t second_space = request_line.find(' ', first_space + 1);
+
+    if (first_space != string::npos && second_space != string::npos)
+    {
+        method = request_line.substr(0, first_space);
+        path = request_line.substr(first_space + 1, second_space - first_space - 1);
+    }
+
+    while (line_end != string::npos)
+    {
+        size_t start = line_end + 2;
+
+        line_end = head.find("\r\n", start);
+
+        string line = head.substr(start, line_end == string::npos ? string::npos : line_end - start);
+        size_t colon = line.find(':');
+
+        if (colon == string::npos)
+        {
+            continue;
+        }
+
+        string name = to_lower(line.substr(0, colon));
+        size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        string value = value_start == string::npos ? "" : line.substr(value_start);
+
+        value.erase(value.find_last_not_of(" \t") + 1);
+
+        if (name == "sec-websocket-key")
+        {
+            key = value;
+        }
+        else if (name == "sec-websocket-version")
+        {
+            version = value;
+        }
+        else if (name == "upgrade")
+        {
+            upgrade = to_lower(value);
+        }
+        else if (name == "connection")
+        {
+            connection = to_lower(value);
+        }
+    }
+
+    client.input.erase(0, end + 4);
+
+    string response;
+    const string prefix = "/instance/";
+
+    if (method != "GET")
+    {
+        response = http_response("405 Method Not Allowed", "Allow: GET\r\n");
+    }
+    else if (path.compare(0, prefix.size(), prefix) == 0 && upgrade == "websocket" &&
+             connection.find("upgrade") != string::npos && !key.empty())
+    {
+        char* number_end = NULL;
+        unsigned long index = strtoul(path.c_str() + prefix.size(), &number_end, 10);
+
+        if (path.size() == prefix.size() || *number_end != '\0' || index >= this->instances.size())
+        {
+            response = http_response("404 Not Found", "");
+        }
+        else if (version != "13")
+        {
+            response = http_response("426 Upgrade Required", "Sec-WebSocket-Version: 13\r\n");
+        }
+        else
+        {
+            response = "HTTP/1.1 101 Switching Protocols\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: " + StreamServer::accept_key(key) + "\r\n\r\n";
+
+            client.output.insert(client.output.end(), response.begin(), response.end());
+            client.websocket = true;
+            client.instance = index;
+            client.needs_keyframe = true;
+
+            this->send_keyframe(client);
+            this->handle_frames(client);
+
+            return;
+        }
+    }
+    else if ((path == "/" || path == "/index.html") && !this->page.empty())
+    {
+        response = http_response("200 OK", "Content-Type: text/html; charset=utf-8\r\nCache-Control: no-cache\r\n",
+                                 this->page);
+    }
+    else
+    {
+        response = http_response("404 Not Found", "");
+    }
+
+    client.output.insert(client.output.end(), response.begin(), response.end());
+    client.closing = true;
+}
+
+// Handles the whole messages in the input (client messages are masked and never fragmented)
+void StreamServer::handle_frames(Client& client)
+{
+    const byte* input = reinterpret_cast<const byte*>(client.input.data());
+    size_t consumed = 0;
+
+    while (!client.closing)
+    {
+        size_t available = client.input.size() - consumed;
+        const byte* frame = input + consumed;
+
+        if (available < 2)
+        {
+            break;
+        }
+
+        bool fin = frame[0] & 0x80;
+        byte opcode = frame[0] & 0x0F;
+        bool masked = frame[1] & 0x80;
+        uint64_t length = frame[1] & 0x7F;
+        size_t header = 2;
+
+        if (length == 126)
+        {
+            header = 4;
+            length = available >= header ? (uint64_t)frame[2] << 8 | frame[3] : 0;
+        }
+        else if (length == 127)
+        {
+            header = 10;
+            length = 0;
+
+            for (unsigned i = 0; i < 8 && available >= header; i++)
+            {
+                length = length << 8 | frame[2 + i];
+            }
+        }
+
+        if (available < header)
+        {
+            break;
+        }
+
+        unsigned error = 0;
+
+        if (!masked)
+        {
+            error = WS_PROTOCOL_ERROR;
+        }
+        else if (length > StreamServer::MAX_MESSAGE)
+        {
+            error = WS_TOO_BIG;
+        }
+        else if (!fin || opcode == WS_CONTINUATION)
+        {
+            error = WS_UNSUPPORTED;
+        }
+
+        if (error != 0)
+        {
+            byte payload[2] = {(byte)(error >> 8), (byte)error};
+
+            this->send_message(client, WS_CLOSE, payload, sizeof(payload));
+            client.closing = true;
+
+            break;
+        }
+
+        if (available < header + 4 + length)
+        {
+            break;
+        }
+
+        byte payload[StreamServer::MAX_MESSAGE];
+        const byte* mask = frame + header;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            payload[i] = frame[header + 4 + i] ^ mask[i % 4];
+        }
+
+        consumed += header + 4 + length;
+
+        switch (opcode)
+        {
+            case WS_BINARY:
+                if (length == 2)
+                {
+                    this->instances[client.instance]->cpu.update_pressed_keys((WORD)(payload[0] | payload[1] << 8));
+                }
+                break;
+            case WS_CLOSE:
+                // Echo the status code and hang up
+                this->send_message(client, WS_CLOSE, payload, std::min<size_t>(length, 2));
+                client.closing = true;
+                break;
+            case WS_PING:
+                this->send_message(client, WS_PONG, payload, length);
+                break;
+            case WS_TEXT:
+            case WS_PONG:
+                break;
+            default:
+            {
+                byte code[2] = {(byte)(WS_PROTOCOL_ERROR >> 8), (byte)WS_PROTOCOL_ERROR};
+
+                this->send_message(client, WS_CLOSE, code, sizeof(code));
+                client.closing = true;
+                break;
+            }
+        }
+    }
+
+    client.input.erase(0, consumed);
+
+    if (client.closing)
+    {
+        client.input.clear();
+    }
+}
+
+// Queues a message (server messages are never masked)
+void StreamServer::send_message(Client& client, byte opcode, const byte* payload, size_t length)
+{
+    std::vector<byte>& output = client.output;
+
+    output.push_back(0x80 | opcode);
+
+    if (length < 126)
+    {
+        output.push_back((byte)length);
+    }
+    else if (length < 65536)
+    {
+        output.push_back(126);
+        output.push_back((byte)(length >> 8));
+        output.push_back((byte)length);
+    }
+    else
+    {
+        output.push_back(127);
+
+        for (int i = 7; i >= 0; i--)
+        {
+            output.push_back((byte)((uint64_t)length >> (8 * i)));
+        }
+    }
+
+    output.insert(output.end(), payload, payload + length);
+}
+
+void StreamServer::send_keyframe(Client& client)
+{
+    this->message.clear();
+    this->instances[client.instance]->encoder.keyframe(this->message);
+
+    this->send_message(client, WS_BINARY, this->message.data(), this->message.size());
+
+    client.needs_keyframe = false;
+    this->stats.messages++;
+    this->stats.keyframes++;
+}
+
+void StreamServer::close_client(Client& client)
+{
+    if (client.fd >= 0)
+    {
+        close(client.fd);
+        client.fd = -1;
+    }
+}
@@ -0,0 +1,149 @@
+#include "terminal_renderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+const char* const TerminalRenderer::HIDE_CURSOR = "\x1b[?25l";
+const char* const TerminalRenderer::SHOW_CURSOR = "\x1b[?25h";
+const char* const TerminalRenderer::CLEAR = "\x1b[2J";
+
+// Bit of each pixel of a Braille cell (column, row) -> dot (Unicode order: 1 2 3 7 / 4 5 6 8)
+static const byte BRAILLE_DOTS[2][4] = {{0x01, 0x02, 0x04, 0x40}, {0x08, 0x10, 0x20, 0x80}};
+
+TerminalRenderer::TerminalRenderer(TerminalGlyphs cell_glyphs, unsigned row, unsigned col) :
+    glyphs(cell_glyphs),
+    origin_row(row),
+    origin_col(col),
+    rows(cell_glyphs == TerminalGlyphs::BRAILLE ? CPU::HEIGHT / 4 : CPU::HEIGHT / 2),
+    columns(cell_glyphs == TerminalGlyphs::BRAILLE ? CPU::WIDTH / 2 : CPU::WIDTH),
+    cells(rows * columns, 0),
+    next(rows * columns, 0),
+    valid(false)
+{
+
+}
+
+unsigned TerminalRenderer::get_rows() const
+{
+    return this->rows;
+}
+
+unsigned TerminalRenderer::get_columns() const
+{
+    return this->columns;
+}
+
+// The next render() clears the terminal and draws every cell (e.g. after a resize)
+void TerminalRenderer::invalidate()
+{
+    this->valid = false;
+}
+
+byte TerminalRenderer::cell(const byte* gfx, unsigned row, unsigned col) const
+{
+    if (this->glyphs == TerminalGlyphs::HALF_BLOCKS)
+    {
+        return gfx[2 * row * CPU::WIDTH + col] | gfx[(2 * row + 1) * CPU::WIDTH + col] << 1;
+    }
+
+    byte dots = 0;
+
+    for (unsigned y = 0; y < 4; y++)
+    {
+        const byte* pixels = gfx + (4 * row + y) * CPU::WIDTH + 2 * col;
+
+        dots |= (pixels[0] ? BRAILLE_DOTS[0][y] : 0) | (pixels[1] ? BRAILLE_DOTS[1][y] : 0);
+    }
+
+    return dots;
+}
+
+// UTF-8 of a cell
+void TerminalRenderer::glyph(byte bits, std::string& output) const
+{
+    if (this->glyphs == TerminalGlyphs::HALF_BLOCKS)
+    {
+        // Top pixel in bit 0, bottom pixel in bit 1
+        const char* const BLOCKS[4] = {" ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88"};
+
+        output += BLOCKS[bits & 3];
+
+        return;
+    }
+
+    // U+2800 + dots
+    output += '\xe2';
+    output += (char)(0xA0 | bits >> 6);
+    output += (char)(0x80 | (bits & 0x3F));
+}
+
+// Appends the escapes that bring the terminal to the given frame. Returns the cells written.
+unsigned TerminalRenderer::render(const byte* gfx, std::string& output)
+{
+    unsigned changed = 0;
+    unsigned cursor_row = 0;
+    unsigned cursor_col = 0;
+    bool cursor_known = false;
+
+    for (unsigned row = 0; row < this->rows; row++)
+    {
+        for (unsigned col = 0; col < this->columns; col++)
+        {
+            this->next[row * this->columns + col] = this->cell(gfx, row, col);
+        }
+    }
+
+    if (!this->valid)
+    {
+        // Cleared cells are blank: only the lit ones need to be drawn
+        output += TerminalRenderer::CLEAR;
+        std::fill(this->cells.begin(), this->cells.end(), 0);
+        this->valid = true;
+    }
+
+    for (unsigned row = 0; row < this->rows; row++)
+    {
+        for (unsigned col = 0; col < this->columns; col++)
+        {
+            unsigned index = row * this->columns + col;
+
+            if (this->next[index] == this->cells[index])
+            {
+                continue;
+            }
+
+            if (!cursor_known || cursor_row != row || cursor_col > col)
+            {
+                char jump[32];
+
+                snprintf(jump, sizeof(jump), "\x1b[%u;%uH", this->origin_row + row, this->origin_col + col);
+                output += jump;
+            }
+            else if (cursor_col < col)
+            {
+                // Same row, some unchanged cells before this one: write them again or skip them
+                string cells_between;
+                char skip[16];
+
+                for (unsigned between = cursor_col; between < col; between++)
+                {
+                    this->glyph(this->cells[row * this->columns + between], cells_between);
+                }
+
+                snprintf(skip, sizeof(skip), "\x1b[%uC", col - cursor_col);
+                output += cells_between.size() <= strlen(skip) ? cells_between : string(skip);
+            }
+
+            this->glyph(this->next[index], output);
+            this->cells[index] = this->next[index];
+
+            cursor_known = true;
+            cursor_row = row;
+            cursor_col = col + 1;
+            changed++;
+        }
+    }
+
+    return changed;
+}
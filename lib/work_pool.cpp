@@ -0,0 +1,194 @@
+#include "work_pool.h"
+
+#include <algorithm>
+
+// Pool and index of the worker running on this thread (NULL outside the workers)
+static thread_local const WorkStealingPool* current_pool = NULL;
+static thread_local unsigned current_worker = 0;
+
+// As many workers as hardware threads when 0
+WorkStealingPool::WorkStealingPool(unsigned count) :
+    queued(0),
+    pending(0),
+    sleeping(0),
+    next_worker(0),
+    stopping(false)
+{
+    if (count == 0)
+    {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        this->workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        this->workers.back()->executed = 0;
+        this->workers.back()->stolen = 0;
+        this->workers.back()->sleeps = 0;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        this->threads.push_back(std::thread(&WorkStealingPool::worker_loop, this, i));
+    }
+}
+
+// Finishes the tasks already submitted
+WorkStealingPool::~WorkStealingPool()
+{
+    this->wait();
+
+    {
+        std::lock_guard<std::mutex> guard(this->idle_lock);
+
+        this->stopping = true;
+    }
+
+    this->work_available.notify_all();
+
+    for (std::thread& thread : this->threads)
+    {
+        thread.join();
+    }
+}
+
+unsigned WorkStealingPool::get_workers() const
+{
+    return this->workers.size();
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    unsigned index = current_pool == this ? current_worker : this->next_worker++ % this->workers.size();
+    Worker& worker = *this->workers[index];
+
+    this->pending++;
+
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+
+        worker.tasks.push_back(std::move(task));
+    }
+
+    this->queued++;
+
+    // A worker going to sleep counts itself before looking at queued (under idle_lock), so
+    // either it sees this task or this sees it sleeping
+    if (this->sleeping > 0)
+    {
+        std::lock_guard<std::mutex> guard(this->idle_lock);
+
+        this->work_available.notify_one();
+    }
+}
+
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> guard(this->idle_lock);
+
+    this->all_done.wait(guard, [this]() { return this->pending == 0; });
+}
+
+// Own tasks from the back, then the others' from the front
+bool WorkStealingPool::take(unsigned index, Task& task)
+{
+    size_t count = this->workers.size();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Worker& worker = *this->workers[(index + i) % count];
+        std::lock_guard<std::mutex> guard(worker.lock);
+
+        if (worker.tasks.empty())
+        {
+            continue;
+        }
+
+        if (i == 0)
+        {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            this->workers[index]->stolen++;
+        }
+
+        this->queued--;
+
+        return true;
+    }
+
+    return false;
+}
+
+void WorkStealingPool::worker_loop(unsigned index)
+{
+    Worker& self = *this->workers[index];
+    Task task;
+
+    current_pool = this;
+    current_worker = index;
+
+    while (true)
+    {
+        if (this->take(index, task))
+        {
+            task(index);
+            task = nullptr;
+            self.executed++;
+
+            if (--this->pending == 0)
+            {
+                std::lock_guard<std::mutex> guard(this->idle_lock);
+
+                this->all_done.notify_all();
+            }
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(this->idle_lock);
+
+        this->sleeping++;
+
+        if (this->queued == 0 && !this->stopping)
+        {
+            self.sleeps++;
+            this->work_available.wait(guard, [this]() { return this->queued > 0 || this->stopping; });
+        }
+
+        this->sleeping--;
+
+        if (this->stopping && this->queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+WorkPoolStats WorkStealingPool::get_stats() const
+{
+    WorkPoolStats total = {0, 0, 0};
+
+    for (unsigned i = 0; i < this->workers.size(); i++)
+    {
+        WorkPoolStats worker = this->get_worker_stats(i);
+
+        total.tasks += worker.tasks;
+        total.steals += worker.steals;
+        total.sleeps += worker.sleeps;
+    }
+
+    return total;
+}
+
+WorkPoolStats WorkStealingPool::get_worker_stats(unsigned index) const
+{
+    const Worker& worker = *this->workers[index];
+    WorkPoolStats stats = {worker.executed, worker.stolen, worker.sleeps};
+
+    return stats;
+}
@@ -1,30 +1,76 @@
 #include "cpu.h"
+#include "rom_catalog.h"
+#include "frame_pacer.h"
+#include "key_input.h"
+#include "audio.h"
+#include "pixel_pipeline.h"
 
 #include <SDL2/SDL.h>
 #include <iostream>
 #include <string>
 #include <csignal>
-#include <chrono>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <vector>
 
 const unsigned SCREEN_FACTOR = 10;
 const double FREQUENCY = 60.0;
-const double TIME_PER_OPCODE = 1000.0 / FREQUENCY;
+const unsigned CYCLES_PER_FRAME = 1;   // The timers tick once per instruction, so they run at FREQUENCY
 
 struct SDL2Graphics
 {
     SDL_Window* window;
     SDL_Renderer* renderer;
 
+    // Frame converted by the pixel pipeline and uploaded as a whole (stretched to the window)
+    SDL_Texture* texture;
+    PixelPipeline pipeline;
+    std::vector<uint32_t> pixels;
+
     SDL2Graphics() :
         window(NULL),
-        renderer(NULL)
+        renderer(NULL),
+        texture(NULL)
     {
     }
 };
 
 SDL2Graphics* _graphics = NULL;
+// Set by the signal handler, the main loop does the shutdown
+volatile sig_atomic_t _quit = 0;
 
 std::string rom_path("");
+PacingMode pacing_mode = PacingMode::LOW_LATENCY;
+PixelScaler scaler = PixelScaler::NEAREST;
+std::string audio_output("sdl");   // "sdl", "none" or the path of a WAV file
+
+/*
+ * The emulation runs in its own thread, paced by FramePacer. The main thread sleeps on SDL
+ * events (SDL wants them and the rendering there): key events go to the emulation through
+ * KeyInput, and the emulation posts a frame event whenever the screen changed.
+ */
+struct Emulation
+{
+    KeyInput input;
+    Buzzer buzzer;
+    std::atomic<bool> running;
+    std::atomic<bool> frame_pending;
+    Uint32 frame_event;
+
+    // Last screen, copied by the emulation thread and drawn by the main thread
+    std::mutex frame_mutex;
+    byte frame[CPU::GFX_LENGTH];
+
+    Emulation() :
+        running(true),
+        frame_pending(false),
+        frame_event(0)
+    {
+    }
+};
 
 const byte KEY_MAPPING[CPU::KEY_MAPPING_SIZE] = 
 {
@@ -38,6 +84,12 @@ void delete_graphics(SDL2Graphics* graphics)
 {
     if (graphics != NULL)
     {
+        if (graphics->texture != NULL)
+        {
+            std::cout << "Destroying SDL texture..." << std::endl;
+
+            SDL_DestroyTexture(graphics->texture);
+        }
         if (graphics->window != NULL)
         {
             std::cout << "Destroying SDL window..." << std::endl;
@@ -63,11 +115,21 @@ void delete_graphics(SDL2Graphics* graphics)
 
 void signal_handler(int signal_num)
 {
-    std::cout << std::endl << "Interrupt signal (" << signal_num << ") received." << std::endl;
-
-    delete_graphics(_graphics);
+    _quit = signal_num;
+}
 
-    exit(signal_num);
+// Scale of the converted frame (Scale2x and Scale3x have their own, SDL stretches it to the window)
+unsigned texture_factor()
+{
+    switch (scaler)
+    {
+        case PixelScaler::SCALE2X:
+            return 2;
+        case PixelScaler::SCALE3X:
+            return 3;
+        default:
+            return SCREEN_FACTOR;
+    }
 }
 
 SDL2Graphics* setup_graphics()
@@ -112,6 +174,18 @@ SDL2Graphics* setup_graphics()
         return NULL;
     }
 
+    unsigned factor = texture_factor();
+
+    _graphics->pixels.resize(CPU::GFX_LENGTH * factor * factor);
+    _graphics->texture = SDL_CreateTexture(_graphics->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                           CPU::WIDTH * factor, CPU::HEIGHT * factor);
+
+    if (_graphics->texture == NULL)
+    {
+        std::cerr << "SDL_CreateTexture Error: " << SDL_GetError() << std::endl;
+        return NULL;
+    }
+
     // Set the color
     SDL_SetRenderDrawColor(_graphics->renderer, 0, 0, 0, 255);
 
@@ -126,96 +200,198 @@ SDL2Graphics* setup_graphics()
 
 void draw_graphics(SDL2Graphics* graphics, byte* gfx)
 {
-    for (size_t row = 0; row < CPU::HEIGHT; row++)
-    {
-        for (size_t col = 0; col < CPU::WIDTH; col++)
-        {
-            SDL_Rect rectangle;
-
-            rectangle.x = col * SCREEN_FACTOR;
-            rectangle.y = row * SCREEN_FACTOR;
-            rectangle.w = SCREEN_FACTOR;
-            rectangle.h = SCREEN_FACTOR;
-
-            if (gfx[row * CPU::WIDTH + col] == CPU::COLOR_BLACK)
-            {
-                SDL_SetRenderDrawColor(graphics->renderer, 0, 0, 0, 255);
-            }
-            else if (gfx[row * CPU::WIDTH + col] == CPU::COLOR_WHITE)
-            {
-                SDL_SetRenderDrawColor(graphics->renderer, 255, 255, 255, 255);
-            }
-            else
-            {
-                std::cout << "WARNING: unknown color. Using black by default." << std::endl;
-
-                SDL_SetRenderDrawColor(graphics->renderer, 0, 0, 0, 255);
-            }
+    unsigned width = CPU::WIDTH * texture_factor();
 
-            SDL_RenderFillRect(graphics->renderer, &rectangle);
-
-            //SDL_RenderPresent(graphics->renderer);    // It updates the screen at every rectangle that is created
-        }
-    }
+    graphics->pipeline.render(gfx, PixelPipeline::DEFAULT_PALETTE, scaler, SCREEN_FACTOR, graphics->pixels.data());
 
+    SDL_UpdateTexture(graphics->texture, NULL, graphics->pixels.data(), width * sizeof(uint32_t));
+    SDL_RenderCopy(graphics->renderer, graphics->texture, NULL, NULL);
     SDL_RenderPresent(graphics->renderer);
 }
 
 void print_syntax_and_exit(char** argv)
 {
-    std::cerr << "Syntax: " << argv[0] << " [path_to_file | --env_var=ENV_VAR]" << std::endl;
+    std::cerr << "Syntax: " << argv[0] << " [--pacing=latency|power] [--audio=sdl|none|file.wav] "
+              << "[--scaler=nearest|scale2x|scale3x] "
+              << "[path_to_file | --env_var=ENV_VAR]" << std::endl;
 
     exit(-1);
 }
 
 void handle_args(int argc, char** argv)
 {
-    if (argc > 1)
+    for (int i = 1; i < argc; i++)
     {
-        if (argc == 2)
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else if (strncmp(argv[i], "--pacing=", 9) == 0)
         {
-            if (strcmp(argv[1], "--help") == 0)
+            if (strcmp(argv[i] + 9, "latency") == 0)
+            {
+                pacing_mode = PacingMode::LOW_LATENCY;
+            }
+            else if (strcmp(argv[i] + 9, "power") == 0)
+            {
+                pacing_mode = PacingMode::LOW_POWER;
+            }
+            else
             {
                 print_syntax_and_exit(argv);
             }
-            else if (strncmp(argv[1], "--env_var=", 10) == 0)
+        }
+        else if (strncmp(argv[i], "--scaler=", 9) == 0)
+        {
+            if (strcmp(argv[i] + 9, "nearest") == 0)
             {
-                if (strlen(argv[1]) == 10)
-                {
-                    print_syntax_and_exit(argv);
-                }
-                else
-                {
-                    rom_path = string(getenv(argv[1] + 10));
-                }
+                scaler = PixelScaler::NEAREST;
+            }
+            else if (strcmp(argv[i] + 9, "scale2x") == 0)
+            {
+                scaler = PixelScaler::SCALE2X;
+            }
+            else if (strcmp(argv[i] + 9, "scale3x") == 0)
+            {
+                scaler = PixelScaler::SCALE3X;
             }
             else
             {
-                rom_path = string(argv[1]);
+                print_syntax_and_exit(argv);
             }
         }
-        else
+        else if (strncmp(argv[i], "--audio=", 8) == 0 && strlen(argv[i]) > 8)
+        {
+            audio_output = string(argv[i] + 8);
+        }
+        else if (!rom_path.empty())
         {
             print_syntax_and_exit(argv);
         }
+        else if (strncmp(argv[i], "--env_var=", 10) == 0)
+        {
+            if (strlen(argv[i]) == 10 || getenv(argv[i] + 10) == NULL)
+            {
+                print_syntax_and_exit(argv);
+            }
+            else
+            {
+                rom_path = string(getenv(argv[i] + 10));
+            }
+        }
+        else
+        {
+            rom_path = string(argv[i]);
+        }
+    }
+}
+
+// Keypad index of a scancode, -1 if it is not mapped
+int keypad_index(SDL_Scancode scancode)
+{
+    for (size_t i = 0; i < CPU::KEY_MAPPING_SIZE; i++)
+    {
+        if (KEY_MAPPING[i] == scancode)
+        {
+            return i;
+        }
     }
+
+    return -1;
+}
+
+void audio_callback(void* userdata, Uint8* stream, int length)
+{
+    static_cast<Buzzer*>(userdata)->render(reinterpret_cast<int16_t*>(stream), length / sizeof(int16_t));
 }
 
-void get_pressed_keys(byte* keys, size_t length, const byte* keyboard_state)
+// Audio device fed by the buzzer from SDL's audio thread (0 if there is none: the emulation goes on silent)
+SDL_AudioDeviceID open_audio(Buzzer& buzzer)
 {
-    SDL_PumpEvents();
+    SDL_AudioSpec wanted;
+    SDL_AudioSpec obtained;
 
-    for (size_t i = 0; i < length; i++)
+    memset(&wanted, 0, sizeof(wanted));
+    wanted.freq = buzzer.get_sample_rate();
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = 512;
+    wanted.callback = audio_callback;
+    wanted.userdata = &buzzer;
+
+    SDL_AudioDeviceID device = SDL_OpenAudioDevice(NULL, 0, &wanted, &obtained, 0);
+
+    if (device == 0)
     {
-        if (keyboard_state[KEY_MAPPING[i]])
+        std::cerr << "WARNING: couldn't open the audio device (" << SDL_GetError() << "). No sound." << std::endl;
+
+        return 0;
+    }
+
+    SDL_PauseAudioDevice(device, 0);
+
+    return device;
+}
+
+void emulate(CPU* cpu, Emulation* emulation)
+{
+    FramePacer pacer(FREQUENCY, pacing_mode);
+    AudioRecorder recorder(emulation->buzzer, FREQUENCY);
+    bool recording = audio_output != "sdl";
+    uint64_t presented = cpu->get_frame_hash();   // The window starts cleared, like the display
+
+    if (recording && !recorder.open(audio_output == "none" ? "" : audio_output))
+    {
+        recording = false;
+    }
+
+    while (emulation->running)
+    {
+        bool draw = false;
+
+        emulation->input.apply(*cpu);
+
+        for (unsigned cycle = 0; cycle < CYCLES_PER_FRAME; cycle++)
         {
-            keys[i] = (byte)1;
+            cpu->emulate_cycle();
+
+            draw |= cpu->is_draw_flag_set();
         }
-        else
+
+        emulation->buzzer.set_active(cpu->get_state().sound_timer > 0);
+
+        if (recording)
         {
-            keys[i] = (byte)0;
+            recorder.frame();
+        }
+
+        // Sprites erased and drawn again in the same place set the draw flag, but leave the same frame
+        if (draw && cpu->get_frame_hash() != presented)
+        {
+            presented = cpu->get_frame_hash();
+
+            {
+                std::lock_guard<std::mutex> lock(emulation->frame_mutex);
+
+                memcpy(emulation->frame, cpu->get_gfx(), CPU::GFX_LENGTH);
+            }
+
+            // One event at a time: if the main thread is behind it draws the latest frame once
+            if (!emulation->frame_pending.exchange(true))
+            {
+                SDL_Event event;
+
+                memset(&event, 0, sizeof(event));
+                event.type = emulation->frame_event;
+                SDL_PushEvent(&event);
+            }
         }
+
+        pacer.wait();
     }
+
+    // Also after an interrupt: main() stops the emulation and joins this thread first
+    pacer.print_stats(std::cout);
 }
 
 int main(int argc, char** argv)
@@ -226,7 +402,6 @@ int main(int argc, char** argv)
     signal(SIGTSTP, signal_handler);
 
     CPU chip8_cpu;
-    byte* gfx = chip8_cpu.get_gfx();
 
     SDL2Graphics* graphics = setup_graphics();
 
@@ -248,6 +423,26 @@ int main(int argc, char** argv)
         std::getline(std::cin, rom_path);   // It allows spaces
     }
 
+    if (!std::ifstream(rom_path).good())
+    {
+        // Not a file: look it up by name or hash in the ROM catalog
+        RomCatalog catalog;
+
+        if (catalog.load(RomCatalog::DEFAULT_INDEX))
+        {
+            const RomEntry* entry = catalog.find(rom_path);
+
+            if (entry != NULL)
+            {
+                std::cout << "Found \"" << rom_path << "\" in the catalog: " << entry->path
+                          << " (" << RomCatalog::platform_name(entry->platform) << ")" << std::endl;
+
+                rom_path = entry->path;
+                chip8_cpu.set_quirks(RomCatalog::quirks_profile());
+            }
+        }
+    }
+
     bool loaded = chip8_cpu.load_rom(rom_path);
 
     if (loaded)
@@ -263,47 +458,72 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    double wait = TIME_PER_OPCODE;
-    byte keys[CPU::KEY_MAPPING_SIZE];
-    const byte* keyboard_state = SDL_GetKeyboardState(NULL);
-    
-    for (;;)
-    {
-        std::chrono::high_resolution_clock::time_point begin = 
-            std::chrono::high_resolution_clock::now();
-
-        chip8_cpu.emulate_cycle();
-
-        if (chip8_cpu.is_draw_flag_set())
-        {
-            draw_graphics(graphics, gfx);
-        }
+    Emulation emulation;
+    byte frame[CPU::GFX_LENGTH];
+    SDL_Event event;
 
-        get_pressed_keys(keys, CPU::KEY_MAPPING_SIZE, keyboard_state);
-        chip8_cpu.update_pressed_keys(keys);
+    SDL_AudioDeviceID audio = audio_output == "sdl" ? open_audio(emulation.buzzer) : 0;
 
-        std::chrono::high_resolution_clock::time_point end = 
-            std::chrono::high_resolution_clock::now();
+    emulation.frame_event = SDL_RegisterEvents(1);
 
-        std::chrono::duration<double> time = 
-            std::chrono::duration_cast<std::chrono::duration<double>>(end - begin);
-        double time_ms = time.count();
+    std::thread emulation_thread(emulate, &chip8_cpu, &emulation);
 
-        wait -= time_ms;
+    while (emulation.running && !_quit)
+    {
+        // Wakes up now and then to see the signal flag
+        if (!SDL_WaitEventTimeout(&event, 100))
+        {
+            continue;
+        }
 
-        if (wait > 0.0)
+        if (event.type == SDL_QUIT)
         {
-            SDL_Delay((int)wait);
+            emulation.running = false;
+        }
+        else if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && event.key.repeat == 0)
+        {
+            int key = keypad_index(event.key.keysym.scancode);
+
+            if (key < 0)
+            {
+                continue;
+            }
 
-            wait = TIME_PER_OPCODE;
+            if (event.type == SDL_KEYDOWN)
+            {
+                emulation.input.press(key);
+            }
+            else
+            {
+                emulation.input.release(key);
+            }
         }
-        else
+        else if (event.type == emulation.frame_event)
         {
-            std::cout << "STRANGE!" << std::endl;
-            wait += TIME_PER_OPCODE;
+            {
+                std::lock_guard<std::mutex> lock(emulation.frame_mutex);
+
+                memcpy(frame, emulation.frame, CPU::GFX_LENGTH);
+                emulation.frame_pending = false;
+            }
+
+            draw_graphics(graphics, frame);
         }
     }
 
+    if (_quit)
+    {
+        std::cout << std::endl << "Interrupt signal (" << _quit << ") received." << std::endl;
+    }
+
+    emulation.running = false;
+    emulation_thread.join();
+
+    if (audio != 0)
+    {
+        SDL_CloseAudioDevice(audio);
+    }
+
     delete_graphics(graphics);
 
     return 0;
@@ -0,0 +1,133 @@
+#include "rom_analyzer.h"
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " path_to_file [--dot]" << std::endl;
+    std::cerr << "        " << argv[0] << " --corpus [roms_dir]" << std::endl;
+
+    exit(-1);
+}
+
+bool read_rom(const std::string& path, byte* buffer, size_t& length)
+{
+    std::ifstream rom(path, std::ios::binary | std::ios::ate);
+
+    if (!rom.is_open())
+    {
+        std::cerr << "The file (" << path << ") couldn't be opened or found." << std::endl;
+
+        return false;
+    }
+
+    std::streamoff size = rom.tellg();
+
+    if (size < 0 || size > CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN)
+    {
+        std::cerr << "ERROR: the whole game doesn't fit (" << path << "). Skipping." << std::endl;
+
+        return false;
+    }
+
+    rom.seekg(0, std::ios::beg);
+    rom.read((char*)buffer, size);
+
+    length = size;
+
+    return true;
+}
+
+int analyze_corpus(const std::string& root)
+{
+    RomCatalog catalog;
+    RomAnalyzer analyzer;
+    byte buffer[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN];
+    size_t length = 0;
+    unsigned static_code = 0;
+    unsigned hitting = 0;
+
+    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+    if (!catalog.build(root))
+    {
+        return -1;
+    }
+
+    const std::vector<RomEntry>& entries = catalog.get_entries();
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (!read_rom(entries[i].path, buffer, length))
+        {
+            continue;
+        }
+
+        analyzer.analyze(buffer, length);
+
+        unsigned hits = 0;
+
+        for (size_t s = 0; s < analyzer.get_stores().size(); s++)
+        {
+            hits += analyzer.get_stores()[s].hits_code;
+        }
+
+        static_code += analyzer.has_static_code();
+        hitting += hits > 0;
+
+        printf("%4u blocks  %5u code  %5u data  %3u stores  %2u hit code  %-7s  %s\n",
+               (unsigned)analyzer.get_blocks().size(), analyzer.get_code_size(), analyzer.get_data_size(),
+               (unsigned)analyzer.get_stores().size(), hits, analyzer.has_static_code() ? "static" : "guarded",
+               entries[i].path.c_str());
+    }
+
+    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - begin;
+
+    std::cout << entries.size() << " ROM(s) analyzed in " << time.count() * 1000 << " ms: " << static_code
+              << " with static code, " << hitting << " writing over their code." << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || strcmp(argv[1], "--help") == 0)
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    if (strcmp(argv[1], "--corpus") == 0)
+    {
+        return analyze_corpus(argc > 2 ? argv[2] : "roms");
+    }
+
+    bool dot = argc > 2 && strcmp(argv[2], "--dot") == 0;
+    byte buffer[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN];
+    size_t length = 0;
+    RomAnalyzer analyzer;
+
+    if ((argc > 2 && !dot) || !read_rom(argv[1], buffer, length))
+    {
+        return -1;
+    }
+
+    analyzer.analyze(buffer, length);
+
+    if (dot)
+    {
+        analyzer.print_dot(std::cout, argv[1]);
+    }
+    else
+    {
+        analyzer.print(std::cout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "aot.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+std::string rom_path("");
+std::string output_path("");
+std::string name("");
+bool with_main = false;
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " path_to_file [-o output.cpp] [--name=symbol] [--main]" << std::endl;
+
+    exit(-1);
+}
+
+void handle_args(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = std::string(argv[++i]);
+        }
+        else if (strncmp(argv[i], "--name=", 7) == 0)
+        {
+            name = std::string(argv[i] + 7);
+        }
+        else if (strcmp(argv[i], "--main") == 0)
+        {
+            with_main = true;
+        }
+        else if (rom_path.empty())
+        {
+            rom_path = std::string(argv[i]);
+        }
+        else
+        {
+            print_syntax_and_exit(argv);
+        }
+    }
+
+    if (rom_path.empty())
+    {
+        print_syntax_and_exit(argv);
+    }
+}
+
+// "Tetris [Fran Dachille, 1991].ch8" -> "tetris"
+std::string symbol_from_path(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string symbol;
+
+    for (size_t i = slash == std::string::npos ? 0 : slash + 1; i < path.size(); i++)
+    {
+        if (isalnum((unsigned char)path[i]))
+        {
+            symbol += tolower((unsigned char)path[i]);
+        }
+        else if (path[i] == '[' || path[i] == '(' || path[i] == '.')
+        {
+            break;
+        }
+        else if (!symbol.empty() && symbol[symbol.size() - 1] != '_')
+        {
+            symbol += '_';
+        }
+    }
+
+    while (!symbol.empty() && symbol[symbol.size() - 1] == '_')
+    {
+        symbol.erase(symbol.size() - 1);
+    }
+
+    return symbol.empty() ? "rom" : symbol;
+}
+
+int main(int argc, char** argv)
+{
+    handle_args(argc, argv);
+
+    std::ifstream rom(rom_path, std::ios::binary | std::ios::ate);
+
+    if (!rom.is_open())
+    {
+        std::cerr << "The file (" << rom_path << ") couldn't be opened or found." << std::endl;
+
+        return -1;
+    }
+
+    std::streamoff length = rom.tellg();
+    byte buffer[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN];
+
+    if (length < 0 || length > CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN)
+    {
+        std::cerr << "ERROR: the whole game doesn't fit. Aborting." << std::endl;
+
+        return -1;
+    }
+
+    rom.seekg(0, std::ios::beg);
+    rom.read((char*)buffer, length);
+
+    if (name.empty())
+    {
+        name = symbol_from_path(rom_path);
+    }
+
+    if (output_path.empty())
+    {
+        return AotCompiler::emit(std::cout, buffer, length, name, rom_path, with_main) ? 0 : -1;
+    }
+
+    std::ofstream output(output_path);
+
+    if (!output.is_open())
+    {
+        std::cerr << "ERROR: the output (" << output_path << ") couldn't be written." << std::endl;
+
+        return -1;
+    }
+
+    return AotCompiler::emit(output, buffer, length, name, rom_path, with_main) ? 0 : -1;
+}
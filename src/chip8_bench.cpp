@@ -0,0 +1,593 @@
+#include "cpu.h"
+#include "diff_harness.h"
+#include "conformance.h"
+#include "pixel_pipeline.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+/*
+ * ROM-level throughput benchmark
+ * ------------------------------
+ * Runs a fixed set of ROMs headless for a fixed number of instructions on every engine and
+ * reports instructions per second, ns per instruction, DXYN per second and frames per second
+ * (Conformance::DEFAULT_OPTIONS.cycles_per_frame cycles each), best of --repeat runs. Then
+ * microbenchmarks single opcode handlers, the conversion of a frame to pixels pixel by pixel,
+ * and the kernels and scalers of the pixel pipeline.
+ *
+ * --json writes the results (one entry per line) and --baseline compares them with a previous
+ * file: entries slower by more than --threshold percent are regressions (exit code 1).
+ */
+
+#if defined(__SANITIZE_ADDRESS__)
+const char* const FLAVOUR = "sanitized";
+#elif defined(__OPTIMIZE__)
+const char* const FLAVOUR = "optimized";
+#else
+const char* const FLAVOUR = "debug";
+#endif
+
+const char* const ROMS[] =
+{
+    "roms/games/Pong (1 player).ch8",
+    "roms/games/Space Invaders [David Winter].ch8",
+    "roms/games/Tetris [Fran Dachille, 1991].ch8",
+    "roms/games/Brix [Andreas Gustafsson, 1990].ch8",
+    "roms/games/Blinky [Hans Christian Egeberg, 1991].ch8",
+    "roms/games/Tank.ch8",
+    "roms/demos/Maze [David Winter, 199x].ch8",
+    "roms/demos/Particle Demo [zeroZshadow, 2008].ch8",
+    "roms/demos/Sierpinski [Sergey Naydenov, 2010].ch8",
+    "roms/demos/Trip8 Demo (2008) [Revival Studios].ch8",
+    "roms/demos/Zero Demo [zeroZshadow, 2007].ch8"
+};
+
+// Handlers measured on their own (2NNN and 00EE alternate, so the stack never overflows)
+const WORD OPCODES[] = {0x6A2B, 0x7A01, 0x8AB4, 0x8AB6, 0xA300, 0x3A00, 0xD015, 0xFA33, 0xF555, 0xF565, 0xCAFF, 0xEA9E, 0x2300};
+
+const unsigned SCREEN_FACTOR = 10;
+
+struct BenchResult
+{
+    string name;
+    uint64_t instructions;
+    double seconds;
+    uint64_t dxyn;
+};
+
+struct MicroResult
+{
+    string name;
+    double ns;
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [options]" << std::endl;
+    std::cerr << "  --instructions=N  instructions per ROM and engine (default: 1000000)" << std::endl;
+    std::cerr << "  --repeat=N        runs of each measure, the best one is kept (default: 3)" << std::endl;
+    std::cerr << "  --json=FILE       write the results as JSON" << std::endl;
+    std::cerr << "  --baseline=FILE   compare with the results of a previous --json" << std::endl;
+    std::cerr << "  --threshold=PCT   slowdown reported as a regression (default: 5)" << std::endl;
+
+    exit(-1);
+}
+
+string rom_name(const string& path)
+{
+    string name = path.substr(path.find_last_of('/') + 1);
+
+    return name.substr(0, name.find(".ch8"));
+}
+
+string json_escape(const string& text)
+{
+    string escaped;
+
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+// Cycles run before halting (up to the limit) and DXYN among them, with the interpreter
+void count_instructions(const std::shared_ptr<const CPU::Image>& image, uint64_t limit, uint64_t& instructions, uint64_t& dxyn)
+{
+    CPU cpu;
+    const CPU::State& state = cpu.get_state();
+
+    cpu.initializate();
+    cpu.load_image(image);
+    cpu.seed(1);
+
+    instructions = 0;
+    dxyn = 0;
+
+    while (instructions < limit && !state.halt)
+    {
+        cpu.emulate_cycle();
+
+        instructions++;
+        dxyn += (state.opcode & 0xF000) == 0xD000;
+    }
+}
+
+double run_engine(const std::shared_ptr<const CPU::Image>& image, const DiffEngine* engine, uint64_t instructions)
+{
+    CPU cpu;
+    std::unique_ptr<ExecutionManager> manager;
+
+    cpu.initializate();
+    cpu.load_image(image);
+    cpu.seed(1);
+
+    if (engine != NULL)
+    {
+        manager = DiffHarness::create_manager(*engine);
+    }
+
+    Clock::time_point begin = Clock::now();
+
+    if (manager)
+    {
+        manager->run(cpu, instructions);
+    }
+    else
+    {
+        for (uint64_t i = 0; i < instructions; i++)
+        {
+            cpu.emulate_cycle();
+        }
+    }
+
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+double micro_opcode(WORD opcode, unsigned iterations)
+{
+    CPU cpu;
+    CPU::State& state = cpu.get_state();
+
+    cpu.initializate();
+    cpu.seed(1);
+
+    Clock::time_point begin = Clock::now();
+
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        state.I = CPU::FONTSET_MEMORY_BEGIN;
+        cpu.execute_instruction(opcode);
+
+        if (opcode >> 12 == 0x2)
+        {
+            cpu.execute_instruction(0x00EE);
+        }
+    }
+
+    return std::chrono::duration<double>(Clock::now() - begin).count() * 1e9 / iterations;
+}
+
+// Frame to 32-bit pixels, pixel by pixel as draw_graphics() picks its colors (optionally scaled)
+double micro_frame(unsigned factor, unsigned iterations)
+{
+    CPU cpu;
+    std::vector<uint32_t> pixels(CPU::GFX_LENGTH * factor * factor);
+    volatile uint32_t sink = 0;
+
+    cpu.initializate();
+
+    byte* gfx = cpu.get_gfx();
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        gfx[i] = (i * 7 / 3) % 2;
+    }
+
+    Clock::time_point begin = Clock::now();
+
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        for (unsigned row = 0; row < CPU::HEIGHT * factor; row++)
+        {
+            for (unsigned col = 0; col < CPU::WIDTH * factor; col++)
+            {
+                byte color = gfx[(row / factor) * CPU::WIDTH + col / factor];
+
+                pixels[row * CPU::WIDTH * factor + col] = color == CPU::COLOR_WHITE ? 0xFFFFFFFF : 0xFF000000;
+            }
+        }
+
+        sink += pixels[i % pixels.size()];
+    }
+
+    return std::chrono::duration<double>(Clock::now() - begin).count() * 1e9 / iterations;
+}
+
+// Pixel pipeline: each supported kernel, then the scalers with the best one
+void micro_pipeline(unsigned repeat, std::vector<MicroResult>& micro)
+{
+    const PixelKernel kernels[] = {PixelKernel::SCALAR, PixelKernel::SSE2, PixelKernel::AVX2};
+    const unsigned ITERATIONS = 20000;
+    std::vector<uint32_t> pixels(CPU::GFX_LENGTH * SCREEN_FACTOR * SCREEN_FACTOR);
+    byte gfx[CPU::GFX_LENGTH];
+    byte packed[CPU::GFX_LENGTH / 8] = {};
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        gfx[i] = (i * 7 / 3) % 2;
+        packed[i / 8] |= gfx[i] << (7 - i % 8);
+    }
+
+    auto measure = [&](const string& name, unsigned iterations, const std::function<void()>& kernel)
+    {
+        double best = 0;
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            Clock::time_point begin = Clock::now();
+
+            for (unsigned i = 0; i < iterations; i++)
+            {
+                kernel();
+            }
+
+            double ns = std::chrono::duration<double>(Clock::now() - begin).count() * 1e9 / iterations;
+
+            best = r == 0 ? ns : std::min(best, ns);
+        }
+
+        micro.push_back({name, best});
+    };
+
+    for (PixelKernel kernel : kernels)
+    {
+        if (!PixelPipeline::is_supported(kernel))
+        {
+            continue;
+        }
+
+        PixelPipeline pipeline(kernel);
+
+        measure(string("pixels/expand/") + PixelPipeline::kernel_name(kernel), ITERATIONS,
+                [&]() { pipeline.expand(gfx, PixelPipeline::DEFAULT_PALETTE, pixels.data()); });
+        measure(string("pixels/expand_packed/") + PixelPipeline::kernel_name(kernel), ITERATIONS,
+                [&]() { pipeline.expand_packed(packed, PixelPipeline::DEFAULT_PALETTE, pixels.data()); });
+    }
+
+    PixelPipeline pipeline;
+
+    measure("pixels/nearest/x" + std::to_string(SCREEN_FACTOR), ITERATIONS / 10,
+            [&]() { pipeline.render(gfx, PixelPipeline::DEFAULT_PALETTE, PixelScaler::NEAREST, SCREEN_FACTOR, pixels.data()); });
+    measure("pixels/scale2x", ITERATIONS / 10,
+            [&]() { pipeline.render(gfx, PixelPipeline::DEFAULT_PALETTE, PixelScaler::SCALE2X, 2, pixels.data()); });
+    measure("pixels/scale3x", ITERATIONS / 10,
+            [&]() { pipeline.render(gfx, PixelPipeline::DEFAULT_PALETTE, PixelScaler::SCALE3X, 3, pixels.data()); });
+}
+
+bool write_json(const string& path, uint64_t instructions, const std::vector<BenchResult>& results,
+                const std::vector<MicroResult>& micro)
+{
+    std::ofstream json(path);
+
+    if (!json.is_open())
+    {
+        std::cerr << "ERROR: " << path << " couldn't be written." << std::endl;
+
+        return false;
+    }
+
+    json << "{\n  \"flavour\": \"" << FLAVOUR << "\",\n  \"instructions\": " << instructions << ",\n  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        char line[512];
+
+        snprintf(line, sizeof(line),
+                 "    {\"name\": \"%s\", \"instructions\": %llu, \"seconds\": %.6f, \"instructions_per_second\": %.0f, "
+                 "\"ns_per_instruction\": %.3f, \"dxyn_per_second\": %.0f, \"frames_per_second\": %.0f}%s\n",
+                 json_escape(result.name).c_str(), (unsigned long long)result.instructions, result.seconds,
+                 result.instructions / result.seconds, result.seconds * 1e9 / result.instructions, result.dxyn / result.seconds,
+                 result.instructions / (double)Conformance::DEFAULT_OPTIONS.cycles_per_frame / result.seconds,
+                 i + 1 < results.size() ? "," : "");
+
+        json << line;
+    }
+
+    json << "  ],\n  \"micro\": [\n";
+
+    for (size_t i = 0; i < micro.size(); i++)
+    {
+        char line[256];
+
+        snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"ns\": %.3f}%s\n", json_escape(micro[i].name).c_str(),
+                 micro[i].ns, i + 1 < micro.size() ? "," : "");
+
+        json << line;
+    }
+
+    json << "  ]\n}\n";
+
+    return true;
+}
+
+// Name -> ns (per instruction or per call) of a file written by write_json()
+bool read_baseline(const string& path, string& flavour, std::map<string, double>& values)
+{
+    std::ifstream json(path);
+    string line;
+
+    if (!json.is_open())
+    {
+        std::cerr << "ERROR: the baseline (" << path << ") couldn't be opened." << std::endl;
+
+        return false;
+    }
+
+    while (std::getline(json, line))
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t ns = line.find("\"ns_per_instruction\": ");
+        size_t length = strlen("\"ns_per_instruction\": ");
+
+        if (line.find("\"flavour\": \"") != string::npos)
+        {
+            size_t begin = line.find("\"flavour\": \"") + strlen("\"flavour\": \"");
+
+            flavour = line.substr(begin, line.find('"', begin) - begin);
+        }
+        if (name == string::npos)
+        {
+            continue;
+        }
+        if (ns == string::npos)
+        {
+            ns = line.find("\"ns\": ");
+            length = strlen("\"ns\": ");
+        }
+
+        size_t begin = name + strlen("\"name\": \"");
+        size_t end = begin;
+
+        while (end < line.size() && (line[end] != '"' || line[end - 1] == '\\'))
+        {
+            end++;
+        }
+
+        string key;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            if (line[i] != '\\' || (i > begin && line[i - 1] == '\\'))
+            {
+                key += line[i];
+            }
+        }
+
+        values[key] = strtod(line.c_str() + ns + length, NULL);
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t instructions = 1000000;
+    unsigned repeat = 3;
+    double threshold = 5.0;
+    string json;
+    string baseline;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 15, "--instructions=") == 0)
+        {
+            instructions = strtoull(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--repeat=") == 0)
+        {
+            repeat = std::max(1ul, strtoul(value.c_str(), NULL, 10));
+        }
+        else if (arg.compare(0, 7, "--json=") == 0)
+        {
+            json = value;
+        }
+        else if (arg.compare(0, 11, "--baseline=") == 0)
+        {
+            baseline = value;
+        }
+        else if (arg.compare(0, 12, "--threshold=") == 0)
+        {
+            threshold = strtod(value.c_str(), NULL);
+        }
+        else
+        {
+            print_syntax_and_exit(argv);
+        }
+    }
+
+    const DiffEngine engines[] = {DiffEngine::DECODED, DiffEngine::FUSED, DiffEngine::TIERED};
+    const unsigned ENGINES = 1 + sizeof(engines) / sizeof(engines[0]);
+    std::vector<BenchResult> results;
+    std::vector<BenchResult> totals(ENGINES);
+    std::vector<MicroResult> micro;
+
+    for (unsigned e = 0; e < ENGINES; e++)
+    {
+        totals[e].name = string(e == 0 ? "interpreter" : DiffHarness::engine_name(engines[e - 1])) + "/all";
+        totals[e].instructions = 0;
+        totals[e].seconds = 0;
+        totals[e].dxyn = 0;
+    }
+
+    printf("Flavour: %s, %llu instructions per ROM, best of %u\n\n", FLAVOUR, (unsigned long long)instructions, repeat);
+    printf("%-12s %-40s %10s %9s %10s %11s\n", "Engine", "ROM", "M instr/s", "ns/instr", "k DXYN/s", "k frames/s");
+
+    for (const char* path : ROMS)
+    {
+        std::shared_ptr<const CPU::Image> image = CPU::read_image(path);
+        uint64_t executed = 0;
+        uint64_t dxyn = 0;
+
+        if (!image)
+        {
+            continue;
+        }
+
+        count_instructions(image, instructions, executed, dxyn);
+
+        for (unsigned e = 0; e < ENGINES; e++)
+        {
+            double best = 0;
+
+            for (unsigned r = 0; r < repeat; r++)
+            {
+                double seconds = run_engine(image, e == 0 ? NULL : &engines[e - 1], executed);
+
+                best = r == 0 ? seconds : std::min(best, seconds);
+            }
+
+            BenchResult result = {totals[e].name.substr(0, totals[e].name.find('/')) + "/" + rom_name(path), executed, best, dxyn};
+
+            results.push_back(result);
+            totals[e].instructions += executed;
+            totals[e].seconds += best;
+            totals[e].dxyn += dxyn;
+
+            printf("%-12s %-40s %10.2f %9.2f %10.1f %11.1f\n", result.name.substr(0, result.name.find('/')).c_str(),
+                   rom_name(path).substr(0, 40).c_str(), executed / best / 1e6, best * 1e9 / executed, dxyn / best / 1e3,
+                   executed / (double)Conformance::DEFAULT_OPTIONS.cycles_per_frame / best / 1e3);
+        }
+    }
+
+    results.insert(results.end(), totals.begin(), totals.end());
+
+    // Microbenchmarks
+    for (WORD opcode : OPCODES)
+    {
+        char name[32];
+        double best = 0;
+
+        snprintf(name, sizeof(name), "opcode/%04X", opcode);
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            double ns = micro_opcode(opcode, 1000000);
+
+            best = r == 0 ? ns : std::min(best, ns);
+        }
+
+        micro.push_back({name, best});
+    }
+
+    const unsigned factors[] = {1, SCREEN_FACTOR};
+
+    for (unsigned factor : factors)
+    {
+        double best = 0;
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            double ns = micro_frame(factor, factor == 1 ? 20000 : 200);
+
+            best = r == 0 ? ns : std::min(best, ns);
+        }
+
+        micro.push_back({"frame/x" + std::to_string(factor), best});
+    }
+
+    micro_pipeline(repeat, micro);
+
+    printf("\n");
+
+    for (const BenchResult& total : totals)
+    {
+        printf("%-12s %-40s %10.2f %9.2f %10.1f %11.1f\n", total.name.substr(0, total.name.find('/')).c_str(), "(all)",
+               total.instructions / total.seconds / 1e6, total.seconds * 1e9 / total.instructions,
+               total.dxyn / total.seconds / 1e3,
+               total.instructions / (double)Conformance::DEFAULT_OPTIONS.cycles_per_frame / total.seconds / 1e3);
+    }
+
+    printf("\n%-28s %12s\n", "Microbenchmark", "ns/call");
+
+    for (const MicroResult& result : micro)
+    {
+        printf("%-28s %12.2f\n", result.name.c_str(), result.ns);
+    }
+
+    if (!json.empty() && !write_json(json, instructions, results, micro))
+    {
+        return -1;
+    }
+
+    if (baseline.empty())
+    {
+        return 0;
+    }
+
+    // Comparison with the baseline (lower is better for every value)
+    string flavour;
+    std::map<string, double> previous;
+    std::vector<std::pair<string, double> > current;
+    unsigned regressions = 0;
+
+    if (!read_baseline(baseline, flavour, previous))
+    {
+        return -1;
+    }
+
+    for (const BenchResult& result : results)
+    {
+        current.push_back(std::make_pair(result.name, result.seconds * 1e9 / result.instructions));
+    }
+    for (const MicroResult& result : micro)
+    {
+        current.push_back(std::make_pair(result.name, result.ns));
+    }
+
+    printf("\nCompared with %s (%s%s)\n", baseline.c_str(), flavour.c_str(),
+           flavour == FLAVOUR ? "" : ", another flavour");
+
+    for (const std::pair<string, double>& value : current)
+    {
+        std::map<string, double>::const_iterator found = previous.find(value.first);
+
+        if (found == previous.end() || found->second <= 0)
+        {
+            continue;
+        }
+
+        double change = (value.second - found->second) * 100.0 / found->second;
+        bool regression = change > threshold;
+
+        regressions += regression;
+
+        printf("%-52s %10.2f -> %10.2f ns %+7.1f%%%s\n", value.first.substr(0, 52).c_str(), found->second, value.second,
+               change, regression ? "  REGRESSION" : (change < -threshold ? "  improved" : ""));
+    }
+
+    printf("%u regression(s) over %.1f%%\n", regressions, threshold);
+
+    return regressions == 0 ? 0 : 1;
+}
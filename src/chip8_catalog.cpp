@@ -0,0 +1,89 @@
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " build [roms_dir] [index]" << std::endl;
+    std::cerr << "        " << argv[0] << " list [index]" << std::endl;
+    std::cerr << "        " << argv[0] << " find name_or_hash [index]" << std::endl;
+
+    exit(-1);
+}
+
+void print_entry(const RomEntry& entry)
+{
+    printf("%016llx  %5u  %-11s  %s\n", (unsigned long long)entry.hash, entry.size,
+           RomCatalog::platform_name(entry.platform), entry.path.c_str());
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    RomCatalog catalog;
+    std::string command(argv[1]);
+
+    if (command == "build")
+    {
+        std::string root = argc > 2 ? argv[2] : "roms";
+        std::string index = argc > 3 ? argv[3] : RomCatalog::DEFAULT_INDEX;
+
+        if (!catalog.build(root) || !catalog.save(index))
+        {
+            return -1;
+        }
+
+        std::cout << catalog.get_entries().size() << " ROM(s) indexed in " << index << "." << std::endl;
+    }
+    else if (command == "list")
+    {
+        if (!catalog.load(argc > 2 ? argv[2] : RomCatalog::DEFAULT_INDEX))
+        {
+            return -1;
+        }
+
+        for (size_t i = 0; i < catalog.get_entries().size(); i++)
+        {
+            print_entry(catalog.get_entries()[i]);
+        }
+    }
+    else if (command == "find" && argc > 2)
+    {
+        if (!catalog.load(argc > 3 ? argv[3] : RomCatalog::DEFAULT_INDEX))
+        {
+            return -1;
+        }
+
+        const RomEntry* entry = catalog.find(argv[2]);
+
+        if (entry == NULL)
+        {
+            std::cerr << "ROM not found (" << argv[2] << ")." << std::endl;
+
+            return -1;
+        }
+
+        print_entry(*entry);
+
+        std::cout << "Title    : " << entry->title << std::endl;
+        std::cout << "Author   : " << entry->author << std::endl;
+        std::cout << "Year     : " << entry->year << std::endl;
+        std::cout << "Controls : " << entry->controls << std::endl;
+        std::cout << "Quirks   : " << (RomCatalog::quirks_profile().wrap_sprites ? "sprites wrap" : "sprites clipped")
+                  << std::endl;
+    }
+    else
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "diff_harness.h"
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+struct DiffJob
+{
+    size_t rom;
+    DiffEngine engine;
+    DiffResult result;
+};
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [options] [roms_dir | file.ch8 ...]" << std::endl;
+    std::cerr << "  --engine=NAME   decoded, fused, tiered or all (default: all)" << std::endl;
+    std::cerr << "  --cycles=N      cycles per ROM and engine (default: " << DiffHarness::DEFAULT_OPTIONS.cycles << ")" << std::endl;
+    std::cerr << "  --keys=N        max. cycles between key changes, 0 for no keys (default: "
+              << DiffHarness::DEFAULT_OPTIONS.key_period << ")" << std::endl;
+    std::cerr << "  --seed=N        seed of the CXNN and key schedules (default: 1)" << std::endl;
+    std::cerr << "  --jobs=N        parallel runs (default: hardware threads)" << std::endl;
+
+    exit(-1);
+}
+
+bool ends_with(const string& text, const string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    DiffOptions options = DiffHarness::DEFAULT_OPTIONS;
+    std::vector<DiffEngine> engines = {DiffEngine::DECODED, DiffEngine::FUSED, DiffEngine::TIERED};
+    std::vector<string> roots;
+    uint32_t seed = 1;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 9, "--engine=") == 0)
+        {
+            DiffEngine engine;
+
+            if (value == "all")
+            {
+                continue;
+            }
+            if (!DiffHarness::parse_engine(value, engine))
+            {
+                print_syntax_and_exit(argv);
+            }
+
+            engines.assign(1, engine);
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            options.cycles = strtoull(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--keys=") == 0)
+        {
+            options.key_period = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--seed=") == 0)
+        {
+            seed = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--jobs=") == 0)
+        {
+            jobs = std::max(1ul, strtoul(value.c_str(), NULL, 10));
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            roots.push_back(arg);
+        }
+    }
+
+    if (roots.empty())
+    {
+        roots.push_back("roms");
+    }
+
+    // Every image is read before the runs start
+    std::vector<string> paths;
+    std::vector<std::shared_ptr<const CPU::Image> > images;
+
+    for (const string& root : roots)
+    {
+        RomCatalog catalog;
+        std::vector<string> found;
+
+        if (ends_with(root, ".ch8"))
+        {
+            found.push_back(root);
+        }
+        else if (catalog.build(root))
+        {
+            for (const RomEntry& entry : catalog.get_entries())
+            {
+                found.push_back(entry.path);
+            }
+        }
+        else
+        {
+            return -1;
+        }
+
+        for (const string& path : found)
+        {
+            std::shared_ptr<const CPU::Image> image = CPU::read_image(path);
+
+            if (image)
+            {
+                paths.push_back(path);
+                images.push_back(image);
+            }
+        }
+    }
+
+    std::vector<DiffJob> work;
+
+    for (size_t rom = 0; rom < images.size(); rom++)
+    {
+        for (DiffEngine engine : engines)
+        {
+            work.push_back({rom, engine, DiffResult()});
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+    for (unsigned t = 0; t < std::min<size_t>(jobs, work.size()); t++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (size_t i = next++; i < work.size(); i = next++)
+            {
+                const CPU::Image& image = *images[work[i].rom];
+                uint64_t hash = RomCatalog::hash(image.data, CPU::MEMORY_LENGTH_B);
+                DiffHarness harness(work[i].engine, options);
+
+                // Depends on the ROM, not on its position in the corpus
+                work[i].result = harness.run(images[work[i].rom], seed ^ (uint32_t)(hash ^ (hash >> 32)));
+            }
+        }));
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - begin;
+
+    uint64_t cycles = 0;
+    unsigned mismatches = 0;
+
+    for (const DiffJob& job : work)
+    {
+        cycles += job.result.cycles;
+        mismatches += !job.result.match;
+
+        printf("%-8s %-8s %10llu cycles  %s\n", job.result.match ? "OK" : "MISMATCH", DiffHarness::engine_name(job.engine),
+               (unsigned long long)job.result.cycles, paths[job.rom].c_str());
+
+        if (!job.result.match)
+        {
+            printf("%s", job.result.report.c_str());
+        }
+    }
+
+    printf("%u run(s) of %u ROM(s), %u mismatch(es), %llu cycles compared in %.2f s (%.1f M cycles/s, %u job(s))\n",
+           (unsigned)work.size(), (unsigned)images.size(), mismatches, (unsigned long long)cycles, time.count(),
+           cycles / time.count() / 1e6, jobs);
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#include "state_explorer.h"
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+/*
+ * Explores the states of every ROM given (or found under a directory) by pressing the keys
+ * for it, see StateExplorer. ROMs go one after the other, each explored by all the workers.
+ * The exit status is 1 when a ROM reached an unknown opcode or broke its stack.
+ */
+
+void print_syntax_and_exit(char** argv)
+{
+    const ExploreOptions& defaults = StateExplorer::DEFAULT_OPTIONS;
+
+    std::cerr << "Syntax: " << argv[0] << " [options] [roms_dir | file.ch8 ...]" << std::endl;
+    std::cerr << "  --cycles=N      instructions per frame (default: " << defaults.cycles << ")" << std::endl;
+    std::cerr << "  --depth=N       max. frames deep (default: " << defaults.max_depth << ")" << std::endl;
+    std::cerr << "  --states=N      max. states per ROM (default: " << defaults.max_states << ")" << std::endl;
+    std::cerr << "  --seed=N        seed of CXNN (default: " << defaults.seed << ")" << std::endl;
+    std::cerr << "  --wrap          sprites wrap around the screen (default: clipped)" << std::endl;
+    std::cerr << "  --jobs=N        workers (default: hardware threads)" << std::endl;
+    std::cerr << "  --summary       one line per ROM, without the findings" << std::endl;
+
+    exit(-1);
+}
+
+bool ends_with(const string& text, const string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    ExploreOptions options = StateExplorer::DEFAULT_OPTIONS;
+    std::vector<string> roots;
+    unsigned jobs = 0;
+    bool summary = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            options.cycles = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 8, "--depth=") == 0)
+        {
+            options.max_depth = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--states=") == 0)
+        {
+            options.max_states = std::max(1ull, strtoull(value.c_str(), NULL, 10));
+        }
+        else if (arg.compare(0, 7, "--seed=") == 0)
+        {
+            options.seed = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg == "--wrap")
+        {
+            options.quirks.wrap_sprites = true;
+        }
+        else if (arg.compare(0, 7, "--jobs=") == 0)
+        {
+            jobs = std::max(1ul, strtoul(value.c_str(), NULL, 10));
+        }
+        else if (arg == "--summary")
+        {
+            summary = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            roots.push_back(arg);
+        }
+    }
+
+    if (roots.empty())
+    {
+        roots.push_back("roms");
+    }
+
+    std::vector<string> paths;
+
+    for (const string& root : roots)
+    {
+        RomCatalog catalog;
+
+        if (ends_with(root, ".ch8"))
+        {
+            paths.push_back(root);
+        }
+        else if (catalog.build(root))
+        {
+            for (const RomEntry& entry : catalog.get_entries())
+            {
+                paths.push_back(entry.path);
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    WorkStealingPool pool(jobs);
+    StateExplorer explorer(pool, options);
+    unsigned explored = 0;
+    unsigned broken = 0;
+    unsigned stuck = 0;
+    unsigned off_screen = 0;
+    uint64_t states = 0;
+    double seconds = 0;
+
+    for (const string& path : paths)
+    {
+        std::shared_ptr<const CPU::Image> image = CPU::read_image(path);
+
+        if (!image)
+        {
+            continue;
+        }
+
+        ExploreResult result = explorer.explore(image);
+
+        bool crashes = result.counts[(unsigned)Finding::UNKNOWN_OPCODE] > 0 ||
+                       result.counts[(unsigned)Finding::STACK_OVERFLOW] > 0 ||
+                       result.counts[(unsigned)Finding::STACK_UNDERFLOW] > 0;
+
+        explored++;
+        broken += crashes ? 1 : 0;
+        stuck += result.counts[(unsigned)Finding::STUCK] > 0 ? 1 : 0;
+        off_screen += result.counts[(unsigned)Finding::DRAW_OFF_SCREEN] > 0 ? 1 : 0;
+        states += result.states;
+        seconds += result.seconds;
+
+        if (summary)
+        {
+            printf("%-8s %8llu states %4u frames %5u screens %4u/%-4u code  %s\n",
+                   crashes ? "CRASH" : result.counts[(unsigned)Finding::STUCK] > 0 ? "STUCK" : "OK",
+                   (unsigned long long)result.states, result.depth, result.screens, result.static_covered,
+                   result.static_code, path.c_str());
+            fflush(stdout);
+
+            continue;
+        }
+
+        std::cout << "== " << path << std::endl;
+        StateExplorer::print(std::cout, result);
+        std::cout << std::endl;
+    }
+
+    WorkPoolStats stats = pool.get_stats();
+
+    printf("%u ROM(s) explored: %u crash(es), %u stuck, %u drawing off screen; %llu states in %.2f s "
+           "(%u worker(s), %llu task(s), %llu stolen)\n",
+           explored, broken, stuck, off_screen, (unsigned long long)states, seconds, pool.get_workers(),
+           (unsigned long long)stats.tasks, (unsigned long long)stats.steals);
+
+    return broken > 0 ? 1 : 0;
+}
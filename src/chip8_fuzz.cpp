@@ -0,0 +1,475 @@
+#include "cpu.h"
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+/*
+ * Snapshot-reset fuzzing of the CPU core
+ * --------------------------------------
+ * Every execution starts from a snapshot taken right after initializate() and the loading of
+ * a corpus ROM (CPU::restore(): state, the rows drawn by the previous execution and the few
+ * private memory pages, the ROM image itself is shared). Then it:
+ *
+ *   - mutates ROM bytes (random bytes or opcodes around the edges of the core),
+ *   - picks the quirks and sometimes randomizes the registers, I and the stack pointer,
+ *   - runs a few cycles with a random key schedule, mixing fetched instructions with random
+ *     opcodes given to execute_instruction(),
+ *   - checks the invariants of the core after each cycle: stack pointer in range, 12-bit PC
+ *     and I, halting (in place) on stack errors only, FX0A the only one waiting for keys,
+ *   - checks the rows of the screen it drew on (pixels 0 or 1) and, one in
+ *     FuzzOptions::SCREEN_PERIOD executions, the frame hash against hash_frame().
+ *
+ * One in FuzzOptions::LOAD_PERIOD executions goes through load_rom_from_buffer() instead, with
+ * mutated bytes and lengths around the limit.
+ *
+ * Everything an execution does comes from its seed, so a failure is repeated with --replay.
+ * Build chip8-fuzz-asan (make chip8-fuzz-asan) to also catch invalid accesses. It also counts
+ * the out-of-range accesses the core turned into defined behaviour (CPU::Violations).
+ */
+
+struct FuzzOptions
+{
+    static const unsigned LOAD_PERIOD = 256;
+    static const unsigned SCREEN_PERIOD = 64;
+
+    uint64_t executions;
+    unsigned cycles;        // Per execution
+    uint64_t seed;
+};
+
+// xorshift64*: cheap enough to seed once per execution
+class FuzzRandom
+{
+    public:
+        FuzzRandom(uint64_t seed) :
+            state(seed * 0x9E3779B97F4A7C15ull | 1)
+        {
+
+        }
+
+        uint32_t next()
+        {
+            this->state ^= this->state >> 12;
+            this->state ^= this->state << 25;
+            this->state ^= this->state >> 27;
+
+            return (this->state * 0x2545F4914F6CDD1Dull) >> 32;
+        }
+
+        unsigned below(unsigned limit)
+        {
+            return this->next() % limit;
+        }
+
+    private:
+        uint64_t state;
+};
+
+// Opcodes around the edges of the core: stack, keys, end of memory and screen, fontset
+const WORD INTERESTING[] =
+{
+    0x00E0, 0x00EE, 0x00EE, 0x2200, 0x2FFE, 0xAFFF, 0xAFF8, 0xF055, 0xFF55, 0xFF65,
+    0xF033, 0xF029, 0xFF1E, 0xD00F, 0xDFFF, 0xE09E, 0xE0A1, 0xF00A, 0xBFFF, 0x1FFE,
+    0x8006, 0x800E, 0xC0FF, 0x60FF, 0x6FFF
+};
+
+const unsigned INTERESTING_COUNT = sizeof(INTERESTING) / sizeof(INTERESTING[0]);
+const size_t MAX_ROM_LENGTH = CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN;
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [options] [roms_dir | file.ch8 ...]" << std::endl;
+    std::cerr << "  --runs=N        executions (default: 1000000)" << std::endl;
+    std::cerr << "  --cycles=N      cycles per execution (default: 32)" << std::endl;
+    std::cerr << "  --seed=N        seed of the first execution (default: 1)" << std::endl;
+    std::cerr << "  --replay=N      run only the execution with seed N, printing every cycle" << std::endl;
+
+    exit(-1);
+}
+
+bool ends_with(const string& text, const string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool read_rom(const string& path, std::vector<byte>& rom)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    return !rom.empty() && rom.size() <= MAX_ROM_LENGTH;
+}
+
+WORD random_opcode(FuzzRandom& random)
+{
+    if (random.below(2) == 0)
+    {
+        return random.next();
+    }
+
+    // Interesting opcode with some of its operand bits flipped
+    return INTERESTING[random.below(INTERESTING_COUNT)] ^ (random.below(4) == 0 ? random.next() & 0x0FFF : 0);
+}
+
+// Returns the broken invariant (NULL if none) after opcode ran (ran: false if the CPU was halted)
+const char* check(CPU& cpu, const CPU::State& before, bool was_waiting, WORD opcode, bool ran)
+{
+    const CPU::State& state = cpu.get_state();
+
+    if (state.sp > CPU::STACK_DEEPNESS)
+    {
+        return "stack pointer out of range";
+    }
+
+    if (state.pc > 0x0FFF || state.I > 0x0FFF)
+    {
+        return "PC or I past 12 bits";
+    }
+
+    // The stack errors are the only way to halt: the PC and the stack stay where they were
+    bool stack_error = ran && (((opcode & 0xF000) == 0x2000 && before.sp >= CPU::STACK_DEEPNESS) ||
+                               (opcode == 0x00EE && before.sp == 0));
+
+    if (stack_error && (!state.halt || state.pc != before.pc || state.sp != before.sp))
+    {
+        return "stack error without halting in place";
+    }
+
+    if (!before.halt && state.halt && !stack_error)
+    {
+        return "halted without a stack error";
+    }
+
+    // Only FX0A waits for a key, and it stays on its own address while it does
+    if (ran && (opcode & 0xF0FF) == 0xF00A)
+    {
+        if (cpu.is_waiting_for_key() != (state.pc == before.pc))
+        {
+            return "FX0A waiting for a key and moving on (or neither)";
+        }
+    }
+    else if (cpu.is_waiting_for_key() != was_waiting)
+    {
+        return "key wait changed outside FX0A";
+    }
+
+    return NULL;
+}
+
+// Only the rows drawn since the restore (the snapshots have a blank screen); full: also the frame hash
+const char* check_screen(const CPU& cpu, bool full)
+{
+    const byte* gfx = cpu.get_gfx();
+    byte pixels = 0;
+
+    for (uint32_t rows = cpu.get_dirty_rows(); rows != 0; rows &= rows - 1)
+    {
+        const byte* row = gfx + __builtin_ctz(rows) * CPU::WIDTH;
+
+        // Branchless, so the compiler vectorizes it
+        for (unsigned i = 0; i < CPU::WIDTH; i++)
+        {
+            pixels |= row[i];
+        }
+    }
+
+    if (pixels > CPU::COLOR_WHITE)
+    {
+        return "pixel with a value other than 0 or 1";
+    }
+
+    // Recomputed from scratch: 2048 pixels, as long as the rest of the execution
+    if (full && cpu.get_frame_hash() != CPU::hash_frame(gfx))
+    {
+        return "frame hash out of sync with the display";
+    }
+
+    return NULL;
+}
+
+const char* fuzz_one(CPU& cpu, const CPU& blank, const std::vector<CPU>& snapshots,
+                     const std::vector<std::vector<byte> >& roms, const FuzzOptions& options, uint64_t seed, bool verbose)
+{
+    FuzzRandom random(seed);
+    size_t rom = random.below(roms.size());
+
+    if (random.below(FuzzOptions::LOAD_PERIOD) == 0)
+    {
+        // Through the loader, lengths close to the limit included
+        std::vector<byte> buffer = roms[rom];
+
+        if (random.below(2) == 0)
+        {
+            buffer.resize(MAX_ROM_LENGTH - 2 + random.below(5), random.next());
+        }
+        for (unsigned mutations = random.below(16); mutations > 0 && !buffer.empty(); mutations--)
+        {
+            buffer[random.below(buffer.size())] = random.next();
+        }
+
+        cpu.restore(blank);
+
+        if (cpu.load_rom_from_buffer(buffer.data(), buffer.size()) != (buffer.size() <= MAX_ROM_LENGTH))
+        {
+            return "load_rom_from_buffer() accepted a ROM that doesn't fit (or rejected one that does)";
+        }
+    }
+    else
+    {
+        cpu.restore(snapshots[rom]);
+
+        for (unsigned mutations = 1 + random.below(8); mutations > 0; mutations--)
+        {
+            WORD addr = CPU::ROM_MEMORY_BEGIN + (random.below(roms[rom].size()) & ~1u);
+
+            if (random.below(2) == 0)
+            {
+                cpu.store(addr + random.below(2), random.next());
+            }
+            else
+            {
+                WORD opcode = random_opcode(random);
+
+                cpu.store(addr, opcode >> 8);
+                cpu.store(addr + 1, opcode & 0xFF);
+            }
+        }
+    }
+
+    // The snapshots have a blank screen: the next restore only has to copy the rows drawn from now on
+    cpu.clear_dirty_rows();
+
+    CPU::State& state = cpu.get_state();
+    CPU::Quirks quirks = CPU::DEFAULT_QUIRKS;
+
+    quirks.wrap_sprites = random.below(2) == 0;
+    cpu.set_quirks(quirks);
+
+    if (random.below(4) == 0)
+    {
+        for (unsigned i = 0; i < CPU::GENERAL_PURPOSE_REGISTERS; i++)
+        {
+            state.V[i] = random.next();
+        }
+
+        state.I = random.next() & 0x0FFF;
+        state.sp = random.below(CPU::STACK_DEEPNESS + 1);
+        state.delay_timer = random.next();
+        state.sound_timer = random.below(2);
+    }
+
+    byte keys[CPU::KEY_MAPPING_SIZE] = {};
+    unsigned next_keys = 0;
+
+    for (unsigned cycle = 0; cycle < options.cycles; cycle++)
+    {
+        if (cycle == next_keys)
+        {
+            uint32_t mask = random.next();
+
+            for (unsigned i = 0; i < CPU::KEY_MAPPING_SIZE; i++)
+            {
+                keys[i] = (mask >> i) & (mask >> (i + CPU::KEY_MAPPING_SIZE)) & 1;
+            }
+
+            cpu.update_pressed_keys(keys);
+            next_keys = cycle + 1 + random.below(options.cycles);
+        }
+
+        CPU::State before = state;
+        bool was_waiting = cpu.is_waiting_for_key();
+        bool ran = true;
+        WORD opcode;
+
+        if (random.below(8) == 0)
+        {
+            opcode = random_opcode(random);
+
+            if (verbose)
+            {
+                printf("%6u  pc = 0x%03X  execute_instruction(0x%04X)\n", cycle, state.pc, opcode);
+            }
+
+            cpu.execute_instruction(opcode);
+            cpu.tick_timers();
+        }
+        else
+        {
+            if (verbose)
+            {
+                printf("%6u  pc = 0x%03X  opcode = 0x%02X%02X\n", cycle, state.pc, cpu.load(state.pc), cpu.load(state.pc + 1));
+            }
+
+            cpu.emulate_cycle();
+
+            opcode = state.opcode;
+            ran = !before.halt;
+        }
+
+        const char* broken = check(cpu, before, was_waiting, opcode, ran);
+
+        if (broken != NULL)
+        {
+            return broken;
+        }
+    }
+
+    return check_screen(cpu, verbose || seed % FuzzOptions::SCREEN_PERIOD == 0);
+}
+
+int main(int argc, char** argv)
+{
+    FuzzOptions options = {1000000, 32, 1};
+    std::vector<string> roots;
+    bool replay = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 7, "--runs=") == 0)
+        {
+            options.executions = strtoull(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            options.cycles = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--seed=") == 0 || arg.compare(0, 9, "--replay=") == 0)
+        {
+            options.seed = strtoull(value.c_str(), NULL, 10);
+            replay = arg.compare(0, 9, "--replay=") == 0;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            roots.push_back(arg);
+        }
+    }
+
+    if (roots.empty())
+    {
+        roots.push_back("roms");
+    }
+
+    // Corpus: one snapshot per ROM, right after initializate() and the loading
+    CPU blank;
+    std::vector<std::vector<byte> > roms;
+    std::vector<CPU> snapshots;
+
+    blank.initializate();
+    blank.seed(1);
+
+    for (const string& root : roots)
+    {
+        RomCatalog catalog;
+        std::vector<string> paths;
+
+        if (ends_with(root, ".ch8"))
+        {
+            paths.push_back(root);
+        }
+        else if (catalog.build(root))
+        {
+            for (const RomEntry& entry : catalog.get_entries())
+            {
+                paths.push_back(entry.path);
+            }
+        }
+
+        for (const string& path : paths)
+        {
+            std::vector<byte> rom;
+
+            if (read_rom(path, rom))
+            {
+                roms.push_back(rom);
+                snapshots.push_back(blank);
+                snapshots.back().load_rom_from_buffer(rom.data(), rom.size());
+            }
+        }
+    }
+
+    if (roms.empty())
+    {
+        std::cerr << "No ROMs to fuzz." << std::endl;
+
+        return -1;
+    }
+
+    // Copied once, then restored from the snapshots
+    CPU cpu = blank;
+
+    if (replay)
+    {
+        const char* broken = fuzz_one(cpu, blank, snapshots, roms, options, options.seed, true);
+
+        printf("Execution %llu: %s\n", (unsigned long long)options.seed, broken != NULL ? broken : "no invariant broken");
+
+        return broken != NULL;
+    }
+
+    const char* broken = NULL;
+    uint64_t execution = 0;
+    CPU::Violations violations = {};
+
+    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+    for (; execution < options.executions && broken == NULL; execution++)
+    {
+        broken = fuzz_one(cpu, blank, snapshots, roms, options, options.seed + execution, false);
+
+        // Zero unless built with CHIP8_CPU_DEBUG_VIOLATIONS
+        const CPU::Violations& seen = cpu.get_violations();
+
+        violations.fetch += seen.fetch;
+        violations.memory += seen.memory;
+        violations.screen += seen.screen;
+        violations.font += seen.font;
+        violations.keys += seen.keys;
+        violations.stack += seen.stack;
+    }
+
+    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - begin;
+
+    if (broken != NULL)
+    {
+        printf("Execution %llu broke an invariant: %s\n", (unsigned long long)(options.seed + execution - 1), broken);
+        printf("Repeat it with: %s --replay=%llu", argv[0], (unsigned long long)(options.seed + execution - 1));
+
+        for (const string& root : roots)
+        {
+            printf(" \"%s\"", root.c_str());
+        }
+
+        printf("\n");
+    }
+
+    printf("%llu execution(s) of %u cycle(s) over %u ROM(s) in %.2f s (%.0f executions/s)\n",
+           (unsigned long long)execution, options.cycles, (unsigned)roms.size(), time.count(), execution / time.count());
+
+    #ifdef CHIP8_CPU_DEBUG_VIOLATIONS
+    printf("Violations: %llu fetch, %llu memory, %llu screen, %llu font, %llu keys, %llu stack\n",
+           (unsigned long long)violations.fetch, (unsigned long long)violations.memory, (unsigned long long)violations.screen,
+           (unsigned long long)violations.font, (unsigned long long)violations.keys, (unsigned long long)violations.stack);
+    #endif
+
+    return broken != NULL;
+}
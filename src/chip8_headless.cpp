@@ -0,0 +1,314 @@
+#include "cpu.h"
+#include "audio.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+/*
+ * Headless frontend
+ * -----------------
+ * Runs a ROM without SDL (only the core is linked) and writes its frames to stdout or to a
+ * file, to record gameplay or pipe it into an encoder on machines without a display:
+ *
+ *   raw    64x32 bits per frame, 1 = white, rows top to bottom, most significant bit first
+ *   pbm    a binary PBM (P4) per frame, concatenated (1 = black, as PBM wants)
+ *   y4m    YUV4MPEG2 video, mono, at FREQUENCY frames per second
+ *
+ * Frames that didn't change are skipped unless --every-frame is given (a Y4M stream for an
+ * encoder should keep them, so the video runs at the right speed).
+ *
+ *   chip8-headless --format=y4m --every-frame --frames=3600 rom.ch8 | ffmpeg -i - out.mp4
+ */
+
+const double FREQUENCY = 60.0;
+
+enum class FrameFormat
+{
+    RAW,
+    PBM,
+    Y4M
+};
+
+struct HeadlessOptions
+{
+    FrameFormat format;
+    unsigned frames;
+    unsigned cycles_per_frame;
+    unsigned scale;
+    bool every_frame;
+    string output;
+    string audio;
+};
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [options] file.ch8" << std::endl;
+    std::cerr << "  --format=F      raw, pbm or y4m (default: pbm)" << std::endl;
+    std::cerr << "  --frames=N      frames to run (default: 600, " << FREQUENCY << " per second)" << std::endl;
+    std::cerr << "  --cycles=N      instructions per frame, the speed (default: 1)" << std::endl;
+    std::cerr << "  --scale=N       pixels per CHIP-8 pixel, PBM and Y4M (default: 1)" << std::endl;
+    std::cerr << "  --every-frame   write unchanged frames too" << std::endl;
+    std::cerr << "  --output=FILE   write the frames to FILE instead of stdout" << std::endl;
+    std::cerr << "  --audio=FILE    record the buzzer to a WAV file" << std::endl;
+
+    exit(-1);
+}
+
+// 8 pixels (bytes of value 0 or 1) to a byte, leftmost pixel in the most significant bit
+inline byte pack_pixels(const byte* pixels)
+{
+    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t word;
+
+    memcpy(&word, pixels, sizeof(word));
+
+    return (byte)((word * 0x8040201008040201ULL) >> 56);
+    #else
+    byte packed = 0;
+
+    for (unsigned i = 0; i < 8; i++)
+    {
+        packed = packed << 1 | pixels[i];
+    }
+
+    return packed;
+    #endif
+}
+
+// Frame as 1 bit per pixel (rows padded to whole bytes)
+void pack_frame(const byte* gfx, unsigned scale, bool invert, std::vector<byte>& packed)
+{
+    const unsigned width = CPU::WIDTH * scale;
+    const unsigned row_bytes = (width + 7) / 8;
+
+    packed.assign(row_bytes * CPU::HEIGHT * scale, 0);
+
+    for (unsigned row = 0; row < CPU::HEIGHT * scale; row++)
+    {
+        const byte* pixels = gfx + (row / scale) * CPU::WIDTH;
+        byte* output = packed.data() + row * row_bytes;
+
+        if (scale == 1)
+        {
+            // Straight from the display buffer, 8 pixels at a time
+            for (unsigned b = 0; b < row_bytes; b++)
+            {
+                output[b] = pack_pixels(pixels + 8 * b) ^ (invert ? 0xFF : 0x00);
+            }
+
+            continue;
+        }
+
+        for (unsigned col = 0; col < width; col++)
+        {
+            byte bit = (pixels[col / scale] != 0) ^ invert;
+
+            output[col / 8] |= bit << (7 - col % 8);
+        }
+    }
+}
+
+// Luma plane (studio range: black 16, white 235)
+void luma_frame(const byte* gfx, unsigned scale, std::vector<byte>& luma)
+{
+    const unsigned width = CPU::WIDTH * scale;
+
+    luma.resize(width * CPU::HEIGHT * scale);
+
+    for (unsigned row = 0; row < CPU::HEIGHT * scale; row++)
+    {
+        const byte* pixels = gfx + (row / scale) * CPU::WIDTH;
+        byte* output = luma.data() + row * width;
+
+        for (unsigned col = 0; col < width; col++)
+        {
+            output[col] = 16 + 219 * pixels[col / scale];
+        }
+    }
+}
+
+bool write_frame(FILE* output, const HeadlessOptions& options, const byte* gfx, std::vector<byte>& buffer)
+{
+    const unsigned width = CPU::WIDTH * options.scale;
+    const unsigned height = CPU::HEIGHT * options.scale;
+
+    switch (options.format)
+    {
+        case FrameFormat::RAW:
+            pack_frame(gfx, 1, false, buffer);
+            break;
+        case FrameFormat::PBM:
+            fprintf(output, "P4\n%u %u\n", width, height);
+            pack_frame(gfx, options.scale, true, buffer);
+            break;
+        case FrameFormat::Y4M:
+            fputs("FRAME\n", output);
+            luma_frame(gfx, options.scale, buffer);
+            break;
+    }
+
+    return fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size();
+}
+
+int main(int argc, char** argv)
+{
+    HeadlessOptions options = {FrameFormat::PBM, 600, 1, 1, false, "", ""};
+    string rom;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 9, "--format=") == 0)
+        {
+            if (value == "raw")
+            {
+                options.format = FrameFormat::RAW;
+            }
+            else if (value == "pbm")
+            {
+                options.format = FrameFormat::PBM;
+            }
+            else if (value == "y4m")
+            {
+                options.format = FrameFormat::Y4M;
+            }
+            else
+            {
+                print_syntax_and_exit(argv);
+            }
+        }
+        else if (arg.compare(0, 9, "--frames=") == 0)
+        {
+            options.frames = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            options.cycles_per_frame = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 8, "--scale=") == 0)
+        {
+            options.scale = strtoul(value.c_str(), NULL, 10);
+
+            if (options.scale == 0 || options.scale > 64)
+            {
+                print_syntax_and_exit(argv);
+            }
+        }
+        else if (arg == "--every-frame")
+        {
+            options.every_frame = true;
+        }
+        else if (arg.compare(0, 9, "--output=") == 0)
+        {
+            options.output = value;
+        }
+        else if (arg.compare(0, 8, "--audio=") == 0)
+        {
+            options.audio = value;
+        }
+        else if (arg.compare(0, 2, "--") == 0 || !rom.empty())
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            rom = arg;
+        }
+    }
+
+    if (rom.empty())
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    CPU cpu;
+    Buzzer buzzer;
+    AudioRecorder recorder(buzzer, FREQUENCY);
+
+    cpu.initializate();
+
+    if (!cpu.load_rom(rom) || (!options.audio.empty() && !recorder.open(options.audio)))
+    {
+        return -1;
+    }
+
+    FILE* output = options.output.empty() ? stdout : fopen(options.output.c_str(), "wb");
+
+    if (output == NULL)
+    {
+        std::cerr << "ERROR: " << options.output << " couldn't be written." << std::endl;
+
+        return -1;
+    }
+
+    if (options.format == FrameFormat::Y4M)
+    {
+        fprintf(output, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 Cmono\n", CPU::WIDTH * options.scale,
+                CPU::HEIGHT * options.scale, (unsigned)FREQUENCY);
+    }
+
+    // The frames own stdout: the CPU's messages go to stderr
+    std::streambuf* out = std::cout.rdbuf(std::cerr.rdbuf());
+
+    const byte* gfx = cpu.get_gfx();
+    uint64_t last = 0;
+    std::vector<byte> buffer;
+    unsigned written = 0;
+    bool ok = true;
+
+    for (unsigned frame = 0; frame < options.frames && ok; frame++)
+    {
+        for (unsigned cycle = 0; cycle < options.cycles_per_frame; cycle++)
+        {
+            cpu.emulate_cycle();
+        }
+
+        buzzer.set_active(cpu.get_state().sound_timer > 0);
+
+        if (!options.audio.empty())
+        {
+            recorder.frame();
+        }
+
+        // Drawing may leave the same pixels: the frame hash tells, without looking at them
+        if (!options.every_frame && frame > 0 && cpu.get_frame_hash() == last)
+        {
+            continue;
+        }
+
+        last = cpu.get_frame_hash();
+
+        ok = write_frame(output, options, gfx, buffer);
+        written++;
+    }
+
+    std::cout.rdbuf(out);
+
+    recorder.close();
+
+    if (output != stdout)
+    {
+        fclose(output);
+    }
+    else
+    {
+        fflush(output);
+    }
+
+    if (!ok)
+    {
+        std::cerr << "ERROR: the frames couldn't be written." << std::endl;
+
+        return -1;
+    }
+
+    std::cerr << written << " of " << options.frames << " frame(s) written" << std::endl;
+
+    return 0;
+}
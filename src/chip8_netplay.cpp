@@ -0,0 +1,604 @@
+#include "rollback.h"
+#include "rom_catalog.h"
+#include "frame_pacer.h"
+#include "terminal_renderer.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Netplay
+ * -------
+ * Two-player games over UDP with rollback (see RollbackSession), one process per player:
+ *
+ *   chip8-netplay --port=7000 --peer=127.0.0.1:7001 --keys=14 --cycles=10 "roms/games/Pong [Paul Vervalin, 1990].ch8"
+ *   chip8-netplay --port=7001 --peer=127.0.0.1:7000 --keys=cd --cycles=10 "roms/games/Pong [Paul Vervalin, 1990].ch8"
+ *
+ * There's no keyboard: each player is a bot that holds one of its --keys (or none) for a while,
+ * so two runs can be compared. --delay, --jitter and --loss are applied to the packets this
+ * peer sends, to try the rollback on localhost. Every packet carries all the local inputs the
+ * peer hasn't acknowledged yet, so lost packets cost latency, not inputs.
+ *
+ * After --frames frames both peers wait for each other's last inputs and print the hash of
+ * the final state: the same on both sides (and any run with the same bots) if they stayed in
+ * sync. --view draws the game in the terminal meanwhile.
+ */
+
+const double FREQUENCY = 60.0;
+const uint32_t MAGIC = 0x504E3843;      // "C8NP"
+const uint32_t NO_FRAME = 0xFFFFFFFF;
+const unsigned MAX_INPUTS_PER_PACKET = 64;
+const unsigned HELLO_PERIOD = 6;        // Frames between HELLOs while waiting for the peer
+const unsigned LINGER_FRAMES = 30;      // Frames still sent once done, for the peer to finish
+const double PEER_TIMEOUT = 5.0;        // Seconds without packets before giving up
+
+enum PacketType : byte
+{
+    PACKET_HELLO = 1,   // image hash (u64), cycles per frame (u32)
+    PACKET_INPUT = 2    // ack (u32), checkpoint frame (u32) and hash (u64), first frame (u32), count (u8), masks (u16)
+};
+
+struct NetplayOptions
+{
+    unsigned port;
+    sockaddr_in peer;
+    WORD keys;
+    unsigned frames;
+    unsigned cycles_per_frame;
+    unsigned input_delay;
+    unsigned delay;
+    unsigned jitter;
+    unsigned loss;
+    uint32_t seed;
+    bool view;
+};
+
+struct PendingPacket
+{
+    std::chrono::steady_clock::time_point due;
+    std::vector<byte> data;
+};
+
+volatile sig_atomic_t _quit = 0;
+
+void signal_handler(int)
+{
+    _quit = 1;
+}
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " --port=N --peer=IP:PORT [options] file.ch8" << std::endl;
+    std::cerr << "  --keys=HEX        keys the bot presses, e.g. 14 or cd (default: 14)" << std::endl;
+    std::cerr << "  --frames=N        frames to play (default: 1800)" << std::endl;
+    std::cerr << "  --cycles=N        instructions per frame, the same on both peers (default: 1)" << std::endl;
+    std::cerr << "  --input-delay=N   frames before local keys apply (default: 0, max. "
+              << RollbackSession::MAX_INPUT_DELAY << ")" << std::endl;
+    std::cerr << "  --delay=MS        added to every packet sent (default: 0)" << std::endl;
+    std::cerr << "  --jitter=MS       random extra delay, up to MS (default: 0)" << std::endl;
+    std::cerr << "  --loss=PCT        packets sent that are dropped (default: 0)" << std::endl;
+    std::cerr << "  --seed=N          seed of the bot (default: the port)" << std::endl;
+    std::cerr << "  --view            draw the game in the terminal" << std::endl;
+
+    exit(-1);
+}
+
+uint32_t next_random(uint32_t& random)
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    return random;
+}
+
+// Holds one of the keys (or none) for 10 to 40 frames
+WORD bot_input(const NetplayOptions& options, uint32_t& random, unsigned& hold, WORD& current)
+{
+    if (hold > 0)
+    {
+        hold--;
+
+        return current;
+    }
+
+    std::vector<WORD> choices(1, 0);
+
+    for (unsigned key = 0; key < CPU::KEY_MAPPING_SIZE; key++)
+    {
+        if (options.keys & (1 << key))
+        {
+            choices.push_back((WORD)(1 << key));
+        }
+    }
+
+    current = choices[next_random(random) % choices.size()];
+    hold = 10 + next_random(random) % 30;
+
+    return current;
+}
+
+void put(std::vector<byte>& packet, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; i++)
+    {
+        packet.push_back((byte)(value >> (8 * i)));
+    }
+}
+
+uint64_t get(const byte* data, unsigned bytes)
+{
+    uint64_t value = 0;
+
+    for (unsigned i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)data[i] << (8 * i);
+    }
+
+    return value;
+}
+
+bool parse_peer(const string& value, sockaddr_in& peer)
+{
+    size_t colon = value.rfind(':');
+
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+
+    if (colon == string::npos || inet_pton(AF_INET, value.substr(0, colon).c_str(), &peer.sin_addr) != 1)
+    {
+        return false;
+    }
+
+    unsigned long port = strtoul(value.c_str() + colon + 1, NULL, 10);
+
+    peer.sin_port = htons((unsigned short)port);
+
+    return port > 0 && port < 65536;
+}
+
+class Link
+{
+    public:
+        Link(const NetplayOptions& link_options) :
+            options(link_options),
+            fd(-1),
+            random(link_options.seed ^ 0x9E3779B9),
+            sent(0),
+            received(0),
+            dropped(0)
+        {
+
+        }
+
+        ~Link()
+        {
+            if (this->fd >= 0)
+            {
+                close(this->fd);
+            }
+        }
+
+        bool open()
+        {
+            sockaddr_in addr;
+
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(this->options.port);
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+            this->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+            if (this->fd < 0 || bind(this->fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            {
+                std::cerr << "ERROR: couldn't bind UDP port " << this->options.port << " (" << strerror(errno) << ")."
+                          << std::endl;
+
+                return false;
+            }
+
+            return true;
+        }
+
+        // Queued with the emulated delay and loss
+        void send(const std::vector<byte>& packet)
+        {
+            if (this->options.loss > 0 && next_random(this->random) % 100 < this->options.loss)
+            {
+                this->dropped++;
+
+                return;
+            }
+
+            unsigned delay = this->options.delay;
+
+            if (this->options.jitter > 0)
+            {
+                delay += next_random(this->random) % (this->options.jitter + 1);
+            }
+
+            this->pending.push_back({std::chrono::steady_clock::now() + std::chrono::milliseconds(delay), packet});
+            this->flush();
+        }
+
+        // Sends the packets that are due (they may overtake each other with jitter)
+        void flush()
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < this->pending.size();)
+            {
+                if (this->pending[i].due > now)
+                {
+                    i++;
+
+                    continue;
+                }
+
+                const std::vector<byte>& data = this->pending[i].data;
+
+                if (sendto(this->fd, data.data(), data.size(), 0, reinterpret_cast<const sockaddr*>(&this->options.peer),
+                           sizeof(this->options.peer)) == (ssize_t)data.size())
+                {
+                    this->sent++;
+                }
+
+                this->pending.erase(this->pending.begin() + i);
+            }
+        }
+
+        // Next packet from the peer (false when there are no more)
+        bool receive(std::vector<byte>& packet)
+        {
+            byte buffer[1024];
+            sockaddr_in from;
+            socklen_t length = sizeof(from);
+
+            while (true)
+            {
+                ssize_t size = recvfrom(this->fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &length);
+
+                if (size < 0)
+                {
+                    return false;
+                }
+
+                if (size < 5 || get(buffer, 4) != MAGIC || from.sin_port != this->options.peer.sin_port ||
+                    from.sin_addr.s_addr != this->options.peer.sin_addr.s_addr)
+                {
+                    continue;
+                }
+
+                this->received++;
+                packet.assign(buffer, buffer + size);
+
+                return true;
+            }
+        }
+
+        uint64_t get_sent() const
+        {
+            return this->sent;
+        }
+
+        uint64_t get_received() const
+        {
+            return this->received;
+        }
+
+        uint64_t get_dropped() const
+        {
+            return this->dropped;
+        }
+
+    private:
+        const NetplayOptions& options;
+        int fd;
+        uint32_t random;
+        uint64_t sent;
+        uint64_t received;
+        uint64_t dropped;
+        std::vector<PendingPacket> pending;
+};
+
+int main(int argc, char** argv)
+{
+    NetplayOptions options;
+    string rom;
+    bool has_peer = false;
+
+    memset(&options, 0, sizeof(options));
+    options.keys = 0x0012;
+    options.frames = 1800;
+    options.cycles_per_frame = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 7, "--port=") == 0)
+        {
+            options.port = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--peer=") == 0)
+        {
+            has_peer = parse_peer(value, options.peer);
+
+            if (!has_peer)
+            {
+                print_syntax_and_exit(argv);
+            }
+        }
+        else if (arg.compare(0, 7, "--keys=") == 0)
+        {
+            options.keys = 0;
+
+            for (char digit : value)
+            {
+                string hex(1, digit);
+                char* end = NULL;
+                unsigned long key = strtoul(hex.c_str(), &end, 16);
+
+                if (*end != '\0')
+                {
+                    print_syntax_and_exit(argv);
+                }
+
+                options.keys |= (WORD)(1 << key);
+            }
+        }
+        else if (arg.compare(0, 9, "--frames=") == 0)
+        {
+            options.frames = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            options.cycles_per_frame = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 14, "--input-delay=") == 0)
+        {
+            options.input_delay = strtoul(value.c_str(), NULL, 10);
+
+            if (options.input_delay > RollbackSession::MAX_INPUT_DELAY)
+            {
+                print_syntax_and_exit(argv);
+            }
+        }
+        else if (arg.compare(0, 8, "--delay=") == 0)
+        {
+            options.delay = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--jitter=") == 0)
+        {
+            options.jitter = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--loss=") == 0)
+        {
+            options.loss = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--seed=") == 0)
+        {
+            options.seed = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg == "--view")
+        {
+            options.view = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0 || !rom.empty())
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            rom = arg;
+        }
+    }
+
+    if (rom.empty() || !has_peer || options.port == 0 || options.port > 65535 || options.loss >= 100)
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    if (options.seed == 0)
+    {
+        options.seed = options.port;
+    }
+
+    std::shared_ptr<const CPU::Image> image = CPU::read_image(rom);
+
+    if (!image)
+    {
+        return -1;
+    }
+
+    // Both peers derive the CXNN seed from the image, so they don't have to agree on one
+    uint64_t image_hash = RomCatalog::hash(image->data, CPU::MEMORY_LENGTH_B);
+    RollbackSession session(image, (DWORD)(image_hash ^ (image_hash >> 32)), options.cycles_per_frame,
+                            options.input_delay);
+    Link link(options);
+
+    if (!link.open())
+    {
+        return -1;
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    FramePacer pacer(FREQUENCY, PacingMode::LOW_POWER);
+    TerminalRenderer renderer;
+    std::vector<byte> packet;
+    string screen;
+    bool peer_seen = false;
+    uint32_t remote_ack = 0;
+    uint32_t bot_random = options.seed | 1;
+    unsigned bot_hold = 0;
+    WORD bot_keys = 0;
+    unsigned linger = 0;
+    unsigned long long iterations = 0;
+    bool first_view = true;
+    auto last_packet = std::chrono::steady_clock::now();
+    string error;
+
+    fprintf(stderr, "Waiting for the peer on UDP port %u...\n", options.port);
+
+    while (!_quit)
+    {
+        // Everything the peer sent since the last frame
+        while (link.receive(packet))
+        {
+            last_packet = std::chrono::steady_clock::now();
+
+            if (packet[4] == PACKET_HELLO && packet.size() >= 17)
+            {
+                if (get(packet.data() + 5, 8) != image_hash || get(packet.data() + 13, 4) != options.cycles_per_frame)
+                {
+                    error = "the peer runs another ROM or another --cycles";
+                    _quit = 1;
+                }
+
+                peer_seen = true;
+            }
+            else if (packet[4] == PACKET_INPUT && packet.size() >= 26)
+            {
+                uint32_t first = get(packet.data() + 21, 4);
+                unsigned count = std::min<size_t>(packet[25], (packet.size() - 26) / 2);
+
+                peer_seen = true;
+                remote_ack = std::max(remote_ack, (uint32_t)get(packet.data() + 5, 4));
+
+                if (get(packet.data() + 9, 4) != NO_FRAME)
+                {
+                    session.check_remote(get(packet.data() + 9, 4), get(packet.data() + 13, 8));
+                }
+
+                for (unsigned i = 0; i < count; i++)
+                {
+                    session.add_remote_input(first + i, get(packet.data() + 26 + 2 * i, 2));
+                }
+            }
+        }
+
+        link.flush();
+
+        if (!peer_seen)
+        {
+            if (iterations++ % HELLO_PERIOD == 0)
+            {
+                packet.clear();
+                put(packet, MAGIC, 4);
+                put(packet, PACKET_HELLO, 1);
+                put(packet, image_hash, 8);
+                put(packet, options.cycles_per_frame, 4);
+                link.send(packet);
+            }
+
+            pacer.wait();
+
+            continue;
+        }
+
+        if (session.get_frame() < options.frames)
+        {
+            if (session.can_advance())
+            {
+                session.set_local_input(bot_input(options, bot_random, bot_hold, bot_keys));
+            }
+
+            session.advance();
+        }
+        else if (session.get_confirmed_frame() >= options.frames && remote_ack >= options.frames &&
+                 ++linger >= LINGER_FRAMES)
+        {
+            break;
+        }
+
+        // The inputs the peer doesn't have yet, and our newest checkpoint
+        uint32_t first = std::max(remote_ack, session.get_local_frames() > MAX_INPUTS_PER_PACKET ?
+                                              session.get_local_frames() - MAX_INPUTS_PER_PACKET : 0);
+        uint32_t checkpoint_frame = NO_FRAME;
+        uint64_t checkpoint_hash = 0;
+        std::vector<WORD> masks;
+
+        session.get_checkpoint(checkpoint_frame, checkpoint_hash);
+
+        for (WORD mask; masks.size() < MAX_INPUTS_PER_PACKET && session.get_local_input(first + masks.size(), mask);)
+        {
+            masks.push_back(mask);
+        }
+
+        packet.clear();
+        put(packet, MAGIC, 4);
+        put(packet, PACKET_INPUT, 1);
+        put(packet, session.get_confirmed_frame(), 4);
+        put(packet, checkpoint_frame, 4);
+        put(packet, checkpoint_hash, 8);
+        put(packet, first, 4);
+        put(packet, masks.size(), 1);
+
+        for (WORD mask : masks)
+        {
+            put(packet, mask, 2);
+        }
+
+        link.send(packet);
+
+        if (options.view)
+        {
+            screen.clear();
+
+            if (first_view)
+            {
+                screen += TerminalRenderer::HIDE_CURSOR;
+                first_view = false;
+            }
+
+            renderer.render(session.get_cpu().get_gfx(), screen);
+            fwrite(screen.data(), 1, screen.size(), stdout);
+            fflush(stdout);
+        }
+
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - last_packet).count() > PEER_TIMEOUT)
+        {
+            error = "no packets from the peer for a while";
+            break;
+        }
+
+        pacer.wait();
+    }
+
+    session.synchronize();
+
+    if (options.view)
+    {
+        printf("%s\n", TerminalRenderer::SHOW_CURSOR);
+    }
+
+    if (!error.empty())
+    {
+        fprintf(stderr, "ERROR: %s.\n", error.c_str());
+    }
+
+    RollbackSession::print_stats(std::cout, session.get_stats());
+
+    printf("Network: %llu packet(s) sent, %llu received, %llu dropped on purpose; %.1f ms frame budget\n",
+           (unsigned long long)link.get_sent(), (unsigned long long)link.get_received(),
+           (unsigned long long)link.get_dropped(), 1000.0 / FREQUENCY);
+    printf("Final state: frame %u, confirmed %u, hash %016llx\n", session.get_frame(), session.get_confirmed_frame(),
+           (unsigned long long)session.get_cpu().get_state_hash());
+
+    return error.empty() && session.get_stats().desyncs == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include "env_server.h"
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <thread>
+
+EnvServer* _server = NULL;
+
+std::string rom_path("");
+std::string shm_name("/chip8-env");
+unsigned instances = 1;
+unsigned workers = 1;
+bool tiered = false;
+
+void signal_handler(int)
+{
+    if (_server != NULL)
+    {
+        _server->stop();
+    }
+}
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " path_to_file [--instances=N] [--workers=N] [--name=/shm_name] [--tiered]" << std::endl;
+
+    exit(-1);
+}
+
+void handle_args(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else if (strncmp(argv[i], "--instances=", 12) == 0)
+        {
+            instances = strtoul(argv[i] + 12, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--workers=", 10) == 0)
+        {
+            workers = strtoul(argv[i] + 10, NULL, 10);
+        }
+        else if (strcmp(argv[i], "--tiered") == 0)
+        {
+            tiered = true;
+        }
+        else if (strncmp(argv[i], "--name=", 7) == 0)
+        {
+            shm_name = std::string(argv[i] + 7);
+        }
+        else if (rom_path.empty())
+        {
+            rom_path = std::string(argv[i]);
+        }
+        else
+        {
+            print_syntax_and_exit(argv);
+        }
+    }
+
+    if (rom_path.empty() || instances == 0 || workers == 0)
+    {
+        print_syntax_and_exit(argv);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    handle_args(argc, argv);
+
+    if (workers > instances)
+    {
+        workers = instances;
+    }
+
+    EnvServer server;
+
+    if (!server.create(shm_name, rom_path, instances, workers, tiered))
+    {
+        std::cerr << "Couldn't create the environment... aborting." << std::endl;
+
+        return -1;
+    }
+
+    _server = &server;
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    std::cout << "Serving " << instances << " instance(s) of " << rom_path
+              << " on " << shm_name << " with " << workers << " worker(s)." << std::endl;
+
+    server.run();
+
+    std::cout << "Shutting down the environment..." << std::endl;
+
+    if (tiered)
+    {
+        ExecutionManager::print_metrics(std::cout, server.get_metrics());
+    }
+
+    _server = NULL;
+    server.destroy();
+
+    return 0;
+}
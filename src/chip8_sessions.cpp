@@ -0,0 +1,260 @@
+#include "session_scheduler.h"
+#include "frame_pacer.h"
+#include "rom_catalog.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+
+/*
+ * Hosts many sessions in one process (see SessionScheduler): --sessions CPUs spread over the
+ * ROMs given (or found under a directory), ticked at 60 Hz for --seconds. Each session gets a
+ * player bot that taps a random key now and then (--input taps per minute), so sessions idling
+ * in FX0A or spin loops park and wake up as they would with people playing.
+ *
+ * At the end it prints the scheduler's totals and the sessions that missed the most deadlines.
+ * --unpaced runs the ticks back to back (how many sessions fit in a frame on this machine).
+ */
+
+struct HostOptions
+{
+    unsigned sessions;
+    unsigned cycles_per_frame;
+    double seconds;
+    double deadline;        // ms, 0: the tick period
+    double input;           // Taps per session and minute
+    unsigned jobs;
+    unsigned report;
+    bool unpaced;
+};
+
+// A session's bot: the next tick it presses or releases a key
+struct Player
+{
+    uint64_t next;
+    WORD keys;
+};
+
+volatile sig_atomic_t _quit = 0;
+
+void signal_handler(int)
+{
+    _quit = 1;
+}
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [options] [roms_dir | file.ch8 ...]" << std::endl;
+    std::cerr << "  --sessions=N    sessions (default: 1000)" << std::endl;
+    std::cerr << "  --cycles=N      instructions per frame (default: 10)" << std::endl;
+    std::cerr << "  --seconds=N     time to run (default: 10)" << std::endl;
+    std::cerr << "  --deadline=MS   frame deadline of every session (default: the tick period)" << std::endl;
+    std::cerr << "  --input=N       key taps per session and minute (default: 30)" << std::endl;
+    std::cerr << "  --jobs=N        workers (default: hardware threads)" << std::endl;
+    std::cerr << "  --report=N      sessions with the most missed deadlines shown (default: 5)" << std::endl;
+    std::cerr << "  --unpaced       ticks back to back instead of at 60 Hz" << std::endl;
+
+    exit(-1);
+}
+
+bool ends_with(const string& text, const string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+uint32_t next_random(uint32_t& random)
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    return random;
+}
+
+int main(int argc, char** argv)
+{
+    HostOptions options = {1000, 10, 10, 0, 30, 0, 5, false};
+    std::vector<string> roots;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 11, "--sessions=") == 0)
+        {
+            options.sessions = std::max(1ul, strtoul(value.c_str(), NULL, 10));
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            options.cycles_per_frame = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 10, "--seconds=") == 0)
+        {
+            options.seconds = strtod(value.c_str(), NULL);
+        }
+        else if (arg.compare(0, 11, "--deadline=") == 0)
+        {
+            options.deadline = strtod(value.c_str(), NULL);
+        }
+        else if (arg.compare(0, 8, "--input=") == 0)
+        {
+            options.input = strtod(value.c_str(), NULL);
+        }
+        else if (arg.compare(0, 7, "--jobs=") == 0)
+        {
+            options.jobs = std::max(1ul, strtoul(value.c_str(), NULL, 10));
+        }
+        else if (arg.compare(0, 9, "--report=") == 0)
+        {
+            options.report = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg == "--unpaced")
+        {
+            options.unpaced = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            roots.push_back(arg);
+        }
+    }
+
+    if (roots.empty())
+    {
+        roots.push_back("roms/games");
+    }
+
+    std::vector<string> paths;
+    std::vector<std::shared_ptr<const CPU::Image> > images;
+
+    for (const string& root : roots)
+    {
+        RomCatalog catalog;
+        std::vector<string> found;
+
+        if (ends_with(root, ".ch8"))
+        {
+            found.push_back(root);
+        }
+        else if (catalog.build(root))
+        {
+            for (const RomEntry& entry : catalog.get_entries())
+            {
+                found.push_back(entry.path);
+            }
+        }
+        else
+        {
+            return -1;
+        }
+
+        for (const string& path : found)
+        {
+            std::shared_ptr<const CPU::Image> image = CPU::read_image(path);
+
+            if (image)
+            {
+                paths.push_back(path);
+                images.push_back(image);
+            }
+        }
+    }
+
+    if (images.empty())
+    {
+        std::cerr << "ERROR: no ROMs to run." << std::endl;
+
+        return -1;
+    }
+
+    WorkStealingPool pool(options.jobs);
+    SessionScheduler scheduler(pool);
+    std::vector<Player> players(options.sessions);
+    uint32_t random = 0xC8;
+
+    // Mean ticks between two key events of a session (a tap is a press and a release)
+    double gap = options.input > 0 ? SessionScheduler::DEFAULT_FREQUENCY * 60.0 / (2 * options.input) : 0;
+
+    for (unsigned i = 0; i < options.sessions; i++)
+    {
+        scheduler.add_session(images[i % images.size()], options.cycles_per_frame, i + 1, options.deadline);
+        players[i].next = gap > 0 ? next_random(random) % (unsigned)(2 * gap + 1) : UINT64_MAX;
+        players[i].keys = 0;
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    FramePacer pacer(SessionScheduler::DEFAULT_FREQUENCY, PacingMode::LOW_POWER);
+    uint64_t ticks = (uint64_t)(options.seconds * SessionScheduler::DEFAULT_FREQUENCY);
+    FramePacer::Clock::time_point begin = FramePacer::Clock::now();
+
+    for (uint64_t tick = 0; tick < ticks && !_quit; tick++)
+    {
+        for (unsigned i = 0; i < options.sessions; i++)
+        {
+            Player& player = players[i];
+
+            if (player.next > tick)
+            {
+                continue;
+            }
+
+            // Held for a few frames, so games polling the keys see it too
+            player.keys = player.keys == 0 ? (WORD)(1 << (next_random(random) % CPU::KEY_MAPPING_SIZE)) : 0;
+            player.next = tick + (player.keys != 0 ? 3 + next_random(random) % 8 :
+                                                     1 + next_random(random) % (unsigned)(2 * gap + 1));
+            scheduler.set_keys(i, player.keys);
+        }
+
+        scheduler.tick();
+
+        if (!options.unpaced)
+        {
+            pacer.wait();
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(FramePacer::Clock::now() - begin).count();
+
+    SchedulerStats stats = scheduler.get_stats();
+
+    SessionScheduler::print_stats(std::cout, stats);
+    printf("Run: %.2f s, %u ROM(s), %u worker(s), %.1f M instructions/s\n", elapsed, (unsigned)images.size(),
+           pool.get_workers(), stats.frames * (double)options.cycles_per_frame / elapsed / 1e6);
+
+    // The sessions that missed the most deadlines
+    std::vector<unsigned> order(options.sessions);
+
+    for (unsigned i = 0; i < options.sessions; i++)
+    {
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&scheduler](unsigned a, unsigned b)
+    {
+        return scheduler.get_session_stats(a).missed > scheduler.get_session_stats(b).missed;
+    });
+
+    for (unsigned i = 0; i < std::min(options.report, options.sessions); i++)
+    {
+        SessionStats session = scheduler.get_session_stats(order[i]);
+
+        printf("  session %-5u %6llu frames %6llu parked %5llu wakeups %5llu missed (max. %.3f ms late), "
+               "%.1f us/frame (max. %.1f)  %s\n",
+               order[i], (unsigned long long)session.frames, (unsigned long long)session.parked,
+               (unsigned long long)session.wakeups, (unsigned long long)session.missed, session.late_max,
+               session.run_mean, session.run_max, paths[order[i] % paths.size()].c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "stream_server.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+#include <chrono>
+
+/*
+ * Streaming server
+ * ----------------
+ * Runs ROMs and streams them over WebSocket to browsers on this host (see StreamServer):
+ *
+ *   chip8-stream --instances=4 "roms/games/Pong (1 player).ch8"
+ *
+ * and open http://127.0.0.1:8080/ (the page is web/chip8_stream.html, ?instance=N picks the
+ * instance). Every ROM given gets --instances instances, numbered in order from 0.
+ */
+
+StreamServer* _server = NULL;
+
+void signal_handler(int)
+{
+    if (_server != NULL)
+    {
+        _server->stop();
+    }
+}
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [options] file.ch8 [file.ch8 ...]" << std::endl;
+    std::cerr << "  --port=N        TCP port (default: 8080, 0: any free port)" << std::endl;
+    std::cerr << "  --host=IP       address to listen on (default: 127.0.0.1)" << std::endl;
+    std::cerr << "  --instances=N   instances of each ROM (default: 1)" << std::endl;
+    std::cerr << "  --cycles=N      instructions per frame, the speed (default: 1)" << std::endl;
+    std::cerr << "  --page=FILE     client page served on / (default: web/chip8_stream.html)" << std::endl;
+
+    exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned port = 8080;
+    string host = "127.0.0.1";
+    unsigned instances = 1;
+    unsigned cycles_per_frame = 1;
+    string page_path = "web/chip8_stream.html";
+    std::vector<string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        string value = arg.find('=') != string::npos ? arg.substr(arg.find('=') + 1) : "";
+
+        if (arg.compare(0, 7, "--port=") == 0)
+        {
+            port = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--host=") == 0)
+        {
+            host = value;
+        }
+        else if (arg.compare(0, 12, "--instances=") == 0)
+        {
+            instances = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            cycles_per_frame = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (arg.compare(0, 7, "--page=") == 0)
+        {
+            page_path = value;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            roms.push_back(arg);
+        }
+    }
+
+    if (roms.empty() || instances == 0 || port > 65535)
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    StreamServer server;
+
+    for (const string& rom : roms)
+    {
+        // The ROM is read once and its image is shared by all its instances
+        std::shared_ptr<const CPU::Image> image = CPU::read_image(rom);
+
+        if (!image)
+        {
+            return -1;
+        }
+
+        for (unsigned i = 0; i < instances; i++)
+        {
+            server.add_instance(image, cycles_per_frame);
+        }
+    }
+
+    std::ifstream page(page_path);
+
+    if (page.is_open())
+    {
+        std::stringstream content;
+
+        content << page.rdbuf();
+        server.set_page(content.str());
+    }
+    else
+    {
+        std::cerr << "WARNING: " << page_path << " couldn't be read, only the WebSocket endpoints are served." << std::endl;
+    }
+
+    if (!server.listen(port, host))
+    {
+        return -1;
+    }
+
+    _server = &server;
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    printf("Streaming %u instance(s) on http://%s:%u/ (WebSocket: /instance/0 to /instance/%u)\n",
+           server.get_instance_count(), host.c_str(), server.get_port(), server.get_instance_count() - 1);
+    fflush(stdout);
+
+    auto start = std::chrono::steady_clock::now();
+
+    server.run();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    StreamStats stats = server.get_stats();
+
+    _server = NULL;
+
+    printf("%llu frame(s) in %.1f s, %llu message(s) (%llu keyframe(s)), %.1f KB sent (%.2f KB/s)\n",
+           (unsigned long long)stats.frames, seconds, (unsigned long long)stats.messages,
+           (unsigned long long)stats.keyframes, stats.bytes_sent / 1024.0,
+           seconds > 0 ? stats.bytes_sent / 1024.0 / seconds : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include "cpu.h"
+#include "frame_pacer.h"
+#include "terminal_renderer.h"
+
+#include <iostream>
+#include <string>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <termios.h>
+#include <unistd.h>
+
+/*
+ * Terminal frontend
+ * -----------------
+ * Runs a ROM in an ANSI terminal (e.g. over SSH): the display is drawn with half blocks or
+ * Braille cells by TerminalRenderer, which only sends the cells that changed, and the keys
+ * are read from the tty in raw mode (Ctrl+C or Esc quits).
+ *
+ * Terminals only report key presses (and their auto-repeat), never releases: a key stays
+ * pressed for HOLD_FRAMES frames after its last press or repeat.
+ */
+
+const double FREQUENCY = 60.0;
+const unsigned HOLD_FRAMES = 8;
+
+// Same layout as the SDL frontend
+const char KEY_MAPPING[CPU::KEY_MAPPING_SIZE + 1] = "1234qwerasdfzxcv";
+
+struct termios _saved_tty;
+bool _tty_raw = false;
+volatile sig_atomic_t _resized = 0;
+volatile sig_atomic_t _quit = 0;
+
+void restore_terminal()
+{
+    if (_tty_raw)
+    {
+        const string reset = string(TerminalRenderer::SHOW_CURSOR) + "\x1b[0m\n";
+
+        if (write(STDOUT_FILENO, reset.data(), reset.size()) < 0)
+        {
+            // Nothing else to do on the way out
+        }
+
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &_saved_tty);
+        _tty_raw = false;
+    }
+}
+
+void signal_handler(int signal_num)
+{
+    if (signal_num == SIGWINCH)
+    {
+        _resized = 1;
+    }
+    else
+    {
+        _quit = 1;
+    }
+}
+
+// No echo, no line buffering, no signals from the keyboard, reads that never block
+bool raw_terminal()
+{
+    struct termios raw;
+
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &_saved_tty) != 0)
+    {
+        std::cerr << "ERROR: the standard input is not a terminal." << std::endl;
+
+        return false;
+    }
+
+    raw = _saved_tty;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0)
+    {
+        std::cerr << "ERROR: the terminal couldn't be set to raw mode." << std::endl;
+
+        return false;
+    }
+
+    _tty_raw = true;
+    atexit(restore_terminal);
+
+    return true;
+}
+
+// Presses the keys read since the last frame. Returns false to quit.
+bool read_keys(CPU& cpu, unsigned* hold)
+{
+    char input[64];
+    ssize_t length;
+
+    while ((length = read(STDIN_FILENO, input, sizeof(input))) > 0)
+    {
+        for (ssize_t i = 0; i < length; i++)
+        {
+            // Ctrl+C, or an Esc that doesn't start an escape sequence (arrows and such are ignored)
+            if (input[i] == 0x03 || (input[i] == 0x1b && i + 1 == length))
+            {
+                return false;
+            }
+            if (input[i] == 0x1b)
+            {
+                i += 2;
+
+                continue;
+            }
+
+            const char* key = strchr(KEY_MAPPING, tolower((unsigned char)input[i]));
+
+            if (key != NULL && *key != '\0')
+            {
+                cpu.key_event(key - KEY_MAPPING, true);
+                hold[key - KEY_MAPPING] = HOLD_FRAMES;
+            }
+        }
+    }
+
+    return true;
+}
+
+void print_syntax_and_exit(char** argv)
+{
+    std::cerr << "Syntax: " << argv[0] << " [--braille] [--cycles=N] file.ch8" << std::endl;
+    std::cerr << "  --braille    2x4 pixels per character (default: half blocks, 1x2)" << std::endl;
+    std::cerr << "  --cycles=N   instructions per frame, the speed (default: 1)" << std::endl;
+
+    exit(-1);
+}
+
+int main(int argc, char** argv)
+{
+    TerminalGlyphs glyphs = TerminalGlyphs::HALF_BLOCKS;
+    unsigned cycles_per_frame = 1;
+    string rom;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--braille")
+        {
+            glyphs = TerminalGlyphs::BRAILLE;
+        }
+        else if (arg.compare(0, 9, "--cycles=") == 0)
+        {
+            cycles_per_frame = strtoul(arg.c_str() + 9, NULL, 10);
+        }
+        else if (arg.compare(0, 2, "--") == 0 || !rom.empty())
+        {
+            print_syntax_and_exit(argv);
+        }
+        else
+        {
+            rom = arg;
+        }
+    }
+
+    if (rom.empty())
+    {
+        print_syntax_and_exit(argv);
+    }
+
+    CPU cpu;
+
+    cpu.initializate();
+
+    if (!cpu.load_rom(rom) || !raw_terminal())
+    {
+        return -1;
+    }
+
+    signal(SIGWINCH, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGHUP, signal_handler);
+
+    TerminalRenderer renderer(glyphs);
+    FramePacer pacer(FREQUENCY, PacingMode::LOW_POWER);
+    unsigned hold[CPU::KEY_MAPPING_SIZE] = {};
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    uint64_t shown = 0;
+    string output;
+
+    while (!_quit && read_keys(cpu, hold))
+    {
+        bool repaint = frames == 0;
+
+        for (unsigned i = 0; i < CPU::KEY_MAPPING_SIZE; i++)
+        {
+            if (hold[i] > 0 && --hold[i] == 0)
+            {
+                cpu.key_event(i, false);
+            }
+        }
+
+        for (unsigned cycle = 0; cycle < cycles_per_frame; cycle++)
+        {
+            cpu.emulate_cycle();
+        }
+
+        if (_resized)
+        {
+            _resized = 0;
+            renderer.invalidate();
+            repaint = true;
+        }
+
+        // Only frames with other pixels (the frame hash changed) are looked at
+        if (repaint || cpu.get_frame_hash() != shown)
+        {
+            shown = cpu.get_frame_hash();
+
+            output.clear();
+
+            if (frames == 0)
+            {
+                output += TerminalRenderer::HIDE_CURSOR;
+            }
+
+            renderer.render(cpu.get_gfx(), output);
+
+            // The whole frame in a single write
+            if (!output.empty() && write(STDOUT_FILENO, output.data(), output.size()) < 0)
+            {
+                break;
+            }
+
+            bytes += output.size();
+        }
+
+        frames++;
+        pacer.wait();
+    }
+
+    char cursor[32];
+
+    // Below the display
+    snprintf(cursor, sizeof(cursor), "\x1b[%u;1H", renderer.get_rows() + 1);
+    std::cout << cursor << std::flush;
+
+    restore_terminal();
+
+    std::cout << frames << " frame(s), " << bytes << " byte(s) written ("
+              << (frames > 0 ? bytes / frames : 0) << " per frame)" << std::endl;
+
+    return 0;
+}
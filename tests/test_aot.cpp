@@ -0,0 +1,65 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "aot.h"
+
+/*
+ * The C++ source chip8-aot emits for a small ROM (run the result with --main and --check to
+ * compare it with the interpreter in lockstep). The same source, compiled in from
+ * tests/test_aot_sample.inc, then runs against the interpreter.
+ */
+
+#include "test_aot_sample.inc"
+
+int main()
+{
+    // V0 = 5, I = 0x300; then forever: BCD of V0 at I, V0 += 1, skip when V0 is 0x10, CXNN
+    const byte rom[] = {0x60, 0x05, 0xA3, 0x00, 0xF0, 0x33, 0x70, 0x01, 0x30, 0x10, 0x12, 0x04, 0xC1, 0x0F, 0x12, 0x04};
+
+    std::ostringstream source;
+    bool emitted = AotCompiler::emit(source, rom, sizeof(rom), "sample", "test_aot", false);
+
+    std::cout << source.str();
+    std::cout << "Emitted = " << emitted << std::endl;
+
+    // The compiled-in program must be what the emitter gives now
+    std::ifstream sample("tests/test_aot_sample.inc");
+    std::stringstream compiled;
+
+    compiled << sample.rdbuf();
+
+    std::cout << "Same as tests/test_aot_sample.inc = " << (compiled.str() == source.str()) << std::endl;
+
+    // Lockstep: the state hashes must match after every block (same seed, CXNN included)
+    const unsigned long long CYCLES = 100000;
+    CPU cpu;
+    CPU reference;
+    AotRunner runner(chip8_aot_sample);
+    unsigned long long done = 0;
+    unsigned ran;
+    bool same = true;
+
+    cpu.initializate();
+    cpu.seed(1);
+    cpu.load_rom_from_buffer(rom, sizeof(rom));
+    reference.initializate();
+    reference.seed(1);
+    reference.load_rom_from_buffer(rom, sizeof(rom));
+
+    while (same && (ran = runner.step(cpu, CYCLES - done)) > 0)
+    {
+        for (unsigned i = 0; i < ran; i++)
+        {
+            reference.emulate_cycle();
+        }
+
+        done += ran;
+        same = cpu.get_state_hash() == reference.get_state_hash();
+    }
+
+    std::cout << "Lockstep: " << done << " cycles, same state = " << same << ", compiled = "
+              << (runner.get_compiled_cycles() > 0) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+
+#include "cpu.h"
+#include "audio.h"
+
+// Sign changes of a second of samples (twice the frequency of a square wave)
+unsigned transitions(Buzzer& buzzer)
+{
+    std::vector<int16_t> samples(buzzer.get_sample_rate());
+    unsigned count = 0;
+
+    buzzer.render(samples.data(), samples.size());
+
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        count += (samples[i] > 0) != (samples[i - 1] > 0);
+    }
+
+    return count;
+}
+
+int main()
+{
+    // V0 = 10; sound timer = V0; loop forever
+    const byte rom[] = {0x60, 0x0A, 0xF0, 0x18, 0x12, 0x04};
+    const char* const WAV = "tests/test_audio.wav";
+
+    CPU cpu;
+    Buzzer buzzer;
+    AudioRecorder recorder(buzzer, 60.0);
+
+    cpu.initializate();
+    cpu.load_rom_from_buffer(rom, sizeof(rom));
+
+    if (!recorder.open(WAV))
+    {
+        return -1;
+    }
+
+    // One instruction per frame, as the frontend runs
+    for (unsigned frame = 0; frame < 60; frame++)
+    {
+        cpu.emulate_cycle();
+        buzzer.set_active(cpu.get_state().sound_timer > 0);
+        recorder.frame();
+    }
+
+    recorder.close();
+
+    std::cout << "Samples = " << recorder.get_samples() << std::endl;
+    std::cout << "Frames with sound = " << recorder.get_active_samples() / 735 << std::endl;
+    std::cout << "WAV size = " << std::ifstream(WAV, std::ios::binary | std::ios::ate).tellg() << std::endl;
+
+    remove(WAV);
+
+    buzzer.set_active(false);
+    std::cout << "Silent transitions = " << transitions(buzzer) << std::endl;
+
+    buzzer.set_active(true);
+    std::cout << "Tone transitions = " << transitions(buzzer) << std::endl;
+
+    const byte pattern[Buzzer::PATTERN_BYTES] = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+                                                 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+
+    buzzer.set_pattern(pattern);
+    std::cout << "Pattern transitions (pitch 64) = " << transitions(buzzer) << std::endl;
+
+    buzzer.set_pattern(pattern, 64 + 48);
+    std::cout << "Pattern transitions (pitch 112) = " << transitions(buzzer) << std::endl;
+
+    return 0;
+}
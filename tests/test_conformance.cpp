@@ -0,0 +1,95 @@
+#include <iostream>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#include "conformance.h"
+
+// Runs every ROM of roms/ on both engines and compares the frames with tests/conformance.golden
+// (--update records them again from the interpreter).
+int main(int argc, char** argv)
+{
+    bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    RomCatalog catalog;
+    Conformance conformance;
+    std::vector<ConformanceRecord> golden;
+
+    if (!catalog.build("roms") || (!update && !conformance.load(Conformance::DEFAULT_GOLDEN, golden)))
+    {
+        return -1;
+    }
+
+    std::unordered_map<uint64_t, const ConformanceRecord*> expected;
+
+    for (const ConformanceRecord& record : golden)
+    {
+        expected[record.rom_hash] = &record;
+    }
+
+    const bool engines[] = {false, true};
+    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+    for (bool tiered : engines)
+    {
+        const char* engine = tiered ? "tiered" : "interpreter";
+        std::vector<ConformanceRecord> records;
+
+        bool complete = conformance.run_corpus(catalog.get_entries(), tiered, jobs, records);
+
+        if (update)
+        {
+            if (!complete || !conformance.save(Conformance::DEFAULT_GOLDEN, records))
+            {
+                return -1;
+            }
+
+            std::cout << records.size() << " ROM(s) recorded in " << Conformance::DEFAULT_GOLDEN << std::endl;
+
+            return 0;
+        }
+
+        unsigned matching = 0;
+
+        for (const ConformanceRecord& record : records)
+        {
+            std::unordered_map<uint64_t, const ConformanceRecord*>::const_iterator found = expected.find(record.rom_hash);
+
+            if (found == expected.end())
+            {
+                std::cout << "No golden frames (" << engine << "): " << record.path << std::endl;
+
+                continue;
+            }
+
+            const std::vector<uint64_t>& checkpoints = found->second->checkpoints;
+            size_t first = 0;
+
+            while (first < record.checkpoints.size() && first < checkpoints.size() &&
+                   record.checkpoints[first] == checkpoints[first])
+            {
+                first++;
+            }
+
+            if (first == checkpoints.size() && first == record.checkpoints.size())
+            {
+                matching++;
+            }
+            else
+            {
+                std::cout << "Mismatch (" << engine << ") at frame "
+                          << (first + 1) * Conformance::DEFAULT_OPTIONS.checkpoint_period << ": " << record.path << std::endl;
+            }
+        }
+
+        std::cout << engine << ": " << matching << " of " << records.size() << " ROM(s) match the golden frames" << std::endl;
+    }
+
+    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - begin;
+
+    // Not part of the expected output
+    std::cerr << "Conformance suite run in " << time.count() << " s (" << jobs << " job(s))" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+
+#include "cpu.h"
+
+int main()
+{
+    #ifndef CHIP8_CPU_DEBUG
+
+    std::cerr << "Preprocessor directive CHIP8_CPU_DEBUG is not set and is necessary for execute the test. Aborting." << std::endl;
+
+    return -1;
+
+    #else
+
+    const byte rom[] = {0x60, 0x2A, 0xA2, 0x0A, 0xF0, 0x33, 0x12, 0x06};
+    byte too_big[CPU::MEMORY_LENGTH_B - CPU::ROM_MEMORY_BEGIN + 1] = {0};
+
+    CPU cpu;
+    CPU shared;
+
+    cpu.initializate();
+    shared.initializate();
+
+    std::cout << "Oversized ROM loaded = " << std::boolalpha << cpu.load_rom_from_buffer(too_big, sizeof(too_big)) << std::endl;
+    std::cout << "ROM loaded = " << std::boolalpha << cpu.load_rom_from_buffer(rom, sizeof(rom)) << std::endl;
+
+    // Both instances share the image until one of them writes (FX33)
+    shared.load_image(cpu.get_image());
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        cpu.emulate_cycle();
+    }
+
+    std::cout << "Image shared = " << std::boolalpha << (cpu.get_image() == shared.get_image()) << std::endl;
+    std::cout << "BCD = " << (unsigned)cpu.load(0x20A) << (unsigned)cpu.load(0x20B) << (unsigned)cpu.load(0x20C) << std::endl;
+    std::cout << "BCD (shared) = " << (unsigned)shared.load(0x20A) << (unsigned)shared.load(0x20B) << (unsigned)shared.load(0x20C) << std::endl;
+
+    cpu.print_status();
+    cpu.print_memory();
+
+    #endif
+
+    return 0;
+}
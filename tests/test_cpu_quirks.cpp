@@ -0,0 +1,111 @@
+#include <iostream>
+#include <cstdio>
+
+#include "cpu.h"
+
+// Loads the ROM and runs the cycles
+void run(CPU& cpu, const byte* rom, size_t length, unsigned cycles, const CPU::Quirks& quirks = CPU::DEFAULT_QUIRKS)
+{
+    cpu.initializate();
+    cpu.set_quirks(quirks);
+    cpu.load_rom_from_buffer(rom, length);
+
+    for (unsigned i = 0; i < cycles; i++)
+    {
+        cpu.emulate_cycle();
+    }
+}
+
+void print_cpu(const char* name, const CPU& cpu)
+{
+    const CPU::State& state = cpu.get_state();
+
+    printf("%s: pc = 0x%03X, sp = %u, halt = %d\n", name, state.pc, state.sp, state.halt);
+}
+
+// Lit pixels, and whether the sprite reached each corner of the screen
+void print_screen(const char* name, const CPU& cpu)
+{
+    const byte* gfx = cpu.get_gfx();
+    unsigned lit = 0;
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        lit += gfx[i];
+    }
+
+    printf("%s: %u pixels, (60, 30) = %u, (0, 30) = %u, (60, 0) = %u, (0, 0) = %u\n", name, lit,
+           gfx[30 * CPU::WIDTH + 60], gfx[30 * CPU::WIDTH], gfx[60], gfx[0]);
+}
+
+int main()
+{
+    #ifndef CHIP8_CPU_DEBUG
+
+    std::cerr << "Preprocessor directive CHIP8_CPU_DEBUG is not set and is necessary for execute the test. Aborting." << std::endl;
+
+    return -1;
+
+    #else
+
+    // 4x8 block of pixels at (60, 30): past the right and bottom edges
+    const byte sprite[] = {0x60, 0x3C, 0x61, 0x1E, 0xA2, 0x0A, 0xD0, 0x14, 0x12, 0x08, 0xFF, 0xFF, 0xFF, 0xFF};
+    // Calls itself until the stack is full
+    const byte call[] = {0x22, 0x00};
+    // Returns with an empty stack
+    const byte ret[] = {0x00, 0xEE};
+    // V0 = 0x25 (key 5); EX9E skips V1 = 1, EXA1 doesn't skip V2 = 1
+    const byte keys[] = {0x60, 0x25, 0xE0, 0x9E, 0x61, 0x01, 0xE0, 0xA1, 0x62, 0x01, 0x12, 0x0A};
+    // BCD of 123 at 0xFFE
+    const byte bcd[] = {0x60, 0x7B, 0xAF, 0xFE, 0xF0, 0x33, 0x12, 0x06};
+    // V0..V2 stored at 0xFFE, cleared and loaded back
+    const byte store[] = {0x60, 0xAA, 0x61, 0xBB, 0x62, 0xCC, 0xAF, 0xFE, 0xF2, 0x55,
+                          0x60, 0x00, 0x61, 0x00, 0x62, 0x00, 0xF2, 0x65, 0x12, 0x12};
+
+    CPU cpu;
+    CPU::Quirks wrap = CPU::DEFAULT_QUIRKS;
+
+    wrap.wrap_sprites = true;
+
+    run(cpu, sprite, sizeof(sprite), 5);
+    print_screen("DXYN clipped", cpu);
+    print_cpu("DXYN clipped", cpu);
+
+    run(cpu, sprite, sizeof(sprite), 5, wrap);
+    print_screen("DXYN wrapped", cpu);
+    print_cpu("DXYN wrapped", cpu);
+
+    run(cpu, call, sizeof(call), CPU::STACK_DEEPNESS + 2);
+    print_cpu("2NNN on a full stack", cpu);
+
+    run(cpu, ret, sizeof(ret), 2);
+    print_cpu("00EE on an empty stack", cpu);
+
+    cpu.initializate();
+    cpu.load_rom_from_buffer(keys, sizeof(keys));
+    cpu.key_event(0x5, true);
+
+    for (unsigned i = 0; i < 6; i++)
+    {
+        cpu.emulate_cycle();
+    }
+
+    printf("EX9E/EXA1 with VX = 0x25 and key 5 down: V1 = %u (skipped), V2 = %u\n", cpu.get_state().V[1],
+           cpu.get_state().V[2]);
+    print_cpu("EX9E/EXA1", cpu);
+
+    run(cpu, bcd, sizeof(bcd), 4);
+    printf("FX33 at 0xFFE: 0xFFE = %u, 0xFFF = %u, 0x000 = %u, I = 0x%03X\n", cpu.load(0xFFE), cpu.load(0xFFF),
+           cpu.load(0x000), cpu.get_state().I);
+    print_cpu("FX33", cpu);
+
+    run(cpu, store, sizeof(store), 10);
+    printf("FX55/FX65 at 0xFFE: 0xFFE = 0x%02X, 0xFFF = 0x%02X, 0x000 = 0x%02X, V0..V2 = 0x%02X 0x%02X 0x%02X, I = 0x%03X\n",
+           cpu.load(0xFFE), cpu.load(0xFFF), cpu.load(0x000), cpu.get_state().V[0], cpu.get_state().V[1],
+           cpu.get_state().V[2], cpu.get_state().I);
+    print_cpu("FX55/FX65", cpu);
+
+    #endif
+
+    return 0;
+}
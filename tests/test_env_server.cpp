@@ -0,0 +1,103 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "cpu.h"
+#include "env_server.h"
+
+/*
+ * A server with two Pong instances and an agent attached in the same process: after reset and
+ * every step, the frame, its hash, the cycles and a memory window read through the shared
+ * memory match a plain CPU run for the same cycles with the same keys.
+ */
+
+const char* ROM_PATH = "roms/games/Pong [Paul Vervalin, 1990].ch8";
+const unsigned CYCLES = 10;
+const unsigned STEPS = 200;
+const WORD WINDOW = 0x200;
+
+bool same_as(const EnvClient& client, unsigned index, const CPU& cpu)
+{
+    bool same = memcmp(client.get_gfx(index), cpu.get_gfx(), CPU::GFX_LENGTH) == 0 &&
+                client.get_frame_hash(index) == cpu.get_frame_hash();
+
+    for (unsigned i = 0; i < EnvSlot::READ_WINDOW_SIZE; i++)
+    {
+        same = same && client.get_read_buffer(index)[i] == cpu.load(WINDOW + i);
+    }
+
+    return same;
+}
+
+int main()
+{
+    std::string name = "/chip8-test-env-" + std::to_string(getpid());
+    EnvServer server;
+
+    if (!server.create(name, ROM_PATH, 2, 1))
+    {
+        return -1;
+    }
+
+    std::thread serving(&EnvServer::run, &server);
+    EnvClient client;
+
+    std::cout << "Attached = " << client.attach(name) << ", slots = " << client.get_slot_count() << std::endl;
+
+    CPU cpu;
+    byte keys[CPU::KEY_MAPPING_SIZE] = {0};
+
+    cpu.initializate();
+    cpu.load_image(CPU::read_image(ROM_PATH));
+
+    client.set_read_window(1, WINDOW, EnvSlot::READ_WINDOW_SIZE);
+    client.reset(1);
+
+    std::cout << "Reset: same as a new CPU = " << same_as(client, 1, cpu) << ", cycles = "
+              << client.get_total_cycles(1) << std::endl;
+
+    // Paddle up and down (keys 1 and 4) for a while each
+    unsigned mismatches = 0;
+    bool drawn = false;
+
+    for (unsigned step = 0; step < STEPS; step++)
+    {
+        memset(keys, 0, sizeof(keys));
+        keys[(step / 25) % 2 == 0 ? 0x1 : 0x4] = 1;
+
+        client.step(1, keys, CYCLES);
+        cpu.update_pressed_keys(keys);
+
+        bool draw = false;
+
+        for (unsigned cycle = 0; cycle < CYCLES; cycle++)
+        {
+            cpu.emulate_cycle();
+            draw |= cpu.is_draw_flag_set();
+        }
+
+        mismatches += same_as(client, 1, cpu) && client.is_draw_flag_set(1) == draw ? 0 : 1;
+        drawn |= draw;
+    }
+
+    std::cout << "Steps: " << STEPS << ", cycles = " << client.get_total_cycles(1) << ", drawn = " << drawn
+              << ", mismatches = " << mismatches << std::endl;
+    std::cout << "Other slot untouched: cycles = " << client.get_total_cycles(0) << std::endl;
+
+    client.reset(1);
+    cpu.initializate();
+    cpu.load_image(CPU::read_image(ROM_PATH));
+
+    std::cout << "Reset again: same as a new CPU = " << same_as(client, 1, cpu) << ", cycles = "
+              << client.get_total_cycles(1) << std::endl;
+
+    client.detach();
+    server.stop();
+    serving.join();
+    server.destroy();
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <cstring>
+
+#include "cpu.h"
+#include "execution_manager.h"
+
+bool same_state(const CPU::State& a, const CPU::State& b)
+{
+    return a.pc == b.pc && a.opcode == b.opcode && a.I == b.I && a.sp == b.sp &&
+           memcmp(a.V, b.V, sizeof(a.V)) == 0 && memcmp(a.stack, b.stack, sizeof(a.stack)) == 0 &&
+           a.delay_timer == b.delay_timer && a.sound_timer == b.sound_timer &&
+           a.draw_flag == b.draw_flag && a.halt == b.halt;
+}
+
+int main()
+{
+    // Counts 16 times in V3, patches its own loop (ADD V3, 1 -> ADD V3, 2) with FX55 and counts 16 times again
+    const byte rom[] = {0x60, 0x00, 0x73, 0x01, 0x70, 0x01, 0x30, 0x10, 0x12, 0x02, 0x32, 0x01, 0x12, 0x10, 0x12, 0x0E,
+                        0x62, 0x01, 0x60, 0x73, 0x61, 0x02, 0xA2, 0x02, 0xF1, 0x55, 0x60, 0x00, 0x12, 0x02};
+    const TierThresholds thresholds = {2, 4};
+
+    CPU interpreted;
+    CPU tiered;
+    ExecutionManager manager(thresholds);
+
+    interpreted.initializate();
+    tiered.initializate();
+    interpreted.load_rom_from_buffer(rom, sizeof(rom));
+    tiered.load_rom_from_buffer(rom, sizeof(rom));
+
+    for (size_t i = 0; i < 500; i++)
+    {
+        interpreted.emulate_cycle();
+    }
+
+    manager.run(tiered, 500);
+
+    const CPU::State& expected = interpreted.get_state();
+    const CPU::State& state = tiered.get_state();
+
+    std::cout << "V3 (interpreter) = " << (unsigned)expected.V[3] << std::endl;
+    std::cout << "V3 (tiered) = " << (unsigned)state.V[3] << std::endl;
+    std::cout << "Same PC = " << std::boolalpha << (expected.pc == state.pc) << std::endl;
+    std::cout << "Loop tier = " << ExecutionManager::tier_name(manager.get_tier(0x202)) << std::endl;
+    std::cout << "Decoded promotions = " << manager.get_metrics().promotions[(unsigned)Tier::DECODED] << std::endl;
+    std::cout << "Invalidations = " << manager.get_metrics().invalidations << std::endl;
+
+    manager.print_metrics(std::cout);
+
+    // Load pair, draw, counted loop (L: 7201; 3240; 1L) and delay wait (L: F407; 3400; 1L), forever
+    const byte fused_rom[] = {0x60, 0x00, 0x61, 0x05, 0xA2, 0x1A, 0xD0, 0x15, 0x72, 0x01, 0x32, 0x40, 0x12, 0x08,
+                              0x63, 0x30, 0xF3, 0x15, 0xF4, 0x07, 0x34, 0x00, 0x12, 0x12, 0x12, 0x00,
+                              0xF0, 0x90, 0x90, 0x90, 0xF0};
+    ExecutionManager fusing(thresholds);
+
+    interpreted.initializate();
+    tiered.initializate();
+    interpreted.load_rom_from_buffer(fused_rom, sizeof(fused_rom));
+    tiered.load_rom_from_buffer(fused_rom, sizeof(fused_rom));
+
+    for (size_t i = 0; i < 5000; i++)
+    {
+        interpreted.emulate_cycle();
+    }
+
+    fusing.run(tiered, 5000);
+
+    std::cout << "Same state = " << std::boolalpha << same_state(expected, state) << std::endl;
+    std::cout << "Same screen = " << std::boolalpha << (memcmp(interpreted.get_gfx(), tiered.get_gfx(), CPU::GFX_LENGTH) == 0) << std::endl;
+
+    fusing.print_metrics(std::cout);
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <iostream>
+
+#include "cpu.h"
+
+int main()
+{
+    // I = font "0"; V1 = 10, V2 = 5; draw, draw again (erase), draw, CLS, draw; 1L
+    const byte rom[] = {0xA0, 0x50, 0x61, 0x0A, 0x62, 0x05, 0xD1, 0x25, 0xD1, 0x25, 0xD1, 0x25,
+                        0x00, 0xE0, 0xD1, 0x25, 0x12, 0x10};
+
+    CPU cpu;
+
+    cpu.initializate();
+    cpu.load_rom_from_buffer(rom, sizeof(rom));
+
+    std::cout << "Blank display hash = " << cpu.get_frame_hash() << std::endl;
+
+    for (unsigned i = 0; i < 4; i++)
+    {
+        cpu.emulate_cycle();
+    }
+
+    uint64_t drawn = cpu.get_frame_hash();
+
+    std::cout << "Sprite drawn: hash changed = " << (drawn != 0) << ", matches the pixels = "
+              << (drawn == CPU::hash_frame(cpu.get_gfx())) << std::endl;
+
+    cpu.emulate_cycle();
+
+    std::cout << "Sprite erased: hash = " << cpu.get_frame_hash() << std::endl;
+
+    cpu.emulate_cycle();
+
+    std::cout << "Same sprite again: same hash = " << (cpu.get_frame_hash() == drawn) << std::endl;
+
+    cpu.emulate_cycle();
+
+    std::cout << "Cleared: hash = " << cpu.get_frame_hash() << std::endl;
+
+    cpu.emulate_cycle();
+
+    std::cout << "Redrawn after a clear: same hash = " << (cpu.get_frame_hash() == drawn) << std::endl;
+
+    // Jumping in place doesn't touch the display
+    for (unsigned i = 0; i < 100; i++)
+    {
+        cpu.emulate_cycle();
+    }
+
+    std::cout << "Unchanged display: same hash = " << (cpu.get_frame_hash() == drawn) << std::endl;
+
+    return 0;
+}
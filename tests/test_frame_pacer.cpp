@@ -0,0 +1,48 @@
+#include <iostream>
+#include <thread>
+
+#include "frame_pacer.h"
+
+// Only checks what holds on any machine: the schedule is absolute (never shorter than the
+// frames asked for), every frame is counted and the percentiles are ordered.
+int main()
+{
+    const PacingMode modes[] = {PacingMode::LOW_LATENCY, PacingMode::LOW_POWER};
+    const unsigned FRAMES = 24;
+
+    for (PacingMode mode : modes)
+    {
+        FramePacer pacer(240.0, mode);
+        FramePacer::Clock::time_point begin = FramePacer::Clock::now();
+
+        pacer.start();
+
+        for (unsigned frame = 0; frame < FRAMES; frame++)
+        {
+            pacer.wait();
+        }
+
+        PacerStats stats = pacer.get_stats();
+
+        std::cout << FramePacer::mode_name(mode) << ":" << std::endl;
+        std::cout << "Frames = " << stats.frames << std::endl;
+        std::cout << "Schedule kept = " << std::boolalpha
+                  << (FramePacer::Clock::now() - begin >= pacer.get_period() * (int)FRAMES) << std::endl;
+        std::cout << "Ordered percentiles = "
+                  << (stats.p50 <= stats.p95 && stats.p95 <= stats.p99 && stats.p99 <= stats.max) << std::endl;
+    }
+
+    // A frame far longer than MAX_LATE_FRAMES periods restarts the schedule
+    FramePacer pacer(240.0, PacingMode::LOW_POWER);
+
+    pacer.start();
+    std::this_thread::sleep_for(pacer.get_period() * (int)(FramePacer::MAX_LATE_FRAMES + 4));
+
+    bool in_time = pacer.wait();
+
+    std::cout << "Late frame in time = " << in_time << std::endl;
+    std::cout << "Overruns = " << pacer.get_stats().overruns << std::endl;
+    std::cout << "Resyncs = " << pacer.get_stats().resyncs << std::endl;
+
+    return 0;
+}
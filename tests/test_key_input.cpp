@@ -0,0 +1,87 @@
+#include <iostream>
+
+#include "cpu.h"
+#include "key_input.h"
+
+int main()
+{
+    // L: FX0A (V5); EX9E (V5); 1L; then 1202 forever once the key is held
+    const byte rom[] = {0xF5, 0x0A, 0xE5, 0x9E, 0x12, 0x00, 0x12, 0x06};
+
+    CPU cpu;
+    KeyInput input;
+    const CPU::State& state = cpu.get_state();
+
+    cpu.initializate();
+    cpu.load_rom_from_buffer(rom, sizeof(rom));
+
+    // A key held before FX0A starts waiting doesn't count
+    input.press(0x3);
+    input.apply(cpu);
+
+    for (unsigned i = 0; i < 10; i++)
+    {
+        cpu.emulate_cycle();
+    }
+
+    std::cout << "Waiting with a held key: PC = 0x" << std::hex << state.pc << std::dec << std::endl;
+
+    input.release(0x3);
+    input.apply(cpu);
+    cpu.emulate_cycle();
+
+    std::cout << "Released a key held before: PC = 0x" << std::hex << state.pc << std::dec << std::endl;
+
+    // A key pressed and released between two instructions is seen through the edges
+    input.press(0xB);
+    input.release(0xB);
+    input.apply(cpu);
+
+    std::cout << "Mask after a tap = " << input.get_mask() << std::endl;
+
+    cpu.emulate_cycle();
+
+    std::cout << "Tapped key: V5 = 0x" << std::hex << (unsigned)state.V[5] << ", PC = 0x" << state.pc << std::dec
+              << std::endl;
+    std::cout << "Other registers untouched: VB = " << (unsigned)state.V[0xB] << std::endl;
+
+    // EX9E tests the key bit: not held -> back to FX0A
+    cpu.emulate_cycle();
+    cpu.emulate_cycle();
+
+    std::cout << "EX9E without the key: PC = 0x" << std::hex << state.pc << std::dec << std::endl;
+
+    // FX0A starts waiting, V5's key is pressed and released, then held: EX9E skips to the end
+    cpu.emulate_cycle();
+    input.press(0xB);
+    input.apply(cpu);
+    cpu.emulate_cycle();
+    input.release(0xB);
+    input.apply(cpu);
+    cpu.emulate_cycle();
+    input.press(0xB);
+    input.apply(cpu);
+    cpu.emulate_cycle();
+
+    std::cout << "EX9E with the key: PC = 0x" << std::hex << state.pc << std::dec << std::endl;
+    std::cout << "Pressed keys = 0x" << std::hex << cpu.get_pressed_keys() << std::dec << std::endl;
+
+    // Held keys repeat on the input side: only one edge each
+    KeyInput repeated;
+    KeyEdge edge;
+    unsigned edges = 0;
+
+    repeated.press(0x1);
+    repeated.press(0x1);
+    repeated.release(0x1);
+    repeated.release(0x1);
+
+    while (repeated.poll(edge))
+    {
+        edges++;
+    }
+
+    std::cout << "Edges of a repeated key = " << edges << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+#include "cpu.h"
+#include "pixel_pipeline.h"
+
+int main()
+{
+    const PixelKernel kernels[] = {PixelKernel::SCALAR, PixelKernel::SSE2, PixelKernel::AVX2};
+    const Palette palette = {0xFF102030, 0xFFE0D0C0};
+    byte gfx[CPU::GFX_LENGTH];
+    byte packed[CPU::GFX_LENGTH / 8] = {};
+    uint32_t random = 1;
+
+    for (unsigned i = 0; i < CPU::GFX_LENGTH; i++)
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+
+        gfx[i] = random & 1;
+        packed[i / 8] |= gfx[i] << (7 - i % 8);
+    }
+
+    std::vector<uint32_t> reference(CPU::GFX_LENGTH);
+    std::vector<uint32_t> pixels(CPU::GFX_LENGTH);
+    bool same = true;
+
+    PixelPipeline(PixelKernel::SCALAR).expand(gfx, palette, reference.data());
+
+    // Every kernel the machine has must match the scalar one (the others fall back to it)
+    for (PixelKernel kernel : kernels)
+    {
+        PixelPipeline pipeline(kernel);
+
+        pipeline.expand(gfx, palette, pixels.data());
+        same = same && pixels == reference;
+
+        pipeline.expand_packed(packed, palette, pixels.data());
+        same = same && pixels == reference;
+    }
+
+    std::cout << "Kernels match the scalar expansion = " << std::boolalpha << same << std::endl;
+    std::cout << "First pixels = " << std::hex << reference[0] << " " << reference[1] << " " << reference[2]
+              << std::dec << std::endl;
+
+    // Nearest x3 repeats every pixel in a 3x3 square
+    PixelPipeline pipeline;
+    std::vector<uint32_t> scaled(CPU::GFX_LENGTH * 9);
+    bool squares = true;
+
+    pipeline.render(gfx, palette, PixelScaler::NEAREST, 3, scaled.data());
+
+    for (unsigned row = 0; row < CPU::HEIGHT * 3; row++)
+    {
+        for (unsigned col = 0; col < CPU::WIDTH * 3; col++)
+        {
+            squares = squares && scaled[row * CPU::WIDTH * 3 + col] == reference[(row / 3) * CPU::WIDTH + col / 3];
+        }
+    }
+
+    std::cout << "Nearest x3 = " << squares << std::endl;
+
+    // Scale2x and Scale3x on a diagonal: the staircase is smoothed, a flat area stays flat
+    const uint32_t X = 1;
+    const uint32_t O = 0;
+    const uint32_t diagonal[16] = {X, O, O, O,
+                                   O, X, O, O,
+                                   O, O, X, O,
+                                   O, O, O, X};
+    uint32_t scale2x[64];
+    uint32_t scale3x[144];
+
+    PixelPipeline::scale2x(diagonal, 4, 4, scale2x);
+    PixelPipeline::scale3x(diagonal, 4, 4, scale3x);
+
+    std::cout << "Scale2x:" << std::endl;
+
+    for (unsigned row = 0; row < 8; row++)
+    {
+        for (unsigned col = 0; col < 8; col++)
+        {
+            std::cout << (scale2x[row * 8 + col] ? '#' : '.');
+        }
+
+        std::cout << std::endl;
+    }
+
+    std::cout << "Scale3x:" << std::endl;
+
+    for (unsigned row = 0; row < 12; row++)
+    {
+        for (unsigned col = 0; col < 12; col++)
+        {
+            std::cout << (scale3x[row * 12 + col] ? '#' : '.');
+        }
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+#include "cpu.h"
+#include "rollback.h"
+
+/*
+ * Two peers in memory over a link that delays each input 2 to 6 frames (so they also arrive
+ * out of order). At the end both peers and a plain CPU run with the real inputs must agree.
+ */
+
+const unsigned FRAMES = 1200;
+const unsigned CYCLES = 10;
+
+struct Message
+{
+    unsigned deliver_at;
+    uint32_t frame;
+    WORD mask;
+};
+
+// Player keys held for a while, then others (1 and 4: left paddle, C and D: right paddle)
+WORD bot(uint32_t& random, unsigned frame, WORD up, WORD down)
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    const WORD choices[3] = {0, up, down};
+
+    return choices[(frame / 10 + (random >> 30)) % 3];
+}
+
+void deliver(std::vector<Message>& link, unsigned tick, RollbackSession& session)
+{
+    for (size_t i = 0; i < link.size();)
+    {
+        if (link[i].deliver_at <= tick)
+        {
+            session.add_remote_input(link[i].frame, link[i].mask);
+            link[i] = link.back();
+            link.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+int main()
+{
+    std::shared_ptr<const CPU::Image> image = CPU::read_image("roms/games/Pong [Paul Vervalin, 1990].ch8");
+
+    if (!image)
+    {
+        return -1;
+    }
+
+    const DWORD seed = 0xC8;
+
+    RollbackSession a(image, seed, CYCLES, 0);
+    RollbackSession b(image, seed, CYCLES, 1);
+    std::vector<Message> to_a, to_b;
+    std::vector<WORD> inputs_a, inputs_b;
+    uint32_t random_a = 1, random_b = 2, latency = 3;
+
+    for (unsigned tick = 0; a.get_frame() < FRAMES || b.get_frame() < FRAMES ||
+                            a.get_confirmed_frame() < FRAMES || b.get_confirmed_frame() < FRAMES; tick++)
+    {
+        RollbackSession* peers[2] = {&a, &b};
+        std::vector<WORD>* inputs[2] = {&inputs_a, &inputs_b};
+        std::vector<Message>* links[2] = {&to_b, &to_a};
+
+        for (unsigned p = 0; p < 2; p++)
+        {
+            RollbackSession& peer = *peers[p];
+
+            if (peer.get_frame() < FRAMES && peer.can_advance())
+            {
+                uint32_t& random = p == 0 ? random_a : random_b;
+
+                peer.set_local_input(p == 0 ? bot(random, peer.get_local_frames(), 0x0002, 0x0010)
+                                            : bot(random, peer.get_local_frames(), 0x1000, 0x2000));
+            }
+
+            if (peer.get_frame() < FRAMES)
+            {
+                peer.advance();
+            }
+
+            // Inputs go out once, each with its own delay
+            for (WORD mask; peer.get_local_input(inputs[p]->size(), mask);)
+            {
+                latency = (latency * 1103515245 + 12345) & 0x7FFFFFFF;
+                links[p]->push_back({tick + 2 + latency % 5, (uint32_t)inputs[p]->size(), mask});
+                inputs[p]->push_back(mask);
+            }
+        }
+
+        deliver(to_a, tick, a);
+        deliver(to_b, tick, b);
+
+        uint32_t frame;
+        uint64_t hash;
+
+        if (a.get_checkpoint(frame, hash))
+        {
+            b.check_remote(frame, hash);
+        }
+
+        if (b.get_checkpoint(frame, hash))
+        {
+            a.check_remote(frame, hash);
+        }
+    }
+
+    a.synchronize();
+    b.synchronize();
+
+    // The same frames without any rollback
+    CPU reference;
+
+    reference.initializate();
+    reference.load_image(image);
+    reference.seed(seed);
+
+    for (unsigned frame = 0; frame < FRAMES; frame++)
+    {
+        reference.update_pressed_keys((WORD)(inputs_a[frame] | inputs_b[frame]));
+
+        for (unsigned cycle = 0; cycle < CYCLES; cycle++)
+        {
+            reference.emulate_cycle();
+        }
+    }
+
+    RollbackStats stats_a = a.get_stats();
+    RollbackStats stats_b = b.get_stats();
+
+    std::cout << "Frames: " << a.get_frame() << " and " << b.get_frame() << std::endl;
+    std::cout << "Peers agree: " << (a.get_cpu().get_state_hash() == b.get_cpu().get_state_hash()) << std::endl;
+    std::cout << "Same as without rollback: " << (a.get_cpu().get_state_hash() == reference.get_state_hash())
+              << std::endl;
+    std::cout << "Rolled back: " << (stats_a.rollbacks > 0 && stats_b.rollbacks > 0) << ", at most "
+              << RollbackSession::MAX_ROLLBACK << " frames back: "
+              << (stats_a.depth_max <= RollbackSession::MAX_ROLLBACK && stats_b.depth_max <= RollbackSession::MAX_ROLLBACK)
+              << std::endl;
+    std::cout << "Checkpoints compared: " << (stats_a.checks > 0 && stats_b.checks > 0) << ", desyncs: "
+              << stats_a.desyncs + stats_b.desyncs << std::endl;
+
+    printf("Peer A: %llu rollback(s), %llu frame(s) resimulated, inputs %.2f frames late\n",
+           (unsigned long long)stats_a.rollbacks, (unsigned long long)stats_a.resimulated, stats_a.late_mean);
+    printf("Peer B: %llu rollback(s), %llu frame(s) resimulated, inputs %.2f frames late\n",
+           (unsigned long long)stats_b.rollbacks, (unsigned long long)stats_b.resimulated, stats_b.late_mean);
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <cstdio>
+
+#include "rom_analyzer.h"
+
+/*
+ * A ROM with a subroutine, an unreached word and two stores: one to data, one over its own
+ * code. The analyzer must find the code, skip the unreached word and flag the second store.
+ */
+
+int main()
+{
+    const byte rom[] = {0x60, 0x07,     // 0x200: V0 = 7
+                        0x22, 0x08,     // 0x202: call 0x208
+                        0x12, 0x04,     // 0x204: jump to itself
+                        0x12, 0x34,     // 0x206: never reached
+                        0xA3, 0x00,     // 0x208: I = 0x300
+                        0xF0, 0x33,     // 0x20A: BCD of V0 at I (data)
+                        0xA2, 0x02,     // 0x20C: I = 0x202
+                        0xF0, 0x55,     // 0x20E: V0 at I (the call above)
+                        0x00, 0xEE};    // 0x210: return
+
+    RomAnalyzer analyzer;
+
+    analyzer.analyze(rom, sizeof(rom));
+
+    std::cout << "Code:";
+
+    for (WORD addr = CPU::ROM_MEMORY_BEGIN; addr < CPU::ROM_MEMORY_BEGIN + sizeof(rom); addr += 2)
+    {
+        printf(" %03X=%d", addr, analyzer.is_code(addr));
+    }
+
+    std::cout << std::endl;
+    std::cout << "Code size = " << analyzer.get_code_size() << ", blocks = " << analyzer.get_blocks().size()
+              << ", complete = " << analyzer.is_complete() << ", static code = " << analyzer.has_static_code() << std::endl;
+
+    for (const RomStore& store : analyzer.get_stores())
+    {
+        printf("Store at 0x%03X: 0x%03X, %u byte(s), known = %d, hits code = %d\n", store.address, store.target,
+               store.length, store.known, store.hits_code);
+    }
+
+    return 0;
+}
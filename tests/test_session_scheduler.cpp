@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+
+#include "cpu.h"
+#include "work_pool.h"
+#include "session_scheduler.h"
+
+/*
+ * Sessions that park (waiting in FX0A, spinning, halted) and one that never does, plus many
+ * Pong sessions ticked on 3 workers: they must end like the same CPUs run one by one.
+ */
+
+const unsigned CYCLES = 10;
+
+int main()
+{
+    // Waits for a key, draws its digit at (0, 0) and waits again
+    const byte wait_key[] = {0xF0, 0x0A, 0xF0, 0x29, 0x61, 0x00, 0xD1, 0x15, 0x12, 0x00};
+    // Jumps to itself
+    const byte spin[] = {0x12, 0x00};
+    // Counts in V0 forever
+    const byte count[] = {0x70, 0x01, 0x12, 0x00};
+    // Returns with an empty stack (the CPU halts)
+    const byte underflow[] = {0x00, 0xEE};
+
+    WorkStealingPool pool(3);
+    SessionScheduler scheduler(pool);
+
+    scheduler.add_session(CPU::create_image(wait_key, sizeof(wait_key)), CYCLES, 1);
+    scheduler.add_session(CPU::create_image(spin, sizeof(spin)), CYCLES, 1);
+    scheduler.add_session(CPU::create_image(count, sizeof(count)), CYCLES, 1);
+    scheduler.add_session(CPU::create_image(underflow, sizeof(underflow)), CYCLES, 1);
+
+    for (unsigned tick = 0; tick < 10; tick++)
+    {
+        scheduler.tick();
+    }
+
+    bool parked_before = scheduler.is_parked(0);
+    SessionStats waiting = scheduler.get_session_stats(0);
+
+    // Key 5 down: FX0A takes it when released
+    scheduler.set_keys(0, 0x0020);
+    scheduler.tick();
+    scheduler.tick();
+
+    bool parked_pressed = scheduler.is_parked(0);
+
+    scheduler.set_keys(0, 0x0000);
+    scheduler.tick();
+
+    byte key = scheduler.get_cpu(0).get_state().V[0];
+    bool drawn = scheduler.get_cpu(0).get_frame_hash() != 0;
+
+    scheduler.tick();
+
+    SessionStats woken = scheduler.get_session_stats(0);
+    SessionStats counting = scheduler.get_session_stats(2);
+    bool all_parked = scheduler.is_parked(0) && scheduler.is_parked(1) && !scheduler.is_parked(2) &&
+                      scheduler.is_parked(3);
+
+    // Many long-lived sessions with their own keys
+    std::shared_ptr<const CPU::Image> pong = CPU::read_image("roms/games/Pong [Paul Vervalin, 1990].ch8");
+    SessionScheduler many(pool);
+    std::vector<CPU> reference(500);
+    const unsigned TICKS = 120;
+
+    for (unsigned i = 0; i < reference.size(); i++)
+    {
+        many.add_session(pong, CYCLES, i + 1);
+        reference[i].initializate();
+        reference[i].load_image(pong);
+        reference[i].seed(i + 1);
+    }
+
+    for (unsigned tick = 0; tick < TICKS; tick++)
+    {
+        for (unsigned i = 0; i < reference.size(); i++)
+        {
+            WORD keys = (tick / 20 + i) % 3 == 0 ? 0x0002 : (tick / 20 + i) % 3 == 1 ? 0x0010 : 0;
+
+            many.set_keys(i, keys);
+            reference[i].update_pressed_keys(keys);
+
+            for (unsigned cycle = 0; cycle < CYCLES; cycle++)
+            {
+                reference[i].emulate_cycle();
+            }
+        }
+
+        many.tick();
+    }
+
+    bool same = true;
+
+    for (unsigned i = 0; i < reference.size(); i++)
+    {
+        same = same && many.get_cpu(i).get_state_hash() == reference[i].get_state_hash();
+    }
+
+    SchedulerStats stats = many.get_stats();
+
+    std::cout << "Waiting for a key: parked = " << parked_before << ", frames run = " << waiting.frames
+              << ", skipped = " << waiting.parked << std::endl;
+    std::cout << "Key held: parked again = " << parked_pressed << std::endl;
+    std::cout << "Key released: V0 = " << (unsigned)key << ", digit drawn = " << drawn << ", wakeups = "
+              << woken.wakeups << std::endl;
+    std::cout << "Counter: frames run = " << counting.frames << ", skipped = " << counting.parked << std::endl;
+    std::cout << "Parked at the end (waiting, spinning, halted; not the counter) = " << all_parked << std::endl;
+    std::cout << "Pong sessions: " << stats.sessions << ", every frame accounted for = "
+              << (stats.frames + stats.parked == (uint64_t)TICKS * stats.sessions) << ", same as one by one = " << same
+              << std::endl;
+
+    return 0;
+}
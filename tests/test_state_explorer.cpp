@@ -0,0 +1,107 @@
+#include <iostream>
+#include <atomic>
+#include <cstdio>
+
+#include "cpu.h"
+#include "work_pool.h"
+#include "state_explorer.h"
+
+/*
+ * A ROM that waits for a key and breaks in a different way for keys 5 to 8 (the rest go back
+ * to waiting), explored with 1 and 3 workers: same states and findings.
+ */
+
+void print_result(const ExploreResult& result)
+{
+    std::cout << "States: " << result.states << ", frames deep: " << result.depth << ", all seen: "
+              << result.exhausted << ", screens: " << result.screens << std::endl;
+    std::cout << "Instructions run: " << result.instructions << " (" << result.static_covered << " of "
+              << result.static_code << " found statically)" << std::endl;
+
+    for (const ExploreFinding& finding : result.findings)
+    {
+        printf("%s at 0x%03X (0x%04X), frame %u, keys: %s\n", StateExplorer::finding_name(finding.kind), finding.pc,
+               finding.opcode, finding.frame, StateExplorer::describe_keys(finding.keys).c_str());
+    }
+}
+
+bool same_result(const ExploreResult& a, const ExploreResult& b)
+{
+    if (a.states != b.states || a.frames_run != b.frames_run || a.duplicates != b.duplicates || a.depth != b.depth ||
+        a.screens != b.screens || a.instructions != b.instructions || a.findings.size() != b.findings.size())
+    {
+        return false;
+    }
+
+    for (unsigned i = 0; i < ExploreResult::FINDINGS; i++)
+    {
+        if (a.counts[i] != b.counts[i])
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < a.findings.size(); i++)
+    {
+        if (a.findings[i].pc != b.findings[i].pc || a.findings[i].keys != b.findings[i].keys ||
+            a.findings[i].count != b.findings[i].count)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Each task adds its value and spawns two smaller ones
+void spawn(WorkStealingPool& pool, std::atomic<uint64_t>& sum, unsigned depth)
+{
+    sum += depth;
+
+    if (depth > 0)
+    {
+        pool.submit([&pool, &sum, depth](unsigned) { spawn(pool, sum, depth - 1); });
+        pool.submit([&pool, &sum, depth](unsigned) { spawn(pool, sum, depth - 1); });
+    }
+}
+
+int main()
+{
+    // 0x200: wait for a key in V0; 5: recursive call (0x206), 6: return with an empty stack (0x20E),
+    // 7: sprite at (62, 30) (0x218), 8: unknown opcode 8008 (0x220, it runs again and again)
+    const byte rom[] = {0xF0, 0x0A, 0x30, 0x05, 0x12, 0x0A, 0x22, 0x06, 0x12, 0x08,
+                        0x30, 0x06, 0x12, 0x10, 0x00, 0xEE,
+                        0x30, 0x07, 0x12, 0x1C, 0xA0, 0x50, 0x60, 0x3E, 0xD0, 0x05, 0x12, 0x00,
+                        0x30, 0x08, 0x12, 0x00, 0x80, 0x08};
+
+    std::shared_ptr<const CPU::Image> image = CPU::create_image(rom, sizeof(rom));
+    ExploreOptions options = StateExplorer::DEFAULT_OPTIONS;
+    WorkStealingPool one(1);
+    WorkStealingPool three(3);
+
+    ExploreResult single = StateExplorer(one, options).explore(image);
+    ExploreResult parallel = StateExplorer(three, options).explore(image);
+
+    // A real game, stopped by the state limit
+    std::shared_ptr<const CPU::Image> pong = CPU::read_image("roms/games/Pong [Paul Vervalin, 1990].ch8");
+
+    options.max_states = 2000;
+
+    ExploreResult pong_single = StateExplorer(one, options).explore(pong);
+    ExploreResult pong_parallel = StateExplorer(three, options).explore(pong);
+
+    print_result(parallel);
+    std::cout << "Same with 1 and 3 workers: " << same_result(single, parallel) << std::endl;
+
+    std::cout << "Pong: " << pong_parallel.states << " states, stopped at the limit: " << pong_parallel.truncated
+              << ", same with 1 and 3 workers: " << same_result(pong_single, pong_parallel) << std::endl;
+
+    std::atomic<uint64_t> sum(0);
+
+    three.submit([&three, &sum](unsigned) { spawn(three, sum, 10); });
+    three.wait();
+
+    std::cout << "Pool: tasks spawned by tasks all ran: " << (sum == 2036) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "cpu.h"
+#include "frame_delta.h"
+#include "stream_server.h"
+
+// I = font "0", V1 = 5; then forever: draw at V0, erase, V0 += 1
+const byte ROM[] = {0xA0, 0x50, 0x60, 0x00, 0x61, 0x05, 0xD0, 0x15, 0xD0, 0x15, 0x70, 0x01, 0x12, 0x06};
+
+int connect_to(unsigned short port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+    return fd;
+}
+
+// Lets the server work and appends whatever reached the client. Returns false once the server hung up.
+bool pump(StreamServer& server, int fd, std::string& received)
+{
+    bool open = true;
+
+    for (unsigned i = 0; i < 5; i++)
+    {
+        char buffer[4096];
+        ssize_t length;
+
+        server.poll(2);
+
+        while ((length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        {
+            received.append(buffer, length);
+        }
+
+        open &= length != 0;
+    }
+
+    return open;
+}
+
+// Masked client message
+void send_message(int fd, byte opcode, const std::vector<byte>& payload)
+{
+    const byte mask[4] = {0x12, 0x34, 0x56, 0x78};
+    std::vector<byte> message = {(byte)(0x80 | opcode), (byte)(0x80 | payload.size())};
+
+    message.insert(message.end(), mask, mask + 4);
+
+    for (size_t i = 0; i < payload.size(); i++)
+    {
+        message.push_back(payload[i] ^ mask[i % 4]);
+    }
+
+    send(fd, message.data(), message.size(), 0);
+}
+
+// Takes the server messages out of received (opcode and payload each)
+std::vector<std::pair<byte, std::string> > take_messages(std::string& received)
+{
+    std::vector<std::pair<byte, std::string> > messages;
+
+    while (received.size() >= 2)
+    {
+        size_t length = (byte)received[1] & 0x7F;
+        size_t header = 2;
+
+        if (length == 126)
+        {
+            header = 4;
+            length = (byte)received[2] << 8 | (byte)received[3];
+        }
+
+        if (received.size() < header + length)
+        {
+            break;
+        }
+
+        messages.push_back(std::make_pair((byte)(received[0] & 0x0F), received.substr(header, length)));
+        received.erase(0, header + length);
+    }
+
+    return messages;
+}
+
+std::string http_get(StreamServer& server, const std::string& path)
+{
+    int fd = connect_to(server.get_port());
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    std::string received;
+
+    send(fd, request.data(), request.size(), 0);
+
+    while (pump(server, fd, received));
+
+    close(fd);
+
+    return received;
+}
+
+int main()
+{
+    // RFC 6455 sample handshake
+    std::cout << "Accept key: " << StreamServer::accept_key("dGhlIHNhbXBsZSBub25jZQ==") << std::endl;
+
+    // Encoder and decoder alone, frame by frame against the display
+    CPU cpu;
+    FrameDeltaEncoder encoder;
+    FrameDeltaDecoder decoder;
+    std::vector<byte> message;
+    byte decoded[CPU::GFX_LENGTH];
+    unsigned deltas = 0, bytes = 0, mismatches = 0;
+
+    cpu.initializate();
+    cpu.load_rom_from_buffer(ROM, sizeof(ROM));
+
+    encoder.keyframe(message);
+    decoder.apply(message.data(), message.size());
+
+    for (uint32_t frame = 1; frame <= 300; frame++)
+    {
+        cpu.emulate_cycle();
+
+        message.clear();
+
+        if (encoder.encode(cpu.get_gfx(), cpu.get_dirty_rows(), frame, message))
+        {
+            deltas++;
+            bytes += message.size();
+            decoder.apply(message.data(), message.size());
+        }
+
+        cpu.clear_dirty_rows();
+        decoder.get_gfx(decoded);
+        mismatches += memcmp(decoded, cpu.get_gfx(), CPU::GFX_LENGTH) != 0;
+    }
+
+    std::cout << "Codec: " << deltas << " delta(s), " << bytes << " bytes, " << mismatches << " mismatch(es)" << std::endl;
+
+    message.assign(1, FrameDeltaEncoder::DELTA);
+    std::cout << "Truncated delta rejected: " << !decoder.apply(message.data(), message.size()) << std::endl;
+
+    // Server over loopback
+    StreamServer server;
+
+    server.add_instance(CPU::create_image(ROM, sizeof(ROM)));
+    server.set_page("<html>client</html>");
+
+    if (!server.listen(0))
+    {
+        return -1;
+    }
+
+    std::string page = http_get(server, "/");
+
+    std::cout << "GET /: " << page.substr(0, page.find("\r\n")) << ", page sent = "
+              << (page.find("<html>client</html>") != std::string::npos) << std::endl;
+
+    std::string missing = http_get(server, "/instance/7");
+
+    std::cout << "GET /instance/7: " << missing.substr(0, missing.find("\r\n")) << std::endl;
+
+    int fd = connect_to(server.get_port());
+    std::string request = "GET /instance/0 HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+                          "Connection: keep-alive, Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                          "Sec-WebSocket-Version: 13\r\n\r\n";
+    std::string received;
+
+    send(fd, request.data(), request.size(), 0);
+    pump(server, fd, received);
+
+    size_t head_end = received.find("\r\n\r\n");
+    std::string head = received.substr(0, head_end);
+
+    received.erase(0, head_end + 4);
+
+    std::cout << "Upgrade: " << head.substr(0, head.find("\r\n")) << ", accept key sent = "
+              << (head.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") != std::string::npos) << std::endl;
+
+    FrameDeltaDecoder client;
+    unsigned keyframes = 0, updates = 0;
+
+    send_message(fd, 0x2, {0x20, 0x00});
+
+    for (unsigned frame = 0; frame < 120; frame++)
+    {
+        server.frame();
+        pump(server, fd, received);
+
+        for (auto& current : take_messages(received))
+        {
+            const byte* payload = reinterpret_cast<const byte*>(current.second.data());
+
+            keyframes += payload[0] == FrameDeltaEncoder::KEYFRAME;
+            updates += client.apply(payload, current.second.size());
+        }
+    }
+
+    client.get_gfx(decoded);
+
+    std::cout << "Keys from the client: 0x" << std::hex << server.get_cpu(0).get_pressed_keys() << std::dec << std::endl;
+    std::cout << "Messages: " << keyframes << " keyframe(s), " << updates << " applied, frame " << client.get_frame()
+              << ", same display = " << (memcmp(decoded, server.get_cpu(0).get_gfx(), CPU::GFX_LENGTH) == 0) << std::endl;
+
+    StreamStats stats = server.get_stats();
+
+    std::cout << "Stats: " << stats.frames << " frames, " << stats.messages << " messages, " << stats.clients
+              << " client(s)" << std::endl;
+
+    send_message(fd, 0x9, {'h', 'i'});
+    pump(server, fd, received);
+
+    auto pong = take_messages(received);
+
+    std::cout << "Ping: opcode 0x" << std::hex << (unsigned)pong[0].first << std::dec << " '" << pong[0].second << "'"
+              << std::endl;
+
+    send_message(fd, 0x8, {0x03, 0xE8});
+
+    bool open = pump(server, fd, received);
+    auto closing = take_messages(received);
+
+    std::cout << "Close: opcode 0x" << std::hex << (unsigned)closing[0].first << std::dec << ", hung up = " << !open
+              << ", clients = " << server.get_stats().clients << std::endl;
+
+    close(fd);
+
+    return 0;
+}
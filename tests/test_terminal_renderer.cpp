@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+
+#include "cpu.h"
+#include "terminal_renderer.h"
+
+// Escapes shown as \e, so the output stays printable
+std::string visible(const std::string& text)
+{
+    std::string shown;
+
+    for (char c : text)
+    {
+        shown += c == '\x1b' ? std::string("\\e") : std::string(1, c);
+    }
+
+    return shown;
+}
+
+int main()
+{
+    // Draws the font's "0" at (4, 2), then moves it one pixel right
+    const byte rom[] = {0x60, 0x04, 0x61, 0x02, 0xA0, 0x50, 0xD0, 0x15, 0xD0, 0x15, 0x70, 0x01, 0xD0, 0x15, 0x12, 0x0E};
+    const TerminalGlyphs glyphs[] = {TerminalGlyphs::HALF_BLOCKS, TerminalGlyphs::BRAILLE};
+
+    for (TerminalGlyphs glyph : glyphs)
+    {
+        CPU cpu;
+        TerminalRenderer renderer(glyph);
+        std::string output;
+
+        cpu.initializate();
+        cpu.load_rom_from_buffer(rom, sizeof(rom));
+
+        std::cout << (glyph == TerminalGlyphs::BRAILLE ? "Braille" : "Half blocks") << ": "
+                  << renderer.get_columns() << "x" << renderer.get_rows() << " cells" << std::endl;
+
+        unsigned cells = renderer.render(cpu.get_gfx(), output);
+
+        std::cout << "Blank screen: " << cells << " cell(s), " << visible(output) << std::endl;
+
+        for (unsigned i = 0; i < 4; i++)
+        {
+            cpu.emulate_cycle();
+        }
+
+        output.clear();
+        cells = renderer.render(cpu.get_gfx(), output);
+
+        std::cout << "Sprite: " << cells << " cell(s), " << output.size() << " byte(s)" << std::endl;
+
+        output.clear();
+        cells = renderer.render(cpu.get_gfx(), output);
+
+        std::cout << "Same frame: " << cells << " cell(s), " << output.size() << " byte(s)" << std::endl;
+
+        // Erase and draw one pixel to the right
+        for (unsigned i = 0; i < 3; i++)
+        {
+            cpu.emulate_cycle();
+        }
+
+        output.clear();
+        cells = renderer.render(cpu.get_gfx(), output);
+
+        std::cout << "Moved sprite: " << cells << " cell(s), " << output.size() << " byte(s)" << std::endl;
+
+        renderer.invalidate();
+        output.clear();
+        cells = renderer.render(cpu.get_gfx(), output);
+
+        std::cout << "Repaint: " << cells << " cell(s), " << output.size() << " byte(s)" << std::endl;
+    }
+
+    return 0;
+}